@@ -0,0 +1,197 @@
+// Benchmark for libCZI's buffer pool (libCZI::ConfigureBufferPool): writes a synthetic CZI with zstd1 compressed
+// Gray16 subblocks (with hi-lo byte packing, so every decode needs a scratch buffer besides the bitmap), reads all
+// subblocks into memory and then decodes them repeatedly, once with the pool disabled (every bitmap and scratch
+// buffer comes fresh from the heap) and once enabled. For both it reports the decode throughput, the minor page
+// faults per decode (fresh pages from the operating system, which are what makes big allocations expensive) and the
+// pool's reuse counters. The bitmaps are dropped right after decoding, as a converter does once it has composed them.
+//
+// Usage: bench_decode_alloc [--subblock-size N] [--subblocks N] [--passes N] [--threads N] [--pool-mb N]
+//                           [--work-dir DIR] [--keep]
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    struct bench_options
+    {
+        int subblock_size = 1024;
+        int subblocks = 64;
+        int passes = 5;
+        int threads = 1;
+        int pool_mb = 256;
+        std::string work_dir = ".";
+        bool keep = false;
+    };
+
+    struct run_result
+    {
+        double seconds = 0;
+        double minor_faults = -1;
+        libCZI::BufferPoolStatistics pool{};
+    };
+
+    double minor_faults_so_far()
+    {
+#if defined(_WIN32)
+        return -1;
+#else
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return double(usage.ru_minflt);
+#endif
+    }
+
+    run_result decode_all(const std::vector<std::shared_ptr<libCZI::ISubBlock>>& subblocks, const bench_options& options, bool use_pool)
+    {
+        libCZI::BufferPoolOptions pool_options;
+        pool_options.Clear();
+        pool_options.maxRetainedBytes = use_pool ? std::uint64_t(options.pool_mb) * 1024 * 1024 : 0;
+        libCZI::ConfigureBufferPool(pool_options);
+        const libCZI::BufferPoolStatistics pool_before = libCZI::GetBufferPoolStatistics();
+
+        std::atomic<std::size_t> next{ 0 };
+        std::atomic<std::uint64_t> checksum{ 0 };
+        const std::size_t total = subblocks.size() * std::size_t(options.passes);
+        auto worker = [&]() {
+            for (std::size_t i = next.fetch_add(1); i < total; i = next.fetch_add(1)) {
+                const auto bitmap = subblocks[i % subblocks.size()]->CreateBitmap();
+                const libCZI::ScopedBitmapLockerSP lock{ bitmap };
+                checksum.fetch_add(*static_cast<const std::uint16_t*>(lock.ptrDataRoi), std::memory_order_relaxed);
+            }
+        };
+
+        const double faults_before = minor_faults_so_far();
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 1; t < options.threads; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        run_result result;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (faults_before >= 0) {
+            result.minor_faults = (minor_faults_so_far() - faults_before) / double(total);
+        }
+        result.pool = libCZI::GetBufferPoolStatistics();
+        result.pool.allocationCount -= pool_before.allocationCount;
+        result.pool.reuseCount -= pool_before.reuseCount;
+        return result;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--subblock-size") {
+                options.subblock_size = std::stoi(value());
+            }
+            else if (arg == "--subblocks") {
+                options.subblocks = std::stoi(value());
+            }
+            else if (arg == "--passes") {
+                options.passes = std::stoi(value());
+            }
+            else if (arg == "--threads") {
+                options.threads = std::stoi(value());
+            }
+            else if (arg == "--pool-mb") {
+                options.pool_mb = std::stoi(value());
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.subblock_size <= 0 || options.subblocks <= 0 || options.passes <= 0 || options.threads <= 0 || options.pool_mb <= 0) {
+            throw std::invalid_argument("all values must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_decode_alloc [--subblock-size N] [--subblocks N] [--passes N] [--threads N] [--pool-mb N] [--work-dir DIR] [--keep]\n";
+        return 1;
+    }
+
+    const std::string path = options.work_dir + "/bench_decode_alloc.czi";
+    subblock_grid grid;
+    grid.subblock_size = options.subblock_size;
+    grid.count = options.subblocks;
+    grid.columns = 8;
+    grid.compression = subblock_compression::zstd1_hilo;
+    write_subblock_grid(path, grid, gray16_ramp(options.subblock_size));
+    auto reader = libCZI::CreateCZIReader();
+    reader->Open(libCZI::StreamsFactory::CreateDefaultStreamForFile(path.c_str()));
+    std::vector<std::shared_ptr<libCZI::ISubBlock>> subblocks;
+    for (int i = 0; i < options.subblocks; ++i) {
+        subblocks.push_back(reader->ReadSubBlock(i));
+    }
+
+    // a warm-up, so that both runs find the heap in the same state
+    decode_all(subblocks, options, false);
+
+    const double megapixels = double(options.subblock_size) * options.subblock_size * options.subblocks * options.passes / 1e6;
+    std::cout << options.subblocks << " zstd1 Gray16 subblocks of " << options.subblock_size << "x" << options.subblock_size
+        << ", " << options.passes << " passes, " << options.threads << " thread(s)\n"
+        << std::left << std::setw(10) << "pool" << std::setw(12) << "MPix/s" << std::setw(16) << "faults/decode"
+        << std::setw(14) << "allocations" << std::setw(10) << "reused" << "peak retained MB\n";
+    for (const bool use_pool : { false, true }) {
+        const run_result result = decode_all(subblocks, options, use_pool);
+        std::cout << std::setw(10) << (use_pool ? "on" : "off")
+            << std::setw(12) << std::fixed << std::setprecision(1) << megapixels / result.seconds
+            << std::setw(16) << result.minor_faults
+            << std::setw(14) << result.pool.allocationCount
+            << std::setw(10) << result.pool.reuseCount
+            << double(result.pool.peakRetainedBytes) / (1024 * 1024) << "\n";
+    }
+
+    libCZI::BufferPoolOptions pool_options;
+    pool_options.Clear();
+    libCZI::ConfigureBufferPool(pool_options);
+    subblocks.clear();
+    reader.reset();
+    if (!options.keep) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Writes a synthetic H&E-like image as a Deep Zoom image with dzi_writer, with 1, 2, 4, ... threads up to the core
+// count (tbb::global_control), and reports per thread count the time to write all levels (tiles of the block
+// levels from write_block, the levels below from add_block, all JPEG encoding and file writes included), the
+// tiles and bytes written and the speedup over one thread. The blocks are handed over one after the other in
+// row-major order, as the converter's write stage does; the parallelism is the one inside dzi_writer. The image
+// goes to --dir, which should be on the disk to be measured; it is replaced on every run and removed at the end.
+//
+// Usage: bench_dzi_writer [--width N] [--height N] [--tile-size N] [--overlap N] [--max-threads N] [--repeat N] [--dir PATH]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/global_control.h>
+#include "dzi_writer.h"
+
+namespace
+{
+    struct bench_options
+    {
+        std::uint32_t width = 16384;
+        std::uint32_t height = 16384;
+        std::uint32_t tile_size = 254;
+        std::uint32_t overlap = 1;
+        int max_threads = 0;
+        int repeat = 3;
+        std::string dir = (std::filesystem::temp_directory_path() / "bench_dzi_writer").string();
+    };
+
+    // Tissue-like content: smooth blobs of eosin pink and haematoxylin purple on a white background, with fine
+    // grain, so that the encoder sees something closer to a scan than noise or flat colour.
+    std::vector<std::uint8_t> make_image(std::uint32_t width, std::uint32_t height)
+    {
+        std::vector<std::uint8_t> rgb(std::size_t(width) * height * 3);
+        std::uint32_t state = 12345;
+        for (std::uint32_t y = 0; y < height; ++y) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                const double tissue = std::sin(x * 0.0021) * std::sin(y * 0.0017) + 0.5 * std::sin((x + y) * 0.013);
+                const double nuclei = std::max(0.0, std::sin(x * 0.11) * std::sin(y * 0.097) - 0.6) * 2.5;
+                state = state * 1664525u + 1013904223u;
+                const double grain = double(state >> 28) - 7.5;
+                const double t = std::clamp(tissue, 0.0, 1.0);
+                double r = 245 - t * 20 - nuclei * 110 + grain;
+                double g = 245 - t * 90 - nuclei * 100 + grain;
+                double b = 245 - t * 40 - nuclei * 40 + grain;
+                std::uint8_t* p = &rgb[(std::size_t(y) * width + x) * 3];
+                p[0] = std::uint8_t(std::clamp(r, 0.0, 255.0));
+                p[1] = std::uint8_t(std::clamp(g, 0.0, 255.0));
+                p[2] = std::uint8_t(std::clamp(b, 0.0, 255.0));
+            }
+        }
+        return rgb;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--width") {
+                options.width = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--height") {
+                options.height = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--tile-size") {
+                options.tile_size = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--overlap") {
+                options.overlap = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--max-threads") {
+                options.max_threads = std::stoi(value());
+            }
+            else if (arg == "--repeat") {
+                options.repeat = std::stoi(value());
+            }
+            else if (arg == "--dir") {
+                options.dir = value();
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.width == 0 || options.height == 0 || options.tile_size == 0 || options.repeat <= 0 || options.max_threads < 0) {
+            throw std::invalid_argument("width, height, tile size and repeat must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_dzi_writer [--width N] [--height N] [--tile-size N] [--overlap N] [--max-threads N] [--repeat N] [--dir PATH]\n";
+        return 1;
+    }
+
+    const std::uint32_t width = options.width, height = options.height;
+    const std::vector<std::uint8_t> image = make_image(width, height);
+    const double mpixels = double(width) * height / 1e6;
+    const int max_threads = options.max_threads > 0 ? options.max_threads : int(std::max(1u, std::thread::hardware_concurrency()));
+    const pixel_layout layout(channel_order::rgb);
+    const std::filesystem::path descriptor = std::filesystem::path(options.dir) / "bench.dzi";
+
+    std::cout << std::left << std::setw(9) << "threads" << std::setw(12) << "write ms" << std::setw(10) << "MPix/s"
+        << std::setw(9) << "tiles" << std::setw(10) << "MB" << "speedup\n";
+    try {
+        std::filesystem::create_directories(options.dir);
+        double single = 0;
+        for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+            tbb::global_control limit(tbb::global_control::max_allowed_parallelism, std::size_t(threads));
+            double best = 1e30;
+            std::uint64_t tiles = 0, bytes = 0;
+            for (int r = 0; r < options.repeat; ++r) {
+                dzi_writer dzi(descriptor.string(), width, height, options.tile_size, options.overlap, 75);
+                const std::uint32_t block_size = dzi.block_size(), margin = dzi.margin();
+
+                const auto start = std::chrono::steady_clock::now();
+                for (std::uint32_t y = 0; y < height; y += block_size) {
+                    for (std::uint32_t x = 0; x < width; x += block_size) {
+                        dzi_writer::block b;
+                        b.x = x;
+                        b.y = y;
+                        b.width = std::min(block_size, width - x);
+                        b.height = std::min(block_size, height - y);
+                        b.left = std::min(margin, x);
+                        b.top = std::min(margin, y);
+                        b.right = std::min(margin, width - x - b.width);
+                        b.bottom = std::min(margin, height - y - b.height);
+                        const std::uint8_t* pixels = image.data() + (std::size_t(y - b.top) * width + (x - b.left)) * 3;
+                        dzi.add_block(b, dzi.write_block(b, pixels, std::size_t(width) * 3, layout));
+                    }
+                }
+                dzi.close();
+                best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+                tiles = dzi.tile_count();
+                bytes = 0;
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(std::filesystem::path(options.dir) / "bench_files")) {
+                    if (entry.is_regular_file()) {
+                        bytes += entry.file_size();
+                    }
+                }
+            }
+            if (threads == 1) {
+                single = best;
+            }
+            std::cout << std::setw(9) << threads << std::fixed << std::setprecision(1) << std::setw(12) << best * 1e3
+                << std::setw(10) << mpixels / best << std::setw(9) << tiles << std::setprecision(2) << std::setw(10) << bytes / 1e6
+                << single / best << "x\n";
+            if (threads == max_threads) {
+                break;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "bench_dzi_writer: " << e.what() << "\n";
+        return 2;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(options.dir, ec);
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Benchmark for libCZI's mmap-based input stream ("mmap_file_inputstream"): writes a synthetic CZI, then reads all of
+// its subblocks and decodes them, once through the pread-based stream (every subblock is copied into a heap buffer)
+// and once through the mmap-based stream (the subblock data refers to the mapped file). Each is measured with the file
+// in the page cache ("hot") and with the file evicted from it beforehand ("cold", via posix_fadvise(POSIX_FADV_DONTNEED),
+// which needs the file to be written back, so the bench syncs it after writing). The subblocks are either zstd1
+// compressed (the default) or uncompressed - for the latter both streams copy the data once (the mmap stream from the
+// mapping into the bitmap, which must not share the read-only pages), so this compares pread with the page faults.
+//
+// Usage: bench_mmap_read [--subblock-size N] [--subblocks N] [--passes N] [--uncompressed] [--work-dir DIR] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    struct bench_options
+    {
+        int subblock_size = 1024;
+        int subblocks = 256;
+        int passes = 3;
+        bool uncompressed = false;
+        std::string work_dir = ".";
+        bool keep = false;
+    };
+
+    /// Syncs the file and drops it from the page cache; returns false if this is not possible on this platform.
+    bool evict_from_page_cache(const std::string& path)
+    {
+#if defined(_WIN32)
+        return false;
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        fdatasync(fd);
+        const bool success = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        close(fd);
+        return success;
+#endif
+    }
+
+    std::shared_ptr<libCZI::IStream> open_stream(const std::string& path, const char* class_name)
+    {
+        libCZI::StreamsFactory::CreateStreamInfo create_info;
+        create_info.class_name = class_name;
+        return libCZI::StreamsFactory::CreateStream(create_info, path);
+    }
+
+    /// Reads and decodes all subblocks through a freshly opened stream, returns the elapsed time in seconds.
+    double read_and_decode_all(const std::string& path, const char* class_name, std::uint64_t& checksum)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto reader = libCZI::CreateCZIReader();
+        reader->Open(open_stream(path, class_name));
+        reader->EnumerateSubBlocks(
+            [&](int index, const libCZI::SubBlockInfo&) -> bool {
+                const auto bitmap = reader->ReadSubBlock(index)->CreateBitmap();
+                const libCZI::ScopedBitmapLockerSP lock{ bitmap };
+                const auto* row = static_cast<const std::uint8_t*>(lock.ptrDataRoi);
+                for (std::uint32_t y = 0; y < bitmap->GetHeight(); y += 64) {
+                    checksum += row[std::size_t(y) * lock.stride];
+                }
+                return true;
+            });
+        reader->Close();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--subblock-size") {
+                options.subblock_size = std::stoi(value());
+            }
+            else if (arg == "--subblocks") {
+                options.subblocks = std::stoi(value());
+            }
+            else if (arg == "--passes") {
+                options.passes = std::stoi(value());
+            }
+            else if (arg == "--uncompressed") {
+                options.uncompressed = true;
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.subblock_size <= 0 || options.subblocks <= 0 || options.passes <= 0) {
+            throw std::invalid_argument("all values must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_mmap_read [--subblock-size N] [--subblocks N] [--passes N] [--uncompressed] [--work-dir DIR] [--keep]\n";
+        return 1;
+    }
+
+    const std::string path = options.work_dir + "/bench_mmap_read.czi";
+    subblock_grid grid;
+    grid.subblock_size = options.subblock_size;
+    grid.count = options.subblocks;
+    grid.columns = 16;
+    grid.compression = options.uncompressed ? subblock_compression::none : subblock_compression::zstd1;
+    write_subblock_grid(path, grid, gray16_ramp(options.subblock_size));
+    const char* stream_classes[] = { "pread_file_inputstream", "mmap_file_inputstream" };
+    for (const char* class_name : stream_classes) {
+        if (!open_stream(path, class_name)) {
+            std::cerr << "the stream class '" << class_name << "' is not available in this build of libCZI\n";
+            return 1;
+        }
+    }
+
+    const double megapixels = double(options.subblock_size) * options.subblock_size * options.subblocks / 1e6;
+    std::cout << options.subblocks << (options.uncompressed ? " uncompressed" : " zstd1") << " Gray16 subblocks of "
+        << options.subblock_size << "x" << options.subblock_size << ", best of " << options.passes << " passes\n"
+        << std::left << std::setw(26) << "stream" << std::setw(8) << "cache" << "MPix/s\n";
+    std::uint64_t checksum = 0;
+    for (const bool cold : { false, true }) {
+        if (cold && !evict_from_page_cache(path)) {
+            std::cout << "(evicting the file from the page cache is not supported here, skipping the cold runs)\n";
+            break;
+        }
+
+        for (const char* class_name : stream_classes) {
+            double best = 0;
+            for (int pass = 0; pass < options.passes; ++pass) {
+                if (cold) {
+                    evict_from_page_cache(path);
+                }
+                else if (pass == 0) {
+                    read_and_decode_all(path, class_name, checksum);
+                }
+
+                const double seconds = read_and_decode_all(path, class_name, checksum);
+                best = std::max(best, megapixels / seconds);
+            }
+
+            std::cout << std::setw(26) << class_name << std::setw(8) << (cold ? "cold" : "hot")
+                << std::fixed << std::setprecision(1) << best << "\n";
+        }
+    }
+
+    if (!options.keep) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Benchmark for the converter's subblock prefetcher (src/subblock_prefetcher.h): writes a synthetic CZI with a grid of
+// zstd1 compressed Bgr24 subblocks and composes it block by block in row-major order with the scaling accessor, as
+// the converter composes the base level. The file is read through a stream that adds a fixed latency to every read
+// (standing in for a spinning disk or a network mount; concurrent reads overlap, as with a queue of requests), once
+// directly and once through the prefetcher. Without latency the numbers show the cost of the extra copy.
+//
+// Usage: bench_prefetch [--latency-ms N] [--block-size N] [--ahead-mb N] [--reader-threads N] [--work-dir DIR] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+#include "subblock_prefetcher.h"
+
+namespace
+{
+    struct bench_options
+    {
+        int latency_ms = 5;
+        int block_size = 2048;
+        int ahead_mb = 64;
+        int reader_threads = 4;
+        std::string work_dir = ".";
+        bool keep = false;
+    };
+
+    constexpr int subblock_size = 512;
+    constexpr int columns = 24;
+    constexpr int rows = 16;
+
+    class latency_stream : public libCZI::IStream
+    {
+    public:
+        latency_stream(std::shared_ptr<libCZI::IStream> stream, int latency_ms)
+            : stream_(std::move(stream)), latency_(latency_ms)
+        {
+        }
+
+        void Read(std::uint64_t offset, void* pv, std::uint64_t size, std::uint64_t* ptrBytesRead) override
+        {
+            std::this_thread::sleep_for(latency_);
+            stream_->Read(offset, pv, size, ptrBytesRead);
+        }
+
+    private:
+        std::shared_ptr<libCZI::IStream> stream_;
+        std::chrono::milliseconds latency_;
+    };
+
+    void write_synthetic_slide(const std::string& path)
+    {
+        subblock_grid grid;
+        grid.pixel_type = libCZI::PixelType::Bgr24;
+        grid.subblock_size = subblock_size;
+        grid.count = columns * rows;
+        grid.columns = columns;
+        std::uint32_t state = 12345;
+        write_subblock_grid(path, grid, [&state](int index, std::uint8_t* pixels) {
+            for (std::size_t i = 0; i < std::size_t(subblock_size) * subblock_size * 3; ++i) {
+                state = state * 1664525u + 1013904223u;
+                pixels[i] = std::uint8_t((i / 3 % subblock_size + index * 8) + (state >> 29));
+            }
+        });
+    }
+
+    // Composes the whole plane block by block, returns the elapsed time in seconds.
+    double compose_all(const std::string& path, const bench_options& options, int latency_ms, bool prefetch, subblock_prefetcher::statistics& stats)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<libCZI::IStream> stream = std::make_shared<latency_stream>(libCZI::StreamsFactory::CreateDefaultStreamForFile(path.c_str()), latency_ms);
+        std::shared_ptr<subblock_prefetcher> prefetcher;
+        if (prefetch) {
+            prefetcher = std::make_shared<subblock_prefetcher>(stream, std::uint64_t(options.ahead_mb) << 20, options.reader_threads);
+            stream = prefetcher;
+        }
+
+        auto reader = libCZI::CreateCZIReader();
+        reader->Open(stream);
+        const libCZI::CDimCoordinate plane{ { libCZI::DimensionIndex::C, 0 } };
+        const libCZI::IntRect roi = reader->GetStatistics().boundingBox;
+        const std::uint32_t block = std::uint32_t(options.block_size);
+        if (prefetcher) {
+            prefetcher->plan(reader.get(), roi, { &plane }, block, block, false);
+        }
+
+        const auto accessor = reader->CreateSingleChannelScalingTileAccessor();
+        std::size_t index = 0;
+        for (std::uint32_t y = 0; y < std::uint32_t(roi.h); y += block) {
+            for (std::uint32_t x = 0; x < std::uint32_t(roi.w); x += block, ++index) {
+                const libCZI::IntRect rect{ roi.x + int(x), roi.y + int(y),
+                    int(std::min(block, std::uint32_t(roi.w) - x)), int(std::min(block, std::uint32_t(roi.h) - y)) };
+                accessor->Get(rect, &plane, 1.0f, nullptr);
+                if (prefetcher) {
+                    prefetcher->block_done(index);
+                }
+            }
+        }
+
+        if (prefetcher) {
+            stats = prefetcher->stats();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--latency-ms") {
+                options.latency_ms = std::stoi(value());
+            }
+            else if (arg == "--block-size") {
+                options.block_size = std::stoi(value());
+            }
+            else if (arg == "--ahead-mb") {
+                options.ahead_mb = std::stoi(value());
+            }
+            else if (arg == "--reader-threads") {
+                options.reader_threads = std::stoi(value());
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.latency_ms < 0 || options.block_size <= 0 || options.ahead_mb <= 0 || options.reader_threads <= 0) {
+            throw std::invalid_argument("the latency must not be negative, all other values must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_prefetch [--latency-ms N] [--block-size N] [--ahead-mb N] [--reader-threads N] [--work-dir DIR] [--keep]\n";
+        return 1;
+    }
+
+    const std::string path = options.work_dir + "/bench_prefetch.czi";
+    write_synthetic_slide(path);
+
+    const double megapixels = double(columns) * rows * subblock_size * subblock_size / 1e6;
+    std::cout << columns * rows << " zstd1 Bgr24 subblocks of " << subblock_size << "x" << subblock_size << ", blocks of "
+        << options.block_size << ", " << options.ahead_mb << " MB ahead with " << options.reader_threads << " reader threads\n"
+        << std::left << std::setw(12) << "latency" << std::setw(10) << "prefetch" << std::setw(10) << "MPix/s"
+        << std::setw(8) << "ready" << std::setw(8) << "waited" << "missed\n";
+    for (const int latency_ms : { 0, options.latency_ms }) {
+        for (const bool prefetch : { false, true }) {
+            subblock_prefetcher::statistics stats;
+            const double seconds = compose_all(path, options, latency_ms, prefetch, stats);
+            std::cout << std::setw(12) << (std::to_string(latency_ms) + " ms") << std::setw(10) << (prefetch ? "on" : "off")
+                << std::setw(10) << std::fixed << std::setprecision(1) << megapixels / seconds;
+            if (prefetch) {
+                std::cout << std::setw(8) << stats.hits << std::setw(8) << stats.waits << stats.misses;
+            }
+            std::cout << "\n";
+        }
+        if (options.latency_ms == 0) {
+            break;
+        }
+    }
+
+    if (!options.keep) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
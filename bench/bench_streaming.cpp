@@ -0,0 +1,218 @@
+// Regression benchmark for the streaming conversion: writes synthetic slides of growing width (zstd1 compressed
+// Bgr24 subblocks on a 512 px grid, with the label and macro attachments CZIConvert expects), converts each one
+// with CZIConvert in a child process and reports the child's wall time and peak resident memory.
+//
+// Since the base level is processed block by block, peak RSS must not grow with the slide's size while the
+// throughput stays the same. The benchmark fails (exit code 2) if the peak RSS of the widest slide exceeds that
+// of the narrowest one by more than --max-rss-growth.
+//
+// Usage: bench_streaming [--czi-convert PATH] [--work-dir DIR] [--height N] [--widths W1,W2,...]
+//                        [--max-rss-growth F] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    struct bench_options
+    {
+#if defined(CZICONVERT_PATH)
+        std::string czi_convert = CZICONVERT_PATH;
+#else
+        std::string czi_convert = "CZIConvert";
+#endif
+        std::string work_dir = ".";
+        int height = 8192;
+        std::vector<int> widths = { 10000, 50000, 150000 };
+        double max_rss_growth = 1.25;
+        bool keep = false;
+    };
+
+    struct run_result
+    {
+        int exit_code = -1;
+        double seconds = 0;
+        double peak_rss_mb = 0;
+    };
+
+    run_result run_converter(const std::string& converter, const std::string& input, const std::string& output)
+    {
+        run_result result;
+        const auto start = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+        std::string command = "\"" + converter + "\" \"" + input + "\" \"" + output + "\"";
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+        SetHandleInformation(nul, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        startup.hStdOutput = nul;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        PROCESS_INFORMATION process = {};
+        if (!CreateProcessA(nullptr, &command[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &process)) {
+            CloseHandle(nul);
+            throw std::runtime_error("cannot start " + converter);
+        }
+        WaitForSingleObject(process.hProcess, INFINITE);
+        DWORD code = 0;
+        GetExitCodeProcess(process.hProcess, &code);
+        PROCESS_MEMORY_COUNTERS counters = {};
+        GetProcessMemoryInfo(process.hProcess, &counters, sizeof(counters));
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+        CloseHandle(nul);
+        result.exit_code = int(code);
+        result.peak_rss_mb = double(counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+        // the child would otherwise inherit, and flush, what is still buffered
+        std::cout.flush();
+        std::fflush(nullptr);
+        const pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("fork failed");
+        }
+        if (pid == 0) {
+            if (std::freopen("/dev/null", "w", stdout) == nullptr) {
+                _exit(127);
+            }
+            execl(converter.c_str(), converter.c_str(), input.c_str(), output.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        int status = 0;
+        rusage usage = {};
+        if (wait4(pid, &status, 0, &usage) < 0) {
+            throw std::runtime_error("wait4 failed");
+        }
+        result.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#if defined(__APPLE__)
+        result.peak_rss_mb = double(usage.ru_maxrss) / (1024.0 * 1024.0);     // bytes
+#else
+        result.peak_rss_mb = double(usage.ru_maxrss) / 1024.0;                // kilobytes
+#endif
+#endif
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    std::vector<int> parse_widths(const std::string& list)
+    {
+        std::vector<int> widths;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            widths.push_back(std::stoi(item));
+        }
+        return widths;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--czi-convert") {
+                options.czi_convert = value();
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--height") {
+                options.height = std::stoi(value());
+            }
+            else if (arg == "--widths") {
+                options.widths = parse_widths(value());
+            }
+            else if (arg == "--max-rss-growth") {
+                options.max_rss_growth = std::stod(value());
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.widths.empty() || options.height <= 0
+            || std::any_of(options.widths.begin(), options.widths.end(), [](int w) { return w <= 0; })) {
+            throw std::invalid_argument("widths and height must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_streaming [--czi-convert PATH] [--work-dir DIR] [--height N] [--widths W1,W2,...] [--max-rss-growth F] [--keep]\n";
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(10) << "width" << std::setw(8) << "height" << std::setw(12) << "megapixels"
+        << std::setw(10) << "seconds" << std::setw(10) << "MP/s" << "peak RSS (MB)\n";
+
+    std::vector<run_result> results;
+    for (int width : options.widths) {
+        const std::string input = options.work_dir + "/bench_" + std::to_string(width) + ".czi";
+        const std::string output = options.work_dir + "/bench_" + std::to_string(width) + ".svs";
+        write_synthetic_slide(input, options.work_dir, width, options.height);
+
+        const run_result result = run_converter(options.czi_convert, input, output);
+        if (!options.keep) {
+            std::remove(input.c_str());
+            std::remove(output.c_str());
+        }
+        if (result.exit_code != 0) {
+            std::cerr << "CZIConvert failed on " << input << " (exit code " << result.exit_code << ")\n";
+            return 1;
+        }
+
+        const double megapixels = double(width) * options.height / 1e6;
+        std::cout << std::setw(10) << width << std::setw(8) << options.height
+            << std::setw(12) << std::fixed << std::setprecision(1) << megapixels
+            << std::setw(10) << std::setprecision(2) << result.seconds
+            << std::setw(10) << std::setprecision(1) << megapixels / result.seconds
+            << std::setprecision(0) << result.peak_rss_mb << "\n";
+        results.push_back(result);
+    }
+
+    const double growth = results.back().peak_rss_mb / results.front().peak_rss_mb;
+    std::cout << "Peak RSS growth from the narrowest to the widest slide: " << std::setprecision(2) << growth << "x\n";
+    if (growth > options.max_rss_growth) {
+        std::cerr << "Peak RSS grows with the slide's width (limit " << options.max_rss_growth << "x)\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Benchmark for libCZI's sub-block caches under concurrent use, as decode threads sharing one cache would use it.
+// Every thread walks over a window of sub-block indices that slides forward (like the subblocks under successive
+// output tiles), calls Get for each one, Adds a bitmap on a miss and every --prune-every operations prunes the cache
+// to --capacity elements. The same operations run against
+//
+//   simple    CreateSubBlockCache(): one std::map behind one mutex, pruning by repeated min_element over LRU values
+//   sharded   SubBlockCacheOptions::Type::Sharded: lock-striped hash maps with intrusive LRU lists
+//
+// with 1 to --max-threads threads (doubling). The total number of operations is fixed, so a rising Mops/s means the
+// cache scales. Note that threads beyond the core count only measure how well the cache copes with preemption.
+//
+// Usage: bench_subblock_cache [--operations N] [--max-threads N] [--capacity N] [--prune-every N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libCZI.h>
+
+namespace
+{
+    struct bench_options
+    {
+        int operations = 500000;
+        int max_threads = 64;
+        int capacity = 1024;
+        int prune_every = 64;
+    };
+
+    struct run_result
+    {
+        double seconds = 0;
+        double hit_rate = 0;
+    };
+
+    std::shared_ptr<libCZI::ISubBlockCache> create_cache(libCZI::SubBlockCacheOptions::Type type)
+    {
+        libCZI::SubBlockCacheOptions options;
+        options.Clear();
+        options.type = type;
+        return libCZI::CreateSubBlockCache(options);
+    }
+
+    run_result run(libCZI::SubBlockCacheOptions::Type type, int thread_count, const bench_options& options, const std::vector<std::shared_ptr<libCZI::IBitmapData>>& bitmaps)
+    {
+        const auto cache = create_cache(type);
+        const int operations_per_thread = options.operations / thread_count;
+        const int window = options.capacity / 2;
+        libCZI::ISubBlockCacheControl::PruneOptions prune_options;
+        prune_options.maxSubBlockCount = std::uint32_t(options.capacity);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                std::uint32_t state = 12345u + std::uint32_t(t);
+                for (int i = 0; i < operations_per_thread; ++i) {
+                    state = state * 1664525u + 1013904223u;
+                    const int base = i / 16 + t * 64;
+                    const int key = base + int((state >> 8) % std::uint32_t(window));
+                    if (!cache->Get(key).IsValid()) {
+                        cache->Add(key, { bitmaps[std::size_t(key) % bitmaps.size()] });
+                    }
+                    if (i % options.prune_every == options.prune_every - 1) {
+                        cache->Prune(prune_options);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        run_result result;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const auto statistics = cache->GetStatistics(libCZI::ISubBlockCacheStatistics::kHitCount | libCZI::ISubBlockCacheStatistics::kMissCount);
+        result.hit_rate = double(statistics.hitCount) / double(std::max<std::uint64_t>(1, statistics.hitCount + statistics.missCount));
+        return result;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> int {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return std::stoi(argv[++i]);
+            };
+            if (arg == "--operations") {
+                options.operations = value();
+            }
+            else if (arg == "--max-threads") {
+                options.max_threads = value();
+            }
+            else if (arg == "--capacity") {
+                options.capacity = value();
+            }
+            else if (arg == "--prune-every") {
+                options.prune_every = value();
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.operations <= 0 || options.max_threads <= 0 || options.capacity < 2 || options.prune_every <= 0) {
+            throw std::invalid_argument("operations, max-threads and prune-every must be positive, capacity at least 2");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << "Usage: bench_subblock_cache [--operations N] [--max-threads N] [--capacity N] [--prune-every N]\n";
+        return 1;
+    }
+
+    // The cache only holds references, so a few small bitmaps shared by all keys are enough.
+    std::vector<std::shared_ptr<libCZI::IBitmapData>> bitmaps;
+    auto* site = libCZI::GetDefaultSiteObject(libCZI::SiteObjectType::Default);
+    for (int i = 0; i < 16; ++i) {
+        bitmaps.push_back(site->CreateBitmap(libCZI::PixelType::Gray8, 64, 64));
+    }
+
+    std::cout << std::thread::hardware_concurrency() << " hardware threads, " << options.operations << " operations per run\n"
+        << std::left << std::setw(9) << "threads" << std::setw(20) << "simple Mops/s" << std::setw(20) << "sharded Mops/s" << "speedup  hit rate\n";
+    for (int threads = 1; threads <= options.max_threads; threads *= 2) {
+        const run_result simple = run(libCZI::SubBlockCacheOptions::Type::Simple, threads, options, bitmaps);
+        const run_result sharded = run(libCZI::SubBlockCacheOptions::Type::Sharded, threads, options, bitmaps);
+        const double total = double(options.operations / threads * threads) / 1e6;
+        std::cout << std::setw(9) << threads << std::setw(20) << std::fixed << std::setprecision(2) << total / simple.seconds
+            << std::setw(20) << total / sharded.seconds << std::setw(9) << simple.seconds / sharded.seconds
+            << std::setprecision(3) << simple.hit_rate << " / " << sharded.hit_rate << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Benchmark for ROI queries on the subblock directory (ISubBlockRepository::EnumSubset), as the scaling accessor
+// issues one for every block or tile it composes. Writes a synthetic CZI with a large number of overlapping layer-0
+// subblocks (512 px on a 460 px grid) plus pyramid subblocks of minification 2 and 4, then compares
+//
+//   linear scan   walking all subblocks and filtering by plane and ROI, which is what EnumSubset used to do
+//   EnumSubset    libCZI's reader, answering the query from the spatial index of the subblock directory
+//
+// for 512x512 ROIs covering the slide in row-major order. The linear scan only runs on a sample of the ROIs (it
+// is O(subblocks) per query); its results must equal EnumSubset's, otherwise the benchmark fails (exit code 2).
+//
+// Usage: bench_subblock_query [--subblocks N] [--queries N] [--linear-queries N] [--work-dir DIR] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+
+namespace
+{
+    const int subblock_size = 512;
+    const int subblock_step = 460;
+
+    struct bench_options
+    {
+        int subblocks = 200000;
+        int queries = 100000;
+        int linear_queries = 200;
+        std::string work_dir = ".";
+        bool keep = false;
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // All subblocks share the same (zstd compressed, all black) pixels; only the directory matters here.
+    libCZI::IntSize write_synthetic_slide(const std::string& path, int layer0_count)
+    {
+        const int columns = int(std::ceil(std::sqrt(double(layer0_count))));
+        const int rows = (layer0_count + columns - 1) / columns;
+        const int width = (columns - 1) * subblock_step + subblock_size;
+        const int height = (rows - 1) * subblock_step + subblock_size;
+
+        const std::vector<std::uint8_t> pixels(std::size_t(subblock_size) * subblock_size, 0);
+        auto compressed = libCZI::ZstdCompress::CompressZStd1Alloc(
+            subblock_size, subblock_size, subblock_size, libCZI::PixelType::Gray8, pixels.data(), nullptr);
+
+        auto writer = create_czi_writer(path);
+        int index = 0;
+        auto add = [&](int x, int y, int logical_size, bool layer0) {
+            libCZI::AddSubBlockInfoMemPtr info;
+            info.Clear();
+            info.coordinate = libCZI::CDimCoordinate{ { libCZI::DimensionIndex::C, 0 } };
+            info.mIndexValid = layer0;
+            info.mIndex = index++;
+            info.x = x;
+            info.y = y;
+            info.logicalWidth = logical_size;
+            info.logicalHeight = logical_size;
+            info.physicalWidth = subblock_size;
+            info.physicalHeight = subblock_size;
+            info.PixelType = libCZI::PixelType::Gray8;
+            info.SetCompressionMode(libCZI::CompressionMode::Zstd1);
+            info.ptrData = compressed->GetPtr();
+            info.dataSize = std::uint32_t(compressed->GetSizeOfData());
+            writer->SyncAddSubBlock(info);
+        };
+
+        for (int i = 0; i < layer0_count; ++i) {
+            add((i % columns) * subblock_step, (i / columns) * subblock_step, subblock_size, true);
+        }
+        for (int minification = 2; minification <= 4; minification *= 2) {
+            const int logical_size = subblock_size * minification;
+            for (int y = 0; y < height; y += logical_size) {
+                for (int x = 0; x < width; x += logical_size) {
+                    add(x, y, logical_size, false);
+                }
+            }
+        }
+
+        close_czi_writer(writer.get());
+        return libCZI::IntSize{ std::uint32_t(width), std::uint32_t(height) };
+    }
+
+    std::vector<int> query_linear(libCZI::ISubBlockRepository* reader, const libCZI::IDimCoordinate* plane, const libCZI::IntRect& roi)
+    {
+        std::vector<int> indices;
+        reader->EnumerateSubBlocks([&](int index, const libCZI::SubBlockInfo& info) -> bool {
+            if (libCZI::Utils::Compare(plane, &info.coordinate) == 0 && info.logicalRect.IntersectsWith(roi)) {
+                indices.push_back(index);
+            }
+            return true;
+        });
+        return indices;
+    }
+
+    std::vector<int> query_enum_subset(libCZI::ISubBlockRepository* reader, const libCZI::IDimCoordinate* plane, const libCZI::IntRect& roi)
+    {
+        std::vector<int> indices;
+        reader->EnumSubset(plane, &roi, false, [&](int index, const libCZI::SubBlockInfo&) -> bool {
+            indices.push_back(index);
+            return true;
+        });
+        return indices;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--subblocks") {
+                options.subblocks = std::stoi(value());
+            }
+            else if (arg == "--queries") {
+                options.queries = std::stoi(value());
+            }
+            else if (arg == "--linear-queries") {
+                options.linear_queries = std::stoi(value());
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.subblocks <= 0 || options.queries <= 0 || options.linear_queries <= 0) {
+            throw std::invalid_argument("the counts must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_subblock_query [--subblocks N] [--queries N] [--linear-queries N] [--work-dir DIR] [--keep]\n";
+        return 1;
+    }
+
+    const std::string path = options.work_dir + "/bench_subblock_query.czi";
+    auto start = std::chrono::steady_clock::now();
+    const libCZI::IntSize size = write_synthetic_slide(path, options.subblocks);
+    std::cout << "Wrote " << size.w << "x" << size.h << " slide in " << std::fixed << std::setprecision(2) << seconds_since(start) << " s\n";
+
+    start = std::chrono::steady_clock::now();
+    auto reader = libCZI::CreateCZIReader();
+    reader->Open(libCZI::StreamsFactory::CreateDefaultStreamForFile(path.c_str()));
+    const double open_seconds = seconds_since(start);
+    const int subblock_count = reader->GetStatistics().subBlockCount;
+    std::cout << "Opened " << subblock_count << " subblocks in " << std::setprecision(3) << open_seconds << " s\n";
+
+    // 512x512 output tiles in row-major order, wrapping around if there are more queries than tiles
+    const int tiles_across = int((size.w + subblock_size - 1) / subblock_size);
+    const int tiles_down = int((size.h + subblock_size - 1) / subblock_size);
+    auto tile_roi = [&](int i) {
+        const int t = i % (tiles_across * tiles_down);
+        return libCZI::IntRect{ (t % tiles_across) * subblock_size, (t / tiles_across) * subblock_size, subblock_size, subblock_size };
+    };
+
+    const libCZI::CDimCoordinate plane{ { libCZI::DimensionIndex::C, 0 } };
+    const int linear_queries = std::min(options.linear_queries, options.queries);
+    const int linear_stride = std::max(1, options.queries / linear_queries);
+    int status = 0;
+    std::size_t hits = 0;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<std::vector<int>> linear_results;
+    for (int i = 0; i < linear_queries; ++i) {
+        linear_results.push_back(query_linear(reader.get(), &plane, tile_roi(i * linear_stride)));
+    }
+    const double linear_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.queries; ++i) {
+        hits += query_enum_subset(reader.get(), &plane, tile_roi(i)).size();
+    }
+    const double indexed_seconds = seconds_since(start);
+
+    for (int i = 0; i < linear_queries; ++i) {
+        if (query_enum_subset(reader.get(), &plane, tile_roi(i * linear_stride)) != linear_results[i]) {
+            std::cerr << "EnumSubset differs from the linear scan for query " << i * linear_stride << "\n";
+            status = 2;
+        }
+    }
+
+    const double linear_us = linear_seconds / linear_queries * 1e6;
+    const double indexed_us = indexed_seconds / options.queries * 1e6;
+    std::cout << std::left << std::setw(14) << "method" << std::setw(10) << "queries" << "us/query\n"
+        << std::setw(14) << "linear scan" << std::setw(10) << linear_queries << std::setprecision(2) << linear_us << "\n"
+        << std::setw(14) << "EnumSubset" << std::setw(10) << options.queries << indexed_us << "\n"
+        << "Speedup " << std::setprecision(0) << linear_us / indexed_us << "x, " << std::setprecision(1)
+        << double(hits) / options.queries << " subblocks per query\n";
+
+    reader.reset();
+    if (!options.keep) {
+        std::remove(path.c_str());
+    }
+    return status;
+}
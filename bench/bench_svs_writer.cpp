@@ -0,0 +1,331 @@
+// Compares the two SVS writers of CZIConvert on a synthetic slide (zstd1 compressed Bgr24 subblocks on a 512 px
+// grid, with a label and a macro attachment): svs_writer, which writes the tiles from the encoder threads and
+// the IFDs at the end, and libtiff (--libtiff-writer), which writes IFD by IFD. Both conversions run in a child
+// process; the benchmark reports their wall times and output sizes.
+//
+// libtiff is the oracle: the outputs must have the same IFDs in the same order with byte-identical entries,
+// apart from the values of the offset tags (StripOffsets/TileOffsets), and every strip or tile must hold the
+// same bytes. The benchmark fails (exit code 2) on the first difference of each IFD.
+//
+// Usage: bench_svs_writer [--czi-convert PATH] [--work-dir DIR] [--width N] [--height N] [--ycbcr] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <libCZI.h>
+#include "synthetic_czi.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // A quarter of every this many columns is uniform background, whose tiles tile_dedup shares.
+    const int blank_period = 8192;
+
+    struct bench_options
+    {
+#if defined(CZICONVERT_PATH)
+        std::string czi_convert = CZICONVERT_PATH;
+#else
+        std::string czi_convert = "CZIConvert";
+#endif
+        std::string work_dir = ".";
+        int width = 30000;
+        int height = 8192;
+        bool ycbcr = false;
+        bool keep = false;
+    };
+
+    // Runs the converter with 'args' and returns its wall time; throws if it fails.
+    double run_converter(const std::string& converter, const std::vector<std::string>& args)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        int exit_code = -1;
+#if defined(_WIN32)
+        std::string command = "\"" + converter + "\"";
+        for (const std::string& arg : args) {
+            command += " \"" + arg + "\"";
+        }
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+        SetHandleInformation(nul, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        startup.hStdOutput = nul;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        PROCESS_INFORMATION process = {};
+        if (!CreateProcessA(nullptr, &command[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &process)) {
+            CloseHandle(nul);
+            throw std::runtime_error("cannot start " + converter);
+        }
+        WaitForSingleObject(process.hProcess, INFINITE);
+        DWORD code = 0;
+        GetExitCodeProcess(process.hProcess, &code);
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+        CloseHandle(nul);
+        exit_code = int(code);
+#else
+        // the child would otherwise inherit, and flush, what is still buffered
+        std::cout.flush();
+        std::fflush(nullptr);
+        std::vector<char*> argv{ const_cast<char*>(converter.c_str()) };
+        for (const std::string& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        const pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("fork failed");
+        }
+        if (pid == 0) {
+            if (std::freopen("/dev/null", "w", stdout) == nullptr) {
+                _exit(127);
+            }
+            execv(converter.c_str(), argv.data());
+            _exit(127);
+        }
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0) {
+            throw std::runtime_error("waitpid failed");
+        }
+        exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+        if (exit_code != 0) {
+            throw std::runtime_error("CZIConvert failed (exit code " + std::to_string(exit_code) + ")");
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A BigTIFF directory entry with its value, wherever it is stored.
+    struct entry
+    {
+        std::uint16_t type = 0;
+        std::uint64_t count = 0;
+        std::vector<std::uint8_t> value;
+    };
+
+    using directory = std::map<std::uint16_t, entry>;
+
+    std::size_t type_size(std::uint16_t type)
+    {
+        switch (type) {
+        case 3: case 8:
+            return 2;
+        case 4: case 9: case 11: case 13:
+            return 4;
+        case 5: case 10: case 12: case 16: case 17: case 18:
+            return 8;
+        default:
+            return 1;
+        }
+    }
+
+    template <typename T>
+    T load(const std::vector<std::uint8_t>& file, std::uint64_t offset)
+    {
+        if (offset + sizeof(T) > file.size()) {
+            throw std::runtime_error("offset beyond the end of the file");
+        }
+        T value;
+        std::memcpy(&value, file.data() + offset, sizeof(T));
+        return value;
+    }
+
+    // The IFDs of a little-endian BigTIFF, in file order.
+    std::vector<directory> read_directories(const std::vector<std::uint8_t>& file)
+    {
+        if (file.size() < 16 || file[0] != 'I' || file[1] != 'I' || load<std::uint16_t>(file, 2) != 43) {
+            throw std::runtime_error("not a little-endian BigTIFF");
+        }
+        std::vector<directory> directories;
+        for (std::uint64_t offset = load<std::uint64_t>(file, 8); offset != 0;) {
+            const std::uint64_t count = load<std::uint64_t>(file, offset);
+            directory d;
+            for (std::uint64_t i = 0; i < count; ++i) {
+                const std::uint64_t p = offset + 8 + i * 20;
+                entry e;
+                e.type = load<std::uint16_t>(file, p + 2);
+                e.count = load<std::uint64_t>(file, p + 4);
+                const std::uint64_t size = e.count * type_size(e.type);
+                const std::uint64_t at = size <= 8 ? p + 12 : load<std::uint64_t>(file, p + 12);
+                if (at + size > file.size()) {
+                    throw std::runtime_error("tag value beyond the end of the file");
+                }
+                e.value.assign(file.begin() + std::ptrdiff_t(at), file.begin() + std::ptrdiff_t(at + size));
+                d[load<std::uint16_t>(file, p)] = std::move(e);
+            }
+            directories.push_back(std::move(d));
+            offset = load<std::uint64_t>(file, offset + 8 + count * 20);
+        }
+        return directories;
+    }
+
+    std::vector<std::uint64_t> values(const entry& e)
+    {
+        std::vector<std::uint64_t> v(e.count);
+        for (std::uint64_t i = 0; i < e.count; ++i) {
+            const std::uint8_t* p = e.value.data() + i * type_size(e.type);
+            std::uint64_t value = 0;
+            std::memcpy(&value, p, type_size(e.type));
+            v[i] = value;
+        }
+        return v;
+    }
+
+    // Compares two SVS files as described at the top; returns the differences found.
+    std::vector<std::string> compare(const std::vector<std::uint8_t>& expected, const std::vector<std::uint8_t>& actual)
+    {
+        const std::vector<directory> a = read_directories(expected), b = read_directories(actual);
+        std::vector<std::string> differences;
+        if (a.size() != b.size()) {
+            differences.push_back(std::to_string(b.size()) + " IFDs instead of " + std::to_string(a.size()));
+        }
+        for (std::size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+            const std::string ifd = "IFD " + std::to_string(i) + ": ";
+            std::string difference;
+            for (const auto& tag_entry : a[i]) {
+                const std::uint16_t tag = tag_entry.first;
+                const entry& ea = tag_entry.second;
+                const auto found = b[i].find(tag);
+                if (found == b[i].end()) {
+                    difference = "tag " + std::to_string(tag) + " is missing";
+                    break;
+                }
+                const entry& eb = found->second;
+                const bool offsets = tag == 273 || tag == 324;
+                if (ea.type != eb.type || ea.count != eb.count || (!offsets && ea.value != eb.value)) {
+                    difference = "tag " + std::to_string(tag) + " differs";
+                    break;
+                }
+            }
+            if (difference.empty() && b[i].size() != a[i].size()) {
+                difference = "has tags libtiff does not write";
+            }
+            if (difference.empty()) {
+                const bool tiled = a[i].count(324) != 0;
+                const std::vector<std::uint64_t> offsets_a = values(a[i].at(tiled ? 324 : 273)), offsets_b = values(b[i].at(tiled ? 324 : 273));
+                const std::vector<std::uint64_t> sizes = values(a[i].at(tiled ? 325 : 279));
+                for (std::size_t k = 0; k < sizes.size(); ++k) {
+                    if (offsets_a[k] + sizes[k] > expected.size() || offsets_b[k] + sizes[k] > actual.size()
+                        || !std::equal(expected.begin() + std::ptrdiff_t(offsets_a[k]), expected.begin() + std::ptrdiff_t(offsets_a[k] + sizes[k]), actual.begin() + std::ptrdiff_t(offsets_b[k]))) {
+                        difference = std::string(tiled ? "tile " : "strip ") + std::to_string(k) + " differs";
+                        break;
+                    }
+                }
+            }
+            if (!difference.empty()) {
+                differences.push_back(ifd + difference);
+            }
+        }
+        return differences;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--czi-convert") {
+                options.czi_convert = value();
+            }
+            else if (arg == "--work-dir") {
+                options.work_dir = value();
+            }
+            else if (arg == "--width") {
+                options.width = std::stoi(value());
+            }
+            else if (arg == "--height") {
+                options.height = std::stoi(value());
+            }
+            else if (arg == "--ycbcr") {
+                options.ycbcr = true;
+            }
+            else if (arg == "--keep") {
+                options.keep = true;
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.width <= 0 || options.height <= 0) {
+            throw std::invalid_argument("width and height must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_svs_writer [--czi-convert PATH] [--work-dir DIR] [--width N] [--height N] [--ycbcr] [--keep]\n";
+        return 1;
+    }
+
+    const std::string input = options.work_dir + "/bench_svs_writer.czi";
+    const std::string native_output = options.work_dir + "/bench_svs_writer.svs";
+    const std::string libtiff_output = options.work_dir + "/bench_svs_writer_libtiff.svs";
+    write_synthetic_slide(input, options.work_dir, options.width, options.height, blank_period);
+
+    std::vector<std::string> native_args{ input, native_output }, libtiff_args{ input, libtiff_output, "--libtiff-writer" };
+    if (options.ycbcr) {
+        native_args.push_back("--ycbcr");
+        libtiff_args.push_back("--ycbcr");
+    }
+
+    std::vector<std::string> differences;
+    try {
+        const double native_seconds = run_converter(options.czi_convert, native_args);
+        const double libtiff_seconds = run_converter(options.czi_convert, libtiff_args);
+        const std::vector<std::uint8_t> native = read_file(native_output), libtiff = read_file(libtiff_output);
+
+        std::cout << std::left << std::setw(12) << "writer" << std::setw(10) << "seconds" << "MB\n" << std::fixed;
+        std::cout << std::setw(12) << "svs_writer" << std::setw(10) << std::setprecision(2) << native_seconds << std::setprecision(1) << native.size() / 1e6 << "\n";
+        std::cout << std::setw(12) << "libtiff" << std::setw(10) << std::setprecision(2) << libtiff_seconds << std::setprecision(1) << libtiff.size() / 1e6 << "\n";
+        differences = compare(libtiff, native);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (!options.keep) {
+        std::remove(input.c_str());
+        std::remove(native_output.c_str());
+        std::remove(libtiff_output.c_str());
+    }
+    if (!differences.empty()) {
+        for (const std::string& difference : differences) {
+            std::cerr << difference << "\n";
+        }
+        return 2;
+    }
+    std::cout << "Tags and tile data identical to libtiff's output\n";
+    return 0;
+}
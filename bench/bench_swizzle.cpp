@@ -0,0 +1,206 @@
+// Microbenchmark for moving the pixels of a composed Bgr24 bitmap into the RGB JPEG tile buffers.
+//
+//   two-pass      what CziBitmapToBuffer and encode_jpeg_tiles used to do: copy the locked bitmap row by row into
+//                 a contiguous RGB buffer, swapping the channels pixel by pixel, then memcpy every tile's rows
+//                 out of that buffer
+//   fused/KERNEL  copy_to_rgb's single pass straight from the strided bitmap into each tile buffer, with the
+//                 scalar, SSSE3 and AVX2 row kernels (the ones the CPU supports)
+//
+// Every variant's tiles are checked against the two-pass ones. Throughput is in GB/s of source pixels.
+//
+// Usage: bench_swizzle [--width N] [--height N] [--tile N] [--repeat N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "pixel_swizzle.h"
+
+namespace
+{
+    struct bench_options
+    {
+        std::uint32_t width = 8192;
+        std::uint32_t height = 8192;
+        std::uint32_t tile = 512;
+        int repeat = 5;
+    };
+
+    // A Bgr24 bitmap as libCZI hands it out: rows padded to a multiple of 64 bytes.
+    struct bitmap
+    {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::size_t stride = 0;
+        std::vector<std::uint8_t> data;
+    };
+
+    bitmap make_bitmap(std::uint32_t width, std::uint32_t height)
+    {
+        bitmap bmp;
+        bmp.width = width;
+        bmp.height = height;
+        bmp.stride = (std::size_t(width) * 3 + 63) / 64 * 64;
+        bmp.data.resize(bmp.stride * height);
+        std::uint32_t state = 12345;
+        for (auto& b : bmp.data) {
+            state = state * 1664525u + 1013904223u;
+            b = std::uint8_t(state >> 24);
+        }
+        return bmp;
+    }
+
+    // Calls 'tile_fn(index, x, y, w, h, tile_buffer)' for every tile, reusing one zero-padded tile buffer.
+    template <typename TileFn>
+    void for_each_tile(const bitmap& bmp, std::uint32_t tile, std::vector<std::uint8_t>& tile_buffer, TileFn tile_fn)
+    {
+        const std::uint32_t across = (bmp.width + tile - 1) / tile;
+        const std::uint32_t down = (bmp.height + tile - 1) / tile;
+        for (std::uint32_t i = 0; i < across * down; ++i) {
+            const std::uint32_t x = (i % across) * tile;
+            const std::uint32_t y = (i / across) * tile;
+            tile_buffer.assign(std::size_t(tile) * tile * 3, 0);
+            tile_fn(i, x, y, std::min(tile, bmp.width - x), std::min(tile, bmp.height - y), tile_buffer);
+        }
+    }
+
+    std::vector<std::uint8_t> two_pass(const bitmap& bmp, std::uint32_t tile, std::vector<std::vector<std::uint8_t>>* tiles)
+    {
+        std::vector<std::uint8_t> rgb(std::size_t(bmp.width) * bmp.height * 3);
+        for (std::uint32_t y = 0; y < bmp.height; ++y) {
+            const std::uint8_t* src = bmp.data.data() + y * bmp.stride;
+            std::uint8_t* dst = rgb.data() + std::size_t(y) * bmp.width * 3;
+            for (std::uint32_t x = 0; x < bmp.width; ++x) {
+                dst[x * 3 + 0] = src[x * 3 + 2];
+                dst[x * 3 + 1] = src[x * 3 + 1];
+                dst[x * 3 + 2] = src[x * 3 + 0];
+            }
+        }
+
+        std::vector<std::uint8_t> tile_buffer;
+        for_each_tile(bmp, tile, tile_buffer, [&](std::uint32_t i, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h, std::vector<std::uint8_t>& buf) {
+            for (std::uint32_t r = 0; r < h; ++r) {
+                std::memcpy(buf.data() + std::size_t(r) * tile * 3, rgb.data() + (std::size_t(y + r) * bmp.width + x) * 3, std::size_t(w) * 3);
+            }
+            if (tiles != nullptr) {
+                (*tiles)[i] = buf;
+            }
+        });
+        return rgb;
+    }
+
+    void fused(const bitmap& bmp, std::uint32_t tile, bgr_to_rgb_row_function row, std::vector<std::vector<std::uint8_t>>* tiles)
+    {
+        std::vector<std::uint8_t> tile_buffer;
+        for_each_tile(bmp, tile, tile_buffer, [&](std::uint32_t i, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h, std::vector<std::uint8_t>& buf) {
+            for (std::uint32_t r = 0; r < h; ++r) {
+                row(bmp.data.data() + std::size_t(y + r) * bmp.stride + std::size_t(x) * 3, buf.data() + std::size_t(r) * tile * 3, w);
+            }
+            if (tiles != nullptr) {
+                (*tiles)[i] = buf;
+            }
+        });
+    }
+
+    template <typename Fn>
+    double best_seconds(int repeat, Fn fn)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> int {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return std::stoi(argv[++i]);
+            };
+            if (arg == "--width") {
+                options.width = std::uint32_t(value());
+            }
+            else if (arg == "--height") {
+                options.height = std::uint32_t(value());
+            }
+            else if (arg == "--tile") {
+                options.tile = std::uint32_t(value());
+            }
+            else if (arg == "--repeat") {
+                options.repeat = value();
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.width == 0 || options.height == 0 || options.tile == 0 || options.repeat <= 0) {
+            throw std::invalid_argument("width, height, tile and repeat must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << "Usage: bench_swizzle [--width N] [--height N] [--tile N] [--repeat N]\n";
+        return 1;
+    }
+
+    const bitmap bmp = make_bitmap(options.width, options.height);
+    const std::size_t tile_count = std::size_t((options.width + options.tile - 1) / options.tile) * ((options.height + options.tile - 1) / options.tile);
+    const double gigabytes = double(options.width) * options.height * 3 / 1e9;
+
+    std::vector<std::vector<std::uint8_t>> expected(tile_count);
+    two_pass(bmp, options.tile, &expected);
+    const double baseline = best_seconds(options.repeat, [&]() { two_pass(bmp, options.tile, nullptr); });
+
+    std::cout << std::left << std::setw(14) << "variant" << std::setw(10) << "ms" << std::setw(8) << "GB/s" << "speedup\n";
+    std::cout << std::setw(14) << "two-pass" << std::setw(10) << std::fixed << std::setprecision(1) << baseline * 1e3
+        << std::setw(8) << std::setprecision(2) << gigabytes / baseline << "1.00\n";
+
+    const struct
+    {
+        const char* name;
+        swizzle_kernel kernel;
+    } kernels[] = { { "fused/scalar", swizzle_kernel::scalar }, { "fused/ssse3", swizzle_kernel::ssse3 }, { "fused/avx2", swizzle_kernel::avx2 } };
+
+    int status = 0;
+    for (const auto& k : kernels) {
+        if (!swizzle_kernel_supported(k.kernel)) {
+            std::cout << std::setw(14) << k.name << "not supported by this CPU\n";
+            continue;
+        }
+
+        const bgr_to_rgb_row_function row = bgr_to_rgb_row(k.kernel);
+        std::vector<std::vector<std::uint8_t>> tiles(tile_count);
+        fused(bmp, options.tile, row, &tiles);
+        if (tiles != expected) {
+            std::cerr << k.name << ": tiles differ from the two-pass ones\n";
+            status = 2;
+            continue;
+        }
+
+        const double seconds = best_seconds(options.repeat, [&]() { fused(bmp, options.tile, row, nullptr); });
+        std::cout << std::setw(14) << k.name << std::setw(10) << std::setprecision(1) << seconds * 1e3
+            << std::setw(8) << std::setprecision(2) << gigabytes / seconds << baseline / seconds << "\n";
+    }
+    return status;
+}
@@ -0,0 +1,204 @@
+// Compares the JPEG tile formats of the SVS levels on a synthetic H&E-like image:
+//
+//   rgb           PHOTOMETRIC_RGB tiles without chroma subsampling (the default)
+//   ycbcr-4:2:0   PHOTOMETRIC_YCBCR tiles with 2x2 chroma subsampling (--ycbcr)
+//
+// For each format it reports the encode time of encode_jpeg_tiles (tile extraction included, on the TBB pool),
+// the bytes of the tiles and their JPEGTABLES, the decode time the way OpenSlide reads Aperio tiles (libjpeg
+// fed the IFD's tables, then the abbreviated tile stream, with the colour space the PHOTOMETRIC tag gives,
+// decoded to RGB on one thread) and the PSNR of the decoded tiles against the source.
+//
+// Usage: bench_ycbcr_tiles [--width N] [--height N] [--quality N] [--repeat N]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <jpeglib.h>
+#include "jpeg_tile_encoder.h"
+
+namespace
+{
+    struct bench_options
+    {
+        std::uint32_t width = 8192;
+        std::uint32_t height = 8192;
+        int quality = 75;
+        int repeat = 3;
+    };
+
+    const std::uint32_t tile_size = 512;
+
+    // Tissue-like content: smooth blobs of eosin pink and haematoxylin purple on a white background, with fine
+    // grain, so that the encoders see something closer to a scan than noise or flat colour.
+    std::vector<std::uint8_t> make_image(std::uint32_t width, std::uint32_t height)
+    {
+        std::vector<std::uint8_t> rgb(std::size_t(width) * height * 3);
+        std::uint32_t state = 12345;
+        for (std::uint32_t y = 0; y < height; ++y) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                const double tissue = std::sin(x * 0.0021) * std::sin(y * 0.0017) + 0.5 * std::sin((x + y) * 0.013);
+                const double nuclei = std::max(0.0, std::sin(x * 0.11) * std::sin(y * 0.097) - 0.6) * 2.5;
+                state = state * 1664525u + 1013904223u;
+                const double grain = double(state >> 28) - 7.5;
+                const double t = std::clamp(tissue, 0.0, 1.0);
+                double r = 245 - t * 20 - nuclei * 110 + grain;
+                double g = 245 - t * 90 - nuclei * 100 + grain;
+                double b = 245 - t * 40 - nuclei * 40 + grain;
+                std::uint8_t* p = &rgb[(std::size_t(y) * width + x) * 3];
+                p[0] = std::uint8_t(std::clamp(r, 0.0, 255.0));
+                p[1] = std::uint8_t(std::clamp(g, 0.0, 255.0));
+                p[2] = std::uint8_t(std::clamp(b, 0.0, 255.0));
+            }
+        }
+        return rgb;
+    }
+
+    // Decodes the tiles as OpenSlide does and returns the squared error against the image.
+    double decode_tiles(
+        const std::vector<std::vector<std::uint8_t>>& tiles,
+        const std::vector<std::uint8_t>& tables,
+        const jpeg_tile_format& format,
+        const std::vector<std::uint8_t>& image,
+        std::uint32_t width,
+        std::uint32_t height)
+    {
+        jpeg_decompress_struct cinfo;
+        jpeg_error_mgr jerr;
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_decompress(&cinfo);
+
+        const std::uint32_t across = (width + tile_size - 1) / tile_size;
+        std::vector<std::uint8_t> pixels(std::size_t(tile_size) * tile_size * 3);
+        double squared_error = 0;
+        for (std::size_t i = 0; i < tiles.size(); ++i) {
+            jpeg_mem_src(&cinfo, tables.data(), static_cast<unsigned long>(tables.size()));
+            jpeg_read_header(&cinfo, FALSE);
+            jpeg_mem_src(&cinfo, tiles[i].data(), static_cast<unsigned long>(tiles[i].size()));
+            jpeg_read_header(&cinfo, TRUE);
+            cinfo.jpeg_color_space = format.ycbcr ? JCS_YCbCr : JCS_RGB;
+            cinfo.out_color_space = JCS_RGB;
+            jpeg_start_decompress(&cinfo);
+            while (cinfo.output_scanline < cinfo.output_height) {
+                JSAMPROW row = pixels.data() + std::size_t(cinfo.output_scanline) * tile_size * 3;
+                jpeg_read_scanlines(&cinfo, &row, 1);
+            }
+            jpeg_finish_decompress(&cinfo);
+
+            const std::uint32_t x0 = std::uint32_t(i % across) * tile_size, y0 = std::uint32_t(i / across) * tile_size;
+            for (std::uint32_t y = 0; y < std::min(tile_size, height - y0); ++y) {
+                for (std::uint32_t x = 0; x < std::min(tile_size, width - x0) * 3; ++x) {
+                    const double d = double(pixels[std::size_t(y) * tile_size * 3 + x]) - image[(std::size_t(y0 + y) * width + x0) * 3 + x];
+                    squared_error += d * d;
+                }
+            }
+        }
+        jpeg_destroy_decompress(&cinfo);
+        return squared_error;
+    }
+
+    template <typename Fn>
+    double best_seconds(int repeat, Fn fn)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> int {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return std::stoi(argv[++i]);
+            };
+            if (arg == "--width") {
+                options.width = std::uint32_t(value());
+            }
+            else if (arg == "--height") {
+                options.height = std::uint32_t(value());
+            }
+            else if (arg == "--quality") {
+                options.quality = value();
+            }
+            else if (arg == "--repeat") {
+                options.repeat = value();
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.width == 0 || options.height == 0 || options.repeat <= 0 || options.quality < 1 || options.quality > 100) {
+            throw std::invalid_argument("width, height and repeat must be positive, quality within 1 to 100");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << "Usage: bench_ycbcr_tiles [--width N] [--height N] [--quality N] [--repeat N]\n";
+        return 1;
+    }
+
+    const std::uint32_t width = options.width, height = options.height;
+    const std::vector<std::uint8_t> image = make_image(width, height);
+    const double mpixels = double(width) * height / 1e6;
+
+    jpeg_tile_format ycbcr;
+    ycbcr.ycbcr = true;
+    ycbcr.h_sampling = 2;
+    ycbcr.v_sampling = 2;
+    const struct
+    {
+        const char* name;
+        jpeg_tile_format format;
+    } formats[] = { { "rgb", jpeg_tile_format{} }, { "ycbcr-4:2:0", ycbcr } };
+
+    std::cout << std::left << std::setw(14) << "format" << std::setw(12) << "encode ms" << std::setw(10) << "MPix/s"
+        << std::setw(12) << "MB" << std::setw(12) << "decode ms" << std::setw(10) << "MPix/s" << "PSNR dB\n";
+    for (const auto& f : formats) {
+        std::vector<std::vector<std::uint8_t>> tiles;
+        const double encode = best_seconds(options.repeat, [&]() {
+            tiles = encode_jpeg_tiles(image.data(), width, height, std::size_t(width) * 3, channel_order::rgb,
+                tile_size, tile_size, options.quality, f.format);
+        });
+        const std::vector<std::uint8_t> tables = jpeg_tile_encoder::thread_encoder().tables(options.quality, f.format);
+        std::size_t bytes = tables.size();
+        for (const auto& tile : tiles) {
+            bytes += tile.size();
+        }
+
+        double squared_error = 0;
+        const double decode = best_seconds(options.repeat, [&]() {
+            squared_error = decode_tiles(tiles, tables, f.format, image, width, height);
+        });
+        const double psnr = 10 * std::log10(255.0 * 255.0 / std::max(squared_error / (double(width) * height * 3), 1e-12));
+
+        std::cout << std::setw(14) << f.name << std::fixed << std::setprecision(1)
+            << std::setw(12) << encode * 1e3 << std::setw(10) << mpixels / encode
+            << std::setprecision(2) << std::setw(12) << bytes / 1e6
+            << std::setprecision(1) << std::setw(12) << decode * 1e3 << std::setw(10) << mpixels / decode
+            << std::setprecision(2) << psnr << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Encodes a synthetic H&E-like image into the chunks of a Zarr store with zarr_writer and writes them, with 1, 2,
+// 4, ... threads up to the core count (tbb::global_control), for each codec:
+//
+//   blosc   Blosc containers of zstd frames (the default of --zarr)
+//   zstd    plain zstd frames
+//   raw     uncompressed chunks
+//
+// For each it reports the encode time of encode_chunks (RGB conversion and planar copy included, on the TBB
+// pool), the time to write the chunk files from as many threads (each chunk its own file, no lock), the bytes
+// written and the speedup of encoding plus writing over one thread. The store goes to --dir, which should be
+// on the disk to be measured; it is replaced on every run and removed at the end.
+//
+// Usage: bench_zarr_writer [--width N] [--height N] [--chunk-size N] [--max-threads N] [--repeat N] [--dir PATH]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include "zarr_writer.h"
+
+namespace
+{
+    struct bench_options
+    {
+        std::uint32_t width = 16384;
+        std::uint32_t height = 16384;
+        std::uint32_t chunk_size = 512;
+        int max_threads = 0;
+        int repeat = 3;
+        std::string dir = (std::filesystem::temp_directory_path() / "bench_zarr_writer.zarr").string();
+    };
+
+    // Tissue-like content: smooth blobs of eosin pink and haematoxylin purple on a white background, with fine
+    // grain, so that the codecs see something closer to a scan than noise or flat colour.
+    std::vector<std::uint8_t> make_image(std::uint32_t width, std::uint32_t height)
+    {
+        std::vector<std::uint8_t> rgb(std::size_t(width) * height * 3);
+        std::uint32_t state = 12345;
+        for (std::uint32_t y = 0; y < height; ++y) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                const double tissue = std::sin(x * 0.0021) * std::sin(y * 0.0017) + 0.5 * std::sin((x + y) * 0.013);
+                const double nuclei = std::max(0.0, std::sin(x * 0.11) * std::sin(y * 0.097) - 0.6) * 2.5;
+                state = state * 1664525u + 1013904223u;
+                const double grain = double(state >> 28) - 7.5;
+                const double t = std::clamp(tissue, 0.0, 1.0);
+                double r = 245 - t * 20 - nuclei * 110 + grain;
+                double g = 245 - t * 90 - nuclei * 100 + grain;
+                double b = 245 - t * 40 - nuclei * 40 + grain;
+                std::uint8_t* p = &rgb[(std::size_t(y) * width + x) * 3];
+                p[0] = std::uint8_t(std::clamp(r, 0.0, 255.0));
+                p[1] = std::uint8_t(std::clamp(g, 0.0, 255.0));
+                p[2] = std::uint8_t(std::clamp(b, 0.0, 255.0));
+            }
+        }
+        return rgb;
+    }
+
+    bench_options parse_command_line(int argc, char** argv)
+    {
+        bench_options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--width") {
+                options.width = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--height") {
+                options.height = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--chunk-size") {
+                options.chunk_size = std::uint32_t(std::stoi(value()));
+            }
+            else if (arg == "--max-threads") {
+                options.max_threads = std::stoi(value());
+            }
+            else if (arg == "--repeat") {
+                options.repeat = std::stoi(value());
+            }
+            else if (arg == "--dir") {
+                options.dir = value();
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (options.width == 0 || options.height == 0 || options.chunk_size == 0 || options.repeat <= 0 || options.max_threads < 0) {
+            throw std::invalid_argument("width, height, chunk size and repeat must be positive");
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    try {
+        options = parse_command_line(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: bench_zarr_writer [--width N] [--height N] [--chunk-size N] [--max-threads N] [--repeat N] [--dir PATH]\n";
+        return 1;
+    }
+
+    const std::uint32_t width = options.width, height = options.height;
+    const std::vector<std::uint8_t> image = make_image(width, height);
+    const double mpixels = double(width) * height / 1e6;
+    const int max_threads = options.max_threads > 0 ? options.max_threads : int(std::max(1u, std::thread::hardware_concurrency()));
+
+    const struct
+    {
+        const char* name;
+        zarr_codec codec;
+    } codecs[] = { { "blosc", zarr_codec::blosc }, { "zstd", zarr_codec::zstd }, { "raw", zarr_codec::raw } };
+
+    std::cout << std::left << std::setw(8) << "codec" << std::setw(9) << "threads" << std::setw(12) << "encode ms"
+        << std::setw(12) << "write ms" << std::setw(10) << "MPix/s" << std::setw(10) << "MB" << "speedup\n";
+    try {
+        for (const auto& c : codecs) {
+            double single = 0;
+            for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+                tbb::global_control limit(tbb::global_control::max_allowed_parallelism, std::size_t(threads));
+                double best_encode = 1e30, best_write = 1e30;
+                std::size_t bytes = 0;
+                for (int r = 0; r < options.repeat; ++r) {
+                    zarr_writer zarr(options.dir, options.chunk_size, c.codec);
+                    zarr.add_level(width, height);
+
+                    const auto start = std::chrono::steady_clock::now();
+                    const std::vector<std::vector<std::uint8_t>> chunks = zarr.encode_chunks(image.data(), width, height, std::size_t(width) * 3, channel_order::rgb);
+                    const auto encoded = std::chrono::steady_clock::now();
+                    tbb::parallel_for(std::size_t(0), chunks.size(), [&](std::size_t i) {
+                        zarr.write_chunk(0, i, chunks[i]);
+                    });
+                    zarr.close("bench", 0, 0);
+                    const auto written = std::chrono::steady_clock::now();
+
+                    best_encode = std::min(best_encode, std::chrono::duration<double>(encoded - start).count());
+                    best_write = std::min(best_write, std::chrono::duration<double>(written - encoded).count());
+                    bytes = 0;
+                    for (const auto& chunk : chunks) {
+                        bytes += chunk.size();
+                    }
+                }
+                const double total = best_encode + best_write;
+                if (threads == 1) {
+                    single = total;
+                }
+                std::cout << std::setw(8) << c.name << std::setw(9) << threads << std::fixed << std::setprecision(1)
+                    << std::setw(12) << best_encode * 1e3 << std::setw(12) << best_write * 1e3 << std::setw(10) << mpixels / total
+                    << std::setprecision(2) << std::setw(10) << bytes / 1e6 << single / total << "x\n";
+                if (threads == max_threads) {
+                    break;
+                }
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "bench_zarr_writer: " << e.what() << "\n";
+        return 2;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(options.dir, ec);
+    return 0;
+}
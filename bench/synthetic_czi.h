@@ -0,0 +1,227 @@
+#pragma once
+
+// Synthetic CZI slides for the benchmarks, written with libCZI's CZI writer.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include <libCZI.h>
+
+// Edge length of the subblocks of write_synthetic_slide.
+inline constexpr int synthetic_subblock_size = 512;
+
+// Tissue-like content: smooth colour gradients with a texture, so the JPEG encoder has realistic work. With a
+// 'blank_period', the first quarter of every 'blank_period' columns is uniform background instead, so that the
+// tiles range from large to ones tile_dedup shares.
+inline void fill_subblock(std::vector<std::uint8_t>& bgr, int x0, int y0, int w, int h, int blank_period = 0)
+{
+    bgr.resize(std::size_t(w) * h * 3);
+    for (int y = 0; y < h; ++y) {
+        std::uint8_t* row = bgr.data() + std::size_t(y) * w * 3;
+        for (int x = 0; x < w; ++x) {
+            const int gx = x0 + x, gy = y0 + y;
+            if (blank_period > 0 && gx % blank_period < blank_period / 4) {
+                row[x * 3 + 0] = row[x * 3 + 1] = row[x * 3 + 2] = 240;
+                continue;
+            }
+            const int texture = ((gx / 37 + gy / 41) & 1) * 40;
+            row[x * 3 + 0] = std::uint8_t(150 + ((gx >> 4) & 63) + texture / 2);
+            row[x * 3 + 1] = std::uint8_t(90 + ((gy >> 4) & 63) + texture);
+            row[x * 3 + 2] = std::uint8_t(160 + (((gx + gy) >> 5) & 63));
+        }
+    }
+}
+
+inline void add_subblock(libCZI::ICziWriter* writer, int index, int x, int y, int w, int h, const std::vector<std::uint8_t>& bgr)
+{
+    auto compressed = libCZI::ZstdCompress::CompressZStd1Alloc(
+        std::uint32_t(w), std::uint32_t(h), std::uint32_t(w) * 3, libCZI::PixelType::Bgr24, bgr.data(), nullptr);
+
+    libCZI::AddSubBlockInfoMemPtr info;
+    info.Clear();
+    info.coordinate = libCZI::CDimCoordinate{ { libCZI::DimensionIndex::C, 0 } };
+    info.mIndexValid = true;
+    info.mIndex = index;
+    info.x = x;
+    info.y = y;
+    info.logicalWidth = w;
+    info.logicalHeight = h;
+    info.physicalWidth = w;
+    info.physicalHeight = h;
+    info.PixelType = libCZI::PixelType::Bgr24;
+    info.SetCompressionMode(libCZI::CompressionMode::Zstd1);
+    info.ptrData = compressed->GetPtr();
+    info.dataSize = std::uint32_t(compressed->GetSizeOfData());
+    writer->SyncAddSubBlock(info);
+}
+
+inline void write_metadata(libCZI::ICziWriter* writer)
+{
+    libCZI::PrepareMetadataInfo prepare;
+    auto metadata = writer->GetPreparedMetadata(prepare);
+    const std::string xml = metadata->GetXml(true);
+    libCZI::WriteMetadataInfo info;
+    info.Clear();
+    info.szMetadata = xml.c_str();
+    info.szMetadataSize = xml.size();
+    writer->SyncWriteMetadata(info);
+}
+
+// A CZI writer that creates (or replaces) 'path'.
+inline std::shared_ptr<libCZI::ICziWriter> create_czi_writer(const std::string& path)
+{
+    auto writer = libCZI::CreateCZIWriter();
+    writer->Create(libCZI::CreateOutputStreamForFileUtf8(path.c_str(), true), std::make_shared<libCZI::CCziWriterInfo>(libCZI::GUID{ 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } }));
+    return writer;
+}
+
+// Writes the metadata and finishes the file.
+inline void close_czi_writer(libCZI::ICziWriter* writer)
+{
+    write_metadata(writer);
+    writer->Close();
+}
+
+inline std::vector<std::uint8_t> read_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Writes a single-subblock CZI, the format CZI files embed their label and macro images in. Its content is taken
+// from the middle of a 'blank_period', clear of the background columns.
+inline std::vector<std::uint8_t> make_attachment_czi(const std::string& path, int w, int h, int blank_period = 0)
+{
+    {
+        auto writer = create_czi_writer(path);
+        std::vector<std::uint8_t> bgr;
+        fill_subblock(bgr, blank_period / 2, 0, w, h, blank_period);
+        add_subblock(writer.get(), 0, 0, 0, w, h, bgr);
+        close_czi_writer(writer.get());
+    }
+
+    std::vector<std::uint8_t> data = read_file(path);
+    std::remove(path.c_str());
+    return data;
+}
+
+// Writes a slide of zstd1 compressed Bgr24 subblocks on a synthetic_subblock_size grid, filled by fill_subblock,
+// with the label and macro attachments CZIConvert expects. The attachments are made in 'work_dir'.
+inline void write_synthetic_slide(const std::string& path, const std::string& work_dir, int width, int height, int blank_period = 0)
+{
+    auto writer = create_czi_writer(path);
+    std::vector<std::uint8_t> bgr;
+    int index = 0;
+    for (int y = 0; y < height; y += synthetic_subblock_size) {
+        for (int x = 0; x < width; x += synthetic_subblock_size) {
+            const int w = std::min(synthetic_subblock_size, width - x), h = std::min(synthetic_subblock_size, height - y);
+            fill_subblock(bgr, x, y, w, h, blank_period);
+            add_subblock(writer.get(), index++, x, y, w, h, bgr);
+        }
+    }
+
+    const struct { const char* name; int w; int h; std::uint32_t id; } attachments[] = {
+        { "Label", 400, 300, 1 },
+        { "SlidePreview", 1200, 300, 2 },
+    };
+    for (const auto& a : attachments) {
+        std::vector<std::uint8_t> data = make_attachment_czi(work_dir + "/bench_attachment.czi", a.w, a.h, blank_period);
+        libCZI::AddAttachmentInfo info;
+        info.contentGuid = libCZI::GUID{ a.id, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } };
+        info.SetName(a.name);
+        info.SetContentFileType("CZI");
+        info.ptrData = data.data();
+        info.dataSize = std::uint32_t(data.size());
+        writer->SyncAddAttachment(info);
+    }
+    close_czi_writer(writer.get());
+}
+
+// How add_subblock_grid stores the subblocks.
+enum class subblock_compression
+{
+    none,
+    zstd1,
+    zstd1_hilo,     // zstd1 with hi-lo byte packing, so that decoding 16-bit samples takes a scratch buffer
+};
+
+// Equally sized subblocks of one channel and pixel type, 'columns' across from the origin, in row-major order.
+struct subblock_grid
+{
+    libCZI::PixelType pixel_type = libCZI::PixelType::Gray16;
+    int subblock_size = 1024;
+    int count = 64;
+    int columns = 8;
+    subblock_compression compression = subblock_compression::zstd1;
+    int channel = 0;
+    int first_index = 0;    // M-index of the first subblock
+};
+
+// Fills the pixels of the grid's subblock 'index' (rows of subblock_size pixels without padding).
+using subblock_filler = std::function<void(int index, std::uint8_t* pixels)>;
+
+inline void add_subblock_grid(libCZI::ICziWriter* writer, const subblock_grid& grid, const subblock_filler& fill)
+{
+    const int size = grid.subblock_size;
+    const std::uint32_t stride = std::uint32_t(size) * std::uint32_t(libCZI::Utils::GetBytesPerPixel(grid.pixel_type));
+    std::vector<std::uint8_t> pixels(std::size_t(stride) * size);
+    libCZI::CompressParametersOnMap parameters;
+    if (grid.compression == subblock_compression::zstd1_hilo) {
+        parameters.map[static_cast<int>(libCZI::CompressionParameterKey::ZSTD_PREPROCESS_DOLOHIBYTEPACKING)] = libCZI::CompressParameter(true);
+    }
+    for (int i = 0; i < grid.count; ++i) {
+        fill(i, pixels.data());
+
+        libCZI::AddSubBlockInfoMemPtr info;
+        info.Clear();
+        info.coordinate = libCZI::CDimCoordinate{ { libCZI::DimensionIndex::C, grid.channel } };
+        info.mIndexValid = true;
+        info.mIndex = grid.first_index + i;
+        info.x = (i % grid.columns) * size;
+        info.y = (i / grid.columns) * size;
+        info.logicalWidth = info.physicalWidth = size;
+        info.logicalHeight = info.physicalHeight = size;
+        info.PixelType = grid.pixel_type;
+        std::shared_ptr<libCZI::IMemoryBlock> compressed;
+        if (grid.compression == subblock_compression::none) {
+            info.ptrData = pixels.data();
+            info.dataSize = std::uint32_t(pixels.size());
+        }
+        else {
+            compressed = libCZI::ZstdCompress::CompressZStd1Alloc(std::uint32_t(size), std::uint32_t(size), stride, grid.pixel_type, pixels.data(),
+                grid.compression == subblock_compression::zstd1_hilo ? &parameters : nullptr);
+            info.SetCompressionMode(libCZI::CompressionMode::Zstd1);
+            info.ptrData = compressed->GetPtr();
+            info.dataSize = std::uint32_t(compressed->GetSizeOfData());
+        }
+        writer->SyncAddSubBlock(info);
+    }
+}
+
+// Writes a CZI holding just 'grid'.
+inline void write_subblock_grid(const std::string& path, const subblock_grid& grid, const subblock_filler& fill)
+{
+    auto writer = create_czi_writer(path);
+    add_subblock_grid(writer.get(), grid, fill);
+    close_czi_writer(writer.get());
+}
+
+// Gray16 ramps with 4 bits of noise, shifted by 16 per subblock, for a grid of 'subblock_size' subblocks.
+inline subblock_filler gray16_ramp(int subblock_size)
+{
+    return [subblock_size, state = std::uint32_t(12345)](int index, std::uint8_t* pixels) mutable {
+        std::uint16_t* samples = reinterpret_cast<std::uint16_t*>(pixels);
+        for (int y = 0; y < subblock_size; ++y) {
+            for (int x = 0; x < subblock_size; ++x) {
+                state = state * 1664525u + 1013904223u;
+                samples[std::size_t(y) * subblock_size + x] = std::uint16_t(((x + y + index * 16) << 2) + (state >> 28));
+            }
+        }
+    };
+}
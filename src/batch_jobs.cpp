@@ -0,0 +1,141 @@
+#include "batch_jobs.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool has_wildcards(const std::string& s)
+    {
+        return s.find_first_of("*?") != std::string::npos;
+    }
+
+    // '*' matches any run of characters, '?' a single one.
+    bool wildcard_match(const char* pattern, const char* name)
+    {
+        const char* star = nullptr;
+        const char* resume = nullptr;
+        while (*name != '\0') {
+            if (*pattern == '*') {
+                star = pattern++;
+                resume = name;
+            }
+            else if (*pattern == '?' || *pattern == *name) {
+                ++pattern;
+                ++name;
+            }
+            else if (star != nullptr) {
+                pattern = star + 1;
+                name = ++resume;
+            }
+            else {
+                return false;
+            }
+        }
+        while (*pattern == '*') {
+            ++pattern;
+        }
+        return *pattern == '\0';
+    }
+
+    bool is_czi(const fs::path& p)
+    {
+        std::string ext = p.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        return ext == ".czi";
+    }
+
+    std::vector<fs::path> list_directory(const fs::path& dir, const std::string& pattern)
+    {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            const std::string name = entry.path().filename().string();
+            if (pattern.empty() ? is_czi(entry.path()) : wildcard_match(pattern.c_str(), name.c_str())) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::string default_output(const fs::path& input, const std::string& output_dir, const std::string& extension)
+    {
+        const fs::path dir = output_dir.empty() ? input.parent_path() : fs::path(output_dir);
+        return (dir / input.stem()).string() + extension;
+    }
+}
+
+std::vector<batch_job> collect_batch_jobs(const std::string& source, const std::string& output_dir, const std::string& extension)
+{
+    const fs::path source_path(source);
+    std::vector<batch_job> jobs;
+    auto add = [&](const fs::path& input, const std::string& output) {
+        batch_job job;
+        job.input = input.string();
+        job.output = output.empty() ? default_output(input, output_dir, extension) : output;
+        std::error_code ec;
+        job.input_size = fs::file_size(input, ec);
+        jobs.push_back(std::move(job));
+    };
+
+    if (has_wildcards(source_path.filename().string())) {
+        const fs::path dir = source_path.has_parent_path() ? source_path.parent_path() : fs::path(".");
+        if (!fs::is_directory(dir)) {
+            throw std::invalid_argument("batch: no such directory: " + dir.string());
+        }
+        for (const auto& p : list_directory(dir, source_path.filename().string())) {
+            add(p, std::string());
+        }
+    }
+    else if (fs::is_directory(source_path)) {
+        for (const auto& p : list_directory(source_path, std::string())) {
+            add(p, std::string());
+        }
+    }
+    else if (!fs::is_regular_file(source_path)) {
+        throw std::invalid_argument("batch: no such file or directory: " + source);
+    }
+    else if (is_czi(source_path)) {
+        add(source_path, std::string());
+    }
+    else {
+        std::ifstream manifest(source_path);
+        const fs::path base = source_path.parent_path();
+        std::string line;
+        while (std::getline(manifest, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            const std::size_t tab = line.find('\t');
+            const fs::path input = base / fs::path(line.substr(0, tab));
+            const std::string output = tab == std::string::npos ? std::string() : (base / fs::path(line.substr(tab + 1))).string();
+            add(input, output);
+        }
+    }
+
+    if (jobs.empty()) {
+        throw std::invalid_argument("batch: no CZI files found in " + source);
+    }
+
+    std::set<std::string> outputs;
+    for (const auto& job : jobs) {
+        if (!outputs.insert(fs::absolute(job.output).lexically_normal().string()).second) {
+            throw std::invalid_argument("batch: more than one slide would be written to " + job.output);
+        }
+    }
+
+    std::stable_sort(jobs.begin(), jobs.end(), [](const batch_job& a, const batch_job& b) { return a.input_size > b.input_size; });
+    return jobs;
+}
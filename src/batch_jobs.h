@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One slide of a batch conversion.
+struct batch_job
+{
+    std::string input;
+    std::string output;
+    std::uintmax_t input_size = 0;      // bytes, to schedule the largest slides first
+};
+
+// Lists the slides to convert from 'source', which is one of
+//   - a directory: every *.czi in it (not recursive),
+//   - a glob: a path whose file name contains '*' or '?', e.g. /data/run42/*.czi,
+//   - a .czi file,
+//   - a manifest: a text file with one CZI path per line, optionally followed by a tab and the output path.
+//     Blank lines and lines starting with '#' are skipped; relative paths are relative to the manifest.
+// Unless the manifest names it, a slide's output is <output_dir>/<input stem><extension>, or sits next to the input if
+// 'output_dir' is empty. The jobs are sorted by decreasing input size, so that a big slide is not the last one
+// to start. Throws std::invalid_argument if 'source' does not exist, nothing matches, or two slides would be
+// written to the same file.
+std::vector<batch_job> collect_batch_jobs(const std::string& source, const std::string& output_dir, const std::string& extension = ".svs");
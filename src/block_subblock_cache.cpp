@@ -0,0 +1,131 @@
+#include "block_subblock_cache.h"
+
+#include <algorithm>
+
+block_subblock_cache::block_subblock_cache(
+    libCZI::ICZIReader* reader,
+    const libCZI::IntRect& roi,
+    const std::vector<const libCZI::IDimCoordinate*>& planes,
+    std::uint32_t block_w,
+    std::uint32_t block_h,
+    std::uint64_t max_bytes,
+    std::uint32_t margin)
+    : max_bytes_(max_bytes)
+{
+    libCZI::SubBlockCacheOptions options;
+    options.Clear();
+    options.type = libCZI::SubBlockCacheOptions::Type::Sharded;
+    cache_ = libCZI::CreateSubBlockCache(options);
+
+    const std::size_t subblock_count = std::size_t(std::max(reader->GetStatistics().subBlockCount, 0));
+    last_block_.assign(subblock_count, -1);
+    read_ = std::vector<std::atomic<std::uint8_t>>(subblock_count);
+    added_.assign(subblock_count, false);
+
+    const std::int64_t blocks_across = (std::int64_t(roi.w) + block_w - 1) / block_w;
+    for (const libCZI::IDimCoordinate* plane : planes) {
+        reader->EnumSubset(plane, &roi, false,
+            [&](int index, const libCZI::SubBlockInfo& info) -> bool {
+                const libCZI::IntRect& r = info.logicalRect;
+                const std::int64_t x0 = std::max(r.x, roi.x) - roi.x;
+                const std::int64_t y0 = std::max(r.y, roi.y) - roi.y;
+                const std::int64_t x1 = std::min(std::int64_t(r.x) + r.w, std::int64_t(roi.x) + roi.w) - roi.x;
+                const std::int64_t y1 = std::min(std::int64_t(r.y) + r.h, std::int64_t(roi.y) + roi.h) - roi.y;
+                if (x1 <= x0 || y1 <= y0 || std::size_t(index) >= subblock_count) {
+                    return true;
+                }
+
+                // the blocks whose composed area (the block and its margin) it overlaps
+                const std::int64_t first_column = std::max<std::int64_t>(x0 - margin, 0) / block_w;
+                const std::int64_t last_column = (std::min<std::int64_t>(x1 + margin, roi.w) - 1) / block_w;
+                const std::int64_t first_row = std::max<std::int64_t>(y0 - margin, 0) / block_h;
+                const std::int64_t last_row = (std::min<std::int64_t>(y1 + margin, roi.h) - 1) / block_h;
+                if (first_column != last_column || first_row != last_row) {
+                    last_block_[std::size_t(index)] = last_row * blocks_across + last_column;
+                }
+                return true;
+            });
+    }
+}
+
+libCZI::ISubBlockCacheOperation::CacheItem block_subblock_cache::Get(int subblock_index)
+{
+    const std::size_t index = std::size_t(subblock_index);
+    reads_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= last_block_.size()) {
+        return {};
+    }
+    if (read_[index].exchange(1, std::memory_order_relaxed) == 0) {
+        distinct_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (last_block_[index] < 0) {
+        return {};
+    }
+
+    CacheItem item = cache_->Get(subblock_index);
+    if (item.IsValid()) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+void block_subblock_cache::Add(int subblock_index, const CacheItem& cache_item)
+{
+    const std::size_t index = std::size_t(subblock_index);
+    if (index >= last_block_.size() || last_block_[index] < 0) {
+        return;
+    }
+
+    const libCZI::IntSize size = cache_item.bitmap->GetSize();
+    const std::uint64_t bytes = std::uint64_t(size.w) * size.h * libCZI::Utils::GetBytesPerPixel(cache_item.bitmap->GetPixelType());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (added_[index] || last_block_[index] <= done_through_) {
+        return;
+    }
+    if (kept_bytes_ + bytes > max_bytes_) {
+        ++rejected_;
+        return;
+    }
+
+    added_[index] = true;
+    kept_.emplace(last_block_[index], std::make_pair(subblock_index, bytes));
+    kept_bytes_ += bytes;
+    peak_bytes_ = std::max(peak_bytes_, kept_bytes_);
+    cache_->Add(subblock_index, cache_item);
+}
+
+void block_subblock_cache::block_done(std::size_t block)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_through_ = std::int64_t(block);
+    const auto done = kept_.upper_bound(done_through_);
+    if (done == kept_.begin()) {
+        return;
+    }
+    for (auto it = kept_.begin(); it != done; ++it) {
+        kept_bytes_ -= it->second.second;
+    }
+    kept_.erase(kept_.begin(), done);
+
+    // The libCZI cache evicts in LRU order only. Touching the subblocks that are still needed makes the finished
+    // ones the least recently used, so pruning to the number still needed drops exactly those.
+    for (const auto& kept : kept_) {
+        cache_->Get(kept.second.first);
+    }
+    libCZI::ISubBlockCacheControl::PruneOptions prune;
+    prune.maxSubBlockCount = std::uint32_t(kept_.size());
+    cache_->Prune(prune);
+}
+
+block_subblock_cache::statistics block_subblock_cache::stats() const
+{
+    statistics result;
+    result.reads = reads_.load();
+    result.hits = hits_.load();
+    result.distinct = distinct_.load();
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.rejected = rejected_;
+    result.peak_bytes = peak_bytes_;
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <libCZI.h>
+
+// Lets the base-level blocks share the decoded subblocks that straddle block boundaries, so that each subblock is
+// decoded about once instead of once per block it overlaps. It is handed to the accessors as their subBlockCache.
+//
+// Since the blocks are composed in row-major order, the directory tells in advance which blocks will read a
+// subblock and which of them is the last. Only subblocks read by more than one block are kept, in a sharded libCZI
+// sub-block cache, and block_done() drops those whose last block is done. This keeps the cache to the subblocks
+// along the boundaries of the current block row (a subblock straddling a row boundary is held until the row below
+// reaches it), up to 'max_bytes'; a subblock that does not fit is decoded again by the next block.
+class block_subblock_cache : public libCZI::ISubBlockCacheOperation
+{
+public:
+    struct statistics
+    {
+        std::uint64_t reads = 0;        // subblock bitmaps the accessors asked for
+        std::uint64_t hits = 0;         // ... and got from the cache; the others were decoded
+        std::uint64_t distinct = 0;     // different subblocks read
+        std::uint64_t rejected = 0;     // shared subblocks not kept for lack of space
+        std::uint64_t peak_bytes = 0;
+    };
+
+    // The blocks are 'block_w' x 'block_h' pixels, laid out from the top left of 'roi' (layer-0 coordinates),
+    // composed of the subblocks of 'planes' with 'margin' pixels around them within the ROI.
+    block_subblock_cache(
+        libCZI::ICZIReader* reader,
+        const libCZI::IntRect& roi,
+        const std::vector<const libCZI::IDimCoordinate*>& planes,
+        std::uint32_t block_w,
+        std::uint32_t block_h,
+        std::uint64_t max_bytes,
+        std::uint32_t margin = 0);
+
+    CacheItem Get(int subblock_index) override;
+    void Add(int subblock_index, const CacheItem& cache_item) override;
+
+    // To be called for every block in row-major order (0, 1, ...) once it is composed.
+    void block_done(std::size_t block);
+
+    statistics stats() const;
+
+private:
+    std::shared_ptr<libCZI::ISubBlockCache> cache_;
+    std::vector<std::int64_t> last_block_;              // per subblock, the last block reading it; -1 if only one does
+    std::vector<std::atomic<std::uint8_t>> read_;       // per subblock, whether it was read yet
+    std::uint64_t max_bytes_;
+    std::atomic<std::uint64_t> reads_{ 0 };
+    std::atomic<std::uint64_t> hits_{ 0 };
+    std::atomic<std::uint64_t> distinct_{ 0 };
+
+    mutable std::mutex mutex_;                          // guards the members below
+    std::multimap<std::int64_t, std::pair<int, std::uint64_t>> kept_;  // last block -> subblock, size
+    std::vector<bool> added_;
+    std::int64_t done_through_ = -1;
+    std::uint64_t kept_bytes_ = 0;
+    std::uint64_t peak_bytes_ = 0;
+    std::uint64_t rejected_ = 0;
+};
@@ -0,0 +1,171 @@
+#include "channel_composite.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include "pixel_window.h"
+
+namespace
+{
+    // Rows per strip the compositor runs over in parallel.
+    const std::uint32_t strip_rows = 128;
+
+    // Tints of channels without display settings, in the order of the composed channels.
+    const libCZI::Rgb8Color palette[] = {
+        { 0, 0, 255 }, { 0, 255, 0 }, { 255, 0, 0 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 0 }, { 255, 255, 255 },
+    };
+
+    // A strip of rows of another bitmap, so that the compositor can work on the strips of one destination
+    // concurrently.
+    class bitmap_rows : public libCZI::IBitmapData
+    {
+    public:
+        bitmap_rows(libCZI::IBitmapData* bitmap, std::uint32_t y, std::uint32_t height) : bitmap_(bitmap), y_(y), height_(height) {}
+
+        libCZI::PixelType GetPixelType() const override { return bitmap_->GetPixelType(); }
+        libCZI::IntSize GetSize() const override { return libCZI::IntSize{ bitmap_->GetWidth(), height_ }; }
+        libCZI::BitmapLockInfo Lock() override
+        {
+            libCZI::BitmapLockInfo info = bitmap_->Lock();
+            info.ptrDataRoi = static_cast<std::uint8_t*>(info.ptrDataRoi) + std::size_t(y_) * info.stride;
+            info.size = std::uint64_t(height_) * info.stride;
+            return info;
+        }
+        void Unlock() override { bitmap_->Unlock(); }
+        int GetLockCount() const override { return bitmap_->GetLockCount(); }
+
+    private:
+        libCZI::IBitmapData* bitmap_;
+        std::uint32_t y_;
+        std::uint32_t height_;
+    };
+
+    bool is_16_bit(libCZI::PixelType type)
+    {
+        return type == libCZI::PixelType::Gray16 || type == libCZI::PixelType::Bgr48;
+    }
+}
+
+channel_composite::channel_composite(
+    libCZI::ICZIReader* reader,
+    const std::shared_ptr<libCZI::IDisplaySettings>& display_settings,
+    std::vector<int> channels,
+    const libCZI::IntRect& roi,
+    double window_percentile)
+    : channels_(std::move(channels))
+{
+    if (channels_.empty()) {
+        if (display_settings) {
+            channels_ = libCZI::CDisplaySettingsHelper::GetActiveChannels(display_settings.get());
+        }
+        if (channels_.empty()) {
+            libCZI::SubBlockStatistics statistics = reader->GetStatistics();
+            int start = 0, size = 1;
+            statistics.dimBounds.TryGetInterval(libCZI::DimensionIndex::C, &start, &size);
+            for (int c = start; c < start + size; ++c) {
+                channels_.push_back(c);
+            }
+        }
+    }
+
+    planes_.reserve(channels_.size());
+    luts_.reserve(channels_.size());
+    for (std::size_t i = 0; i < channels_.size(); ++i) {
+        const int c = channels_[i];
+        const std::size_t luts_before = luts_.size();
+        planes_.push_back(libCZI::CDimCoordinate{ { libCZI::DimensionIndex::C, c } });
+
+        libCZI::SubBlockInfo subblock;
+        if (!reader->TryGetSubBlockInfoOfArbitrarySubBlockInChannel(c, subblock)) {
+            throw std::runtime_error("channel " + std::to_string(c) + " has no subblocks");
+        }
+        const libCZI::PixelType type = subblock.pixelType;
+        if (type != libCZI::PixelType::Gray8 && type != libCZI::PixelType::Gray16
+            && type != libCZI::PixelType::Bgr24 && type != libCZI::PixelType::Bgr48) {
+            throw std::runtime_error("channel " + std::to_string(c) + " has the unsupported pixel type "
+                + libCZI::Utils::PixelTypeToInformalString(type));
+        }
+        const int lut_size = is_16_bit(type) ? 65536 : 256;
+
+        libCZI::Compositors::ChannelInfo info;
+        info.Clear();
+        const std::shared_ptr<libCZI::IChannelDisplaySetting> setting =
+            display_settings ? display_settings->GetChannelDisplaySettings(c) : nullptr;
+        if (setting) {
+            // as CDisplaySettingsHelper does, except that a channel asked for by index is composed even if disabled
+            info.weight = setting->GetWeight();
+            setting->GetBlackWhitePoint(&info.blackPoint, &info.whitePoint);
+            info.enableTinting = setting->TryGetTintingColorRgb8(&info.tinting.color);
+            switch (setting->GetGradationCurveMode()) {
+            case libCZI::IDisplaySettings::GradationCurveMode::Gamma: {
+                float gamma = 1;
+                setting->TryGetGamma(&gamma);
+                luts_.push_back(libCZI::Utils::Create8BitLookUpTableFromGamma(lut_size, info.blackPoint, info.whitePoint, gamma));
+                break;
+            }
+            case libCZI::IDisplaySettings::GradationCurveMode::Spline: {
+                std::vector<libCZI::IDisplaySettings::SplineData> splines;
+                setting->TryGetSplineData(&splines);
+                luts_.push_back(libCZI::Utils::Create8BitLookUpTableFromSplines(lut_size, info.blackPoint, info.whitePoint, splines));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        else {
+            info.weight = 1;
+            info.blackPoint = 0;
+            info.whitePoint = 1;
+            if (channels_.size() > 1) {
+                info.enableTinting = true;
+                info.tinting.color = palette[i % (sizeof(palette) / sizeof(palette[0]))];
+            }
+            if (is_16_bit(type)) {
+                luts_.push_back(make_window_lut(find_window(sample_histogram(reader, &planes_.back(), roi, 64), window_percentile)));
+            }
+        }
+        if (luts_.size() > luts_before) {
+            // a table replaces the black and white point
+            info.ptrLookUpTable = luts_.back().data();
+            info.lookUpTableElementCount = lut_size;
+        }
+        infos_.push_back(info);
+    }
+}
+
+std::shared_ptr<libCZI::IBitmapData> channel_composite::compose(
+    const std::function<std::shared_ptr<libCZI::IBitmapData>(const libCZI::IDimCoordinate*)>& get) const
+{
+    // isolated, so that a thread waiting for the channels does not pick up another block's work meanwhile
+    std::vector<std::shared_ptr<libCZI::IBitmapData>> bitmaps(channels_.size());
+    tbb::this_task_arena::isolate([&] {
+        tbb::parallel_for(std::size_t(0), channels_.size(), [&](std::size_t i) { bitmaps[i] = get(&planes_[i]); });
+    });
+
+    const std::uint32_t width = bitmaps[0]->GetWidth(), height = bitmaps[0]->GetHeight();
+    for (const auto& bitmap : bitmaps) {
+        if (bitmap->GetWidth() != width || bitmap->GetHeight() != height) {
+            throw std::runtime_error("the channels of a composite differ in size");
+        }
+    }
+
+    const std::shared_ptr<libCZI::IBitmapData> composite = libCZI::GetDefaultSiteObject(libCZI::SiteObjectType::Default)->CreateBitmap(libCZI::PixelType::Bgr24, width, height);
+    tbb::parallel_for(std::uint32_t(0), (height + strip_rows - 1) / strip_rows, [&](std::uint32_t strip) {
+        const std::uint32_t y = strip * strip_rows, rows = std::min(strip_rows, height - y);
+        std::deque<bitmap_rows> sources;
+        std::vector<libCZI::IBitmapData*> source_pointers;
+        for (const auto& bitmap : bitmaps) {
+            sources.emplace_back(bitmap.get(), y, rows);
+            source_pointers.push_back(&sources.back());
+        }
+        bitmap_rows destination(composite.get(), y, rows);
+        libCZI::Compositors::ComposeMultiChannel_Bgr24(&destination, int(source_pointers.size()), source_pointers.data(), infos_.data());
+    });
+    return composite;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <libCZI.h>
+
+// Composes several channels of a fluorescence CZI into one Bgr24 image, the way ZEN shows them: each channel is
+// mapped through its gradation (black and white point, gamma or spline curve), tinted with its colour and the
+// weighted channels are added up (libCZI's multi-channel compositor).
+//
+// The gradations and colours come from the file's display settings. A channel without display settings is tinted
+// from a fixed palette and, if it has 16-bit samples, windowed from a sample of its subblocks like a single-channel
+// slide (c.f. pixel_window.h).
+//
+// compose() is meant for the base-level blocks: it reads the channels of a block concurrently and runs the
+// compositor over strips of rows in parallel, so that the channels cost little more wall time than one.
+class channel_composite
+{
+public:
+    // 'channels' lists the channel indices (the C coordinate) to compose; empty takes the channels enabled in the
+    // display settings, or every channel if the file has none. 'window_percentile' is find_window's cut-off for
+    // windowing 16-bit channels without display settings. Throws if a channel has no subblocks or a pixel type
+    // the compositor cannot take.
+    channel_composite(
+        libCZI::ICZIReader* reader,
+        const std::shared_ptr<libCZI::IDisplaySettings>& display_settings,
+        std::vector<int> channels,
+        const libCZI::IntRect& roi,
+        double window_percentile);
+
+    std::size_t channel_count() const { return channels_.size(); }
+
+    // The channel index and the plane coordinate of the i-th composed channel.
+    int channel(std::size_t i) const { return channels_[i]; }
+    const libCZI::IDimCoordinate* plane(std::size_t i) const { return &planes_[i]; }
+
+    // The plane coordinates of all composed channels, e.g. for planning the reads of the blocks.
+    std::vector<const libCZI::IDimCoordinate*> planes() const
+    {
+        std::vector<const libCZI::IDimCoordinate*> planes;
+        for (const auto& plane : planes_) {
+            planes.push_back(&plane);
+        }
+        return planes;
+    }
+
+    // Composes one region: 'get' returns the bitmap of the region in the given plane, all of the same size.
+    // It is called concurrently for the channels.
+    std::shared_ptr<libCZI::IBitmapData> compose(
+        const std::function<std::shared_ptr<libCZI::IBitmapData>(const libCZI::IDimCoordinate*)>& get) const;
+
+private:
+    std::vector<int> channels_;
+    std::vector<libCZI::CDimCoordinate> planes_;
+    std::vector<libCZI::Compositors::ChannelInfo> infos_;
+    std::vector<std::vector<std::uint8_t>> luts_;       // the gradation tables infos_ point into
+};
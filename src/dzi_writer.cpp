@@ -0,0 +1,270 @@
+#include "dzi_writer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tbb/parallel_for.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const int sample_per_pixels = 3;
+
+    // The levels of a block computed from its pixels (the base level and the ones below it, down to
+    // block_levels); more make bigger blocks.
+    const std::uint32_t max_block_levels = 3;
+
+    std::uint32_t ceil_shift(std::uint32_t value, std::uint32_t shift)
+    {
+        return std::uint32_t((std::uint64_t(value) + (std::uint64_t(1) << shift) - 1) >> shift);
+    }
+
+    // One output row of the average of the 2x2 pixels of rows 'upper' and 'lower' ('lower' null for an odd last
+    // row) that are 'width' pixels wide; an odd last column is averaged on its own, so the row is ceil(width / 2)
+    // pixels.
+    void downsample_row(const std::uint8_t* upper, const std::uint8_t* lower, std::uint8_t* dst, std::uint32_t width)
+    {
+        const std::uint32_t pairs = width / 2;
+        for (std::uint32_t x = 0; x < pairs; ++x) {
+            const std::uint8_t* a = upper + std::size_t(x) * 2 * sample_per_pixels;
+            const std::uint8_t* b = lower != nullptr ? lower + std::size_t(x) * 2 * sample_per_pixels : a;
+            for (int c = 0; c < sample_per_pixels; ++c) {
+                const unsigned sum = unsigned(a[c]) + a[c + sample_per_pixels] + b[c] + b[c + sample_per_pixels];
+                dst[std::size_t(x) * sample_per_pixels + c] = std::uint8_t((sum + 2) >> 2);
+            }
+        }
+        if (width % 2 != 0) {
+            const std::uint8_t* a = upper + std::size_t(pairs) * 2 * sample_per_pixels;
+            const std::uint8_t* b = lower != nullptr ? lower + std::size_t(pairs) * 2 * sample_per_pixels : a;
+            for (int c = 0; c < sample_per_pixels; ++c) {
+                dst[std::size_t(pairs) * sample_per_pixels + c] = std::uint8_t((unsigned(a[c]) + b[c] + 1) >> 1);
+            }
+        }
+    }
+
+    void write_file(const fs::path& path, const char* data, std::size_t size)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(data, std::streamsize(size)) || !file.flush()) {
+            throw std::runtime_error("cannot write " + path.string());
+        }
+    }
+}
+
+dzi_writer::dzi_writer(const std::string& path, std::uint32_t width, std::uint32_t height, std::uint32_t tile_size, std::uint32_t overlap, int quality)
+    : path_(path), tile_size_(tile_size), overlap_(overlap), quality_(quality)
+{
+    if (width == 0 || height == 0 || tile_size == 0 || overlap >= tile_size) {
+        throw std::invalid_argument("dzi_writer: the image must not be empty, and the overlap must be below the tile size");
+    }
+    format_.ycbcr = true;
+    format_.h_sampling = 2;
+    format_.v_sampling = 2;
+    format_.embed_tables = true;
+
+    std::uint32_t w = width, h = height;
+    for (;;) {
+        level_state level;
+        level.width = w;
+        level.height = h;
+        level.tiles_across = (w + tile_size - 1) / tile_size;
+        level.tiles_down = (h + tile_size - 1) / tile_size;
+        levels_.push_back(std::move(level));
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    block_levels_ = std::min<std::uint32_t>(max_block_levels, std::uint32_t(levels_.size() - 1));
+
+    files_ = path_.parent_path() / (path_.stem().string() + "_files");
+    std::error_code ec;
+    if (fs::is_regular_file(path_, ec)) {
+        fs::remove(path_, ec);
+        fs::remove_all(files_, ec);
+    }
+    else if (fs::exists(files_, ec) && !(fs::is_directory(files_, ec) && fs::is_empty(files_, ec))) {
+        throw std::runtime_error(files_.string() + " exists and belongs to no Deep Zoom image");
+    }
+    for (std::size_t level = 0; level < levels_.size(); ++level) {
+        fs::create_directories(files_ / std::to_string(level), ec);
+        if (ec) {
+            throw std::runtime_error("cannot create " + (files_ / std::to_string(level)).string() + ": " + ec.message());
+        }
+    }
+}
+
+dzi_writer::~dzi_writer()
+{
+    if (!closed_) {
+        std::error_code ec;
+        fs::remove_all(files_, ec);
+    }
+}
+
+void dzi_writer::write_tile(std::size_t level, std::uint32_t column, std::uint32_t row, const std::uint8_t* pixels, std::size_t stride,
+    std::uint32_t x0, std::uint32_t y0) const
+{
+    const level_state& lvl = levels_[level];
+    const std::uint32_t left = column * tile_size_ - (column > 0 ? overlap_ : 0);
+    const std::uint32_t top = row * tile_size_ - (row > 0 ? overlap_ : 0);
+    const std::uint32_t right = std::min((column + 1) * tile_size_ + overlap_, lvl.width);
+    const std::uint32_t bottom = std::min((row + 1) * tile_size_ + overlap_, lvl.height);
+
+    thread_local std::vector<std::uint8_t> jpeg;
+    jpeg_tile_encoder::thread_encoder().encode(pixels + std::size_t(top - y0) * stride + std::size_t(left - x0) * sample_per_pixels,
+        right - left, bottom - top, stride, quality_, jpeg, format_);
+
+    // Deep Zoom numbers the levels from the 1x1 one up
+    const fs::path file = files_ / std::to_string(levels_.size() - 1 - level) / (std::to_string(column) + "_" + std::to_string(row) + ".jpg");
+    write_file(file, reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+    tiles_written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<std::uint8_t> dzi_writer::write_block(const block& b, const std::uint8_t* pixels, std::size_t stride, const pixel_layout& layout) const
+{
+    // the block with its margin, as RGB
+    const std::uint32_t x0 = b.x - b.left, y0 = b.y - b.top;
+    std::uint32_t width = b.left + b.width + b.right, height = b.top + b.height + b.bottom;
+    std::vector<std::uint8_t> current(std::size_t(width) * height * sample_per_pixels), below;
+    copy_to_rgb(pixels, stride, layout, width, height, current.data(), std::size_t(width) * sample_per_pixels);
+
+    // The margin keeps the origin a multiple of 1 << block_levels_, so the averaged pixels are those of the whole
+    // level; it reaches 'overlap' pixels beyond the block on every block level.
+    for (std::uint32_t level = 0; level < block_levels_; ++level) {
+        const std::uint32_t first_column = (b.x >> level) / tile_size_, last_column = (ceil_shift(b.x + b.width, level) - 1) / tile_size_;
+        const std::uint32_t first_row = (b.y >> level) / tile_size_, last_row = (ceil_shift(b.y + b.height, level) - 1) / tile_size_;
+        const std::uint32_t across = last_column - first_column + 1;
+        const std::size_t row_bytes = std::size_t(width) * sample_per_pixels;
+        tbb::parallel_for(std::uint32_t(0), across * (last_row - first_row + 1), [&](std::uint32_t t) {
+            write_tile(level, first_column + t % across, first_row + t / across, current.data(), row_bytes, x0 >> level, y0 >> level);
+        });
+
+        const std::uint32_t w = (width + 1) / 2, h = (height + 1) / 2;
+        below.resize(std::size_t(w) * h * sample_per_pixels);
+        tbb::parallel_for(std::uint32_t(0), h, [&](std::uint32_t r) {
+            const std::uint8_t* upper = current.data() + std::size_t(2 * r) * row_bytes;
+            downsample_row(upper, 2 * r + 1 < height ? upper + row_bytes : nullptr, below.data() + std::size_t(r) * w * sample_per_pixels, width);
+        });
+        current.swap(below);
+        width = w;
+        height = h;
+    }
+
+    // the block itself on the smallest block level
+    const std::uint32_t left = (b.x >> block_levels_) - (x0 >> block_levels_), top = (b.y >> block_levels_) - (y0 >> block_levels_);
+    const std::uint32_t w = ceil_shift(b.x + b.width, block_levels_) - (b.x >> block_levels_);
+    const std::uint32_t h = ceil_shift(b.y + b.height, block_levels_) - (b.y >> block_levels_);
+    std::vector<std::uint8_t> smallest(std::size_t(w) * h * sample_per_pixels);
+    for (std::uint32_t r = 0; r < h; ++r) {
+        std::copy_n(current.data() + (std::size_t(top + r) * width + left) * sample_per_pixels, std::size_t(w) * sample_per_pixels,
+            smallest.data() + std::size_t(r) * w * sample_per_pixels);
+    }
+    return smallest;
+}
+
+void dzi_writer::add_block(const block& b, const std::vector<std::uint8_t>& smallest)
+{
+    const level_state& lvl = levels_[block_levels_];
+    const std::uint32_t x = b.x >> block_levels_;
+    const std::uint32_t w = ceil_shift(b.x + b.width, block_levels_) - x;
+    const std::uint32_t h = ceil_shift(b.y + b.height, block_levels_) - (b.y >> block_levels_);
+    const std::size_t row_bytes = std::size_t(lvl.width) * sample_per_pixels;
+    if (b.x == 0) {
+        band_.resize(row_bytes * h);
+    }
+    for (std::uint32_t r = 0; r < h; ++r) {
+        std::copy_n(smallest.data() + std::size_t(r) * w * sample_per_pixels, std::size_t(w) * sample_per_pixels,
+            band_.data() + r * row_bytes + std::size_t(x) * sample_per_pixels);
+    }
+
+    // the row of blocks is complete with its last block
+    if (b.x + b.width == levels_[0].width) {
+        this->add_rows(block_levels_, band_.data(), h);
+    }
+}
+
+void dzi_writer::add_rows(std::size_t level, const std::uint8_t* rows, std::uint32_t count)
+{
+    level_state& lvl = levels_[level];
+    const std::size_t row_bytes = std::size_t(lvl.width) * sample_per_pixels;
+    const std::uint32_t first = lvl.first_row + lvl.row_count;
+
+    // the rows of the level below: a pending even row pairs with the first new one, then the new ones pair up
+    std::vector<std::uint8_t> below;
+    std::uint32_t below_count = 0;
+    if (level + 1 < levels_.size()) {
+        const std::size_t below_bytes = std::size_t(levels_[level + 1].width) * sample_per_pixels;
+        const std::uint32_t start = first % 2;
+        const std::uint32_t pairs = (count - std::min(start, count)) / 2;
+        const bool odd_end = (count - std::min(start, count)) % 2 != 0;
+        const bool last_alone = odd_end && first + count == lvl.height;
+        below_count = std::min(start, count) + pairs + (last_alone ? 1 : 0);
+        below.resize(below_bytes * below_count);
+
+        std::uint8_t* dst = below.data();
+        if (start == 1 && count > 0) {
+            downsample_row(lvl.pending.data(), rows, dst, lvl.width);
+            dst += below_bytes;
+        }
+        tbb::parallel_for(std::uint32_t(0), pairs, [&](std::uint32_t p) {
+            const std::uint8_t* upper = rows + std::size_t(start + 2 * p) * row_bytes;
+            downsample_row(upper, upper + row_bytes, dst + p * below_bytes, lvl.width);
+        });
+        if (odd_end) {
+            const std::uint8_t* last = rows + std::size_t(count - 1) * row_bytes;
+            if (last_alone) {
+                downsample_row(last, nullptr, dst + std::size_t(pairs) * below_bytes, lvl.width);
+            }
+            else {
+                lvl.pending.assign(last, last + row_bytes);
+            }
+        }
+    }
+
+    lvl.rows.insert(lvl.rows.end(), rows, rows + std::size_t(count) * row_bytes);
+    lvl.row_count += count;
+    while (lvl.next_tile_row < lvl.tiles_down) {
+        const std::uint32_t row = lvl.next_tile_row;
+        if (lvl.first_row + lvl.row_count < std::min((row + 1) * tile_size_ + overlap_, lvl.height)) {
+            break;
+        }
+        tbb::parallel_for(std::uint32_t(0), lvl.tiles_across, [&](std::uint32_t column) {
+            write_tile(level, column, row, lvl.rows.data(), row_bytes, 0, lvl.first_row);
+        });
+        ++lvl.next_tile_row;
+
+        // keep the rows the next tile row overlaps
+        const std::uint32_t keep = lvl.next_tile_row < lvl.tiles_down ? lvl.next_tile_row * tile_size_ - overlap_ : lvl.first_row + lvl.row_count;
+        const std::uint32_t drop = keep - lvl.first_row;
+        lvl.rows.erase(lvl.rows.begin(), lvl.rows.begin() + std::ptrdiff_t(std::size_t(drop) * row_bytes));
+        lvl.first_row += drop;
+        lvl.row_count -= drop;
+    }
+
+    if (below_count > 0) {
+        this->add_rows(level + 1, below.data(), below_count);
+    }
+}
+
+void dzi_writer::close()
+{
+    for (std::size_t level = block_levels_; level < levels_.size(); ++level) {
+        if (levels_[level].next_tile_row != levels_[level].tiles_down) {
+            throw std::logic_error("dzi_writer: not every block was added");
+        }
+    }
+
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"jpg\" Overlap=\"" << overlap_
+        << "\" TileSize=\"" << tile_size_ << "\">\n"
+        << "    <Size Width=\"" << levels_[0].width << "\" Height=\"" << levels_[0].height << "\"/>\n"
+        << "</Image>\n";
+    const std::string text = xml.str();
+    write_file(path_, text.data(), text.size());
+    closed_ = true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "jpeg_tile_encoder.h"
+#include "pixel_swizzle.h"
+
+// Writes a Deep Zoom image: the descriptor 'path' (<name>.dzi) and the tiles <name>_files/<level>/<column>_<row>.jpg
+// of every level, from level 0 (1x1 pixel) up to the full resolution; each level is ceil(half) the size of the
+// one above, as Deep Zoom viewers compute it, and its pixels the average of the (up to) 2x2 pixels above. Tiles
+// are tile_size pixels plus 'overlap' pixels of their neighbours on every side that has one. They are baseline
+// JPEGs in YCbCr 4:2:0, which every browser decodes.
+//
+// The levels are computed from the base level in one pass. The base level is consumed in blocks of block_size()
+// (tile size << block levels) pixels, composed with a margin() of pixels around them, so that a block yields the
+// complete tiles of the upper block levels, overlap included, and needs nothing from its neighbours. The
+// smallest block level's pixels of each block are handed back (add_block) in row-major order; the levels below
+// are then computed row by row as the blocks complete each row of tiles, keeping only the rows a tile row and
+// its overlap span. Memory stays a few blocks and a band of those rows, whatever the slide's size.
+//
+// The tiles are encoded and written on the TBB pool, each tile a file of its own; the level directories are
+// created up front. The descriptor is written last, by close().
+class dzi_writer
+{
+public:
+    // Creates the tile directory next to 'path', replacing a former Deep Zoom image there. Throws if the
+    // directory is something else, or on I/O errors.
+    dzi_writer(const std::string& path, std::uint32_t width, std::uint32_t height, std::uint32_t tile_size, std::uint32_t overlap, int quality);
+
+    // Removes the tiles written if close() was not reached.
+    ~dzi_writer();
+
+    dzi_writer(const dzi_writer&) = delete;
+    dzi_writer& operator=(const dzi_writer&) = delete;
+
+    // Edge length of the base-level blocks. Blocks have to tile the base level: their origin a multiple of
+    // block_size(), and their extent too unless the block reaches the image's edge.
+    std::uint32_t block_size() const { return tile_size_ << block_levels_; }
+
+    // How far the pixels of a block have to reach beyond it on each side, as far as the image goes.
+    std::uint32_t margin() const { return block_levels_ > 0 ? overlap_ << block_levels_ : 0; }
+
+    std::size_t level_count() const { return levels_.size(); }
+    std::uint64_t tile_count() const { return tiles_written_; }
+
+    // A base-level block and how far its pixels reach beyond it (margin(), less at the image's edge).
+    struct block
+    {
+        std::uint32_t x = 0;
+        std::uint32_t y = 0;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t left = 0;
+        std::uint32_t top = 0;
+        std::uint32_t right = 0;
+        std::uint32_t bottom = 0;
+    };
+
+    // Writes the block's tiles of the block levels from its pixels, rows 'stride' bytes apart starting at the
+    // top left of the margin, and returns its pixels at the smallest block level (RGB, no row padding) for
+    // add_block. Safe to call concurrently for different blocks.
+    std::vector<std::uint8_t> write_block(const block& b, const std::uint8_t* pixels, std::size_t stride, const pixel_layout& layout) const;
+
+    // Takes the pixels write_block returned for a block and writes the tiles of the levels below the block
+    // levels that are complete then. Blocks have to come in row-major order. Not thread-safe.
+    void add_block(const block& b, const std::vector<std::uint8_t>& smallest);
+
+    // Writes the descriptor once every block was added. Throws if a tile is missing.
+    void close();
+
+private:
+    struct level_state
+    {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t tiles_across = 0;
+        std::uint32_t tiles_down = 0;
+
+        // The levels computed row by row: the rows from 'first_row' on that the next tile row needs, and
+        // the last row with an even index until the row below it comes (to average the pair).
+        std::vector<std::uint8_t> rows;
+        std::uint32_t first_row = 0;
+        std::uint32_t row_count = 0;
+        std::uint32_t next_tile_row = 0;
+        std::vector<std::uint8_t> pending;
+    };
+
+    // Writes tile 'column'/'row' of 'level' (0 the base level), cut with its overlap from RGB pixels that have
+    // rows 'stride' bytes apart and the level's pixel 'x0'/'y0' at their top left.
+    void write_tile(std::size_t level, std::uint32_t column, std::uint32_t row, const std::uint8_t* pixels, std::size_t stride,
+        std::uint32_t x0, std::uint32_t y0) const;
+
+    // Appends 'count' rows to a level computed row by row, writes the tile rows they complete and passes the
+    // rows they make of the level below on.
+    void add_rows(std::size_t level, const std::uint8_t* rows, std::uint32_t count);
+
+    std::filesystem::path path_;
+    std::filesystem::path files_;
+    std::uint32_t tile_size_;
+    std::uint32_t overlap_;
+    int quality_;
+    jpeg_tile_format format_;
+    std::uint32_t block_levels_ = 0;
+    std::vector<level_state> levels_;       // the base level first
+
+    // The smallest block level's rows of the current row of blocks.
+    std::vector<std::uint8_t> band_;
+
+    mutable std::atomic<std::uint64_t> tiles_written_{ 0 };
+    bool closed_ = false;
+};
@@ -0,0 +1,138 @@
+#include "jpeg_passthrough.h"
+
+#include <algorithm>
+#include <utility>
+#include <tbb/parallel_for.h>
+#include "jpeg_subblock_decoder.h"
+
+namespace
+{
+    // How many candidate streams to inspect for a usable colour format before giving up on passthrough.
+    const int format_probe_limit = 16;
+
+    bool is_power_of_two_sampling(int f)
+    {
+        return f == 1 || f == 2 || f == 4;
+    }
+}
+
+jpeg_passthrough::jpeg_passthrough(
+    std::shared_ptr<libCZI::ICZIReader> reader,
+    const libCZI::IntRect& roi,
+    const libCZI::IDimCoordinate* planeCoord,
+    std::uint32_t tile_size,
+    const jpeg_tile_format* required_format)
+    : reader_(std::move(reader)),
+    tile_size_(tile_size)
+{
+    const int tile = int(tile_size);
+    tiles_across_ = (std::uint32_t(roi.w) + tile_size - 1) / tile_size;
+    tiles_down_ = (std::uint32_t(roi.h) + tile_size - 1) / tile_size;
+    subblock_.assign(std::size_t(tiles_across_) * tiles_down_, -1);
+    std::vector<int> touching(subblock_.size(), 0);
+
+    reader_->EnumSubset(planeCoord, &roi, true,
+        [&](int index, const libCZI::SubBlockInfo& info) -> bool {
+            const libCZI::IntRect& r = info.logicalRect;
+            const int x0 = std::max(r.x, roi.x) - roi.x;
+            const int y0 = std::max(r.y, roi.y) - roi.y;
+            const int x1 = std::min(r.x + r.w, roi.x + roi.w) - roi.x;
+            const int y1 = std::min(r.y + r.h, roi.y + roi.h) - roi.y;
+            if (x1 <= x0 || y1 <= y0) {
+                return true;
+            }
+
+            for (int ty = y0 / tile; ty <= (y1 - 1) / tile; ++ty) {
+                for (int tx = x0 / tile; tx <= (x1 - 1) / tile; ++tx) {
+                    ++touching[std::size_t(ty) * tiles_across_ + tx];
+                }
+            }
+
+            const bool on_grid = (r.x - roi.x) % tile == 0 && (r.y - roi.y) % tile == 0
+                && r.w == tile && r.h == tile
+                && r.x >= roi.x && r.y >= roi.y && r.x + r.w <= roi.x + roi.w && r.y + r.h <= roi.y + roi.h;
+            if (on_grid
+                && info.physicalSize.w == tile_size && info.physicalSize.h == tile_size
+                && info.GetCompressionMode() == libCZI::CompressionMode::Jpg
+                && info.pixelType == libCZI::PixelType::Bgr24) {
+                subblock_[std::size_t((r.y - roi.y) / tile) * tiles_across_ + (r.x - roi.x) / tile] = index;
+            }
+            return true;
+        });
+
+    for (std::size_t i = 0; i < subblock_.size(); ++i) {
+        if (touching[i] != 1) {
+            subblock_[i] = -1;
+        }
+    }
+
+    // The IFD's format follows the first candidate stream that TIFF can describe (and that has the required format).
+    bool have_format = false;
+    int probed = 0;
+    for (std::size_t i = 0; i < subblock_.size() && !have_format && probed < format_probe_limit; ++i) {
+        if (subblock_[i] < 0) {
+            continue;
+        }
+        ++probed;
+
+        auto sb = reader_->ReadSubBlock(subblock_[i]);
+        const void* data;
+        std::size_t size;
+        sb->DangerousGetRawData(libCZI::ISubBlock::MemBlkType::Data, data, size);
+        jpeg_stream_info info;
+        if (!read_jpeg_stream_info(data, size, info) || info.components != 3 || !info.baseline || !info.chroma_full) {
+            continue;
+        }
+        if (required_format != nullptr
+            && (info.ycbcr != required_format->ycbcr || info.h_sampling != required_format->h_sampling || info.v_sampling != required_format->v_sampling)) {
+            continue;
+        }
+        if (info.ycbcr
+            ? (is_power_of_two_sampling(info.h_sampling) && is_power_of_two_sampling(info.v_sampling) && info.v_sampling <= info.h_sampling)
+            : (info.h_sampling == 1 && info.v_sampling == 1)) {
+            format_.ycbcr = info.ycbcr;
+            format_.h_sampling = info.h_sampling;
+            format_.v_sampling = info.v_sampling;
+            have_format = true;
+        }
+    }
+
+    if (!have_format) {
+        std::fill(subblock_.begin(), subblock_.end(), -1);
+    }
+    candidate_count_ = std::size_t(std::count_if(subblock_.begin(), subblock_.end(), [](int i) { return i >= 0; }));
+}
+
+bool jpeg_passthrough::stream_fits(const void* data, std::size_t size) const
+{
+    jpeg_stream_info info;
+    return read_jpeg_stream_info(data, size, info)
+        && info.width == tile_size_ && info.height == tile_size_
+        && info.components == 3 && info.baseline && info.chroma_full
+        && info.ycbcr == format_.ycbcr
+        && info.h_sampling == format_.h_sampling && info.v_sampling == format_.v_sampling;
+}
+
+std::vector<std::vector<std::uint8_t>> jpeg_passthrough::tiles(std::uint32_t first_column, std::uint32_t first_row, std::uint32_t across, std::uint32_t down) const
+{
+    across = std::min(across, tiles_across_ - std::min(first_column, tiles_across_));
+    down = std::min(down, tiles_down_ - std::min(first_row, tiles_down_));
+    std::vector<std::vector<std::uint8_t>> streams(std::size_t(across) * down);
+
+    tbb::parallel_for(std::size_t(0), streams.size(), [&](std::size_t i) {
+        const int index = subblock_[(first_row + i / across) * std::size_t(tiles_across_) + first_column + i % across];
+        if (index < 0) {
+            return;
+        }
+
+        auto sb = reader_->ReadSubBlock(index);
+        const std::uint8_t* data;
+        std::size_t size;
+        sb->DangerousGetRawData(libCZI::ISubBlock::MemBlkType::Data, data, size);
+        if (this->stream_fits(data, size)) {
+            streams[i].assign(data, data + size);
+        }
+    });
+
+    return streams;
+}
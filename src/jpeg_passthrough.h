@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <libCZI.h>
+#include "jpeg_tile_encoder.h"
+
+// Decides which base-level SVS tiles can be written with the JPEG stream of a CZI subblock as it is, without
+// decoding and re-encoding it. A tile qualifies if exactly one layer-0 subblock of the plane touches it, and
+// that subblock is JPG compressed, Bgr24, unscaled and covers precisely the tile (so it lies on the tile grid
+// and the tile is not cut by the ROI's edge). Its stream must also be 8-bit baseline with the colour format
+// of the IFD, which is taken from the first qualifying subblock unless the caller requires one. Every other
+// tile is composed and encoded as usual.
+//
+// The subblock streams are complete JPEGs carrying their own tables, which take precedence over the IFD's
+// JPEGTABLES (those are still written for the encoded tiles).
+class jpeg_passthrough
+{
+public:
+    jpeg_passthrough(
+        std::shared_ptr<libCZI::ICZIReader> reader,
+        const libCZI::IntRect& roi,
+        const libCZI::IDimCoordinate* planeCoord,
+        std::uint32_t tile_size,
+        const jpeg_tile_format* required_format = nullptr);
+
+    // Number of tiles that qualify, going by the subblock directory.
+    std::size_t candidate_count() const { return candidate_count_; }
+
+    // The colour format the base IFD has to be written with.
+    const jpeg_tile_format& format() const { return format_; }
+
+    // Reads the subblock streams for the 'across' x 'down' tiles starting at tile column 'first_column' and tile
+    // row 'first_row', in row-major tile order (clipped to the ROI). Entries are empty for tiles that have to be
+    // encoded, including candidates whose stream turns out not to fit.
+    std::vector<std::vector<std::uint8_t>> tiles(std::uint32_t first_column, std::uint32_t first_row, std::uint32_t across, std::uint32_t down) const;
+
+private:
+    bool stream_fits(const void* data, std::size_t size) const;
+
+    std::shared_ptr<libCZI::ICZIReader> reader_;
+    std::uint32_t tile_size_;
+    std::uint32_t tiles_across_ = 0;
+    std::uint32_t tiles_down_ = 0;
+    std::vector<int> subblock_;     // per tile, the subblock index to pass through or -1
+    std::size_t candidate_count_ = 0;
+    jpeg_tile_format format_;
+};
@@ -0,0 +1,158 @@
+#include "jpeg_subblock_decoder.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <jpeglib.h>
+
+namespace
+{
+    // Same scheme as in jpeg_tile_encoder: libjpeg errors longjmp back to the caller, which throws.
+    struct error_manager
+    {
+        jpeg_error_mgr pub;
+        std::jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+
+        static void error_exit(j_common_ptr cinfo)
+        {
+            auto* self = reinterpret_cast<error_manager*>(cinfo->err);
+            (*cinfo->err->format_message)(cinfo, self->message);
+            std::longjmp(self->jump, 1);
+        }
+
+        // corrupt-data warnings are not worth a message per subblock
+        static void output_message(j_common_ptr) {}
+    };
+
+    struct decompressor
+    {
+        jpeg_decompress_struct cinfo;
+        error_manager err;
+
+        decompressor()
+        {
+            cinfo.err = jpeg_std_error(&err.pub);
+            err.pub.error_exit = &error_manager::error_exit;
+            err.pub.output_message = &error_manager::output_message;
+            jpeg_create_decompress(&cinfo);
+        }
+
+        ~decompressor()
+        {
+            jpeg_destroy_decompress(&cinfo);
+        }
+    };
+}
+
+std::shared_ptr<libCZI::IBitmapData> jpeg_subblock_decoder::Decode(const void* ptrData, size_t size, const libCZI::PixelType* pixelType, const std::uint32_t* width, const std::uint32_t* height, const char* additional_arguments)
+{
+    (void)additional_arguments;
+
+    decompressor d;
+    std::shared_ptr<libCZI::IBitmapData> bitmap;
+    libCZI::IBitmapData* volatile locked = nullptr;
+    if (setjmp(d.err.jump)) {
+        // a bitmap destroyed while locked terminates the program
+        if (locked != nullptr) {
+            locked->Unlock();
+        }
+        throw std::runtime_error(std::string("JPG subblock decode: ") + d.err.message);
+    }
+
+    jpeg_mem_src(&d.cinfo, static_cast<const unsigned char*>(ptrData), static_cast<unsigned long>(size));
+    jpeg_read_header(&d.cinfo, TRUE);
+
+    const libCZI::PixelType type = pixelType != nullptr
+        ? *pixelType
+        : (d.cinfo.num_components == 1 ? libCZI::PixelType::Gray8 : libCZI::PixelType::Bgr24);
+    switch (type) {
+    case libCZI::PixelType::Bgr24:
+        d.cinfo.out_color_space = JCS_EXT_BGR;
+        break;
+    case libCZI::PixelType::Gray8:
+        d.cinfo.out_color_space = JCS_GRAYSCALE;
+        break;
+    default:
+        throw std::runtime_error("JPG subblock decode: unsupported pixel type");
+    }
+
+    if ((width != nullptr && d.cinfo.image_width != *width) || (height != nullptr && d.cinfo.image_height != *height)) {
+        throw std::runtime_error("JPG subblock decode: size of the JPEG does not match the subblock");
+    }
+
+    jpeg_start_decompress(&d.cinfo);
+    bitmap = libCZI::GetDefaultSiteObject(libCZI::SiteObjectType::Default)->CreateBitmap(type, d.cinfo.output_width, d.cinfo.output_height);
+    const libCZI::BitmapLockInfo lock = bitmap->Lock();
+    locked = bitmap.get();
+    while (d.cinfo.output_scanline < d.cinfo.output_height) {
+        JSAMPROW row = static_cast<JSAMPROW>(lock.ptrDataRoi) + std::size_t(d.cinfo.output_scanline) * lock.stride;
+        jpeg_read_scanlines(&d.cinfo, &row, 1);
+    }
+    bitmap->Unlock();
+    locked = nullptr;
+    jpeg_finish_decompress(&d.cinfo);
+    return bitmap;
+}
+
+jpeg_decoder_site::jpeg_decoder_site()
+    : default_site_(libCZI::GetDefaultSiteObject(libCZI::SiteObjectType::Default)),
+    jpg_decoder_(std::make_shared<jpeg_subblock_decoder>())
+{
+}
+
+bool jpeg_decoder_site::IsEnabled(int logLevel)
+{
+    return default_site_->IsEnabled(logLevel);
+}
+
+void jpeg_decoder_site::Log(int level, const char* szMsg)
+{
+    default_site_->Log(level, szMsg);
+}
+
+std::shared_ptr<libCZI::IDecoder> jpeg_decoder_site::GetDecoder(libCZI::ImageDecoderType type, const char* arguments)
+{
+    if (type == libCZI::ImageDecoderType::Jpg) {
+        return jpg_decoder_;
+    }
+
+    return default_site_->GetDecoder(type, arguments);
+}
+
+std::shared_ptr<libCZI::IBitmapData> jpeg_decoder_site::CreateBitmap(libCZI::PixelType pixeltype, std::uint32_t width, std::uint32_t height, std::uint32_t stride, std::uint32_t extraRows, std::uint32_t extraColumns)
+{
+    return default_site_->CreateBitmap(pixeltype, width, height, stride, extraRows, extraColumns);
+}
+
+void jpeg_decoder_site::TerminateProgram(TerminationReason reason, const char* message)
+{
+    default_site_->TerminateProgram(reason, message);
+}
+
+bool read_jpeg_stream_info(const void* data, std::size_t size, jpeg_stream_info& info)
+{
+    decompressor d;
+    if (setjmp(d.err.jump)) {
+        return false;
+    }
+
+    jpeg_mem_src(&d.cinfo, static_cast<const unsigned char*>(data), static_cast<unsigned long>(size));
+    if (jpeg_read_header(&d.cinfo, TRUE) != JPEG_HEADER_OK) {
+        return false;
+    }
+
+    info.width = d.cinfo.image_width;
+    info.height = d.cinfo.image_height;
+    info.components = d.cinfo.num_components;
+    info.ycbcr = d.cinfo.jpeg_color_space == JCS_YCbCr;
+    info.baseline = !d.cinfo.progressive_mode && !d.cinfo.arith_code && d.cinfo.data_precision == 8;
+    info.h_sampling = d.cinfo.comp_info[0].h_samp_factor;
+    info.v_sampling = d.cinfo.comp_info[0].v_samp_factor;
+    info.chroma_full = true;
+    for (int c = 1; c < d.cinfo.num_components; ++c) {
+        info.chroma_full = info.chroma_full && d.cinfo.comp_info[c].h_samp_factor == 1 && d.cinfo.comp_info[c].v_samp_factor == 1;
+    }
+    return true;
+}
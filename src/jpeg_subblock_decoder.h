@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <libCZI.h>
+
+// libCZI has no decoder for JPG compressed subblocks; it asks the site-object for one. This decodes them with
+// libjpeg(-turbo) into Bgr24 or Gray8 bitmaps, so the regular accessors work on JPG CZIs.
+class jpeg_subblock_decoder : public libCZI::IDecoder
+{
+public:
+    std::shared_ptr<libCZI::IBitmapData> Decode(const void* ptrData, size_t size, const libCZI::PixelType* pixelType, const std::uint32_t* width, const std::uint32_t* height, const char* additional_arguments) override;
+};
+
+// Site-object forwarding everything to libCZI's default site, except that it supplies jpeg_subblock_decoder
+// for ImageDecoderType::Jpg. Install it with libCZI::SetSiteObject before the first CZI is opened.
+class jpeg_decoder_site : public libCZI::ISite
+{
+public:
+    jpeg_decoder_site();
+
+    bool IsEnabled(int logLevel) override;
+    void Log(int level, const char* szMsg) override;
+    std::shared_ptr<libCZI::IDecoder> GetDecoder(libCZI::ImageDecoderType type, const char* arguments) override;
+    std::shared_ptr<libCZI::IBitmapData> CreateBitmap(libCZI::PixelType pixeltype, std::uint32_t width, std::uint32_t height, std::uint32_t stride, std::uint32_t extraRows, std::uint32_t extraColumns) override;
+    void TerminateProgram(TerminationReason reason, const char* message) override;
+
+private:
+    libCZI::ISite* default_site_;
+    std::shared_ptr<libCZI::IDecoder> jpg_decoder_;
+};
+
+// What a JPEG stream's frame header says about its layout.
+struct jpeg_stream_info
+{
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    int components = 0;
+    bool ycbcr = false;         // colour transform applied (JFIF or Adobe transform 1), false for plain RGB or gray
+    bool baseline = false;      // 8-bit sequential DCT
+    int h_sampling = 1;         // sampling factors of the first component; the other components must be 1x1
+    int v_sampling = 1;
+    bool chroma_full = true;    // all components but the first are sampled 1x1
+};
+
+// Parses the headers of a complete JPEG stream; false if it is not a readable JPEG.
+bool read_jpeg_stream_info(const void* data, std::size_t size, jpeg_stream_info& info);
@@ -0,0 +1,244 @@
+#include "jpeg_tile_encoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <jpeglib.h>
+#include <tbb/parallel_for.h>
+
+namespace
+{
+    // Whether every pixel of the interleaved RGB buffer has the same colour: then the buffer equals itself
+    // shifted by one pixel.
+    bool is_uniform(const std::vector<std::uint8_t>& rgb)
+    {
+        return rgb.size() <= 3 || std::memcmp(rgb.data(), rgb.data() + 3, rgb.size() - 3) == 0;
+    }
+
+    // Uniform tiles (background glass, mostly) are encoded once per colour and encoding and copied after that.
+    // A slide's background has few distinct colours; the cache stops growing at uniform_tile_cache_limit.
+    struct uniform_tile_key
+    {
+        std::uint8_t r, g, b;
+        std::uint32_t tile_w, tile_h;
+        int quality;
+        bool ycbcr;
+        int h_sampling, v_sampling;
+        bool embed_tables;
+
+        bool operator<(const uniform_tile_key& o) const
+        {
+            return std::tie(r, g, b, tile_w, tile_h, quality, ycbcr, h_sampling, v_sampling, embed_tables)
+                < std::tie(o.r, o.g, o.b, o.tile_w, o.tile_h, o.quality, o.ycbcr, o.h_sampling, o.v_sampling, o.embed_tables);
+        }
+    };
+
+    const std::size_t uniform_tile_cache_limit = 256;
+    std::mutex uniform_tile_mutex;
+    std::map<uniform_tile_key, std::vector<std::uint8_t>> uniform_tiles;
+}
+
+// libjpeg reports errors through error_exit, which must not return. We jump back into the encoder and turn
+// the failure into an exception there, so no C++ exception ever unwinds through libjpeg's frames.
+struct jpeg_tile_encoder::error_manager
+{
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+
+    static void error_exit(j_common_ptr cinfo)
+    {
+        auto* self = reinterpret_cast<error_manager*>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, self->message);
+        std::longjmp(self->jump, 1);
+    }
+};
+
+// Destination manager appending the compressed stream to a std::vector, so the per-tile buffer is reused
+// instead of being malloc'ed by jpeg_mem_dest for every tile.
+struct jpeg_tile_encoder::destination_manager
+{
+    jpeg_destination_mgr pub;
+    std::vector<std::uint8_t>* out = nullptr;
+
+    static constexpr std::size_t chunk = 64 * 1024;
+
+    static void init_destination(j_compress_ptr cinfo)
+    {
+        auto* self = reinterpret_cast<destination_manager*>(cinfo->dest);
+        self->out->resize(chunk);
+        self->pub.next_output_byte = self->out->data();
+        self->pub.free_in_buffer = self->out->size();
+    }
+
+    static boolean empty_output_buffer(j_compress_ptr cinfo)
+    {
+        // libjpeg requires the whole buffer to be consumed when this is called, regardless of free_in_buffer
+        auto* self = reinterpret_cast<destination_manager*>(cinfo->dest);
+        const std::size_t used = self->out->size();
+        self->out->resize(used + chunk);
+        self->pub.next_output_byte = self->out->data() + used;
+        self->pub.free_in_buffer = chunk;
+        return TRUE;
+    }
+
+    static void term_destination(j_compress_ptr cinfo)
+    {
+        auto* self = reinterpret_cast<destination_manager*>(cinfo->dest);
+        self->out->resize(self->out->size() - self->pub.free_in_buffer);
+    }
+};
+
+jpeg_tile_encoder::jpeg_tile_encoder()
+    : cinfo_(new jpeg_compress_struct()), err_(new error_manager()), dest_(new destination_manager())
+{
+    cinfo_->err = jpeg_std_error(&err_->pub);
+    err_->pub.error_exit = &error_manager::error_exit;
+    jpeg_create_compress(cinfo_);
+
+    dest_->pub.init_destination = &destination_manager::init_destination;
+    dest_->pub.empty_output_buffer = &destination_manager::empty_output_buffer;
+    dest_->pub.term_destination = &destination_manager::term_destination;
+    cinfo_->dest = &dest_->pub;
+}
+
+jpeg_tile_encoder::~jpeg_tile_encoder()
+{
+    jpeg_destroy_compress(cinfo_);
+    delete dest_;
+    delete err_;
+    delete cinfo_;
+}
+
+jpeg_tile_encoder& jpeg_tile_encoder::thread_encoder()
+{
+    thread_local jpeg_tile_encoder encoder;
+    return encoder;
+}
+
+// Mirrors the compressor setup of libtiff's JPEG codec for PHOTOMETRIC_RGB, JPEGCOLORMODE_RAW, and for
+// PHOTOMETRIC_YCBCR, JPEGCOLORMODE_RGB.
+void jpeg_tile_encoder::configure(int quality, std::uint32_t width, std::uint32_t height, const jpeg_tile_format& format)
+{
+    cinfo_->image_width = width;
+    cinfo_->image_height = height;
+    cinfo_->input_components = 3;
+    cinfo_->in_color_space = JCS_RGB;
+    jpeg_set_defaults(cinfo_);
+    if (format.ycbcr) {
+        jpeg_set_colorspace(cinfo_, JCS_YCbCr);
+        cinfo_->comp_info[0].h_samp_factor = format.h_sampling;
+        cinfo_->comp_info[0].v_samp_factor = format.v_sampling;
+    }
+    else {
+        jpeg_set_colorspace(cinfo_, JCS_RGB);
+    }
+    jpeg_set_quality(cinfo_, quality, FALSE);
+    cinfo_->write_JFIF_header = FALSE;
+    cinfo_->write_Adobe_marker = FALSE;
+}
+
+std::vector<std::uint8_t> jpeg_tile_encoder::tables(int quality, const jpeg_tile_format& format)
+{
+    std::vector<std::uint8_t> out;
+    if (setjmp(err_->jump)) {
+        jpeg_abort_compress(cinfo_);
+        throw std::runtime_error(std::string("JPEG tables: ") + err_->message);
+    }
+
+    dest_->out = &out;
+    configure(quality, 8, 8, format);
+    jpeg_suppress_tables(cinfo_, FALSE);
+    jpeg_write_tables(cinfo_);
+    return out;
+}
+
+void jpeg_tile_encoder::encode(const std::uint8_t* rgb, std::uint32_t width, std::uint32_t height, std::size_t stride, int quality, std::vector<std::uint8_t>& out, const jpeg_tile_format& format)
+{
+    if (setjmp(err_->jump)) {
+        jpeg_abort_compress(cinfo_);
+        throw std::runtime_error(std::string("JPEG tile encode: ") + err_->message);
+    }
+
+    dest_->out = &out;
+    configure(quality, width, height, format);
+
+    // normally the tables live in JPEGTABLES and each tile only carries the scan
+    jpeg_suppress_tables(cinfo_, format.embed_tables ? FALSE : TRUE);
+    jpeg_start_compress(cinfo_, FALSE);
+    while (cinfo_->next_scanline < cinfo_->image_height) {
+        JSAMPROW row = const_cast<JSAMPROW>(rgb + std::size_t(cinfo_->next_scanline) * stride);
+        jpeg_write_scanlines(cinfo_, &row, 1);
+    }
+    jpeg_finish_compress(cinfo_);
+}
+
+std::vector<std::vector<std::uint8_t>> encode_jpeg_tiles(
+    const std::uint8_t* pixels,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::size_t stride,
+    const pixel_layout& layout,
+    std::uint32_t tile_w,
+    std::uint32_t tile_h,
+    int quality,
+    const jpeg_tile_format& format,
+    const std::vector<bool>* skip)
+{
+    const int sample_per_pixels = 3;
+    const std::uint32_t tiles_across = (width + tile_w - 1) / tile_w;
+    const std::uint32_t tiles_down = (height + tile_h - 1) / tile_h;
+    std::vector<std::vector<std::uint8_t>> encoded(std::size_t(tiles_across) * tiles_down);
+
+    tbb::parallel_for(std::size_t(0), encoded.size(), [&](std::size_t i) {
+        if (skip != nullptr && (*skip)[i]) {
+            return;
+        }
+
+        const std::uint32_t tx = std::uint32_t(i % tiles_across) * tile_w;
+        const std::uint32_t ty = std::uint32_t(i / tiles_across) * tile_h;
+        const std::uint32_t xMax = std::min(tx + tile_w, width);
+        const std::uint32_t yMax = std::min(ty + tile_h, height);
+
+        // only edge tiles need the zero padding; full tiles are overwritten completely
+        thread_local std::vector<std::uint8_t> tileBuf;
+        if (xMax - tx < tile_w || yMax - ty < tile_h) {
+            tileBuf.assign(std::size_t(tile_w) * tile_h * sample_per_pixels, 0);
+        }
+        else {
+            tileBuf.resize(std::size_t(tile_w) * tile_h * sample_per_pixels);
+        }
+
+        copy_to_rgb(pixels + std::size_t(ty) * stride + std::size_t(tx) * layout.bytes_per_pixel(), stride, layout,
+            xMax - tx, yMax - ty, tileBuf.data(), std::size_t(tile_w) * sample_per_pixels);
+
+        const bool uniform = is_uniform(tileBuf);
+        const uniform_tile_key key{ tileBuf[0], tileBuf[1], tileBuf[2], tile_w, tile_h, quality,
+            format.ycbcr, format.h_sampling, format.v_sampling, format.embed_tables };
+        if (uniform) {
+            std::lock_guard<std::mutex> lock(uniform_tile_mutex);
+            const auto it = uniform_tiles.find(key);
+            if (it != uniform_tiles.end()) {
+                encoded[i] = it->second;
+                return;
+            }
+        }
+
+        jpeg_tile_encoder::thread_encoder().encode(tileBuf.data(), tile_w, tile_h, std::size_t(tile_w) * sample_per_pixels, quality, encoded[i], format);
+
+        if (uniform) {
+            std::lock_guard<std::mutex> lock(uniform_tile_mutex);
+            if (uniform_tiles.size() < uniform_tile_cache_limit) {
+                uniform_tiles.emplace(key, encoded[i]);
+            }
+        }
+    });
+
+    return encoded;
+}
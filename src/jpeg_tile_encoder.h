@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pixel_swizzle.h"
+
+struct jpeg_compress_struct;
+
+// Format of an IFD's JPEG tiles. The colour layout has to agree with the IFD's PHOTOMETRIC and
+// YCBCRSUBSAMPLING tags; the default is PHOTOMETRIC_RGB without subsampling.
+struct jpeg_tile_format
+{
+    bool ycbcr = false;
+    int h_sampling = 1;     // luma samples per chroma sample, YCbCr only
+    int v_sampling = 1;
+
+    // Write complete streams carrying their own tables. Needed when the IFD also holds foreign JPEG streams:
+    // libtiff decodes all tiles of an IFD with one libjpeg decompressor, and the tables of a complete stream
+    // stay loaded in it, so an abbreviated tile read after one would be decoded with the wrong tables.
+    bool embed_tables = false;
+};
+
+// JPEG encoder for SVS tiles, built directly on libjpeg(-turbo) so tiles can be compressed outside of libtiff
+// and written with TIFFWriteRawTile. The output matches what libtiff's JPEG codec produces for a
+// PHOTOMETRIC_RGB IFD (RGB colour space without subsampling) or, with a YCbCr format, for a
+// PHOTOMETRIC_YCBCR IFD in JPEGCOLORMODE_RGB: no JFIF/Adobe markers, and (unless embed_tables is set)
+// abbreviated tile streams whose quantisation and Huffman tables go into the IFD's JPEGTABLES tag.
+//
+// An encoder keeps its libjpeg compressor alive between tiles. It is not thread-safe; every worker thread
+// uses its own instance (see thread_encoder()).
+class jpeg_tile_encoder
+{
+public:
+    jpeg_tile_encoder();
+    ~jpeg_tile_encoder();
+
+    jpeg_tile_encoder(const jpeg_tile_encoder&) = delete;
+    jpeg_tile_encoder& operator=(const jpeg_tile_encoder&) = delete;
+
+    // The tables-only JPEG stream (SOI, DQT, DHT, EOI) to store in TIFFTAG_JPEGTABLES.
+    std::vector<std::uint8_t> tables(int quality, const jpeg_tile_format& format = {});
+
+    // Compresses an interleaved 8-bit RGB tile into an abbreviated JPEG stream, replacing the content of 'out'.
+    void encode(const std::uint8_t* rgb, std::uint32_t width, std::uint32_t height, std::size_t stride, int quality, std::vector<std::uint8_t>& out, const jpeg_tile_format& format = {});
+
+    // The encoder owned by the calling thread.
+    static jpeg_tile_encoder& thread_encoder();
+
+private:
+    void configure(int quality, std::uint32_t width, std::uint32_t height, const jpeg_tile_format& format);
+
+    jpeg_compress_struct* cinfo_;
+    struct error_manager;
+    error_manager* err_;
+    struct destination_manager;
+    destination_manager* dest_;
+};
+
+// Cuts an image (or part of an image) with rows 'stride' bytes apart into tile_w x tile_h tiles and
+// JPEG-compresses them concurrently on the TBB pool. Each tile is copied to RGB with copy_to_rgb, so a locked
+// libCZI bitmap of any pixel type copy_to_rgb reads can be passed as it is. Tiles at the right and bottom edge are zero padded
+// to full size, as libtiff does. The result is in row-major tile order. Tiles flagged in 'skip' are left empty.
+// A tile of a single colour is only encoded the first time that colour comes up; identical tiles then have
+// identical bytes, which lets the writer store them once (see tile_dedup).
+std::vector<std::vector<std::uint8_t>> encode_jpeg_tiles(
+    const std::uint8_t* pixels,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::size_t stride,
+    const pixel_layout& layout,
+    std::uint32_t tile_w,
+    std::uint32_t tile_h,
+    int quality,
+    const jpeg_tile_format& format = {},
+    const std::vector<bool>* skip = nullptr);
@@ -1,5 +1,6 @@
 #include <tiffio.h>
 #include <cstdint>
+#include <cstring>
 #include <cmath>
 #include <string>
 #include <sstream>
@@ -13,42 +14,226 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_pipeline.h>
+#include <tbb/task_group.h>
+#include <tbb/task_arena.h>
+#include "batch_jobs.h"
+#include "block_subblock_cache.h"
+#include "channel_composite.h"
+#include "subblock_prefetcher.h"
+#include "pixel_window.h"
+#include "jpeg_passthrough.h"
+#include "jpeg_subblock_decoder.h"
+#include "jpeg_tile_encoder.h"
+#include "pixel_swizzle.h"
+#include "pyramid_builder.h"
+#include "svs_writer.h"
+#include "tile_dedup.h"
+#include "dzi_writer.h"
+#include "zarr_writer.h"
+
+
+// The JPEG colour format declared by the current IFD's PHOTOMETRIC and YCBCRSUBSAMPLING tags.
+static jpeg_tile_format ifd_tile_format(TIFF* tif)
+{
+    jpeg_tile_format format;
+    std::uint16_t photometric = PHOTOMETRIC_RGB;
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+    if (photometric == PHOTOMETRIC_YCBCR) {
+        std::uint16_t h = 2, v = 2;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_YCBCRSUBSAMPLING, &h, &v);
+        format.ycbcr = true;
+        format.h_sampling = h;
+        format.v_sampling = v;
+    }
+    return format;
+}
 
+// Tile geometry and JPEG settings of the current IFD, read once so that tiles can be encoded off the
+// thread that owns the TIFF handle.
+struct tile_encoding
+{
+    std::uint32_t tile_w = 0;
+    std::uint32_t tile_h = 0;
+    int quality = 75;
+    jpeg_tile_format format;
+};
 
-static void write_tiff_tiles_helper(
-    TIFF* tif,
-    const std::vector<unsigned char>& pixels,
+static tile_encoding ifd_tile_encoding(TIFF* tif)
+{
+    tile_encoding enc;
+    TIFFGetField(tif, TIFFTAG_TILEWIDTH, &enc.tile_w);
+    TIFFGetField(tif, TIFFTAG_TILELENGTH, &enc.tile_h);
+    TIFFGetField(tif, TIFFTAG_JPEGQUALITY, &enc.quality);
+    enc.format = ifd_tile_format(tif);
+    return enc;
+}
+
+// Encodes the tiles covering 'pixels' (see write_tiff_tiles_helper), in row-major tile order. Rows are 'stride'
+// bytes apart; the pixels are converted to RGB as the tiles are cut out (c.f. copy_to_rgb).
+static std::vector<std::vector<std::uint8_t>> encode_tiles(
+    const tile_encoding& enc,
+    const std::uint8_t* pixels,
+    std::size_t stride,
+    const pixel_layout& layout,
     std::uint32_t width,
-    std::uint32_t height
+    std::uint32_t height,
+    std::vector<std::vector<std::uint8_t>>* passthrough = nullptr
 )
 {
-    const int sample_per_pixels = 3;
-    std::uint32_t tileW = 0, tileH = 0;
-    TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileW);
-    TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileH);
+    std::vector<bool> skip;
+    if (passthrough != nullptr) {
+        for (const auto& stream : *passthrough) {
+            skip.push_back(!stream.empty());
+        }
+    }
 
-    std::vector<std::uint8_t> tileBuf(tileW * tileH * sample_per_pixels);
+    jpeg_tile_format format = enc.format;
+    format.embed_tables = passthrough != nullptr;
 
-    for (std::uint32_t ty = 0; ty < height; ty += tileH) {
-        for (std::uint32_t tx = 0; tx < width; tx += tileW) {
+    std::vector<std::vector<std::uint8_t>> encoded = encode_jpeg_tiles(pixels, width, height, stride, layout, enc.tile_w, enc.tile_h, enc.quality, format, passthrough != nullptr ? &skip : nullptr);
+    for (std::size_t i = 0; i < skip.size(); ++i) {
+        if (skip[i]) {
+            encoded[i].swap((*passthrough)[i]);
+        }
+    }
+    return encoded;
+}
 
-            std::uint32_t xMax = std::min(tx + tileW, width);
-            std::uint32_t yMax = std::min(ty + tileH, height);
+// Writes one encoded tile of the current IFD, unless 'dedup' knows an identical tile written before: then the
+// tile's TileOffsets/TileByteCounts entry is pointed at that one's data instead.
+static void write_raw_tile(TIFF* tif, ttile_t tile, const std::vector<std::uint8_t>& bytes, tile_dedup& dedup)
+{
+    // libtiff has no call for sharing tile data, but the arrays it returns for these tags are the ones
+    // TIFFWriteDirectory writes out; the first write of the IFD has set them up
+    std::uint64_t* offsets = nullptr;
+    std::uint64_t* byte_counts = nullptr;
+    if (const tile_dedup::location* earlier = dedup.find(bytes)) {
+        TIFFGetField(tif, TIFFTAG_TILEOFFSETS, &offsets);
+        TIFFGetField(tif, TIFFTAG_TILEBYTECOUNTS, &byte_counts);
+        offsets[tile] = earlier->offset;
+        byte_counts[tile] = earlier->size;
+        return;
+    }
 
-            std::fill(tileBuf.begin(), tileBuf.end(), 0);
+    TIFFWriteRawTile(tif, tile, const_cast<std::uint8_t*>(bytes.data()), tmsize_t(bytes.size()));
+    if (dedup.wants(bytes)) {
+        TIFFGetField(tif, TIFFTAG_TILEOFFSETS, &offsets);
+        TIFFGetField(tif, TIFFTAG_TILEBYTECOUNTS, &byte_counts);
+        dedup.add(bytes, tile_dedup::location{ offsets[tile], byte_counts[tile] });
+    }
+}
 
-            for (std::uint32_t y = ty; y < yMax; ++y) {
-                const std::uint8_t* src = &pixels[(std::size_t(y) * width + tx) * sample_per_pixels];
-                std::uint8_t* dst = &tileBuf[(std::size_t(y - ty) * tileW) * sample_per_pixels];
-                std::memcpy(dst, src, (xMax - tx) * sample_per_pixels);
-            }
+// The SVS being written: through libtiff, one IFD after the other, or through a svs_writer, which can have all
+// IFDs open at once, takes their tiles from several threads at once and writes the IFDs at the end. The
+// write_*_ifd functions set their tags on the handle tags() returns either way (the svs_writer's is an in-memory
+// TIFF per IFD whose directory it copies), so both write the same tags and data.
+class svs_output
+{
+public:
+    explicit svs_output(TIFF* tif) : tif_(tif) {}
+    explicit svs_output(svs_writer* writer) : writer_(writer) {}
 
- //           tsize_t nBytes = tsize_t(yMax - ty) * tileW * sample_per_pixels;
-            tsize_t nBytes = tsize_t(tileW) * tileH * sample_per_pixels;
-            ttile_t tile = TIFFComputeTile(tif, tx, ty, 0, 0);
-            TIFFWriteEncodedTile(tif, tile, tileBuf.data(), nBytes);
+    // Whether IFDs may be open at the same time and written to from several threads at once. Otherwise an IFD
+    // has to end before the next one is added, and its tiles come from one thread.
+    bool concurrent() const { return writer_ != nullptr; }
+
+    // Appends an IFD and returns its number; the IFDs are in the file in the order they were added.
+    std::size_t add_ifd()
+    {
+        if (writer_ != nullptr) {
+            return writer_->add_ifd();
         }
+        dedup_ = tile_dedup();
+        return ifd_count_++;
     }
+
+    // The handle to set the IFD's tags on and to write its strips through.
+    TIFF* tags(std::size_t ifd) const { return writer_ != nullptr ? writer_->tags(ifd) : tif_; }
+
+    // Writes an encoded tile of the IFD; identical small tiles share their data (c.f. tile_dedup).
+    void write_tile(std::size_t ifd, ttile_t tile, const std::vector<std::uint8_t>& bytes)
+    {
+        if (writer_ == nullptr) {
+            write_raw_tile(tif_, tile, bytes, dedup_);
+        }
+        else {
+            writer_->write_tile(ifd, tile, bytes);
+        }
+    }
+
+    // Completes the IFD. Returns the number of its tiles that share the data of an identical tile.
+    std::size_t end_ifd(std::size_t ifd)
+    {
+        if (writer_ != nullptr) {
+            return writer_->end_ifd(ifd);
+        }
+        TIFFWriteDirectory(tif_);
+        return dedup_.shared_count();
+    }
+
+private:
+    TIFF* tif_ = nullptr;
+    svs_writer* writer_ = nullptr;
+    std::size_t ifd_count_ = 0;
+    tile_dedup dedup_;
+};
+
+// Writes the encoded tiles of a region 'width' pixels wide whose top left corner is at image position
+// 'x_offset'/'y_offset' (a tile boundary) to the IFD, in tile order.
+static void write_raw_tiles(
+    svs_output& out,
+    std::size_t ifd,
+    const tile_encoding& enc,
+    const std::vector<std::vector<std::uint8_t>>& tiles,
+    std::uint32_t width,
+    std::uint32_t x_offset,
+    std::uint32_t y_offset
+)
+{
+    const std::uint32_t tiles_across = (width + enc.tile_w - 1) / enc.tile_w;
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+        const std::uint32_t tx = std::uint32_t(i % tiles_across) * enc.tile_w;
+        const std::uint32_t ty = std::uint32_t(i / tiles_across) * enc.tile_h;
+        out.write_tile(ifd, TIFFComputeTile(out.tags(ifd), x_offset + tx, y_offset + ty, 0, 0), tiles[i]);
+    }
+}
+
+// Writes the tiles covering 'pixels'. The buffer may hold only a band of the image, in which case
+// 'y_offset' is the image row the band starts at and 'height' must be a multiple of the tile height
+// (except for the last band).
+// Tiles are JPEG-compressed concurrently on the TBB pool, each worker thread using its own libjpeg
+// compressor, and then written to the IFD in tile order. The IFD must have its JPEGTABLES
+// set up by set_jpeg_tables.
+// Non-empty entries of 'passthrough' (one per tile of the band, row-major) are written as they are instead
+// of being encoded from 'pixels'; if all of them are set, 'pixels' may be empty.
+static void write_tiff_tiles_helper(
+    svs_output& out,
+    std::size_t ifd,
+    const std::vector<unsigned char>& pixels,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint32_t y_offset = 0,
+    std::vector<std::vector<std::uint8_t>>* passthrough = nullptr
+)
+{
+    const tile_encoding enc = ifd_tile_encoding(out.tags(ifd));
+    write_raw_tiles(out, ifd, enc, encode_tiles(enc, pixels.data(), std::size_t(width) * 3, channel_order::rgb, width, height, passthrough), width, 0, y_offset);
+}
+
+// Stores the quantisation and Huffman tables shared by all tiles of a JPEG IFD written through
+// write_tiff_tiles_helper. The colour tags must be set before.
+static void set_jpeg_tables(TIFF* tif, int quality)
+{
+    std::vector<std::uint8_t> tables = jpeg_tile_encoder::thread_encoder().tables(quality, ifd_tile_format(tif));
+    TIFFSetField(tif, TIFFTAG_JPEGTABLES, std::uint32_t(tables.size()), tables.data());
 }
 
 
@@ -73,6 +258,22 @@ static void write_tiff_strips_helper(
     }
 }
 
+// The layout of a bitmap's pixels for copy_to_rgb. 'lut' receives the table of 16-bit bitmaps, windowed to the
+// range of their own samples.
+static pixel_layout bitmap_layout(const std::shared_ptr<libCZI::IBitmapData>& bmp, std::vector<std::uint8_t>& lut)
+{
+    pixel_type type;
+    if (!to_pixel_type(bmp->GetPixelType(), &type)) {
+        throw std::runtime_error(std::string("unsupported pixel type ") + libCZI::Utils::PixelTypeToInformalString(bmp->GetPixelType()));
+    }
+    if (type == pixel_type::gray16 || type == pixel_type::bgr48) {
+        std::vector<std::uint64_t> histogram;
+        add_to_histogram(bmp, histogram);
+        lut = make_window_lut(find_window(histogram, 0));
+    }
+    return pixel_layout(type, lut.data());
+}
+
 std::vector<uint8_t> CziBitmapToBuffer(
     const std::shared_ptr<libCZI::IBitmapData>& bmp,
     int* outW = nullptr,
@@ -81,21 +282,17 @@ std::vector<uint8_t> CziBitmapToBuffer(
 
 )
 {
+    std::vector<std::uint8_t> lut;
+    const pixel_layout layout = bitmap_layout(bmp, lut);
     libCZI::ScopedBitmapLockerSP lock(bmp);
     const int w = bmp->GetWidth();
     const int h = bmp->GetHeight();
     const int stride = lock.stride;
     int bpp = 3;
     std::vector<uint8_t> buffer(size_t(w) * h * bpp);
-    for (int y = 0; y < h; y++) {
-        const uint8_t* src =
-            static_cast<const uint8_t*>(lock.ptrDataRoi) + size_t(y) * stride;
-
-        uint8_t* dst =
-            buffer.data() + size_t(y) * w * bpp;
 
-        std::memcpy(dst, src, size_t(w) * bpp);
-    }
+    // libCZI's pixels to the RGB the TIFF tags declare
+    copy_to_rgb(static_cast<const uint8_t*>(lock.ptrDataRoi), stride, layout, w, h, buffer.data(), size_t(w) * bpp);
     if (outW)  *outW = w;
     if (outH)  *outH = h;
     if (outBpp)*outBpp = bpp;
@@ -103,6 +300,17 @@ std::vector<uint8_t> CziBitmapToBuffer(
     return buffer;
 }
 
+// Locks a bitmap composed by libCZI so that its pixels can be read in place, without copying them out first.
+// They are converted to RGB as they are read, so the bitmap has to be of the plane's pixel type.
+static libCZI::ScopedBitmapLockerSP lock_pixels(const std::shared_ptr<libCZI::IBitmapData>& bmp, const pixel_layout& layout)
+{
+    pixel_type type;
+    if (!to_pixel_type(bmp->GetPixelType(), &type) || type != layout.type) {
+        throw std::runtime_error(std::string("unexpected pixel type ") + libCZI::Utils::PixelTypeToInformalString(bmp->GetPixelType()));
+    }
+    return libCZI::ScopedBitmapLockerSP(bmp);
+}
+
 static void load_from_bitmap(const std::string& path,
     std::vector<unsigned char>& pixels,
     int& width,
@@ -117,7 +325,19 @@ static void load_from_bitmap(const std::string& path,
     
 }
 
-void write_base_ifd (TIFF* tif, std::vector<unsigned char>& pixels, int width, int height, std::string desc)
+// Declares the colour layout of the IFD's JPEG tiles (c.f. ifd_tile_format).
+static void set_photometric(TIFF* tif, const jpeg_tile_format& format)
+{
+    if (format.ycbcr) {
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
+        TIFFSetField(tif, TIFFTAG_YCBCRSUBSAMPLING, std::uint16_t(format.h_sampling), std::uint16_t(format.v_sampling));
+    }
+    else {
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    }
+}
+
+static void set_base_ifd_tags(TIFF* tif, int width, int height, const std::string& desc, const jpeg_tile_format& format = {})
 {
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
@@ -126,7 +346,7 @@ void write_base_ifd (TIFF* tif, std::vector<unsigned char>& pixels, int width, i
 	TIFFSetField(tif, TIFFTAG_IMAGEDEPTH, 1);
 
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    set_photometric(tif, format);
 
 	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_JPEG);
 	TIFFSetField(tif, TIFFTAG_JPEGQUALITY, 75);
@@ -134,15 +354,404 @@ void write_base_ifd (TIFF* tif, std::vector<unsigned char>& pixels, int width, i
 	TIFFSetField(tif, TIFFTAG_TILELENGTH, 512);
 	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
     TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, desc.c_str());
-    write_tiff_tiles_helper(tif, pixels, width, height);
-    TIFFWriteDirectory(tif);
+    set_jpeg_tables(tif, 75);
+}
+
+// Where the base level and the native pyramid layers are read from: the ROI of one plane of the CZI.
+struct base_level_source
+{
+    libCZI::ISingleChannelScalingTileAccessor* accessor = nullptr;
+    libCZI::IntRect roi;
+    const libCZI::IDimCoordinate* planeCoord = nullptr;
+
+    // Composes these channels into RGB instead of reading 'planeCoord' alone (the composites are Bgr24).
+    const channel_composite* composite = nullptr;
+
+    // The plane's pixel type, with the window table for 16-bit types (c.f. pixel_window.h).
+    pixel_layout layout = channel_order::bgr;
+
+    // Per pyramid builder level, the CZI layer to read it from if it is native (c.f. find_native_pyramid_layers).
+    libCZI::ISingleChannelPyramidLayerTileAccessor* pyramid_accessor = nullptr;
+    std::vector<std::optional<libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo>> native_layers;
+
+    // Shares the subblocks straddling block boundaries between the blocks; null decodes them for every block.
+    std::shared_ptr<block_subblock_cache> cache;
+
+    // The reader's stream if it reads the blocks' subblocks ahead of the pipeline (c.f. subblock_prefetcher).
+    std::shared_ptr<subblock_prefetcher> prefetcher;
+};
+
+// A block of the base level on its way through run_base_pipeline.
+struct base_block
+{
+    std::size_t index = 0;
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+
+    // How far the composed pixels reach beyond the block on each side (run_base_pipeline's 'margin', less
+    // at the ROI's edges).
+    std::uint32_t margin_left = 0;
+    std::uint32_t margin_top = 0;
+    std::uint32_t margin_right = 0;
+    std::uint32_t margin_bottom = 0;
+
+    std::vector<std::vector<std::uint8_t>> streams;     // the JPEG streams of the tiles passed through, if any
+    std::optional<libCZI::ScopedBitmapLockerSP> pixels;
+    std::vector<std::optional<libCZI::ScopedBitmapLockerSP>> native;
+    std::vector<std::vector<std::uint8_t>> tiles;
+    pyramid_builder::block reduced;
+    std::vector<std::uint8_t> smallest;     // what an output without a pyramid builder passes to its write stage
+};
+
+// What an output does with the blocks of run_base_pipeline; empty functions are skipped.
+struct base_block_stages
+{
+    // In the read stage: fetches what the block takes besides its pixels (the passthrough streams).
+    std::function<void(base_block&)> read;
+
+    // In the encode stage, concurrently for different blocks, once the reduced levels are built: encodes the
+    // base tiles from 'base' (no pixels if the block was not composed; else at the block's top left, with the
+    // margin around), and may write them and those of the reduced levels and take them out of the block.
+    std::function<void(base_block&, const pyramid_builder::source& base)> encode;
+
+    // In the write stage, in block order: writes what the encode stage left, before the reduced levels'
+    // tiles are spilled.
+    std::function<void(base_block&)> write;
+};
+
+// Composes the base level's ROI from the CZI one block of pyramid_builder::block_size() pixels at a time; each
+// block is encoded and written by 'stages' and handed to the pyramid builder before its memory is reused, so
+// peak memory is a few blocks whatever the slide's size. 'block_size' 0 composes the ROI as a single block
+// instead. A block whose tiles are all passed through is only composed if the pyramid builder needs its pixels.
+// 'pyramid' may be null for an output that reduces the blocks itself; 'margin' then composes that many pixels
+// around each block (as far as the ROI goes) for tiles that overlap their neighbours.
+//
+// Blocks (in row-major order) run through a TBB pipeline so that reading, composing, encoding and writing overlap:
+//   read     (serial)    stages.read
+//   compose  (parallel)  composes the block with the accessor, which reads and decodes its subblocks (or takes
+//                        them from source.cache), and reads the block's native pyramid layers; the bitmaps
+//                        stay locked and are read in place. With source.composite, each of them is composed
+//                        from the block's channels
+//   encode   (parallel)  builds the reduced levels, then stages.encode
+//   write    (serial)    stages.write; spills the reduced levels not written yet, and lets the cache drop the
+//                        subblocks no later block reads (and the prefetcher the data read ahead for the block)
+// At most 'blocks_in_flight' blocks exist at any time, which bounds memory when a stage (typically the
+// writer) is the bottleneck.
+static void run_base_pipeline(
+    const base_level_source& source,
+    pyramid_builder* pyramid,
+    std::uint32_t block_size,
+    std::size_t blocks_in_flight,
+    const base_block_stages& stages,
+    std::uint32_t margin = 0
+) {
+    const libCZI::IntRect& roi = source.roi;
+    const std::uint32_t roi_w = std::uint32_t(roi.w), roi_h = std::uint32_t(roi.h);
+    const std::uint32_t block_w = block_size != 0 ? block_size : roi_w;
+    const std::uint32_t block_h = block_size != 0 ? block_size : roi_h;
+
+    libCZI::ISingleChannelScalingTileAccessor::Options accessor_options;
+    accessor_options.Clear();
+    libCZI::ISingleChannelPyramidLayerTileAccessor::Options pyramid_options;
+    pyramid_options.Clear();
+    if (source.cache) {
+        accessor_options.subBlockCache = pyramid_options.subBlockCache = source.cache;
+        accessor_options.onlyUseSubBlockCacheForCompressedData = pyramid_options.onlyUseSubBlockCacheForCompressedData = false;
+    }
+    // A block usually covers many subblocks, so decode them on the TBB workers too (workers idle while the
+    // pipeline has fewer blocks than cores help out). Drawing stays in subblock order, the result is unchanged.
+    // The decodes run isolated: a thread waiting for them must not pick up another block's compose or encode
+    // while it holds this block's decoded subblocks.
+    const int concurrency = tbb::this_task_arena::max_concurrency();
+    if (concurrency > 1) {
+        accessor_options.decodeThreadCount = std::uint32_t(concurrency);
+        accessor_options.decodeTaskRunner = [](int count, const std::function<void(int)>& task) {
+            tbb::this_task_arena::isolate([&] { tbb::parallel_for(0, count, task); });
+        };
+    }
+
+    using plane_getter = std::function<std::shared_ptr<libCZI::IBitmapData>(const libCZI::IDimCoordinate*)>;
+    auto compose = [&source](const plane_getter& get) {
+        return source.composite != nullptr ? source.composite->compose(get) : get(source.planeCoord);
+    };
+
+    std::size_t next_index = 0;
+    std::uint32_t next_x = 0, next_y = 0;
+    tbb::parallel_pipeline(std::max<std::size_t>(blocks_in_flight, 1),
+        tbb::make_filter<void, std::shared_ptr<base_block>>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& fc) -> std::shared_ptr<base_block> {
+                if (next_y >= roi_h) {
+                    fc.stop();
+                    return nullptr;
+                }
+                auto block = std::make_shared<base_block>();
+                block->index = next_index++;
+                block->x = next_x;
+                block->y = next_y;
+                block->width = std::min(block_w, roi_w - next_x);
+                block->height = std::min(block_h, roi_h - next_y);
+                block->margin_left = std::min(margin, block->x);
+                block->margin_top = std::min(margin, block->y);
+                block->margin_right = std::min(margin, roi_w - block->x - block->width);
+                block->margin_bottom = std::min(margin, roi_h - block->y - block->height);
+                next_x += block_w;
+                if (next_x >= roi_w) {
+                    next_x = 0;
+                    next_y += block_h;
+                }
+                if (stages.read) {
+                    stages.read(*block);
+                }
+                return block;
+            }) &
+        tbb::make_filter<std::shared_ptr<base_block>, std::shared_ptr<base_block>>(tbb::filter_mode::parallel,
+            [&](std::shared_ptr<base_block> block) {
+                const libCZI::IntRect rect{ roi.x + int(block->x), roi.y + int(block->y), int(block->width), int(block->height) };
+                const libCZI::IntRect composed{ rect.x - int(block->margin_left), rect.y - int(block->margin_top),
+                    int(block->margin_left + block->width + block->margin_right), int(block->margin_top + block->height + block->margin_bottom) };
+                const bool all_passed = !block->streams.empty()
+                    && std::all_of(block->streams.begin(), block->streams.end(), [](const std::vector<std::uint8_t>& s) { return !s.empty(); });
+                if (!all_passed || (pyramid != nullptr && pyramid->needs_base_pixels())) {
+                    block->pixels = lock_pixels(compose([&](const libCZI::IDimCoordinate* plane) {
+                        return source.accessor->Get(composed, plane, 1.0f, &accessor_options);
+                    }), source.layout);
+                }
+
+                block->native.resize(source.native_layers.size());
+                for (std::size_t level = 0; level < source.native_layers.size(); ++level) {
+                    if (!source.native_layers[level]) {
+                        continue;
+                    }
+                    const auto bmp = compose([&](const libCZI::IDimCoordinate* plane) {
+                        return source.pyramid_accessor->Get(rect, plane, *source.native_layers[level], &pyramid_options);
+                    });
+                    if (bmp->GetWidth() != block->width >> (level + 1) || bmp->GetHeight() != block->height >> (level + 1)) {
+                        throw std::runtime_error("native pyramid layer has an unexpected size");
+                    }
+                    block->native[level] = lock_pixels(bmp, source.layout);
+                }
+                return block;
+            }) &
+        tbb::make_filter<std::shared_ptr<base_block>, std::shared_ptr<base_block>>(tbb::filter_mode::parallel,
+            [&](std::shared_ptr<base_block> block) {
+                auto in_place = [&source](const std::optional<libCZI::ScopedBitmapLockerSP>& lock) {
+                    return lock ? pyramid_builder::source{ static_cast<const std::uint8_t*>(lock->ptrDataRoi), lock->stride, source.layout } : pyramid_builder::source{};
+                };
+                pyramid_builder::source base = in_place(block->pixels);
+                if (base.pixels != nullptr) {
+                    base.pixels += block->margin_top * base.stride + block->margin_left * source.layout.bytes_per_pixel();
+                }
+                if (pyramid != nullptr) {
+                    std::vector<pyramid_builder::source> native(pyramid->level_count());
+                    for (std::size_t level = 0; level < block->native.size(); ++level) {
+                        native[level] = in_place(block->native[level]);
+                    }
+                    block->reduced = pyramid->build_block(block->x, block->y, block->width, block->height, base, native);
+                }
+                if (stages.encode) {
+                    stages.encode(*block, base);
+                }
+
+                // only the encoded tiles wait for the writer
+                block->pixels.reset();
+                std::vector<std::optional<libCZI::ScopedBitmapLockerSP>>().swap(block->native);
+                return block;
+            }) &
+        tbb::make_filter<std::shared_ptr<base_block>, void>(tbb::filter_mode::serial_in_order,
+            [&](std::shared_ptr<base_block> block) {
+                if (source.cache) {
+                    source.cache->block_done(block->index);
+                }
+                if (source.prefetcher) {
+                    source.prefetcher->block_done(block->index);
+                }
+                if (stages.write) {
+                    stages.write(*block);
+                }
+                if (pyramid != nullptr) {
+                    pyramid->add_block(block->reduced);
+                }
+            }));
+}
+
+// Writes the base level through run_base_pipeline: the read stage reads the passthrough JPEG streams of the
+// block, the encode stage JPEG-encodes the tiles that are not passed through and, if 'out' is concurrent,
+// writes them, and those of the reduced levels to 'level_ifds'; otherwise the write stage writes the tiles.
+// 'level_ifds' are empty, or, with a concurrent 'out', the IFDs of the reduced levels with their tags set; they
+// are left to the caller to end.
+// Returns the number of tiles that share the data of an identical tile (see tile_dedup).
+std::size_t write_base_ifd(
+    svs_output& out,
+    std::size_t ifd,
+    const base_level_source& source,
+    const std::string& desc,
+    pyramid_builder& pyramid,
+    const jpeg_passthrough* passthrough = nullptr,
+    std::uint32_t block_size = 0,
+    std::size_t blocks_in_flight = 3,
+    const std::vector<std::size_t>& level_ifds = {}
+) {
+    TIFF* tif = out.tags(ifd);
+    set_base_ifd_tags(tif, source.roi.w, source.roi.h, desc, passthrough != nullptr ? passthrough->format() : pyramid.format());
+    const tile_encoding enc = ifd_tile_encoding(tif);
+
+    base_block_stages stages;
+    if (passthrough != nullptr) {
+        stages.read = [&](base_block& block) {
+            block.streams = passthrough->tiles(block.x / enc.tile_w, block.y / enc.tile_h,
+                (block.width + enc.tile_w - 1) / enc.tile_w, (block.height + enc.tile_h - 1) / enc.tile_h);
+        };
+    }
+    stages.encode = [&](base_block& block, const pyramid_builder::source& base) {
+        block.tiles = encode_tiles(enc, base.pixels, base.stride, source.layout, block.width, block.height, passthrough != nullptr ? &block.streams : nullptr);
+        if (!out.concurrent()) {
+            return;
+        }
+        write_raw_tiles(out, ifd, enc, block.tiles, block.width, block.x, block.y);
+        std::vector<std::vector<std::uint8_t>>().swap(block.tiles);
+        for (std::size_t level = 0; level < level_ifds.size(); ++level) {
+            std::vector<std::vector<std::uint8_t>>& tiles = block.reduced.tiles[level];
+            for (std::size_t t = 0; t < tiles.size(); ++t) {
+                out.write_tile(level_ifds[level], ttile_t(pyramid.level_tile_index(level, block.reduced, t)), tiles[t]);
+            }
+            std::vector<std::vector<std::uint8_t>>().swap(tiles);
+        }
+    };
+    if (!out.concurrent()) {
+        stages.write = [&](base_block& block) {
+            write_raw_tiles(out, ifd, enc, block.tiles, block.width, block.x, block.y);
+        };
+    }
+    run_base_pipeline(source, &pyramid, block_size, blocks_in_flight, stages);
+
+    return out.end_ifd(ifd);
+}
 
+// Writes the base level and the reduced levels as the arrays of a Zarr store through run_base_pipeline, whose
+// encode stage cuts the blocks into chunks and writes them, those of the reduced levels (which 'pyramid'
+// encodes with zarr.encode_chunks) included, so nothing waits for the write stage. The arrays must have been
+// added to 'zarr', the base level's first.
+static void write_zarr_levels(
+    const zarr_writer& zarr,
+    const base_level_source& source,
+    pyramid_builder& pyramid,
+    std::uint32_t block_size,
+    std::size_t blocks_in_flight
+) {
+    const std::uint32_t chunks_across = (std::uint32_t(source.roi.w) + zarr.chunk_size() - 1) / zarr.chunk_size();
+    base_block_stages stages;
+    stages.encode = [&](base_block& block, const pyramid_builder::source& base) {
+        const std::vector<std::vector<std::uint8_t>> chunks = zarr.encode_chunks(base.pixels, block.width, block.height, base.stride, source.layout);
+        const std::uint32_t across = (block.width + zarr.chunk_size() - 1) / zarr.chunk_size();
+        const std::size_t first = std::size_t(block.y / zarr.chunk_size()) * chunks_across + block.x / zarr.chunk_size();
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            zarr.write_chunk(0, first + (c / across) * chunks_across + c % across, chunks[c]);
+        }
+        for (std::size_t level = 0; level < pyramid.level_count(); ++level) {
+            std::vector<std::vector<std::uint8_t>>& tiles = block.reduced.tiles[level];
+            for (std::size_t t = 0; t < tiles.size(); ++t) {
+                zarr.write_chunk(level + 1, pyramid.level_tile_index(level, block.reduced, t), tiles[t]);
+            }
+            std::vector<std::vector<std::uint8_t>>().swap(tiles);
+        }
+    };
+    run_base_pipeline(source, &pyramid, block_size, blocks_in_flight, stages);
+}
+
+// Writes every level of a Deep Zoom image through run_base_pipeline, composing the blocks of dzi.block_size()
+// with dzi.margin() around them: the encode stage writes the tiles of the block levels (dzi_writer::write_block),
+// the write stage hands the smallest of them on, in block order, to compute and write the levels below.
+static void write_dzi_levels(
+    dzi_writer& dzi,
+    const base_level_source& source,
+    std::uint32_t block_size,
+    std::size_t blocks_in_flight
+) {
+    auto dzi_block = [](const base_block& block) {
+        dzi_writer::block b;
+        b.x = block.x;
+        b.y = block.y;
+        b.width = block.width;
+        b.height = block.height;
+        b.left = block.margin_left;
+        b.top = block.margin_top;
+        b.right = block.margin_right;
+        b.bottom = block.margin_bottom;
+        return b;
+    };
+    base_block_stages stages;
+    stages.encode = [&](base_block& block, const pyramid_builder::source& base) {
+        const std::uint8_t* pixels = base.pixels - block.margin_top * base.stride - block.margin_left * source.layout.bytes_per_pixel();
+        block.smallest = dzi.write_block(dzi_block(block), pixels, base.stride, source.layout);
+    };
+    stages.write = [&](base_block& block) {
+        dzi.add_block(dzi_block(block), block.smallest);
+        std::vector<std::uint8_t>().swap(block.smallest);
+    };
+    run_base_pipeline(source, nullptr, block_size, blocks_in_flight, stages, dzi.margin());
+}
+
+// Looks for native pyramid layers to source the reduced levels from. SVS level 'i' is 2^(i+1) times smaller
+// than the base; a CZI layer qualifies if the pyramid statistics list it with exactly that downscale in every
+// scene and its subblocks cover the ROI (their summed logical area, so overlapping tiles can fool the check).
+// Levels without a qualifying layer are left empty and get computed by the pyramid builder.
+static std::vector<std::optional<libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo>> find_native_pyramid_layers(
+    libCZI::ICZIReader* reader,
+    const libCZI::IntRect& roi,
+    const libCZI::IDimCoordinate* planeCoord,
+    std::size_t level_count
+) {
+    std::vector<std::optional<libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo>> layers(level_count);
+    const libCZI::PyramidStatistics pyramidstats = reader->GetPyramidStatistics();
+
+    std::map<int, double> covered;
+    reader->EnumSubset(planeCoord, &roi, false,
+        [&](int, const libCZI::SubBlockInfo& info) -> bool {
+            if (info.physicalSize.w > 0) {
+                const int factor = int(std::lround(double(info.logicalRect.w) / info.physicalSize.w));
+                covered[factor] += double(info.logicalRect.w) * info.logicalRect.h;
+            }
+            return true;
+        });
+
+    for (std::size_t level = 0; level < level_count; ++level) {
+        const int factor = 2 << level;
+        std::optional<libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo> candidate;
+        bool in_every_scene = !pyramidstats.scenePyramidStatistics.empty();
+        for (const auto& scene : pyramidstats.scenePyramidStatistics) {
+            bool found = false;
+            for (const auto& layer : scene.second) {
+                const auto& li = layer.layerInfo;
+                if (li.IsLayer0() || li.IsNotIdentifiedAsPyramidLayer() || layer.count == 0) {
+                    continue;
+                }
+                int layer_factor = 1;
+                for (int i = 0; i < li.pyramidLayerNo; ++i) {
+                    layer_factor *= li.minificationFactor;
+                }
+                if (layer_factor == factor) {
+                    candidate = libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo{ li.minificationFactor, li.pyramidLayerNo };
+                    found = true;
+                }
+            }
+            in_every_scene = in_every_scene && found;
+        }
+
+        if (candidate && in_every_scene && covered[factor] >= double(roi.w) * roi.h) {
+            layers[level] = candidate;
+        }
+    }
+
+    return layers;
 }
 
 void write_thumbnail_ifd(
-    TIFF* tif, std::vector<unsigned char>& pixels, int width, int height,
+    svs_output& out, std::size_t ifd, const std::vector<unsigned char>& pixels, int width, int height,
     const std::string& desc
 ) {
+    TIFF* tif = out.tags(ifd);
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
     TIFFSetField(tif, TIFFTAG_IMAGEDEPTH, 1);
@@ -165,14 +774,11 @@ void write_thumbnail_ifd(
 
     write_tiff_strips_helper(tif, pixels, width, height);
 
-    TIFFWriteDirectory(tif); 
+    out.end_ifd(ifd);
 }
 
-void write_pyramid_ifd(
-    TIFF* tif, std::vector<unsigned char>& pixels,
-    int width, int height,
-    const std::string& desc
-) {
+static void set_pyramid_ifd_tags(TIFF* tif, int width, int height, const std::string& desc, const jpeg_tile_format& format = {})
+{
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
     TIFFSetField(tif, TIFFTAG_IMAGEDEPTH, 1);
@@ -180,7 +786,7 @@ void write_pyramid_ifd(
     TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
     TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
     TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    set_photometric(tif, format);
     TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
     TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 
@@ -191,18 +797,45 @@ void write_pyramid_ifd(
 
     TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
     TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, desc.c_str());
+    set_jpeg_tables(tif, 75);
+}
 
-    write_tiff_tiles_helper(tif, pixels, width, height);
+void write_pyramid_ifd(
+    svs_output& out, std::size_t ifd, std::vector<unsigned char>& pixels,
+    int width, int height,
+    const std::string& desc
+) {
+    set_pyramid_ifd_tags(out.tags(ifd), width, height, desc);
+
+    write_tiff_tiles_helper(out, ifd, pixels, width, height);
 
-    TIFFWriteDirectory(tif);
+    out.end_ifd(ifd);
+}
+
+// Writes a reduced level of the pyramid builder, whose tiles are already JPEG-encoded. Returns the number of
+// tiles that share the data of an identical tile.
+std::size_t write_pyramid_ifd(
+    svs_output& out, std::size_t ifd, const pyramid_builder& pyramid, std::size_t level,
+    const std::string& desc
+) {
+    set_pyramid_ifd_tags(out.tags(ifd), pyramid.level_width(level), pyramid.level_height(level), desc, pyramid.format());
+
+    std::vector<std::uint8_t> tile;
+    for (std::size_t i = 0; i < pyramid.level_tile_count(level); ++i) {
+        pyramid.read_level_tile(level, i, tile);
+        out.write_tile(ifd, ttile_t(i), tile);
+    }
+
+    return out.end_ifd(ifd);
 }
 
 
 void write_label_ifd(
-    TIFF* tif, std::vector<unsigned char>& pixels,
+    svs_output& out, std::size_t ifd, std::vector<unsigned char>& pixels,
     uint32 width, uint32 height,
     const std::string& desc
 ) {
+    TIFF* tif = out.tags(ifd);
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
     TIFFSetField(tif, TIFFTAG_IMAGEDEPTH, 1);
@@ -221,14 +854,15 @@ void write_label_ifd(
 
     write_tiff_strips_helper(tif, pixels, width, height);
 
-    TIFFWriteDirectory(tif);
+    out.end_ifd(ifd);
 
 }
 void write_macro_ifd(
-        TIFF * tif, std::vector<unsigned char>& pixels,
+        svs_output& out, std::size_t ifd, std::vector<unsigned char>& pixels,
         uint32 width, uint32 height,
         const std::string & desc) {
         
+        TIFF* tif = out.tags(ifd);
         TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
         TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
         TIFFSetField(tif, TIFFTAG_IMAGEDEPTH, 1);
@@ -249,7 +883,7 @@ void write_macro_ifd(
 
         write_tiff_strips_helper(tif, pixels, width, height);
 
-        TIFFWriteDirectory(tif);
+        out.end_ifd(ifd);
     }
 
 
@@ -419,32 +1053,326 @@ int attachment_index(std::shared_ptr<libCZI::ICZIReader> reader, const char* nam
     return idx;
 }
 
+// Opens the nested CZI of the attachment called 'name', or returns null if the slide has none.
+static std::shared_ptr<libCZI::ICZIReader> open_attachment_reader(const std::shared_ptr<libCZI::ICZIReader>& reader, const char* name)
+{
+    const int index = attachment_index(reader, name);
+    if (index < 0) {
+        return nullptr;
+    }
 
-int main() 
+    auto attachment = reader->ReadAttachment(index);
+    auto attachmentReader = libCZI::CreateCZIReader();
+    attachmentReader->Open(libCZI::CreateStreamFromMemory(attachment.get()));
+    return attachmentReader;
+}
+
+
+struct convert_options
 {
-    // Proof of concept showing SVS files can be written with libtiff - compression is done internally by libtiff however i have tested with GPU compressed tiles at some point and that also works.
-	// Shows:
-    // Reading CZI Files
-    // reading regions within the base image
-	// Reading scaled versions of the base image (direct access to CZI pyramids is also possible with the pyramid accessor)
-    // extracting usable XML metadata,
-	// finding and reading label and macro attachments,
-	// Shows it is possible to match Aperio SVS structure using libtiff (c++ Proof of concept is not as complete as the python version although i am sure it is possible)
+    std::string input = R"(C:\Users\lewpi\Downloads\591797_H383248_25-2647_1.czi)";
+    std::string output = R"(C:\Projects\Test files\output.svs)";
+
+    // Compose the whole ROI at once instead of block by block; only sensible for small slides.
+    bool in_memory = false;
+
+    // Number of worker threads for tile encoding, 0 lets TBB use all cores.
+    int threads = 0;
+
+    // Source the reduced levels from the CZI's own pyramid layers where the file has them.
+    bool native_pyramid = false;
+
+    // Upper bound on the blocks of the base level in flight in the streaming pipeline.
+    std::size_t blocks_in_flight = 3;
+
+    // Write JPG subblocks that line up with the tile grid into the base level without re-encoding them.
+    bool jpeg_passthrough = true;
+
+    // Memory for decoded subblocks shared by neighbouring base-level blocks (c.f. block_subblock_cache), 0 disables it.
+    std::uint64_t subblock_cache_mb = 256;
+
+    // Memory libCZI keeps for re-using the buffers of decoded subblocks and composed blocks (c.f.
+    // libCZI::ConfigureBufferPool), 0 disables the pool.
+    std::uint64_t buffer_pool_mb = 128;
+
+    // Read the CZI through a memory mapping, so that the subblock data refers to the page cache instead of being
+    // copied (falls back to the default stream where libCZI has no mmap stream).
+    bool mmap_input = false;
+
+    // Gray16 and Bgr48 slides are mapped to 8 bits with a window cutting off this percentage of the samples at
+    // either end (c.f. find_window); 0 windows from the darkest to the brightest sample.
+    double window_percentile = 0;
+
+    // Encode the base and reduced levels as YCbCr 4:2:0 JPEG tiles (PHOTOMETRIC_YCBCR, as Aperio's scanners
+    // write them) instead of RGB ones without subsampling: files about half the size, faster to encode and decode.
+    bool ycbcr = false;
+
+    // Compose the channels of fluorescence slides into RGB with their display settings (c.f. channel_composite)
+    // instead of converting the first channel alone: the ones in 'channels', or with 'channels' empty the ones
+    // enabled in the display settings.
+    bool compose_channels = false;
+    std::vector<int> channels;
+
+    // How far the subblocks of the base-level blocks are read ahead of the pipeline (c.f. subblock_prefetcher),
+    // 0 disables it. Pays off where reads have a latency (spinning disks, network mounts); from the page cache
+    // it only costs a copy. Not used with 'mmap_input', where the kernel reads ahead.
+    std::uint64_t prefetch_mb = 0;
+
+    // Batch mode: a directory, glob or manifest of CZIs to convert instead of 'input' (c.f. collect_batch_jobs).
+    std::string batch;
+
+    // Where batch mode writes the SVS files; empty writes each next to its CZI.
+    std::string output_dir;
+
+    // Number of slides converted concurrently in batch mode. They share the one TBB worker pool (limited by
+    // 'threads'), so idle workers of one slide's pipeline help with the others.
+    std::size_t files_in_flight = 4;
+
+    // Batch mode writes a tab-separated line per slide (input, output, status, seconds, error) to this file.
+    std::string status_file;
+
+    // Writes the SVS through libtiff IFD by IFD instead of svs_writer (c.f. svs_output). The tags and the tile
+    // data are the same, only laid out in a different order.
+    bool libtiff_writer = false;
+
+    // Writes an OME-NGFF Zarr store (c.f. zarr_writer) instead of an SVS: the base and reduced levels in chunks of
+    // 'zarr_chunk_size' pixels compressed with 'zarr_chunk_codec'; the thumbnail, label and macro are not written.
+    bool zarr = false;
+    std::uint32_t zarr_chunk_size = 512;
+    zarr_codec zarr_chunk_codec = zarr_codec::blosc;
+
+    // Writes a Deep Zoom image (c.f. dzi_writer) instead of an SVS: the output is the .dzi descriptor, the tiles of
+    // 'dzi_tile_size' pixels plus 'dzi_overlap' on each side go next to it; the label and macro are not written.
+    bool dzi = false;
+    std::uint32_t dzi_tile_size = 254;
+    std::uint32_t dzi_overlap = 1;
+};
+
+static const char* usage =
+    "Usage: CZIConvert [input.czi] [output.svs] [--in-memory] [--blocks-in-flight N] [--threads N] [--native-pyramid] [--no-jpeg-passthrough] [--subblock-cache-mb N]\n"
+    "                  [--buffer-pool-mb N] [--mmap] [--prefetch-mb N] [--window-percentile P]\n"
+    "                  [--channels all|C,C,...] [--ycbcr] [--libtiff-writer] [--zarr] [--zarr-chunk-size N] [--zarr-codec blosc|zstd|raw]\n"
+    "                  [--dzi] [--dzi-tile-size N] [--dzi-overlap N]\n"
+    "       CZIConvert --batch DIR|GLOB|MANIFEST [--output-dir DIR] [--files-in-flight N] [--status-file PATH] [options]";
+
+// Without arguments the hard-coded test paths above are used.
+static convert_options parse_command_line(int argc, char** argv)
+{
+    convert_options options;
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--in-memory") {
+            options.in_memory = true;
+        }
+        else if (arg == "--stream") {
+            // streaming is the default now; kept so that existing scripts keep working
+            options.in_memory = false;
+        }
+        else if (arg == "--native-pyramid") {
+            options.native_pyramid = true;
+        }
+        else if (arg == "--no-jpeg-passthrough") {
+            options.jpeg_passthrough = false;
+        }
+        else if (arg == "--mmap") {
+            options.mmap_input = true;
+        }
+        else if (arg == "--ycbcr") {
+            options.ycbcr = true;
+        }
+        else if (arg == "--libtiff-writer") {
+            options.libtiff_writer = true;
+        }
+        else if (arg == "--zarr") {
+            options.zarr = true;
+        }
+        else if (arg == "--zarr-chunk-size") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--zarr-chunk-size needs a value");
+            }
+            // the pipeline's blocks are 8 chunks across, so 1024 already makes them 8192 x 8192 pixels
+            const int size = std::stoi(argv[++i]);
+            if (size < 16 || size > 1024) {
+                throw std::invalid_argument("--zarr-chunk-size must be between 16 and 1024");
+            }
+            options.zarr_chunk_size = std::uint32_t(size);
+        }
+        else if (arg == "--zarr-codec") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--zarr-codec needs a value");
+            }
+            const std::string codec = argv[++i];
+            if (codec == "blosc") {
+                options.zarr_chunk_codec = zarr_codec::blosc;
+            }
+            else if (codec == "zstd") {
+                options.zarr_chunk_codec = zarr_codec::zstd;
+            }
+            else if (codec == "raw") {
+                options.zarr_chunk_codec = zarr_codec::raw;
+            }
+            else {
+                throw std::invalid_argument("--zarr-codec takes blosc, zstd or raw");
+            }
+        }
+        else if (arg == "--dzi") {
+            options.dzi = true;
+        }
+        else if (arg == "--dzi-tile-size" || arg == "--dzi-overlap") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            // dzi_writer's blocks are 8 tiles across (plus a margin), so 1024 already makes them 8192 x 8192 pixels;
+            // Deep Zoom tiles are usually 254 or 256
+            const int value = std::stoi(argv[++i]);
+            if (arg == "--dzi-tile-size" && (value < 16 || value > 1024)) {
+                throw std::invalid_argument("--dzi-tile-size must be between 16 and 1024");
+            }
+            if (arg == "--dzi-overlap" && (value < 0 || value > 64)) {
+                throw std::invalid_argument("--dzi-overlap must be between 0 and 64");
+            }
+            (arg == "--dzi-tile-size" ? options.dzi_tile_size : options.dzi_overlap) = std::uint32_t(value);
+        }
+        else if (arg == "--blocks-in-flight") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--blocks-in-flight needs a value");
+            }
+            const int blocks = std::stoi(argv[++i]);
+            if (blocks < 1) {
+                throw std::invalid_argument("--blocks-in-flight must be at least 1");
+            }
+            options.blocks_in_flight = std::size_t(blocks);
+        }
+        else if (arg == "--batch" || arg == "--output-dir" || arg == "--status-file") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            std::string& value = arg == "--batch" ? options.batch : arg == "--output-dir" ? options.output_dir : options.status_file;
+            value = argv[++i];
+        }
+        else if (arg == "--files-in-flight") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--files-in-flight needs a value");
+            }
+            const int files = std::stoi(argv[++i]);
+            if (files < 1) {
+                throw std::invalid_argument("--files-in-flight must be at least 1");
+            }
+            options.files_in_flight = std::size_t(files);
+        }
+        else if (arg == "--subblock-cache-mb" || arg == "--buffer-pool-mb" || arg == "--prefetch-mb") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            const int megabytes = std::stoi(argv[++i]);
+            if (megabytes < 0) {
+                throw std::invalid_argument(arg + " must not be negative");
+            }
+            (arg == "--subblock-cache-mb" ? options.subblock_cache_mb : arg == "--buffer-pool-mb" ? options.buffer_pool_mb : options.prefetch_mb) = std::uint64_t(megabytes);
+        }
+        else if (arg == "--window-percentile") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--window-percentile needs a value");
+            }
+            options.window_percentile = std::stod(argv[++i]);
+            if (options.window_percentile < 0 || options.window_percentile >= 50) {
+                throw std::invalid_argument("--window-percentile must be at least 0 and below 50");
+            }
+        }
+        else if (arg == "--channels") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--channels needs a value");
+            }
+            const std::string list = argv[++i];
+            options.compose_channels = true;
+            options.channels.clear();
+            if (list != "all") {
+                std::stringstream items(list);
+                for (std::string item; std::getline(items, item, ',');) {
+                    const int channel = std::stoi(item);
+                    if (channel < 0) {
+                        throw std::invalid_argument("--channels takes channel indices (0, 1, ...) or 'all'");
+                    }
+                    options.channels.push_back(channel);
+                }
+                if (options.channels.empty()) {
+                    throw std::invalid_argument("--channels needs at least one channel");
+                }
+            }
+        }
+        else if (arg == "--threads") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("--threads needs a value");
+            }
+            options.threads = std::stoi(argv[++i]);
+            if (options.threads < 0) {
+                throw std::invalid_argument("--threads must not be negative");
+            }
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            throw std::invalid_argument("unknown option: " + arg);
+        }
+        else if (positional == 0) {
+            options.input = arg;
+            ++positional;
+        }
+        else if (positional == 1) {
+            options.output = arg;
+            ++positional;
+        }
+        else {
+            throw std::invalid_argument("unexpected argument: " + arg);
+        }
+    }
+    if (!options.batch.empty() && positional > 0) {
+        throw std::invalid_argument("--batch does not take input or output paths");
+    }
+    if (options.zarr && options.dzi) {
+        throw std::invalid_argument("--zarr and --dzi are different outputs");
+    }
+    if (options.dzi && options.dzi_overlap >= options.dzi_tile_size) {
+        throw std::invalid_argument("--dzi-overlap must be below the tile size");
+    }
+    return options;
+}
+
+
+// Converts one slide, writing progress to 'log'. Throws on failure.
+static void convert_slide(const std::string& input, const std::string& output, const convert_options& options, std::ostream& log)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+    auto elapsed_seconds = [&start_time]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    };
+
+    std::unique_ptr<TIFF, void (*)(TIFF*)> tif(nullptr, &TIFFClose);
+    std::unique_ptr<svs_writer> writer;
+    std::unique_ptr<zarr_writer> zarr;
+    if (options.zarr) {
+        zarr = std::make_unique<zarr_writer>(output, options.zarr_chunk_size, options.zarr_chunk_codec);
+    }
+    else if (options.dzi) {
+        // the DZI writer is created once the image's size is known
+    }
+    else if (options.libtiff_writer) {
+        tif.reset(TIFFOpen(output.c_str(), "w8"));
+        if (!tif) {
+            throw std::runtime_error("cannot create " + output);
+        }
+    }
+    else {
+        writer = std::make_unique<svs_writer>(output);
+    }
+    svs_output out = writer ? svs_output(writer.get()) : svs_output(tif.get());
 
-    TIFF* tif = TIFFOpen("C:\\Projects\\Test files\\output.svs", "w8");
-    wchar_t* czifile = LR"(C:\Users\lewpi\Downloads\591797_H383248_25-2647_1.czi)";
-    
-    int ROI_limit_w = 25000, ROI_limit_h = 25000;
     int thumbnail_w = 0, thumbnail_h = 0;
     int ov_w = 0, ov_h;
 	int base_w = 0, base_h = 0;
     
-	int ov1_w = 0, ov1_h = 0;
-	int ov2_w = 0, ov2_h = 0;
-	int ov3_w = 0, ov3_h = 0;
     int label_w = 0, label_h = 0;
     int macro_w = 0, macro_h = 0;
-    int tile_size = 512;
+    int tile_size = zarr ? int(zarr->chunk_size()) : 512;
     int appmag = 40;
     int quality = 75;
     int br = 1, bb = 1, bg = 1;
@@ -453,23 +1381,33 @@ int main()
     double mpp = 0.174;
 
     std::string barcode = "BarcodeExample";
-    std::string ov_desc;
-    std::vector<unsigned char> pixels;
 
     libCZI::CDimCoordinate planeCoord{ { libCZI::DimensionIndex::C,0 } };
 
     // Set up main reader stream 
-    std::shared_ptr<libCZI::IStream> stream =
-        libCZI::CreateStreamFromFile(czifile);
+    std::shared_ptr<libCZI::IStream> stream;
+    if (options.mmap_input) {
+        libCZI::StreamsFactory::CreateStreamInfo stream_info;
+        stream_info.class_name = "mmap_file_inputstream";
+        stream = libCZI::StreamsFactory::CreateStream(stream_info, input);
+        if (!stream) {
+            log << "mmap input stream is not available, using the default stream\n";
+        }
+    }
+    std::shared_ptr<subblock_prefetcher> prefetcher;
+    if (!stream) {
+        stream = libCZI::StreamsFactory::CreateDefaultStreamForFile(input.c_str());
+        if (options.prefetch_mb > 0) {
+            prefetcher = std::make_shared<subblock_prefetcher>(stream, options.prefetch_mb << 20);
+            stream = prefetcher;
+        }
+    }
     std::shared_ptr<libCZI::ICZIReader> mainreader =
         libCZI::CreateCZIReader();
     mainreader->Open(stream);
     auto mainstats = mainreader->GetStatistics();
     auto mainbbox = mainstats.boundingBox;
-    std::cout << "Main image dims:" << " X: " << mainbbox.x << " Y: " << mainbbox.y << " W: " << mainbbox.w << " H: " << mainbbox.h << "\n";
-    mainbbox.w = std::min(mainbbox.w, ROI_limit_w);
-    mainbbox.h = std::min(mainbbox.h, ROI_limit_h);
-    std::cout << "Main image dims (Cropped):" << " X: " << mainbbox.x << " Y: " << mainbbox.y << " W: " << mainbbox.w << " H: " << mainbbox.h << "\n";
+    log << "Main image dims:" << " X: " << mainbbox.x << " Y: " << mainbbox.y << " W: " << mainbbox.w << " H: " << mainbbox.h << "\n";
 	
     // metadata is stored structured like scaling-mPP/name,Channel indexes via a number of diffrent interfaces,   
     // however you can also produce a XML metadata dump, this is how the python program find MPP, appmag, barcode etc.
@@ -479,80 +1417,399 @@ int main()
     
     //Structured metadata examples:
     auto scaling = metastructured->GetScalingInfo();
-    std::cout << "scaling microns per pixel X: " << scaling.scaleX * 1.0e6 << "\n";
+    log << "scaling microns per pixel X: " << scaling.scaleX * 1.0e6 << "\n";
     auto channelmeta = metastructured->GetDimensionChannelsInfo();
-    std::cout << "Number of channels:" << channelmeta->GetChannelCount();
+    log << "Number of channels:" << channelmeta->GetChannelCount();
     
     //XML dump: 
     std::string xml = metadataobj->GetXml();
-    std::cout << xml;
+    log << xml;
 	
     //  This finds the index within the attachment portion for the label attachment and sets up a reader, Theese are nested CZI within the main CZI file.
-    int labelIndex = attachment_index(mainreader, "Label");
-    std::shared_ptr labelAttachment = mainreader->ReadAttachment(labelIndex);
-	std::shared_ptr labelstream = libCZI::CreateStreamFromMemory(labelAttachment.get());
-	std::shared_ptr labelReader = libCZI::CreateCZIReader();
-	labelReader->Open(labelstream);
-	auto labelstats = labelReader->GetStatistics();
-    auto labelbbox = labelstats.boundingBox;
-    std::cout << "Label image dims:" << " X: " << labelbbox.x << " Y: " << labelbbox.y << " W: " << labelbbox.w << " H: " << labelbbox.h << "\n";
+    // Slides without one simply get no label (or macro) IFD.
+    std::shared_ptr<libCZI::ICZIReader> labelReader = open_attachment_reader(mainreader, "Label");
+    libCZI::IntRect labelbbox{};
+    if (labelReader) {
+        labelbbox = labelReader->GetStatistics().boundingBox;
+        log << "Label image dims:" << " X: " << labelbbox.x << " Y: " << labelbbox.y << " W: " << labelbbox.w << " H: " << labelbbox.h << "\n";
+    }
 
 
 	// Same but for the macro image (CZI calls it "SlidePreview")
-    int macroIndex = attachment_index(mainreader, "SlidePreview");
-    std::shared_ptr macroAttachment = mainreader->ReadAttachment(macroIndex);
-    std::shared_ptr macrostream = libCZI::CreateStreamFromMemory(macroAttachment.get());
-    std::shared_ptr macroReader = libCZI::CreateCZIReader();
-    macroReader->Open(macrostream);
-    auto macrostats = macroReader->GetStatistics();
-    auto macrobbox = macrostats.boundingBox;
-    std::cout << "macro image dims:" << " X: " << macrobbox.x << " Y: " << macrobbox.y << " W: " << macrobbox.w << " H: " << macrobbox.h << "\n";
+    std::shared_ptr<libCZI::ICZIReader> macroReader = open_attachment_reader(mainreader, "SlidePreview");
+    libCZI::IntRect macrobbox{};
+    if (macroReader) {
+        macrobbox = macroReader->GetStatistics().boundingBox;
+        log << "macro image dims:" << " X: " << macrobbox.x << " Y: " << macrobbox.y << " W: " << macrobbox.w << " H: " << macrobbox.h << "\n";
+    }
 
 	auto mainimageAccessor = mainreader->CreateSingleChannelScalingTileAccessor();
-    auto mainbitmap = mainimageAccessor->Get(libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h }, &planeCoord, zoom, nullptr);
-    pixels = CziBitmapToBuffer(mainbitmap, &base_w, &base_h);
+    base_w = mainbbox.w;
+    base_h = mainbbox.h;
+
+    // The reduced levels (ov1 = 0.5, ov2 = 0.25, ov3 = 0.125) are area-averaged from the base level as it is
+    // written, and the thumbnail (zoom 0.04, at most thumbnail_max_size pixels across) is box-filtered from ov3,
+    // instead of re-reading the CZI for each.
+    const int thumbnail_max_size = 1024;
+	zoom = std::min(0.04f, float(thumbnail_max_size) / float(std::max(base_w, base_h)));
+    thumbnail_w = static_cast<int>(base_w * zoom);
+    thumbnail_h = static_cast<int>(base_h * zoom);
+    jpeg_tile_format tile_format;
+    if (options.ycbcr) {
+        tile_format.ycbcr = true;
+        tile_format.h_sampling = 2;
+        tile_format.v_sampling = 2;
+    }
+    pyramid_builder pyramid(base_w, base_h, 3, tile_size, quality, zarr ? 0 : thumbnail_w, zarr ? 0 : thumbnail_h, tile_format);
+    if (zarr) {
+        const zarr_writer* chunks = zarr.get();
+        pyramid.set_tile_encoder([chunks](const std::uint8_t* pixels, std::uint32_t width, std::uint32_t height, std::size_t stride, const pixel_layout& layout) {
+            return chunks->encode_chunks(pixels, width, height, stride, layout);
+        });
+    }
+
+    // Composites read every channel's subblocks; the first channel stands in for the others where one plane is asked for.
+    std::unique_ptr<channel_composite> composite;
+    if (options.compose_channels) {
+        composite = std::make_unique<channel_composite>(mainreader.get(), metastructured->GetDisplaySettings(), options.channels, mainbbox, options.window_percentile);
+        log << "Composing channels";
+        for (std::size_t i = 0; i < composite->channel_count(); ++i) {
+            log << " " << composite->channel(i);
+        }
+        log << "\n";
+    }
+    const libCZI::IDimCoordinate* first_plane = composite ? composite->plane(0) : &planeCoord;
+    const std::vector<const libCZI::IDimCoordinate*> read_planes = composite ? composite->planes() : std::vector<const libCZI::IDimCoordinate*>{ &planeCoord };
+
+    std::vector<std::optional<libCZI::ISingleChannelPyramidLayerTileAccessor::PyramidLayerInfo>> native_layers;
+    if (options.native_pyramid && !options.dzi) {
+        native_layers = find_native_pyramid_layers(mainreader.get(), mainbbox, first_plane, pyramid.level_count());
+        for (std::size_t level = 0; level < native_layers.size(); ++level) {
+            if (native_layers[level]) {
+                pyramid.use_native_level(level);
+            }
+            log << "Pyramid level " << level + 1 << (native_layers[level] ? ": native CZI pyramid layer\n" : ": computed\n");
+        }
+    }
+
+    std::unique_ptr<jpeg_passthrough> passthrough;
+    if (options.jpeg_passthrough && !composite && !zarr && !options.dzi) {
+        passthrough = std::make_unique<jpeg_passthrough>(mainreader, mainbbox, &planeCoord, tile_size, options.ycbcr ? &tile_format : nullptr);
+        log << "JPEG passthrough tiles: " << passthrough->candidate_count() << "\n";
+        if (passthrough->candidate_count() == 0) {
+            passthrough.reset();
+        }
+    }
+
+    base_level_source source;
+    source.accessor = mainimageAccessor.get();
+    source.roi = libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h };
+    source.planeCoord = &planeCoord;
+    source.composite = composite.get();
+    libCZI::SubBlockInfo plane_info;
+    pixel_type plane_type = pixel_type::bgr24;
+    if (!composite && mainreader->TryGetSubBlockInfoOfArbitrarySubBlockInChannel(0, plane_info) && !to_pixel_type(plane_info.pixelType, &plane_type)) {
+        throw std::runtime_error(std::string("unsupported pixel type ") + libCZI::Utils::PixelTypeToInformalString(plane_info.pixelType));
+    }
+    std::vector<std::uint8_t> window_lut;
+    if (plane_type == pixel_type::gray16 || plane_type == pixel_type::bgr48) {
+        const sample_window window = find_window(sample_histogram(mainreader.get(), &planeCoord, source.roi, 64), options.window_percentile);
+        window_lut = make_window_lut(window);
+        log << "Pixel type " << libCZI::Utils::PixelTypeToInformalString(plane_info.pixelType) << ", window " << window.low << " to " << window.high << "\n";
+    }
+    source.layout = pixel_layout(plane_type, window_lut.data());
+    std::shared_ptr<libCZI::ISingleChannelPyramidLayerTileAccessor> pyramidAccessor;
+    if (std::any_of(native_layers.begin(), native_layers.end(), [](const auto& layer) { return layer.has_value(); })) {
+        pyramidAccessor = mainreader->CreateSingleChannelPyramidLayerTileAccessor();
+        source.pyramid_accessor = pyramidAccessor.get();
+        source.native_layers = native_layers;
+    }
+    std::unique_ptr<dzi_writer> dzi;
+    if (options.dzi) {
+        dzi = std::make_unique<dzi_writer>(output, base_w, base_h, options.dzi_tile_size, options.dzi_overlap, quality);
+    }
+    const std::uint32_t block_size = options.in_memory ? 0 : dzi ? dzi->block_size() : pyramid.block_size();
+    const std::uint32_t block_margin = block_size != 0 && dzi ? dzi->margin() : 0;
+    if (block_size != 0 && options.subblock_cache_mb > 0) {
+        source.cache = std::make_shared<block_subblock_cache>(mainreader.get(), source.roi, read_planes, block_size, block_size, options.subblock_cache_mb << 20, block_margin);
+    }
+    if (prefetcher) {
+        prefetcher->plan(mainreader.get(), source.roi, read_planes, block_size != 0 ? block_size : std::uint32_t(source.roi.w),
+            block_size != 0 ? block_size : std::uint32_t(source.roi.h), !source.native_layers.empty(), block_margin);
+        source.prefetcher = prefetcher;
+    }
+
+    auto log_read_stats = [&]() {
+        if (source.cache) {
+            const block_subblock_cache::statistics stats = source.cache->stats();
+            log << "Subblock cache: " << stats.reads - stats.hits << " decodes of " << stats.distinct << " subblocks, "
+                << stats.hits << " hits, " << stats.rejected << " not kept for lack of space, peak " << (stats.peak_bytes >> 20) << " MB\n";
+        }
+        if (source.prefetcher) {
+            const subblock_prefetcher::statistics stats = source.prefetcher->stats();
+            log << "Prefetcher: " << (stats.prefetched_bytes >> 20) << " MB read ahead in " << stats.chunks << " chunks, "
+                << stats.hits << " reads ready, " << stats.waits << " waited for, " << stats.misses << " missed\n";
+        }
+    };
+
+    if (zarr) {
+        zarr->add_level(base_w, base_h);
+        for (std::size_t level = 0; level < pyramid.level_count(); ++level) {
+            zarr->add_level(pyramid.level_width(level), pyramid.level_height(level));
+        }
+        write_zarr_levels(*zarr, source, pyramid, block_size, options.blocks_in_flight);
+        log << "Zarr levels written after " << elapsed_seconds() << " s\n";
+        log_read_stats();
+        if (labelReader || macroReader) {
+            log << "The label and macro images are not written to Zarr stores\n";
+        }
+
+        // the CZI's scaling is in metres per pixel, NGFF's in micrometres
+        const double pixel_width = scaling.IsScaleXValid() ? scaling.scaleX * 1.0e6 : 0;
+        const double pixel_height = scaling.IsScaleYValid() ? scaling.scaleY * 1.0e6 : pixel_width;
+        zarr->close(std::filesystem::path(input).stem().string(), pixel_width, pixel_height);
+        log << "Conversion finished in " << elapsed_seconds() << " s\n";
+        return;
+    }
+
+    if (dzi) {
+        write_dzi_levels(*dzi, source, block_size, options.blocks_in_flight);
+        log << dzi->level_count() << " Deep Zoom levels, " << dzi->tile_count() << " tiles written after " << elapsed_seconds() << " s\n";
+        log_read_stats();
+        if (labelReader || macroReader) {
+            log << "The label and macro images are not written to Deep Zoom images\n";
+        }
+        dzi->close();
+        log << "Conversion finished in " << elapsed_seconds() << " s\n";
+        return;
+    }
+
+    // With svs_writer the IFDs are added up front, in the Aperio order: the reduced levels' tiles go to their IFDs
+    // as the base level's blocks are built, and the label and macro are written alongside the base level, so only
+    // the thumbnail is left once the base level is done. With libtiff each IFD is added when its turn comes.
+    const bool concurrent = out.concurrent();
+    auto level_desc = [&](std::size_t level) {
+        return description_generators::make_aperio_description_overview(base_w, base_h, tile_size, tile_size,
+            pyramid.level_width(level), pyramid.level_height(level), quality, appmag, mpp, br, bb, bg, barcode);
+    };
+    std::size_t base_ifd = 0, thumbnail_ifd = 0, label_ifd = 0, macro_ifd = 0;
+    std::vector<std::size_t> level_ifds;
+    if (concurrent) {
+        base_ifd = out.add_ifd();
+        thumbnail_ifd = out.add_ifd();
+        for (std::size_t level = 0; level < pyramid.level_count(); ++level) {
+            level_ifds.push_back(out.add_ifd());
+            set_pyramid_ifd_tags(out.tags(level_ifds.back()), pyramid.level_width(level), pyramid.level_height(level), level_desc(level), pyramid.format());
+        }
+        label_ifd = labelReader ? out.add_ifd() : 0;
+        macro_ifd = macroReader ? out.add_ifd() : 0;
+    }
+
+    auto write_label_and_macro = [&](std::ostream& log) {
+        if (labelReader) {
+            auto labelaccessor = labelReader->CreateSingleChannelTileAccessor();
+            auto labelbitmap = labelaccessor->Get(libCZI::IntRect{ labelbbox.x, labelbbox.y, labelbbox.w, labelbbox.h }, &planeCoord, nullptr);
+            std::vector<unsigned char> label_pixels = CziBitmapToBuffer(labelbitmap, &label_w, &label_h);
+            log << "Found label image dims:" << " W: " << label_w << " H: " << label_h << "\n";
+            std::string label_desc = description_generators::make_aperio_description_label(label_w, label_h);
+            write_label_ifd(out, concurrent ? label_ifd : out.add_ifd(), label_pixels, label_w, label_h, label_desc);
+        }
+
+        if (macroReader) {
+            auto macroAccessor = macroReader->CreateSingleChannelTileAccessor();
+            auto macrobitmap = macroAccessor->Get(libCZI::IntRect{ macrobbox.x, macrobbox.y, macrobbox.w, macrobbox.h }, &planeCoord, nullptr);
+            std::vector<unsigned char> macro_pixels = CziBitmapToBuffer(macrobitmap, &macro_w, &macro_h);
+            log << "Found macro image dims:" << " W: " << macro_w << " H: " << macro_h << "\n";
+            std::string macro_desc = description_generators::make_aperio_description_macro(macro_w, macro_h);
+            write_macro_ifd(out, concurrent ? macro_ifd : out.add_ifd(), macro_pixels, macro_w, macro_h, macro_desc);
+        }
+    };
+    std::ostringstream extras_log;
+    tbb::task_group extras;
+    if (concurrent) {
+        extras.run([&]() { write_label_and_macro(extras_log); });
+    }
+
     std::string base_desc = description_generators::make_aperio_description_IFD0(base_w, base_h, tile_size, tile_size, quality, appmag, mpp, br, bb, bg, barcode);
-    write_base_ifd(tif, pixels, base_w, base_h, base_desc);
+    const std::size_t shared = write_base_ifd(out, concurrent ? base_ifd : out.add_ifd(), source, base_desc, pyramid, passthrough.get(), block_size, options.blocks_in_flight, level_ifds);
+    pyramid.finish();
+    log << "Base level written after " << elapsed_seconds() << " s (" << shared << " duplicate tiles shared)\n";
+    log_read_stats();
 
-	zoom = 0.04f;
-    auto thumbnailbitmap = mainimageAccessor->Get(libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h }, &planeCoord, zoom, nullptr);
-    pixels = CziBitmapToBuffer(thumbnailbitmap, &thumbnail_w, &thumbnail_h);
     std::string thumbnail_desc = description_generators::make_aperio_description_thumbnail(base_w, base_h, thumbnail_w, thumbnail_h, quality, appmag, mpp, br, bb, bg, barcode);
-    write_thumbnail_ifd(tif, pixels, thumbnail_w, thumbnail_h, thumbnail_desc);
-	std::cout << "Thumbnail dims created to fit:" << " W: " << thumbnail_w << " H: " << thumbnail_h << "\n";
-
-	zoom = 0.5f;
-    auto ov1bitmap = mainimageAccessor->Get(libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h }, &planeCoord, zoom, nullptr);
-    pixels = CziBitmapToBuffer(ov1bitmap, &ov1_w, &ov1_h);
-    ov_desc = description_generators::make_aperio_description_overview(base_w, base_h, tile_size, tile_size, ov1_w, ov1_h, quality, appmag, mpp, br, bb, bg, barcode);
-    write_pyramid_ifd(tif, pixels, ov1_w, ov1_h, ov_desc);
-
-	zoom = 0.25f;
-    auto ov2bitmap = mainimageAccessor->Get(libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h }, &planeCoord, zoom, nullptr);
-    pixels = CziBitmapToBuffer(ov2bitmap, &ov2_w, &ov2_h);
-    ov_desc = description_generators::make_aperio_description_overview(base_w, base_h, tile_size, tile_size, ov2_w, ov2_h, quality, appmag, mpp, br, bb, bg, barcode);
-    write_pyramid_ifd(tif, pixels, ov2_w, ov2_h, ov_desc);
-
-    zoom = 0.125f;
-    auto ov3bitmap = mainimageAccessor->Get(libCZI::IntRect{ mainbbox.x, mainbbox.y, mainbbox.w, mainbbox.h }, &planeCoord, zoom, nullptr);
-    pixels = CziBitmapToBuffer(ov3bitmap, &ov3_w, &ov3_h);
-    ov_desc = description_generators::make_aperio_description_overview(base_w, base_h, tile_size, tile_size, ov3_w, ov3_h, quality, appmag, mpp, br, bb, bg, barcode);
-    write_pyramid_ifd(tif, pixels, ov3_w, ov3_h, ov_desc);
-    
-    auto labelaccessor = labelReader->CreateSingleChannelTileAccessor();
-	auto labelbitmap = labelaccessor->Get(libCZI::IntRect{ labelbbox.x, labelbbox.y, labelbbox.w, labelbbox.h }, &planeCoord, nullptr);
-	pixels = CziBitmapToBuffer(labelbitmap, &label_w, &label_h);
-	std::cout << "Found label image dims:" << " W: " << label_w << " H: " << label_h << "\n";
-    std::string label_desc = description_generators::make_aperio_description_label(label_w, label_h);
-    write_label_ifd(tif, pixels, label_w, label_h, label_desc);
-
-    auto macroAccessor = macroReader->CreateSingleChannelTileAccessor();
-    auto macrobitmap = macroAccessor->Get(libCZI::IntRect{ macrobbox.x, macrobbox.y, macrobbox.w, macrobbox.h }, &planeCoord, nullptr);
-    pixels = CziBitmapToBuffer(macrobitmap, &macro_w, &macro_h);
-    std::cout << "Found macro image dims:" << " W: " << macro_w << " H: " << macro_h << "\n";
-    std::string macro_desc = description_generators::make_aperio_description_macro(macro_w, macro_h);
-    write_macro_ifd(tif, pixels, macro_w, macro_h, macro_desc);
-
-    TIFFClose(tif);
+    write_thumbnail_ifd(out, concurrent ? thumbnail_ifd : out.add_ifd(), pyramid.thumbnail(), thumbnail_w, thumbnail_h, thumbnail_desc);
+	log << "Thumbnail dims created to fit:" << " W: " << thumbnail_w << " H: " << thumbnail_h << "\n";
+
+    for (std::size_t level = 0; level < pyramid.level_count(); ++level) {
+        const std::size_t level_shared = concurrent
+            ? out.end_ifd(level_ifds[level])
+            : write_pyramid_ifd(out, out.add_ifd(), pyramid, level, level_desc(level));
+        log << "Pyramid level " << level + 1 << " written after " << elapsed_seconds() << " s (" << level_shared << " duplicate tiles shared)\n";
+    }
+
+    if (concurrent) {
+        extras.wait();
+        log << extras_log.str();
+    }
+    else {
+        write_label_and_macro(log);
+    }
+
+    if (writer) {
+        writer->close();
+    }
+    tif.reset();
+    log << "Conversion finished in " << elapsed_seconds() << " s\n";
+}
+
+// Converts the batch's slides 'files_in_flight' at a time and reports each one's status as it finishes.
+// Returns the number of slides that failed.
+static std::size_t run_batch(const std::vector<batch_job>& jobs, const convert_options& options)
+{
+    struct job_status
+    {
+        const batch_job* job = nullptr;
+        bool ok = false;
+        double seconds = 0;
+        std::string error;
+    };
+
+    std::ofstream status_file;
+    if (!options.status_file.empty()) {
+        status_file.open(options.status_file);
+        if (!status_file) {
+            throw std::runtime_error("cannot create " + options.status_file);
+        }
+        status_file << "input\toutput\tstatus\tseconds\terror\n";
+    }
+
+    std::size_t next = 0, done = 0, failed = 0;
+    tbb::parallel_pipeline(options.files_in_flight,
+        tbb::make_filter<void, std::size_t>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& fc) -> std::size_t {
+                if (next == jobs.size()) {
+                    fc.stop();
+                    return 0;
+                }
+                return next++;
+            }) &
+        tbb::make_filter<std::size_t, job_status>(tbb::filter_mode::parallel,
+            [&](std::size_t index) {
+                const batch_job* job = &jobs[index];
+                job_status status;
+                status.job = job;
+                const auto start = std::chrono::steady_clock::now();
+                try {
+                    // the per-slide log would interleave; only the status line is reported
+                    std::ostringstream log;
+                    // isolated, so that a worker waiting in this slide's pipeline does not take on another slide's
+                    // whole conversion - this one would only return after that one
+                    tbb::this_task_arena::isolate([&] { convert_slide(job->input, job->output, options, log); });
+                    status.ok = true;
+                }
+                catch (const std::exception& e) {
+                    status.error = e.what();
+                    // a Zarr store is a directory; one the writer refused to replace is not the slide's to remove. A
+                    // Deep Zoom image has no descriptor yet, and its writer removed the tiles
+                    std::error_code ec;
+                    if (std::filesystem::is_regular_file(job->output, ec) || std::filesystem::exists(std::filesystem::path(job->output) / ".zgroup", ec)) {
+                        std::filesystem::remove_all(job->output, ec);
+                    }
+                }
+                status.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return status;
+            }) &
+        tbb::make_filter<job_status, void>(tbb::filter_mode::serial_out_of_order,
+            [&](const job_status& status) {
+                ++done;
+                failed += status.ok ? 0 : 1;
+                std::cout << "[" << done << "/" << jobs.size() << "] " << (status.ok ? "ok     " : "FAILED ")
+                    << status.job->input << " -> " << status.job->output << " (" << status.seconds << " s)";
+                if (!status.ok) {
+                    std::cout << ": " << status.error;
+                }
+                std::cout << std::endl;
+                if (status_file) {
+                    status_file << status.job->input << '\t' << status.job->output << '\t' << (status.ok ? "ok" : "failed")
+                        << '\t' << status.seconds << '\t' << status.error << std::endl;
+                }
+            }));
+
+    return failed;
+}
+
+
+int main(int argc, char** argv)
+{
+    // Proof of concept showing SVS files can be written with libtiff - compression is done internally by libtiff however i have tested with GPU compressed tiles at some point and that also works.
+	// Shows:
+    // Reading CZI Files
+    // reading regions within the base image
+	// Reading scaled versions of the base image (direct access to CZI pyramids is also possible with the pyramid accessor)
+    // extracting usable XML metadata,
+	// finding and reading label and macro attachments,
+	// Shows it is possible to match Aperio SVS structure using libtiff (c++ Proof of concept is not as complete as the python version although i am sure it is possible)
+
+    convert_options options;
+    std::vector<batch_job> jobs;
+    try {
+        options = parse_command_line(argc, argv);
+        if (!options.batch.empty()) {
+            jobs = collect_batch_jobs(options.batch, options.output_dir, options.zarr ? ".zarr" : options.dzi ? ".dzi" : ".svs");
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << "\n" << usage << "\n";
+        return 1;
+    }
+    catch (const std::out_of_range&) {
+        // std::stoi and std::stod throw this for numbers that do not fit
+        std::cerr << "a value is out of range\n" << usage << "\n";
+        return 1;
+    }
+    catch (const std::exception& e) {
+        // e.g. a std::filesystem::filesystem_error from a batch directory that cannot be read
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    // lets libCZI decode JPG compressed subblocks
+    static jpeg_decoder_site site;
+    libCZI::SetSiteObject(&site);
+
+    // Every decoded subblock and composed block has one of a few sizes, so re-using their buffers saves the page
+    // faults of fresh allocations.
+    libCZI::BufferPoolOptions pool_options;
+    pool_options.Clear();
+    pool_options.maxRetainedBytes = options.buffer_pool_mb << 20;
+    libCZI::ConfigureBufferPool(pool_options);
+
+    // The one thread budget for everything: with several slides in flight, their pipelines share these workers.
+    std::unique_ptr<tbb::global_control> thread_limit;
+    if (options.threads > 0) {
+        thread_limit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, options.threads);
+    }
+    std::cout << "Encoding threads: " << tbb::this_task_arena::max_concurrency() << "\n";
+
+    if (!jobs.empty()) {
+        if (!options.output_dir.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(options.output_dir, ec);
+        }
+        std::cout << "Converting " << jobs.size() << " slides, " << options.files_in_flight << " at a time\n";
+        const auto start_time = std::chrono::steady_clock::now();
+        const std::size_t failed = run_batch(jobs, options);
+        std::cout << jobs.size() - failed << " of " << jobs.size() << " slides converted in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() << " s\n";
+        return failed == 0 ? 0 : 2;
+    }
+
+    try {
+        convert_slide(options.input, options.output, options, std::cout);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Conversion failed: " << e.what() << "\n";
+        return 2;
+    }
     return 0;
 }
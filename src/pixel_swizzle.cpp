@@ -0,0 +1,329 @@
+#include "pixel_swizzle.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Runtime dispatch as in libCZI's utilities_simd.cpp: the row kernel is called through a function pointer that
+// starts out at a chooser, which checks the CPU with cpuid once and then points it at the best kernel.
+// Unlike libCZI, the file is not compiled with -mavx2. Each SIMD kernel carries its instruction set as a target
+// attribute instead, so nothing outside the kernels (in particular the SSSE3 one) can end up VEX encoded.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CZICONVERT_SWIZZLE_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CZICONVERT_TARGET(isa)
+#else
+#define CZICONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#include <immintrin.h>
+#else
+#define CZICONVERT_SWIZZLE_X86 0
+#endif
+
+namespace
+{
+    void bgr_to_rgb_row_scalar(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            dst[x * 3 + 0] = src[x * 3 + 2];
+            dst[x * 3 + 1] = src[x * 3 + 1];
+            dst[x * 3 + 2] = src[x * 3 + 0];
+        }
+    }
+
+    void gray_to_rgb_row_scalar(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            dst[x * 3 + 0] = dst[x * 3 + 1] = dst[x * 3 + 2] = src[x];
+        }
+    }
+
+#if CZICONVERT_SWIZZLE_X86
+    void run_cpuid(std::uint32_t eax, std::uint32_t ecx, std::uint32_t* abcd)
+    {
+#if defined(_MSC_VER)
+        __cpuidex(reinterpret_cast<int*>(abcd), int(eax), int(ecx));
+#else
+        std::uint32_t ebx = 0, edx;
+# if defined(__i386__) && defined(__PIC__)
+        /* in case of PIC under 32-bit EBX cannot be clobbered */
+        __asm__("movl %%ebx, %%edi \n\t cpuid \n\t xchgl %%ebx, %%edi" : "=D" (ebx),
+# else
+        __asm__("cpuid" : "+b" (ebx),
+# endif
+            "+a" (eax), "+c" (ecx), "=d" (edx));
+        abcd[0] = eax; abcd[1] = ebx; abcd[2] = ecx; abcd[3] = edx;
+#endif
+    }
+
+    bool check_ssse3()
+    {
+        std::uint32_t abcd[4];
+        run_cpuid(1, 0, abcd);
+        return (abcd[2] & (1u << 9)) != 0;     // CPUID.(EAX=01H):ECX.SSSE3[bit 9]
+    }
+
+    bool check_avx2()
+    {
+        std::uint32_t abcd[4];
+        run_cpuid(0, 0, abcd);
+        if (abcd[0] < 7) {
+            return false;
+        }
+
+        run_cpuid(1, 0, abcd);
+        if ((abcd[2] & (1u << 27)) == 0) {     // OSXSAVE
+            return false;
+        }
+
+        std::uint32_t xcr0;
+#if defined(_MSC_VER)
+        xcr0 = static_cast<std::uint32_t>(_xgetbv(0));
+#else
+        __asm__("xgetbv" : "=a" (xcr0) : "c" (0) : "%edx");
+#endif
+        if ((xcr0 & 6) != 6) {                  // xmm and ymm state enabled by the OS
+            return false;
+        }
+
+        run_cpuid(7, 0, abcd);
+        return (abcd[1] & (1u << 5)) != 0;     // CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]
+    }
+
+    // Four pixels per 16-byte shuffle; the store writes 4 bytes beyond them, which the next step (or the
+    // scalar tail) overwrites.
+    CZICONVERT_TARGET("ssse3")
+    void bgr_to_rgb_row_ssse3(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+        std::uint32_t x = 0;
+        for (; x + 6 <= width; x += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + std::size_t(x) * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + std::size_t(x) * 3), _mm_shuffle_epi8(v, shuffle));
+        }
+        bgr_to_rgb_row_scalar(src + std::size_t(x) * 3, dst + std::size_t(x) * 3, width - x);
+    }
+
+    // Eight pixels per step: the 24 source bytes are spread to 12 bytes per 128-bit lane, shuffled within the
+    // lanes and packed back together. The 32-byte store writes 8 bytes beyond them, as in the SSSE3 kernel.
+    CZICONVERT_TARGET("avx2")
+    void bgr_to_rgb_row_avx2(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+        const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+        const __m256i shuffle = _mm256_setr_epi8(
+            2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+            2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+        std::uint32_t x = 0;
+        for (; x + 11 <= width; x += 8) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + std::size_t(x) * 3));
+            const __m256i swapped = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), shuffle);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + std::size_t(x) * 3), _mm256_permutevar8x32_epi32(swapped, pack));
+        }
+        bgr_to_rgb_row_ssse3(src + std::size_t(x) * 3, dst + std::size_t(x) * 3, width - x);
+    }
+
+    // Sixteen pixels per step: three shuffles spread the 16 gray bytes over 48 RGB bytes.
+    CZICONVERT_TARGET("ssse3")
+    void gray_to_rgb_row_ssse3(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        const __m128i spread0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+        const __m128i spread1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        std::uint32_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i* d = reinterpret_cast<__m128i*>(dst + std::size_t(x) * 3);
+            _mm_storeu_si128(d, _mm_shuffle_epi8(v, spread0));
+            _mm_storeu_si128(d + 1, _mm_shuffle_epi8(v, spread1));
+            _mm_storeu_si128(d + 2, _mm_shuffle_epi8(v, spread2));
+        }
+        gray_to_rgb_row_scalar(src + x, dst + std::size_t(x) * 3, width - x);
+    }
+
+    // Sixteen pixels per step as well: the gray bytes are broadcast to both 128-bit lanes, so that one in-lane
+    // shuffle gives the first 32 RGB bytes (no cross-lane permute needed), and an SSSE3 shuffle the last 16.
+    CZICONVERT_TARGET("avx2")
+    void gray_to_rgb_row_avx2(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        const __m256i spread01 = _mm256_setr_epi8(
+            0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5,
+            5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        std::uint32_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            std::uint8_t* d = dst + std::size_t(x) * 3;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(d), _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(v), spread01));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), _mm_shuffle_epi8(v, spread2));
+        }
+        gray_to_rgb_row_scalar(src + x, dst + std::size_t(x) * 3, width - x);
+    }
+
+    bool cpu_supports_ssse3()
+    {
+        static const bool supported = check_ssse3();
+        return supported;
+    }
+
+    bool cpu_supports_avx2()
+    {
+        static const bool supported = check_avx2();
+        return supported;
+    }
+#else
+    bool cpu_supports_ssse3() { return false; }
+    bool cpu_supports_avx2() { return false; }
+    void bgr_to_rgb_row_ssse3(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width) { bgr_to_rgb_row_scalar(src, dst, width); }
+    void bgr_to_rgb_row_avx2(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width) { bgr_to_rgb_row_scalar(src, dst, width); }
+    void gray_to_rgb_row_ssse3(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width) { gray_to_rgb_row_scalar(src, dst, width); }
+    void gray_to_rgb_row_avx2(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width) { gray_to_rgb_row_scalar(src, dst, width); }
+#endif
+
+    void bgr_to_rgb_row_choose(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width);
+
+    bgr_to_rgb_row_function bgr_to_rgb_row_dispatch = &bgr_to_rgb_row_choose;
+
+    // The AVX2 kernel is not preferred: three-byte pixels straddle the 128-bit lanes, and the cross-lane
+    // permutes it needs for that cost more than the wider shuffle saves. bench_swizzle measured it at about
+    // half the SSSE3 kernel's throughput, which is why the chooser stops at SSSE3.
+    void bgr_to_rgb_row_choose(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        bgr_to_rgb_row_function best = &bgr_to_rgb_row_scalar;
+        if (cpu_supports_ssse3()) {
+            best = &bgr_to_rgb_row_ssse3;
+        }
+
+        bgr_to_rgb_row_dispatch = best;
+        best(src, dst, width);
+    }
+
+    void gray_to_rgb_row_choose(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width);
+
+    gray_to_rgb_row_function gray_to_rgb_row_dispatch = &gray_to_rgb_row_choose;
+
+    void gray_to_rgb_row_choose(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width)
+    {
+        gray_to_rgb_row_function best = &gray_to_rgb_row_scalar;
+        if (cpu_supports_ssse3()) {
+            best = &gray_to_rgb_row_ssse3;
+        }
+
+        gray_to_rgb_row_dispatch = best;
+        best(src, dst, width);
+    }
+
+    // The 16-bit types: the table lookups are scalar (a gather of single bytes does not pay off even with AVX2),
+    // gray goes through a small buffer of 8-bit values to the SIMD gray kernel.
+    void gray16_to_rgb_row(const std::uint8_t* src, const std::uint8_t* lut, std::uint8_t* dst, std::uint32_t width)
+    {
+        const std::uint16_t* samples = reinterpret_cast<const std::uint16_t*>(src);
+        std::uint8_t gray[256];
+        for (std::uint32_t x = 0; x < width; x += 256) {
+            const std::uint32_t n = std::min<std::uint32_t>(256, width - x);
+            for (std::uint32_t i = 0; i < n; ++i) {
+                gray[i] = lut[samples[x + i]];
+            }
+            (*gray_to_rgb_row_dispatch)(gray, dst + std::size_t(x) * 3, n);
+        }
+    }
+
+    void bgr48_to_rgb_row(const std::uint8_t* src, const std::uint8_t* lut, std::uint8_t* dst, std::uint32_t width, bool swap)
+    {
+        const std::uint16_t* samples = reinterpret_cast<const std::uint16_t*>(src);
+        const int first = swap ? 2 : 0;
+        for (std::uint32_t x = 0; x < width; ++x) {
+            const std::uint16_t* p = samples + std::size_t(x) * 3;
+            dst[x * 3 + 0] = lut[p[first]];
+            dst[x * 3 + 1] = lut[p[1]];
+            dst[x * 3 + 2] = lut[p[2 - first]];
+        }
+    }
+}
+
+std::size_t pixel_layout::bytes_per_pixel() const
+{
+    switch (type) {
+    case pixel_type::gray8:
+        return 1;
+    case pixel_type::gray16:
+        return 2;
+    case pixel_type::bgr48:
+        return 6;
+    default:
+        return 3;
+    }
+}
+
+void convert_row(const std::uint8_t* src, const pixel_layout& layout, std::uint8_t* dst, channel_order order, std::uint32_t width)
+{
+    switch (layout.type) {
+    case pixel_type::gray8:
+        (*gray_to_rgb_row_dispatch)(src, dst, width);
+        break;
+    case pixel_type::gray16:
+        gray16_to_rgb_row(src, layout.lut, dst, width);
+        break;
+    case pixel_type::bgr48:
+        bgr48_to_rgb_row(src, layout.lut, dst, width, order == channel_order::rgb);
+        break;
+    default:
+        if ((layout.type == pixel_type::bgr24) != (order == channel_order::bgr)) {
+            (*bgr_to_rgb_row_dispatch)(src, dst, width);
+        }
+        else {
+            std::memcpy(dst, src, std::size_t(width) * 3);
+        }
+        break;
+    }
+}
+
+void copy_to_rgb(
+    const std::uint8_t* src,
+    std::size_t src_stride,
+    const pixel_layout& layout,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint8_t* dst,
+    std::size_t dst_stride)
+{
+    for (std::uint32_t y = 0; y < height; ++y) {
+        convert_row(src + std::size_t(y) * src_stride, layout, dst + std::size_t(y) * dst_stride, channel_order::rgb, width);
+    }
+}
+
+bool swizzle_kernel_supported(swizzle_kernel kernel)
+{
+    switch (kernel) {
+    case swizzle_kernel::avx2:
+        return cpu_supports_avx2();
+    case swizzle_kernel::ssse3:
+        return cpu_supports_ssse3();
+    default:
+        return true;
+    }
+}
+
+gray_to_rgb_row_function gray_to_rgb_row(swizzle_kernel kernel)
+{
+    switch (kernel) {
+    case swizzle_kernel::avx2:
+        return &gray_to_rgb_row_avx2;
+    case swizzle_kernel::ssse3:
+        return &gray_to_rgb_row_ssse3;
+    default:
+        return &gray_to_rgb_row_scalar;
+    }
+}
+
+bgr_to_rgb_row_function bgr_to_rgb_row(swizzle_kernel kernel)
+{
+    switch (kernel) {
+    case swizzle_kernel::avx2:
+        return &bgr_to_rgb_row_avx2;
+    case swizzle_kernel::ssse3:
+        return &bgr_to_rgb_row_ssse3;
+    default:
+        return &bgr_to_rgb_row_scalar;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte order of interleaved 8-bit three-channel pixels. libCZI's Bgr24 bitmaps are bgr; the SVS tiles
+// (PHOTOMETRIC_RGB, or YCbCr converted from RGB) are encoded from rgb.
+enum class channel_order
+{
+    rgb,
+    bgr,
+};
+
+// The pixel types of the composed planes the converter reads, after libCZI's: interleaved 8-bit three-channel
+// pixels in either order, 8-bit gray, and 16-bit gray or bgr (high-bit-depth scans).
+enum class pixel_type
+{
+    rgb24,
+    bgr24,
+    gray8,
+    gray16,
+    bgr48,
+};
+
+// Source pixels: their type and, for the 16-bit types, the table mapping every 16-bit sample value to 8 bits
+// (65536 entries, c.f. make_window_lut). A channel_order converts to the 8-bit three-channel layouts.
+struct pixel_layout
+{
+    pixel_type type = pixel_type::bgr24;
+    const std::uint8_t* lut = nullptr;
+
+    pixel_layout() = default;
+    pixel_layout(channel_order order) : type(order == channel_order::rgb ? pixel_type::rgb24 : pixel_type::bgr24) {}
+    pixel_layout(pixel_type type, const std::uint8_t* lut) : type(type), lut(lut) {}
+
+    std::size_t bytes_per_pixel() const;
+};
+
+// Copies 'height' rows of 'width' pixels from 'src' to 'dst' (both strided, in bytes), producing RGB: bgr
+// sources have their first and third channel swapped on the way, gray is replicated to the three channels and
+// 16-bit samples go through the layout's table. This is the one pass that moves pixels out of a locked libCZI
+// bitmap, e.g. straight into a JPEG tile buffer.
+void copy_to_rgb(
+    const std::uint8_t* src,
+    std::size_t src_stride,
+    const pixel_layout& layout,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint8_t* dst,
+    std::size_t dst_stride);
+
+// Converts one row of 'width' pixels to interleaved 8-bit three-channel pixels in 'order'.
+void convert_row(const std::uint8_t* src, const pixel_layout& layout, std::uint8_t* dst, channel_order order, std::uint32_t width);
+
+// The instruction sets the BGR to RGB and gray to RGB kernels come in. copy_to_rgb uses the SSSE3 ones if the
+// CPU supports it and the scalar ones otherwise; the AVX2 kernels are kept for the benchmarks to measure.
+enum class swizzle_kernel
+{
+    scalar,
+    ssse3,
+    avx2,
+};
+
+// Converts one row of 'width' pixels from BGR to RGB ('src' and 'dst' must not overlap).
+using bgr_to_rgb_row_function = void (*)(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width);
+
+// Replicates one row of 'width' 8-bit gray pixels to RGB ('src' and 'dst' must not overlap).
+using gray_to_rgb_row_function = void (*)(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width);
+
+// For benchmarks and tests: whether the CPU (and the build) can run 'kernel', and its row functions.
+bool swizzle_kernel_supported(swizzle_kernel kernel);
+bgr_to_rgb_row_function bgr_to_rgb_row(swizzle_kernel kernel);
+gray_to_rgb_row_function gray_to_rgb_row(swizzle_kernel kernel);
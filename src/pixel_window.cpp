@@ -0,0 +1,152 @@
+#include "pixel_window.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    const std::size_t histogram_bins = 65536;
+    const std::uint64_t samples_per_bitmap = 256 * 1024;
+}
+
+bool to_pixel_type(libCZI::PixelType czi_type, pixel_type* type)
+{
+    switch (czi_type) {
+    case libCZI::PixelType::Bgr24:
+        *type = pixel_type::bgr24;
+        return true;
+    case libCZI::PixelType::Gray8:
+        *type = pixel_type::gray8;
+        return true;
+    case libCZI::PixelType::Gray16:
+        *type = pixel_type::gray16;
+        return true;
+    case libCZI::PixelType::Bgr48:
+        *type = pixel_type::bgr48;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void add_to_histogram(const std::shared_ptr<libCZI::IBitmapData>& bitmap, std::vector<std::uint64_t>& histogram)
+{
+    const libCZI::PixelType type = bitmap->GetPixelType();
+    if (type != libCZI::PixelType::Gray16 && type != libCZI::PixelType::Bgr48) {
+        return;
+    }
+
+    histogram.resize(histogram_bins, 0);
+    const int channels = type == libCZI::PixelType::Bgr48 ? 3 : 1;
+    const std::uint32_t width = bitmap->GetWidth(), height = bitmap->GetHeight();
+    const std::uint64_t pixels = std::uint64_t(width) * height;
+    std::uint32_t step = 1;
+    while (pixels / (std::uint64_t(step) * step) > samples_per_bitmap) {
+        ++step;
+    }
+
+    const libCZI::ScopedBitmapLockerSP lock{ bitmap };
+    for (std::uint32_t y = 0; y < height; y += step) {
+        const std::uint16_t* row = reinterpret_cast<const std::uint16_t*>(static_cast<const std::uint8_t*>(lock.ptrDataRoi) + std::size_t(y) * lock.stride);
+        for (std::uint32_t x = 0; x < width; x += step) {
+            for (int c = 0; c < channels; ++c) {
+                ++histogram[row[std::size_t(x) * channels + c]];
+            }
+        }
+    }
+}
+
+std::vector<std::uint64_t> sample_histogram(
+    libCZI::ICZIReader* reader,
+    const libCZI::IDimCoordinate* planeCoord,
+    const libCZI::IntRect& roi,
+    std::size_t max_subblocks)
+{
+    // by minification, largest first; within a layer in directory order
+    std::vector<std::pair<double, int>> candidates;
+    reader->EnumSubset(planeCoord, &roi, false,
+        [&](int index, const libCZI::SubBlockInfo& info) -> bool {
+            if (info.physicalSize.w > 0) {
+                candidates.emplace_back(double(info.logicalRect.w) / info.physicalSize.w, index);
+            }
+            return true;
+        });
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const std::pair<double, int>& a, const std::pair<double, int>& b) { return a.first > b.first; });
+
+    std::vector<int> chosen;
+    for (std::size_t first = 0; first < candidates.size() && chosen.size() < max_subblocks;) {
+        std::size_t last = first;
+        while (last < candidates.size() && candidates[last].first == candidates[first].first) {
+            ++last;
+        }
+
+        const std::size_t wanted = std::min(last - first, max_subblocks - chosen.size());
+        for (std::size_t i = 0; i < wanted; ++i) {
+            chosen.push_back(candidates[first + i * (last - first) / wanted].second);
+        }
+        first = last;
+    }
+
+    std::vector<std::uint64_t> histogram(histogram_bins, 0);
+    for (const int index : chosen) {
+        add_to_histogram(reader->ReadSubBlock(index)->CreateBitmap(), histogram);
+    }
+    return histogram;
+}
+
+sample_window find_window(const std::vector<std::uint64_t>& histogram, double percentile)
+{
+    std::uint64_t total = 0;
+    for (const std::uint64_t count : histogram) {
+        total += count;
+    }
+
+    sample_window window;
+    if (total == 0) {
+        return window;
+    }
+
+    // the samples cut off at either end, at most; with no cut-off, the first and last non-empty bins
+    const std::uint64_t cut = std::uint64_t(std::floor(double(total) * std::clamp(percentile, 0.0, 50.0) / 100.0));
+    std::uint64_t below = 0;
+    std::size_t low = 0;
+    while (below + histogram[low] <= cut) {
+        below += histogram[low++];
+    }
+    std::uint64_t above = 0;
+    std::size_t high = histogram.size() - 1;
+    while (high > low && above + histogram[high] <= cut) {
+        above += histogram[high--];
+    }
+
+    // a single value (e.g. an empty slide) still needs a window of width 1
+    if (high <= low) {
+        if (low == histogram.size() - 1) {
+            --low;
+        }
+        high = low + 1;
+    }
+    window.low = std::uint16_t(low);
+    window.high = std::uint16_t(high);
+    return window;
+}
+
+std::vector<std::uint8_t> make_window_lut(const sample_window& window)
+{
+    std::vector<std::uint8_t> lut(histogram_bins);
+    const double range = double(window.high) - window.low;
+    for (std::size_t v = 0; v < lut.size(); ++v) {
+        if (v <= window.low) {
+            lut[v] = 0;
+        }
+        else if (v >= window.high) {
+            lut[v] = 255;
+        }
+        else {
+            lut[v] = std::uint8_t(std::lround((double(v) - window.low) * 255.0 / range));
+        }
+    }
+    return lut;
+}
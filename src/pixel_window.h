@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <libCZI.h>
+#include "pixel_swizzle.h"
+
+// Maps the samples of high-bit-depth slides (Gray16, Bgr48) to the 8 bits of the SVS. The window is taken from
+// the histogram of a sample of the slide's subblocks: from the darkest to the brightest value, or with a
+// percentile cut off at either end so that a few hot or dead pixels do not flatten the contrast. All channels
+// of Bgr48 share one window, which keeps the colour balance. Samples are mapped linearly within the window and
+// clamped outside of it, through a table with an entry per 16-bit value (c.f. pixel_layout).
+
+struct sample_window
+{
+    std::uint16_t low = 0;
+    std::uint16_t high = 65535;
+};
+
+// The pixel_type of a libCZI pixel type; false for the ones the converter cannot write (float, complex, Bgra32).
+bool to_pixel_type(libCZI::PixelType czi_type, pixel_type* type);
+
+// Adds the samples of a Gray16 or Bgr48 bitmap to 'histogram' (65536 bins). Large bitmaps are subsampled, taking
+// every n-th pixel of every n-th row so that about a quarter million pixels are counted.
+void add_to_histogram(const std::shared_ptr<libCZI::IBitmapData>& bitmap, std::vector<std::uint64_t>& histogram);
+
+// The histogram (65536 bins) of up to 'max_subblocks' subblocks of the plane within 'roi'. Subblocks of the
+// pyramid layers are preferred, as they cover the most area for the fewest pixels; of the layer that has more
+// subblocks than are still wanted, an evenly spread selection is taken.
+std::vector<std::uint64_t> sample_histogram(
+    libCZI::ICZIReader* reader,
+    const libCZI::IDimCoordinate* planeCoord,
+    const libCZI::IntRect& roi,
+    std::size_t max_subblocks);
+
+// The window cutting off 'percentile' percent of the samples at either end; 0 gives the minimum and maximum.
+sample_window find_window(const std::vector<std::uint64_t>& histogram, double percentile);
+
+// The table mapping every 16-bit value to 8 bits for 'window' (65536 entries).
+std::vector<std::uint8_t> make_window_lut(const sample_window& window);
@@ -0,0 +1,226 @@
+#include "pyramid_builder.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tbb/parallel_for.h>
+#include "jpeg_tile_encoder.h"
+
+namespace
+{
+    const int sample_per_pixels = 3;
+
+    // One output row of the 2x2 area average of rows 'upper' and 'lower'; an odd last column is dropped.
+    void downsample_row(const std::uint8_t* upper, const std::uint8_t* lower, std::uint8_t* dst, std::uint32_t dst_width)
+    {
+        for (std::uint32_t x = 0; x < dst_width; ++x) {
+            const std::uint8_t* a = upper + std::size_t(x) * 2 * sample_per_pixels;
+            const std::uint8_t* b = lower + std::size_t(x) * 2 * sample_per_pixels;
+            for (int c = 0; c < sample_per_pixels; ++c) {
+                const unsigned sum = unsigned(a[c]) + a[c + sample_per_pixels] + b[c] + b[c + sample_per_pixels];
+                dst[std::size_t(x) * sample_per_pixels + c] = std::uint8_t((sum + 2) >> 2);
+            }
+        }
+    }
+
+    // The spill file outgrows 2 GB for large slides, beyond what std::fseek takes on some platforms.
+    int seek(std::FILE* file, std::uint64_t offset)
+    {
+#if defined(_WIN32)
+        return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    }
+}
+
+pyramid_builder::pyramid_builder(
+    std::uint32_t base_width,
+    std::uint32_t base_height,
+    int level_count,
+    std::uint32_t tile_size,
+    int quality,
+    std::uint32_t thumbnail_width,
+    std::uint32_t thumbnail_height,
+    const jpeg_tile_format& format)
+    : base_width_(base_width),
+    base_height_(base_height),
+    tile_size_(tile_size),
+    quality_(quality),
+    format_(format),
+    thumbnail_width_(thumbnail_width),
+    thumbnail_height_(thumbnail_height)
+{
+    std::uint32_t w = base_width, h = base_height;
+    for (int i = 0; i < level_count && w / 2 > 0 && h / 2 > 0; ++i) {
+        w /= 2;
+        h /= 2;
+        level_state level;
+        level.width = w;
+        level.height = h;
+        level.tiles_across = (w + tile_size - 1) / tile_size;
+        level.spilled.resize(std::size_t(level.tiles_across) * ((h + tile_size - 1) / tile_size));
+        levels_.push_back(std::move(level));
+    }
+
+    thumbnail_src_width_ = levels_.empty() ? base_width : levels_.back().width;
+    thumbnail_src_height_ = levels_.empty() ? base_height : levels_.back().height;
+    thumbnail_sums_.assign(std::size_t(thumbnail_width) * thumbnail_height * sample_per_pixels, 0);
+    thumbnail_counts_.assign(std::size_t(thumbnail_width) * thumbnail_height, 0);
+}
+
+pyramid_builder::~pyramid_builder()
+{
+    if (spill_ != nullptr) {
+        std::fclose(spill_);
+    }
+}
+
+void pyramid_builder::use_native_level(std::size_t level)
+{
+    levels_[level].native = true;
+}
+
+pyramid_builder::block pyramid_builder::build_block(
+    std::uint32_t x,
+    std::uint32_t y,
+    std::uint32_t width,
+    std::uint32_t height,
+    const source& base,
+    const std::vector<source>& native) const
+{
+    block b;
+    b.x = x;
+    b.y = y;
+    b.width = width;
+    b.height = height;
+    b.tiles.resize(levels_.size());
+
+    // 'src' is the level above the current one; computed levels alternate between the two buffers
+    source src = base;
+    std::uint32_t src_w = width, src_h = height;
+    std::vector<std::uint8_t> above, pixels;
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+        const std::uint32_t w = src_w / 2, h = src_h / 2;
+        if (levels_[i].native) {
+            src = native[i];
+        }
+        else {
+            pixels.resize(std::size_t(w) * h * sample_per_pixels);
+            const std::size_t dst_stride = std::size_t(w) * sample_per_pixels;
+            std::uint8_t* dst = pixels.data();
+            if (src.layout.type == pixel_type::bgr24) {
+                tbb::parallel_for(std::uint32_t(0), h, [&](std::uint32_t r) {
+                    downsample_row(src.pixels + 2 * r * src.stride, src.pixels + (2 * r + 1) * src.stride, dst + r * dst_stride, w);
+                });
+            }
+            else {
+                tbb::parallel_for(std::uint32_t(0), h, [&](std::uint32_t r) {
+                    thread_local std::vector<std::uint8_t> rows;
+                    const std::size_t row_bytes = std::size_t(w) * 2 * sample_per_pixels;
+                    rows.resize(2 * row_bytes);
+                    convert_row(src.pixels + 2 * r * src.stride, src.layout, rows.data(), channel_order::bgr, w * 2);
+                    convert_row(src.pixels + (2 * r + 1) * src.stride, src.layout, rows.data() + row_bytes, channel_order::bgr, w * 2);
+                    downsample_row(rows.data(), rows.data() + row_bytes, dst + r * dst_stride, w);
+                });
+            }
+            above.swap(pixels);
+            src = source{ above.data(), dst_stride };
+        }
+
+        src_w = w;
+        src_h = h;
+        b.tiles[i] = encoder_
+            ? encoder_(src.pixels, w, h, src.stride, src.layout)
+            : encode_jpeg_tiles(src.pixels, w, h, src.stride, src.layout, tile_size_, tile_size_, quality_, format_);
+    }
+
+    const std::size_t row_bytes = std::size_t(src_w) * sample_per_pixels;
+    b.smallest.resize(row_bytes * src_h);
+    for (std::uint32_t r = 0; r < src_h; ++r) {
+        convert_row(src.pixels + r * src.stride, src.layout, b.smallest.data() + r * row_bytes, channel_order::bgr, src_w);
+    }
+    return b;
+}
+
+std::size_t pyramid_builder::level_tile_index(std::size_t level, const block& b, std::size_t t) const
+{
+    const std::uint32_t shift = std::uint32_t(level) + 1;
+    const std::uint32_t across = ((b.width >> shift) + tile_size_ - 1) / tile_size_;
+    const std::size_t first = std::size_t((b.y >> shift) / tile_size_) * levels_[level].tiles_across + (b.x >> shift) / tile_size_;
+    return first + (t / across) * levels_[level].tiles_across + t % across;
+}
+
+void pyramid_builder::add_block(const block& b)
+{
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+        level_state& lvl = levels_[i];
+        if (!b.tiles[i].empty() && spill_ == nullptr) {
+            spill_ = std::tmpfile();
+            if (spill_ == nullptr) {
+                throw std::runtime_error("pyramid_builder: cannot create the temporary file for the reduced levels");
+            }
+        }
+        for (std::size_t t = 0; t < b.tiles[i].size(); ++t) {
+            const std::vector<std::uint8_t>& tile = b.tiles[i][t];
+            if (std::fwrite(tile.data(), 1, tile.size(), spill_) != tile.size()) {
+                throw std::runtime_error("pyramid_builder: writing the temporary file failed");
+            }
+            spilled_tile& s = lvl.spilled[level_tile_index(i, b, t)];
+            s.offset = spill_size_;
+            s.size = std::uint32_t(tile.size());
+            spill_size_ += tile.size();
+        }
+    }
+
+    const std::uint32_t shift = std::uint32_t(levels_.size());
+    this->accumulate_thumbnail(b.smallest.data(), b.x >> shift, b.y >> shift, b.width >> shift, b.height >> shift);
+}
+
+void pyramid_builder::read_level_tile(std::size_t level, std::size_t index, std::vector<std::uint8_t>& out) const
+{
+    const spilled_tile& s = levels_[level].spilled[index];
+    out.resize(s.size);
+    if (spill_ == nullptr
+        || std::fflush(spill_) != 0
+        || seek(spill_, s.offset) != 0
+        || std::fread(out.data(), 1, s.size, spill_) != s.size
+        || seek(spill_, spill_size_) != 0) {
+        throw std::runtime_error("pyramid_builder: reading the temporary file failed");
+    }
+}
+
+// Box filter: every source pixel is added to the thumbnail pixel it falls into.
+void pyramid_builder::accumulate_thumbnail(const std::uint8_t* pixels, std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+{
+    if (thumbnail_width_ == 0 || thumbnail_height_ == 0) {
+        return;
+    }
+
+    for (std::uint32_t r = 0; r < height && y + r < thumbnail_src_height_; ++r) {
+        const std::uint8_t* src = pixels + std::size_t(r) * width * sample_per_pixels;
+        const std::size_t ty = std::size_t(y + r) * thumbnail_height_ / thumbnail_src_height_;
+        for (std::uint32_t c = 0; c < width && x + c < thumbnail_src_width_; ++c) {
+            const std::size_t tx = std::size_t(x + c) * thumbnail_width_ / thumbnail_src_width_;
+            const std::size_t bin = ty * thumbnail_width_ + tx;
+            for (int s = 0; s < sample_per_pixels; ++s) {
+                thumbnail_sums_[bin * sample_per_pixels + s] += src[std::size_t(c) * sample_per_pixels + s];
+            }
+            ++thumbnail_counts_[bin];
+        }
+    }
+}
+
+void pyramid_builder::finish()
+{
+    thumbnail_.assign(thumbnail_sums_.size(), 0);
+    for (std::size_t bin = 0; bin < thumbnail_counts_.size(); ++bin) {
+        const std::uint32_t n = thumbnail_counts_[bin];
+        if (n == 0) {
+            continue;
+        }
+        // the sums are in Bgr24 order
+        for (int c = 0; c < sample_per_pixels; ++c) {
+            thumbnail_[bin * sample_per_pixels + (sample_per_pixels - 1 - c)] = static_cast<unsigned char>((thumbnail_sums_[bin * sample_per_pixels + c] + n / 2) / n);
+        }
+    }
+}
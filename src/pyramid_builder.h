@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "jpeg_tile_encoder.h"
+#include "pixel_swizzle.h"
+
+// Builds the reduced SVS levels and the thumbnail from the base level while the base level is written.
+//
+// Each level is the 2x2 area average of the level above (dimensions rounded down, like the scaling accessor's
+// CalcSize), which anti-aliases where the accessor's nearest-neighbour zoom would sparkle. The base level is
+// consumed in square blocks of block_size() = tile size << level count pixels. A block's origin is then
+// tile-aligned on every level, so each block yields complete tiles of all levels and needs nothing from its
+// neighbours: the CZI is decoded once per conversion, and memory does not depend on the slide's size.
+// The encoded tiles of the reduced levels are spilled to a temporary file until their IFDs are written
+// after the base IFD, unless the caller writes them as the blocks are built (c.f. level_tile_index).
+//
+// A level can instead be marked as native (use_native_level) when the CZI already holds a pyramid layer of
+// that resolution. The caller then supplies its pixels with each block, and the levels below it are computed
+// from those rather than from the base level.
+//
+// The tiles are JPEG-encoded for the SVS unless the caller supplies its own encoder (set_tile_encoder), e.g. for
+// the chunks of a Zarr store.
+//
+// The builder works on libCZI's Bgr24 pixels as they are; they are only turned into RGB when copied into the
+// JPEG tile buffers (and for the thumbnail, which is box-filtered from the smallest level). Base and native
+// pixels of other types (gray, 16-bit) are converted to Bgr24 row by row as the level below is computed.
+class pyramid_builder
+{
+public:
+    pyramid_builder(
+        std::uint32_t base_width,
+        std::uint32_t base_height,
+        int level_count,
+        std::uint32_t tile_size,
+        int quality,
+        std::uint32_t thumbnail_width,
+        std::uint32_t thumbnail_height,
+        const jpeg_tile_format& format = {});
+    ~pyramid_builder();
+
+    pyramid_builder(const pyramid_builder&) = delete;
+    pyramid_builder& operator=(const pyramid_builder&) = delete;
+
+    // Marks 'level' (0 = half the base resolution) as supplied by the caller; must be called before any block is built.
+    void use_native_level(std::size_t level);
+    bool is_native_level(std::size_t level) const { return levels_[level].native; }
+
+    // False if nothing is built from the base pixels (the first level is native), so they need not be composed.
+    bool needs_base_pixels() const { return levels_.empty() || !levels_[0].native; }
+
+    // Encodes the tiles covering an image with rows 'stride' bytes apart, in row-major tile order (c.f. encode_jpeg_tiles).
+    using tile_encoder = std::function<std::vector<std::vector<std::uint8_t>>(
+        const std::uint8_t* pixels, std::uint32_t width, std::uint32_t height, std::size_t stride, const pixel_layout& layout)>;
+
+    // Encodes the reduced levels' tiles with 'encoder' instead of as JPEG with the quality and format given to the
+    // constructor; must be called before any block is built.
+    void set_tile_encoder(tile_encoder encoder) { encoder_ = std::move(encoder); }
+
+    // Edge length of the base-level blocks. Blocks have to tile the base level: their origin a multiple of
+    // block_size(), and their extent too unless the block reaches the image's edge.
+    std::uint32_t block_size() const { return tile_size_ << levels_.size(); }
+
+    // The colour format the reduced levels' tiles are encoded in; their IFDs have to declare it.
+    const jpeg_tile_format& format() const { return format_; }
+
+    // Pixels with rows 'stride' bytes apart, e.g. a locked libCZI bitmap.
+    struct source
+    {
+        const std::uint8_t* pixels = nullptr;
+        std::size_t stride = 0;
+        pixel_layout layout = channel_order::bgr;
+    };
+
+    // The reduced levels of one block: the encoded tiles of every level and the smallest level's pixels.
+    struct block
+    {
+        std::uint32_t x = 0;
+        std::uint32_t y = 0;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::vector<std::vector<std::vector<std::uint8_t>>> tiles;     // per level, row-major within the block
+        std::vector<std::uint8_t> smallest;     // Bgr24, no row padding
+    };
+
+    // Computes and encodes the reduced levels of the base block at 'x'/'y'. 'native' holds, per level, the
+    // caller's pixels of native levels (the block's extent shifted right by level + 1) and null pixels
+    // otherwise; 'base' may be null if !needs_base_pixels().
+    // Safe to call concurrently for different blocks.
+    block build_block(
+        std::uint32_t x,
+        std::uint32_t y,
+        std::uint32_t width,
+        std::uint32_t height,
+        const source& base,
+        const std::vector<source>& native) const;
+
+    // Spills a built block's tiles and adds it to the thumbnail. Not thread-safe. A level whose tiles the caller
+    // has taken out of the block (written elsewhere) is not spilled; read_level_tile cannot return its tiles.
+    void add_block(const block& b);
+
+    // Completes the thumbnail once every block was added.
+    void finish();
+
+    std::size_t level_count() const { return levels_.size(); }
+    std::uint32_t level_width(std::size_t level) const { return levels_[level].width; }
+    std::uint32_t level_height(std::size_t level) const { return levels_[level].height; }
+    std::size_t level_tile_count(std::size_t level) const { return levels_[level].spilled.size(); }
+
+    // The index (row-major within the level) of tile 't' of 'level' in a built block.
+    std::size_t level_tile_index(std::size_t level, const block& b, std::size_t t) const;
+
+    // Reads back tile 'index' (row-major) of 'level', an abbreviated JPEG stream (c.f. jpeg_tile_encoder) unless
+    // a tile encoder was set.
+    void read_level_tile(std::size_t level, std::size_t index, std::vector<std::uint8_t>& out) const;
+
+    std::uint32_t thumbnail_width() const { return thumbnail_width_; }
+    std::uint32_t thumbnail_height() const { return thumbnail_height_; }
+    const std::vector<unsigned char>& thumbnail() const { return thumbnail_; }     // RGB
+
+private:
+    struct spilled_tile
+    {
+        std::uint64_t offset = 0;
+        std::uint32_t size = 0;
+    };
+
+    struct level_state
+    {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t tiles_across = 0;
+        bool native = false;
+        std::vector<spilled_tile> spilled;
+    };
+
+    void accumulate_thumbnail(const std::uint8_t* pixels, std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height);
+
+    std::uint32_t base_width_;
+    std::uint32_t base_height_;
+    std::uint32_t tile_size_;
+    int quality_;
+    jpeg_tile_format format_;
+    tile_encoder encoder_;
+    std::vector<level_state> levels_;
+
+    std::FILE* spill_ = nullptr;
+    std::uint64_t spill_size_ = 0;
+
+    std::uint32_t thumbnail_width_;
+    std::uint32_t thumbnail_height_;
+    std::uint32_t thumbnail_src_width_ = 0;
+    std::uint32_t thumbnail_src_height_ = 0;
+    std::vector<std::uint32_t> thumbnail_sums_;
+    std::vector<std::uint32_t> thumbnail_counts_;
+    std::vector<unsigned char> thumbnail_;
+};
@@ -0,0 +1,238 @@
+#include "subblock_prefetcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+    // Neighbouring subblocks are read as one chunk if no more than this lies between them...
+    constexpr std::uint64_t max_gap = 256 << 10;
+    // ... and the chunk stays below this size.
+    constexpr std::uint64_t max_chunk_size = 8 << 20;
+    // A subblock taken to be larger than this (because of other segments up to the next one) is not prefetched.
+    constexpr std::uint64_t max_subblock_size = 64 << 20;
+}
+
+subblock_prefetcher::subblock_prefetcher(std::shared_ptr<libCZI::IStream> stream, std::uint64_t ahead_bytes, int reader_threads)
+    : stream_(std::move(stream)), ahead_bytes_(ahead_bytes), reader_threads_(std::max(reader_threads, 1))
+{
+}
+
+subblock_prefetcher::~subblock_prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void subblock_prefetcher::plan(
+    libCZI::ICZIReader* reader,
+    const libCZI::IntRect& roi,
+    const std::vector<const libCZI::IDimCoordinate*>& planes,
+    std::uint32_t block_w,
+    std::uint32_t block_h,
+    bool pyramid_layers,
+    std::uint32_t margin)
+{
+    // the extent of each subblock in the file, up to the next one
+    std::vector<std::pair<std::uint64_t, int>> positions;
+    reader->EnumerateSubBlocksEx(
+        [&](int index, const libCZI::DirectorySubBlockInfo& info) -> bool {
+            positions.emplace_back(info.filePosition, index);
+            return true;
+        });
+    std::sort(positions.begin(), positions.end());
+    int subblock_count = 0;
+    for (const auto& position : positions) {
+        subblock_count = std::max(subblock_count, position.second + 1);
+    }
+    std::vector<std::uint64_t> offset(std::size_t(subblock_count), 0), size(std::size_t(subblock_count), 0);
+    for (std::size_t i = 0; i + 1 < positions.size(); ++i) {
+        const std::uint64_t extent = positions[i + 1].first - positions[i].first;
+        if (extent <= max_subblock_size) {
+            offset[std::size_t(positions[i].second)] = positions[i].first;
+            size[std::size_t(positions[i].second)] = extent;
+        }
+    }
+
+    // the ranges of each block's subblocks not read by an earlier block, coalesced into chunks
+    std::vector<chunk> chunks;
+    std::vector<bool> planned(std::size_t(subblock_count), false);
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+    std::int64_t block = 0;
+    for (std::uint32_t y = 0; y < std::uint32_t(roi.h); y += block_h) {
+        for (std::uint32_t x = 0; x < std::uint32_t(roi.w); x += block_w, ++block) {
+            const std::uint32_t x0 = x - std::min(margin, x), y0 = y - std::min(margin, y);
+            const std::uint32_t x1 = std::min(x + block_w + margin, std::uint32_t(roi.w)), y1 = std::min(y + block_h + margin, std::uint32_t(roi.h));
+            const libCZI::IntRect rect{ roi.x + int(x0), roi.y + int(y0), int(x1 - x0), int(y1 - y0) };
+            ranges.clear();
+            for (const libCZI::IDimCoordinate* plane : planes) {
+                reader->EnumSubset(plane, &rect, !pyramid_layers,
+                    [&](int index, const libCZI::SubBlockInfo&) -> bool {
+                        const std::size_t i = std::size_t(index);
+                        if (i < planned.size() && !planned[i] && size[i] > 0) {
+                            planned[i] = true;
+                            ranges.emplace_back(offset[i], size[i]);
+                        }
+                        return true;
+                    });
+            }
+            std::sort(ranges.begin(), ranges.end());
+
+            for (const auto& range : ranges) {
+                chunk* last = chunks.empty() ? nullptr : &chunks.back();
+                if (last != nullptr && range.first >= last->offset + last->size
+                    && range.first - (last->offset + last->size) <= max_gap
+                    && range.first + range.second - last->offset <= max_chunk_size) {
+                    last->size = range.first + range.second - last->offset;
+                    last->last_block = block;
+                    continue;
+                }
+                chunk c;
+                c.offset = range.first;
+                c.size = range.second;
+                c.last_block = block;
+                chunks.push_back(std::move(c));
+            }
+        }
+    }
+
+    std::vector<std::size_t> by_offset(chunks.size());
+    for (std::size_t i = 0; i < by_offset.size(); ++i) {
+        by_offset[i] = i;
+    }
+    std::sort(by_offset.begin(), by_offset.end(),
+        [&chunks](std::size_t a, std::size_t b) { return chunks[a].offset < chunks[b].offset; });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        chunks_ = std::move(chunks);
+        by_offset_ = std::move(by_offset);
+        stats_.chunks = chunks_.size();
+    }
+    if (threads_.empty()) {
+        for (int i = 0; i < reader_threads_; ++i) {
+            threads_.emplace_back([this]() { read_ahead(); });
+        }
+    }
+}
+
+void subblock_prefetcher::block_done(std::size_t block)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_through_ = std::int64_t(block);
+    for (std::size_t i = first_held_; i < next_chunk_; ++i) {
+        // a chunk being read is freed by its reader thread when done
+        if (chunks_[i].state == chunk_state::ready && chunks_[i].last_block <= done_through_) {
+            free_chunk(chunks_[i]);
+        }
+    }
+    while (first_held_ < next_chunk_ && chunks_[first_held_].state == chunk_state::freed) {
+        ++first_held_;
+    }
+    changed_.notify_all();
+}
+
+subblock_prefetcher::statistics subblock_prefetcher::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void subblock_prefetcher::Read(std::uint64_t offset, void* pv, std::uint64_t size, std::uint64_t* ptrBytesRead)
+{
+    std::shared_ptr<std::uint8_t> data;
+    std::uint64_t chunk_offset = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto next = std::upper_bound(by_offset_.begin(), by_offset_.end(), offset,
+            [this](std::uint64_t value, std::size_t i) { return value < chunks_[i].offset; });
+        if (next != by_offset_.begin()) {
+            chunk& c = chunks_[*std::prev(next)];
+            if (offset + size <= c.offset + c.size) {
+                if (c.state == chunk_state::reading) {
+                    ++stats_.waits;
+                    changed_.wait(lock, [&c]() { return c.state != chunk_state::reading; });
+                }
+                else if (c.state == chunk_state::ready) {
+                    ++stats_.hits;
+                }
+                if (c.state == chunk_state::ready) {
+                    data = c.data;
+                    chunk_offset = c.offset;
+                }
+                else {
+                    ++stats_.misses;
+                }
+            }
+        }
+    }
+
+    if (!data) {
+        stream_->Read(offset, pv, size, ptrBytesRead);
+        return;
+    }
+
+    std::memcpy(pv, data.get() + (offset - chunk_offset), std::size_t(size));
+    if (ptrBytesRead != nullptr) {
+        *ptrBytesRead = size;
+    }
+}
+
+void subblock_prefetcher::read_ahead()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        changed_.wait(lock, [this]() {
+            return stop_ || (next_chunk_ < chunks_.size()
+                && (held_bytes_ == 0 || held_bytes_ + chunks_[next_chunk_].size <= ahead_bytes_));
+        });
+        if (stop_) {
+            return;
+        }
+
+        chunk& c = chunks_[next_chunk_++];
+        if (c.last_block <= done_through_) {
+            // the pipeline got there first
+            c.state = chunk_state::freed;
+            continue;
+        }
+        c.state = chunk_state::reading;
+        held_bytes_ += c.size;
+        lock.unlock();
+
+        // not value-initialized, the read overwrites it anyway
+        std::shared_ptr<std::uint8_t> data(new std::uint8_t[std::size_t(c.size)], std::default_delete<std::uint8_t[]>());
+        std::uint64_t bytes_read = 0;
+        try {
+            stream_->Read(c.offset, data.get(), c.size, &bytes_read);
+        }
+        catch (...) {
+            // the pipeline's own read of the data reports the error
+            bytes_read = 0;
+        }
+
+        lock.lock();
+        if (bytes_read == c.size && c.last_block > done_through_) {
+            c.data = std::move(data);
+            c.state = chunk_state::ready;
+            stats_.prefetched_bytes += c.size;
+        }
+        else {
+            free_chunk(c);
+        }
+        changed_.notify_all();
+    }
+}
+
+void subblock_prefetcher::free_chunk(chunk& c)
+{
+    c.data.reset();
+    c.state = chunk_state::freed;
+    held_bytes_ -= c.size;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <libCZI.h>
+
+// Reads the subblocks of the base-level blocks ahead of the pipeline, so that the accessors find their data in
+// memory instead of waiting for a blocking read each. It sits between the reader and the file as its stream.
+//
+// Since the blocks are composed in row-major order, the directory tells in advance which subblocks each block
+// reads. plan() lists the file ranges of the subblocks in that order (a subblock with the first block reading
+// it), sorts each block's ranges by file position and coalesces neighbouring ones into chunks of up to a few MB.
+// A pool of reader threads then reads the chunks in plan order while they fit into 'ahead_bytes', and block_done()
+// frees the chunks of the blocks that are done. A read the chunks cannot serve (it is outside the plan, its chunk
+// is not read yet or was freed already) goes to the file directly, so the prefetcher only changes timing.
+//
+// The directory has no segment sizes, so a subblock is taken to extend to the next subblock in the file. The last
+// one in the file is not prefetched.
+class subblock_prefetcher : public libCZI::IStream
+{
+public:
+    struct statistics
+    {
+        std::uint64_t chunks = 0;           // chunks planned
+        std::uint64_t prefetched_bytes = 0; // ... and the bytes read ahead for them
+        std::uint64_t hits = 0;             // reads served from a chunk that was ready
+        std::uint64_t waits = 0;            // ... from a chunk that was being read, waiting for it
+        std::uint64_t misses = 0;           // reads inside the plan which went to the file
+    };
+
+    // 'stream' must allow concurrent reads (as the file streams of libCZI do).
+    subblock_prefetcher(std::shared_ptr<libCZI::IStream> stream, std::uint64_t ahead_bytes, int reader_threads = 4);
+    ~subblock_prefetcher() override;
+
+    // Plans the reads of 'roi' in blocks of 'block_w' x 'block_h' pixels, laid out from its top left in row-major
+    // order and composed of the subblocks of 'planes' with 'margin' pixels around them within the ROI, and starts
+    // reading ahead. With 'pyramid_layers' the subblocks of the pyramid layers are included.
+    void plan(
+        libCZI::ICZIReader* reader,
+        const libCZI::IntRect& roi,
+        const std::vector<const libCZI::IDimCoordinate*>& planes,
+        std::uint32_t block_w,
+        std::uint32_t block_h,
+        bool pyramid_layers,
+        std::uint32_t margin = 0);
+
+    // To be called for every block in row-major order (0, 1, ...) once it is composed.
+    void block_done(std::size_t block);
+
+    statistics stats() const;
+
+    void Read(std::uint64_t offset, void* pv, std::uint64_t size, std::uint64_t* ptrBytesRead) override;
+
+private:
+    enum class chunk_state { planned, reading, ready, freed };
+
+    struct chunk
+    {
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+        std::int64_t last_block = 0;                    // freed once this block is done: the last to first read one of its subblocks
+        chunk_state state = chunk_state::planned;
+        std::shared_ptr<std::uint8_t> data;
+    };
+
+    void read_ahead();
+    void free_chunk(chunk& c);
+
+    std::shared_ptr<libCZI::IStream> stream_;
+    std::uint64_t ahead_bytes_;
+    int reader_threads_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;                          // guards the members below
+    std::condition_variable changed_;
+    std::vector<chunk> chunks_;                         // in plan order
+    std::vector<std::size_t> by_offset_;                // indices into chunks_, sorted by file position
+    std::size_t next_chunk_ = 0;                        // the next chunk to read ahead
+    std::size_t first_held_ = 0;                        // chunks before it are freed
+    std::int64_t done_through_ = -1;
+    std::uint64_t held_bytes_ = 0;
+    bool stop_ = false;
+    statistics stats_;
+};
@@ -0,0 +1,425 @@
+#include "svs_writer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const std::uint16_t type_short = 3;
+    const std::uint16_t type_long = 4;
+    const std::uint16_t type_long8 = 16;
+
+    std::size_t type_size(std::uint16_t type)
+    {
+        switch (type) {
+        case 3: case 8:                 // SHORT, SSHORT
+            return 2;
+        case 4: case 9: case 11: case 13:  // LONG, SLONG, FLOAT, IFD
+            return 4;
+        case 5: case 10: case 12: case 16: case 17: case 18:   // RATIONAL, SRATIONAL, DOUBLE, LONG8, SLONG8, IFD8
+            return 8;
+        default:                        // BYTE, ASCII, SBYTE, UNDEFINED
+            return 1;
+        }
+    }
+
+    template <typename T>
+    T load(const std::uint8_t* p)
+    {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void store(std::uint8_t* p, T value)
+    {
+        std::memcpy(p, &value, sizeof(T));
+    }
+
+    std::vector<std::uint64_t> entry_values(std::uint16_t type, std::uint64_t count, const std::vector<std::uint8_t>& value)
+    {
+        std::vector<std::uint64_t> values(count);
+        for (std::uint64_t i = 0; i < count; ++i) {
+            const std::uint8_t* p = value.data() + i * type_size(type);
+            values[i] = type == type_short ? load<std::uint16_t>(p) : type == type_long ? load<std::uint32_t>(p) : load<std::uint64_t>(p);
+        }
+        return values;
+    }
+
+    // The type libtiff (4.5) gives the TileByteCounts of a BigTIFF: LONG8 for a single tile, otherwise SHORT or
+    // LONG if the tile size makes sure the counts fit, assuming compressed tiles are at most 10 times the size of
+    // the raw ones.
+    std::uint16_t tile_byte_counts_type(TIFF* tif, std::uint64_t count)
+    {
+        const std::uint64_t tile_size = std::uint64_t(TIFFTileSize64(tif));
+        std::uint16_t compression = COMPRESSION_NONE;
+        TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+        auto exceeds = [&](std::uint64_t threshold) {
+            switch (compression) {
+            case COMPRESSION_NONE:
+                return tile_size > threshold;
+            case COMPRESSION_JPEG: case COMPRESSION_LZW: case COMPRESSION_ADOBE_DEFLATE: case COMPRESSION_DEFLATE:
+            case COMPRESSION_LZMA: case COMPRESSION_ZSTD: case COMPRESSION_WEBP:
+                return tile_size >= threshold / 10;
+            default:
+                return true;
+            }
+        };
+        if (count <= 1 || exceeds(0xffffffff)) {
+            return type_long8;
+        }
+        return exceeds(0xffff) ? type_long : type_short;
+    }
+
+    // The entry's value as 'type' (the one libtiff chose), or as LONG8 if a value does not fit.
+    void set_entry_values(std::uint16_t& type, std::uint64_t& count, std::vector<std::uint8_t>& value, const std::vector<std::uint64_t>& values)
+    {
+        const std::uint64_t largest = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+        if ((type == type_short && largest > 0xffff) || (type == type_long && largest > 0xffffffff) || (type != type_short && type != type_long)) {
+            type = type_long8;
+        }
+        count = values.size();
+        value.assign(values.size() * type_size(type), 0);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            std::uint8_t* p = value.data() + i * type_size(type);
+            if (type == type_short) {
+                store(p, std::uint16_t(values[i]));
+            }
+            else if (type == type_long) {
+                store(p, std::uint32_t(values[i]));
+            }
+            else {
+                store(p, values[i]);
+            }
+        }
+    }
+}
+
+// A BigTIFF in a growing buffer, for libtiff to serialise one IFD (and its strips) into.
+class svs_writer::memory_tiff
+{
+public:
+    memory_tiff()
+    {
+        tif_ = TIFFClientOpen("svs_writer", "w8", this, &read, &write, &seek, &close, &size, &map, &unmap);
+        if (tif_ == nullptr) {
+            throw std::runtime_error("cannot set up an in-memory TIFF");
+        }
+    }
+
+    ~memory_tiff()
+    {
+        if (tif_ != nullptr) {
+            TIFFClose(tif_);
+        }
+    }
+
+    TIFF* tif() const { return tif_; }
+
+    // Writes the directory and closes the handle; returns the file libtiff wrote.
+    const std::vector<std::uint8_t>& finish()
+    {
+        if (!TIFFWriteDirectory(tif_)) {
+            throw std::runtime_error("libtiff cannot write the IFD's tags");
+        }
+        TIFFClose(tif_);
+        tif_ = nullptr;
+        return data_;
+    }
+
+private:
+    static memory_tiff* self(thandle_t handle) { return static_cast<memory_tiff*>(handle); }
+
+    static tmsize_t read(thandle_t handle, void* buffer, tmsize_t size)
+    {
+        memory_tiff* m = self(handle);
+        const std::uint64_t n = m->position_ < m->data_.size() ? std::min<std::uint64_t>(std::uint64_t(size), m->data_.size() - m->position_) : 0;
+        std::memcpy(buffer, m->data_.data() + m->position_, std::size_t(n));
+        m->position_ += n;
+        return tmsize_t(n);
+    }
+
+    static tmsize_t write(thandle_t handle, void* buffer, tmsize_t size)
+    {
+        memory_tiff* m = self(handle);
+        if (m->position_ + std::uint64_t(size) > m->data_.size()) {
+            m->data_.resize(std::size_t(m->position_ + std::uint64_t(size)));
+        }
+        std::memcpy(m->data_.data() + m->position_, buffer, std::size_t(size));
+        m->position_ += std::uint64_t(size);
+        return size;
+    }
+
+    static toff_t seek(thandle_t handle, toff_t offset, int whence)
+    {
+        memory_tiff* m = self(handle);
+        m->position_ = whence == SEEK_SET ? offset : whence == SEEK_CUR ? m->position_ + offset : m->data_.size() + offset;
+        return m->position_;
+    }
+
+    static int close(thandle_t) { return 0; }
+    static toff_t size(thandle_t handle) { return self(handle)->data_.size(); }
+    static int map(thandle_t, void**, toff_t*) { return 0; }
+    static void unmap(thandle_t, void*, toff_t) {}
+
+    TIFF* tif_ = nullptr;
+    std::vector<std::uint8_t> data_;
+    std::uint64_t position_ = 0;
+};
+
+svs_writer::svs_writer(const std::string& path) : path_(path), end_(16)
+{
+#if defined(_WIN32)
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        file_ = file;
+    }
+    if (file_ == nullptr) {
+        throw std::runtime_error("cannot create " + path);
+    }
+#else
+    file_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_ < 0) {
+        throw std::runtime_error("cannot create " + path);
+    }
+#endif
+}
+
+svs_writer::~svs_writer()
+{
+#if defined(_WIN32)
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+    }
+#else
+    if (file_ >= 0) {
+        ::close(file_);
+    }
+#endif
+}
+
+std::size_t svs_writer::add_ifd()
+{
+    std::lock_guard<std::mutex> lock(ifds_mutex_);
+    ifds_.emplace_back();
+    ifds_.back().memory = std::make_unique<memory_tiff>();
+    return ifds_.size() - 1;
+}
+
+svs_writer::ifd_state& svs_writer::state(std::size_t ifd)
+{
+    std::lock_guard<std::mutex> lock(ifds_mutex_);
+    return ifds_.at(ifd);
+}
+
+TIFF* svs_writer::tags(std::size_t ifd)
+{
+    return state(ifd).memory->tif();
+}
+
+void svs_writer::write_tile(std::size_t ifd, std::uint32_t tile, const std::vector<std::uint8_t>& bytes)
+{
+    ifd_state& s = state(ifd);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.offsets.empty()) {
+            s.offsets.resize(TIFFNumberOfTiles(s.memory->tif()));
+            s.byte_counts.resize(s.offsets.size());
+        }
+        if (tile >= s.offsets.size()) {
+            throw std::out_of_range("tile " + std::to_string(tile) + " is outside the IFD");
+        }
+        if (const tile_dedup::location* earlier = s.dedup.find(bytes)) {
+            s.offsets[tile] = earlier->offset;
+            s.byte_counts[tile] = earlier->size;
+            return;
+        }
+    }
+
+    // two identical tiles written at the same time both get written, which costs only a few bytes
+    const std::uint64_t offset = append(bytes.data(), bytes.size());
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.offsets[tile] = offset;
+    s.byte_counts[tile] = bytes.size();
+    if (s.dedup.wants(bytes)) {
+        s.dedup.add(bytes, tile_dedup::location{ offset, bytes.size() });
+    }
+}
+
+std::size_t svs_writer::end_ifd(std::size_t ifd)
+{
+    ifd_state& s = state(ifd);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const bool tiled = TIFFIsTiled(s.memory->tif()) != 0;
+    if (tiled && s.offsets.empty()) {
+        s.offsets.resize(TIFFNumberOfTiles(s.memory->tif()));
+        s.byte_counts.resize(s.offsets.size());
+    }
+    // libtiff leaves out the tile arrays if no tile went through it; then they get the types it would have used
+    const std::uint16_t byte_counts_type = tiled ? tile_byte_counts_type(s.memory->tif(), s.offsets.size()) : type_long;
+    const std::vector<std::uint8_t>& file = s.memory->finish();
+
+    const std::uint8_t* header = file.data();
+    if (byte_order_[0] == 0) {
+        byte_order_[0] = header[0];
+        byte_order_[1] = header[1];
+    }
+    const std::uint8_t* directory = file.data() + load<std::uint64_t>(header + 8);
+    const std::uint64_t count = load<std::uint64_t>(directory);
+    std::vector<std::uint64_t> strip_offsets, strip_byte_counts;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        const std::uint8_t* p = directory + 8 + i * 20;
+        entry e;
+        e.tag = load<std::uint16_t>(p);
+        e.type = load<std::uint16_t>(p + 2);
+        e.count = load<std::uint64_t>(p + 4);
+        const std::size_t bytes = std::size_t(e.count * type_size(e.type));
+        const std::uint8_t* value = bytes <= 8 ? p + 12 : file.data() + load<std::uint64_t>(p + 12);
+        e.value.assign(value, value + bytes);
+        if (e.tag == TIFFTAG_STRIPOFFSETS) {
+            strip_offsets = entry_values(e.type, e.count, e.value);
+        }
+        else if (e.tag == TIFFTAG_STRIPBYTECOUNTS) {
+            strip_byte_counts = entry_values(e.type, e.count, e.value);
+        }
+        s.entries.push_back(std::move(e));
+    }
+
+    if (!tiled) {
+        // the strips libtiff encoded into memory move to the file
+        s.offsets.resize(strip_offsets.size());
+        s.byte_counts = strip_byte_counts;
+        for (std::size_t i = 0; i < strip_offsets.size() && i < strip_byte_counts.size(); ++i) {
+            if (strip_byte_counts[i] != 0) {
+                s.offsets[i] = append(file.data() + strip_offsets[i], std::size_t(strip_byte_counts[i]));
+            }
+        }
+    }
+    s.memory.reset();
+
+    const std::uint16_t offsets_tag = tiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS;
+    const std::uint16_t byte_counts_tag = tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS;
+    for (std::uint16_t tag : { offsets_tag, byte_counts_tag }) {
+        auto it = std::find_if(s.entries.begin(), s.entries.end(), [tag](const entry& e) { return e.tag >= tag; });
+        if (it == s.entries.end() || it->tag != tag) {
+            entry e;
+            e.tag = tag;
+            e.type = tag == offsets_tag ? type_long8 : byte_counts_type;
+            it = s.entries.insert(it, std::move(e));
+        }
+        set_entry_values(it->type, it->count, it->value, tag == offsets_tag ? s.offsets : s.byte_counts);
+    }
+    return s.dedup.shared_count();
+}
+
+void svs_writer::close()
+{
+    std::lock_guard<std::mutex> lock(ifds_mutex_);
+    if (ifds_.empty()) {
+        throw std::logic_error("an SVS needs at least one IFD");
+    }
+
+    // the IFDs go after all the data, each followed by its values that do not fit into their entries
+    auto even = [](std::uint64_t n) { return (n + 1) & ~std::uint64_t(1); };
+    std::vector<std::uint64_t> ifd_offsets;
+    std::uint64_t size = 0;
+    for (const ifd_state& s : ifds_) {
+        if (s.memory) {
+            throw std::logic_error("an IFD has not ended");
+        }
+        ifd_offsets.push_back(size);
+        size += 8 + s.entries.size() * 20 + 8;
+        for (const entry& e : s.entries) {
+            if (e.value.size() > 8) {
+                size += even(e.value.size());
+            }
+        }
+    }
+    const std::uint64_t start = even(end_.fetch_add(size + 1));
+
+    std::vector<std::uint8_t> block(std::size_t(size), 0);
+    for (std::size_t i = 0; i < ifds_.size(); ++i) {
+        const ifd_state& s = ifds_[i];
+        std::uint8_t* ifd = block.data() + ifd_offsets[i];
+        std::uint64_t values = ifd_offsets[i] + 8 + s.entries.size() * 20 + 8;
+        store(ifd, std::uint64_t(s.entries.size()));
+        for (std::size_t j = 0; j < s.entries.size(); ++j) {
+            const entry& e = s.entries[j];
+            std::uint8_t* p = ifd + 8 + j * 20;
+            store(p, e.tag);
+            store(p + 2, e.type);
+            store(p + 4, e.count);
+            if (e.value.size() <= 8) {
+                std::copy(e.value.begin(), e.value.end(), p + 12);
+            }
+            else {
+                store(p + 12, start + values);
+                std::copy(e.value.begin(), e.value.end(), block.data() + values);
+                values += even(e.value.size());
+            }
+        }
+        store(ifd + 8 + s.entries.size() * 20, i + 1 < ifds_.size() ? start + ifd_offsets[i + 1] : std::uint64_t(0));
+    }
+    write_at(start, block.data(), block.size());
+
+    std::uint8_t header[16] = { byte_order_[0], byte_order_[1] };
+    store(header + 2, std::uint16_t(43));
+    store(header + 4, std::uint16_t(8));
+    store(header + 6, std::uint16_t(0));
+    store(header + 8, start);
+    write_at(0, header, sizeof(header));
+
+#if defined(_WIN32)
+    const bool closed = CloseHandle(file_) != 0;
+    file_ = nullptr;
+#else
+    const bool closed = ::close(file_) == 0;
+    file_ = -1;
+#endif
+    if (!closed) {
+        throw std::runtime_error("cannot write " + path_);
+    }
+}
+
+std::uint64_t svs_writer::append(const std::uint8_t* data, std::size_t size)
+{
+    const std::uint64_t offset = end_.fetch_add(size);
+    write_at(offset, data, size);
+    return offset;
+}
+
+void svs_writer::write_at(std::uint64_t offset, const std::uint8_t* data, std::size_t size)
+{
+    while (size > 0) {
+#if defined(_WIN32)
+        OVERLAPPED at = {};
+        at.Offset = DWORD(offset);
+        at.OffsetHigh = DWORD(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(file_, data, DWORD(std::min<std::size_t>(size, 1u << 30)), &written, &at) || written == 0) {
+            throw std::runtime_error("cannot write " + path_);
+        }
+#else
+        const ssize_t written = ::pwrite(file_, data, size, off_t(offset));
+        if (written <= 0) {
+            throw std::runtime_error("cannot write " + path_);
+        }
+#endif
+        offset += std::uint64_t(written);
+        data += written;
+        size -= std::size_t(written);
+    }
+}
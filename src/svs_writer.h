@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <tiffio.h>
+#include "tile_dedup.h"
+
+// Writes an SVS (a BigTIFF) without serialising the tile data through libtiff: every chunk of data gets its place
+// by atomically reserving the next bytes of the file and is written there with a positional write (pwrite, or
+// WriteFile at an offset on Windows), so the encoder threads can write their tiles concurrently, into any of the
+// IFDs. The IFDs themselves, with the tile offsets and byte counts they have collected, are written at the end
+// by close() in the order they were added, and the header pointing at the first one last.
+//
+// The tags are not composed here. Each IFD has an in-memory libtiff handle the caller sets them on with the same
+// TIFFSetField calls as for a file; when the IFD ends, the directory libtiff serialised is copied entry for entry,
+// only the offsets and byte counts of the data are replaced. Strips (the thumbnail, label and macro images) are
+// written through that handle with libtiff's codecs and copied over with the directory, so the output differs
+// from libtiff's only in where the data lies.
+class svs_writer
+{
+public:
+    // Creates 'path'. Throws if it cannot.
+    explicit svs_writer(const std::string& path);
+
+    // Closes the file; without a close() before, it has no IFDs and is no valid TIFF.
+    ~svs_writer();
+
+    svs_writer(const svs_writer&) = delete;
+    svs_writer& operator=(const svs_writer&) = delete;
+
+    // Appends an IFD and returns its number. Its tags are set on tags(ifd) until end_ifd().
+    std::size_t add_ifd();
+    TIFF* tags(std::size_t ifd);
+
+    // Writes tile 'tile' of an IFD whose tile layout tags are set. Thread-safe; tiles may come in any order.
+    // A small tile identical to one written to the IFD before shares that one's data (c.f. tile_dedup).
+    void write_tile(std::size_t ifd, std::uint32_t tile, const std::vector<std::uint8_t>& bytes);
+
+    // Takes the IFD's tags and strips from tags(ifd) and closes the handle; the IFD's tiles must all have been
+    // written. Returns the number of tiles that share the data of an identical tile.
+    std::size_t end_ifd(std::size_t ifd);
+
+    // Writes the IFDs and the header. Throws if an IFD has not ended or a write fails.
+    void close();
+
+private:
+    class memory_tiff;
+
+    // A directory entry as libtiff wrote it, with the value in the file's byte order.
+    struct entry
+    {
+        std::uint16_t tag = 0;
+        std::uint16_t type = 0;
+        std::uint64_t count = 0;
+        std::vector<std::uint8_t> value;
+    };
+
+    struct ifd_state
+    {
+        std::unique_ptr<memory_tiff> memory;
+        std::vector<entry> entries;
+        std::mutex mutex;                       // guards the rest
+        std::vector<std::uint64_t> offsets;
+        std::vector<std::uint64_t> byte_counts;
+        tile_dedup dedup;
+    };
+
+    ifd_state& state(std::size_t ifd);
+
+    // Reserves 'size' bytes at the end of the file, writes 'data' there and returns their offset.
+    std::uint64_t append(const std::uint8_t* data, std::size_t size);
+    void write_at(std::uint64_t offset, const std::uint8_t* data, std::size_t size);
+
+    std::string path_;
+#if defined(_WIN32)
+    void* file_ = nullptr;
+#else
+    int file_ = -1;
+#endif
+    std::atomic<std::uint64_t> end_;
+    std::mutex ifds_mutex_;
+    std::deque<ifd_state> ifds_;
+    std::uint8_t byte_order_[2] = { 0, 0 };
+};
@@ -0,0 +1,28 @@
+#include "tile_dedup.h"
+
+const tile_dedup::location* tile_dedup::find(const std::vector<std::uint8_t>& tile)
+{
+    if (tile.size() > max_tile_bytes || written_.empty()) {
+        return nullptr;
+    }
+
+    const auto it = written_.find(std::string(tile.begin(), tile.end()));
+    if (it == written_.end()) {
+        return nullptr;
+    }
+
+    ++shared_count_;
+    return &it->second;
+}
+
+bool tile_dedup::wants(const std::vector<std::uint8_t>& tile) const
+{
+    return !tile.empty() && tile.size() <= max_tile_bytes && written_.size() < max_entries;
+}
+
+void tile_dedup::add(const std::vector<std::uint8_t>& tile, const location& where)
+{
+    if (this->wants(tile)) {
+        written_.emplace(std::string(tile.begin(), tile.end()), where);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Remembers the small encoded tiles written to an IFD by their bytes, so that a later tile with identical bytes
+// can share their TileOffsets/TileByteCounts entry instead of being written again. This is aimed at background:
+// uniform glass compresses to a few kB and repeats all over a slide. Tissue tiles are much larger and are not
+// remembered, which bounds the table to max_entries tiles of at most max_tile_bytes.
+class tile_dedup
+{
+public:
+    // Where a tile's data was written.
+    struct location
+    {
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    static constexpr std::size_t max_tile_bytes = 16 * 1024;
+    static constexpr std::size_t max_entries = 1024;
+
+    // The tile written earlier with the same bytes, or nullptr. Counts the hits.
+    const location* find(const std::vector<std::uint8_t>& tile);
+
+    // Whether 'tile' would be remembered by add().
+    bool wants(const std::vector<std::uint8_t>& tile) const;
+
+    void add(const std::vector<std::uint8_t>& tile, const location& where);
+
+    // Number of tiles find() returned a location for.
+    std::size_t shared_count() const { return shared_count_; }
+
+private:
+    std::unordered_map<std::string, location> written_;
+    std::size_t shared_count_ = 0;
+};
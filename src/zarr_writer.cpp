@@ -0,0 +1,275 @@
+#include "zarr_writer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <libCZI.h>
+#include <tbb/parallel_for.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const int sample_per_pixels = 3;
+    const int compression_level = 5;
+
+    void write_file(const fs::path& path, const char* data, std::size_t size)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(data, std::streamsize(size)) || !file.flush()) {
+            throw std::runtime_error("cannot write " + path.string());
+        }
+    }
+
+    void write_file(const fs::path& path, const std::string& text)
+    {
+        write_file(path, text.data(), text.size());
+    }
+
+    // 'size' bytes as one zstd frame, through libCZI's zstd0 compression of a Gray8 bitmap one row high.
+    std::vector<std::uint8_t> compress_zstd(const std::uint8_t* data, std::size_t size)
+    {
+        libCZI::CompressParametersOnMap parameters;
+        parameters.map[int(libCZI::CompressionParameterKey::ZSTD_RAWCOMPRESSIONLEVEL)] = libCZI::CompressParameter(std::int32_t(compression_level));
+        const auto block = libCZI::ZstdCompress::CompressZStd0Alloc(std::uint32_t(size), 1, std::uint32_t(size), libCZI::PixelType::Gray8, data, &parameters);
+        const std::uint8_t* p = static_cast<const std::uint8_t*>(block->GetPtr());
+        return std::vector<std::uint8_t>(p, p + block->GetSizeOfData());
+    }
+
+    void store_le32(std::uint8_t* p, std::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = std::uint8_t(value >> (8 * i));
+        }
+    }
+
+    // A Blosc (1.x format) container of 'size' bytes in blocks of 'block_size', each a zstd frame, or stored as it
+    // is where zstd does not make it smaller. No shuffle: with one-byte items it would not change anything.
+    std::vector<std::uint8_t> compress_blosc(const std::uint8_t* data, std::size_t size, std::size_t block_size)
+    {
+        const std::size_t header_size = 16;
+        const std::size_t blocks = (size + block_size - 1) / block_size;
+        std::vector<std::uint8_t> out(header_size + 4 * blocks);
+        out[0] = 2;                 // format version
+        out[1] = 1;                 // zstd format version
+        out[2] = 0x10 | (4 << 5);   // no shuffle, blocks not split by byte, zstd
+        out[3] = 1;                 // item size
+        store_le32(&out[4], std::uint32_t(size));
+        store_le32(&out[8], std::uint32_t(block_size));
+        for (std::size_t b = 0; b < blocks; ++b) {
+            const std::size_t offset = b * block_size;
+            const std::size_t length = std::min(block_size, size - offset);
+            std::vector<std::uint8_t> frame = compress_zstd(data + offset, length);
+            const bool stored = frame.size() >= length;
+            const std::size_t start = out.size();
+            store_le32(&out[header_size + 4 * b], std::uint32_t(start));
+            out.resize(start + 4);
+            store_le32(&out[start], std::uint32_t(stored ? length : frame.size()));
+            if (stored) {
+                out.insert(out.end(), data + offset, data + offset + length);
+            }
+            else {
+                out.insert(out.end(), frame.begin(), frame.end());
+            }
+        }
+        store_le32(&out[12], std::uint32_t(out.size()));
+        return out;
+    }
+
+    // 'text' as a JSON string literal.
+    std::string json_string(const std::string& text)
+    {
+        std::ostringstream oss;
+        oss << '"';
+        for (const char ch : text) {
+            if (ch == '"' || ch == '\\') {
+                oss << '\\' << ch;
+            }
+            else if (static_cast<unsigned char>(ch) < 0x20) {
+                oss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch) << std::dec;
+            }
+            else {
+                oss << ch;
+            }
+        }
+        oss << '"';
+        return oss.str();
+    }
+
+    std::string scale_json(double scale)
+    {
+        std::ostringstream oss;
+        oss << std::setprecision(12) << scale;
+        std::string text = oss.str();
+        if (text.find_first_of(".e") == std::string::npos) {
+            text += ".0";
+        }
+        return text;
+    }
+}
+
+zarr_writer::zarr_writer(const std::string& path, std::uint32_t chunk_size, zarr_codec codec)
+    : path_(path), chunk_size_(chunk_size), codec_(codec)
+{
+    std::error_code ec;
+    if (fs::exists(path_ / ".zgroup", ec)) {
+        fs::remove_all(path_, ec);
+    }
+    else if (fs::exists(path_, ec) && !(fs::is_directory(path_, ec) && fs::is_empty(path_, ec))) {
+        throw std::runtime_error(path + " exists and is no Zarr store");
+    }
+    fs::create_directories(path_, ec);
+    if (ec) {
+        throw std::runtime_error("cannot create " + path + ": " + ec.message());
+    }
+    write_file(path_ / ".zgroup", "{\n    \"zarr_format\": 2\n}\n");
+}
+
+std::size_t zarr_writer::add_level(std::uint32_t width, std::uint32_t height)
+{
+    level_state level;
+    level.width = width;
+    level.height = height;
+    level.chunks_across = (width + chunk_size_ - 1) / chunk_size_;
+    const std::size_t index = levels_.size();
+    const fs::path dir = path_ / std::to_string(index);
+
+    const std::uint32_t chunks_down = (height + chunk_size_ - 1) / chunk_size_;
+    for (std::uint32_t row = 0; row < chunks_down; ++row) {
+        std::error_code ec;
+        fs::create_directories(dir / "0" / std::to_string(row), ec);
+        if (ec) {
+            throw std::runtime_error("cannot create " + (dir / "0" / std::to_string(row)).string() + ": " + ec.message());
+        }
+    }
+
+    std::string compressor = "null";
+    if (codec_ == zarr_codec::blosc) {
+        compressor = "{\n        \"id\": \"blosc\",\n        \"cname\": \"zstd\",\n        \"clevel\": " + std::to_string(compression_level)
+            + ",\n        \"shuffle\": 0,\n        \"blocksize\": " + std::to_string(std::size_t(chunk_size_) * chunk_size_) + "\n    }";
+    }
+    else if (codec_ == zarr_codec::zstd) {
+        compressor = "{\n        \"id\": \"zstd\",\n        \"level\": " + std::to_string(compression_level) + "\n    }";
+    }
+    std::ostringstream zarray;
+    zarray << "{\n"
+        << "    \"chunks\": [" << sample_per_pixels << ", " << chunk_size_ << ", " << chunk_size_ << "],\n"
+        << "    \"compressor\": " << compressor << ",\n"
+        << "    \"dimension_separator\": \"/\",\n"
+        << "    \"dtype\": \"|u1\",\n"
+        << "    \"fill_value\": 0,\n"
+        << "    \"filters\": null,\n"
+        << "    \"order\": \"C\",\n"
+        << "    \"shape\": [" << sample_per_pixels << ", " << height << ", " << width << "],\n"
+        << "    \"zarr_format\": 2\n"
+        << "}\n";
+    write_file(dir / ".zarray", zarray.str());
+
+    levels_.push_back(level);
+    return index;
+}
+
+std::vector<std::vector<std::uint8_t>> zarr_writer::encode_chunks(
+    const std::uint8_t* pixels,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::size_t stride,
+    const pixel_layout& layout) const
+{
+    const std::uint32_t cs = chunk_size_;
+    const std::uint32_t chunks_across = (width + cs - 1) / cs;
+    const std::uint32_t chunks_down = (height + cs - 1) / cs;
+    std::vector<std::vector<std::uint8_t>> encoded(std::size_t(chunks_across) * chunks_down);
+
+    tbb::parallel_for(std::size_t(0), encoded.size(), [&](std::size_t i) {
+        const std::uint32_t cx = std::uint32_t(i % chunks_across) * cs;
+        const std::uint32_t cy = std::uint32_t(i / chunks_across) * cs;
+        const std::uint32_t w = std::min(cs, width - cx);
+        const std::uint32_t h = std::min(cs, height - cy);
+        const std::size_t plane = std::size_t(cs) * cs;
+
+        // only edge chunks need the zero padding; full chunks are overwritten completely
+        thread_local std::vector<std::uint8_t> planes;
+        thread_local std::vector<std::uint8_t> row;
+        if (w < cs || h < cs) {
+            planes.assign(plane * sample_per_pixels, 0);
+        }
+        else {
+            planes.resize(plane * sample_per_pixels);
+        }
+        row.resize(std::size_t(w) * sample_per_pixels);
+        for (std::uint32_t y = 0; y < h; ++y) {
+            convert_row(pixels + std::size_t(cy + y) * stride + std::size_t(cx) * layout.bytes_per_pixel(), layout, row.data(), channel_order::rgb, w);
+            for (int c = 0; c < sample_per_pixels; ++c) {
+                std::uint8_t* dst = planes.data() + c * plane + std::size_t(y) * cs;
+                for (std::uint32_t x = 0; x < w; ++x) {
+                    dst[x] = row[std::size_t(x) * sample_per_pixels + c];
+                }
+            }
+        }
+
+        switch (codec_) {
+        case zarr_codec::blosc:
+            encoded[i] = compress_blosc(planes.data(), planes.size(), plane);
+            break;
+        case zarr_codec::zstd:
+            encoded[i] = compress_zstd(planes.data(), planes.size());
+            break;
+        case zarr_codec::raw:
+            encoded[i] = planes;
+            break;
+        }
+    });
+    return encoded;
+}
+
+void zarr_writer::write_chunk(std::size_t level, std::size_t chunk, const std::vector<std::uint8_t>& bytes) const
+{
+    const level_state& lvl = levels_.at(level);
+    const fs::path file = path_ / std::to_string(level) / "0" / std::to_string(chunk / lvl.chunks_across) / std::to_string(chunk % lvl.chunks_across);
+    write_file(file, reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+void zarr_writer::close(const std::string& name, double pixel_width, double pixel_height)
+{
+    const bool calibrated = pixel_width > 0 && pixel_height > 0;
+    const char* unit = calibrated ? ", \"unit\": \"micrometer\"" : "";
+    std::ostringstream zattrs;
+    zattrs << "{\n"
+        << "    \"multiscales\": [\n"
+        << "        {\n"
+        << "            \"version\": \"0.4\",\n"
+        << "            \"name\": " << json_string(name) << ",\n"
+        << "            \"axes\": [\n"
+        << "                {\"name\": \"c\", \"type\": \"channel\"},\n"
+        << "                {\"name\": \"y\", \"type\": \"space\"" << unit << "},\n"
+        << "                {\"name\": \"x\", \"type\": \"space\"" << unit << "}\n"
+        << "            ],\n"
+        << "            \"datasets\": [\n";
+    for (std::size_t level = 0; level < levels_.size(); ++level) {
+        const double factor = double(std::uint64_t(1) << level);
+        zattrs << "                {\"path\": \"" << level << "\", \"coordinateTransformations\": [{\"type\": \"scale\", \"scale\": [1.0, "
+            << scale_json((calibrated ? pixel_height : 1.0) * factor) << ", " << scale_json((calibrated ? pixel_width : 1.0) * factor) << "]}]}"
+            << (level + 1 < levels_.size() ? ",\n" : "\n");
+    }
+    zattrs << "            ],\n"
+        << "            \"type\": \"mean\"\n"
+        << "        }\n"
+        << "    ],\n"
+        << "    \"omero\": {\n"
+        << "        \"channels\": [\n";
+    const char* channels[] = { "Red", "Green", "Blue" };
+    const char* colors[] = { "FF0000", "00FF00", "0000FF" };
+    for (int c = 0; c < sample_per_pixels; ++c) {
+        zattrs << "            {\"label\": \"" << channels[c] << "\", \"color\": \"" << colors[c]
+            << "\", \"active\": true, \"window\": {\"min\": 0, \"max\": 255, \"start\": 0, \"end\": 255}}"
+            << (c + 1 < sample_per_pixels ? ",\n" : "\n");
+    }
+    zattrs << "        ],\n"
+        << "        \"rdefs\": {\"model\": \"color\"}\n"
+        << "    }\n"
+        << "}\n";
+    write_file(path_ / ".zattrs", zattrs.str());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "pixel_swizzle.h"
+
+// How the chunks of a Zarr store are compressed.
+enum class zarr_codec
+{
+    blosc,      // Blosc containers of zstd frames (numcodecs "blosc" with cname "zstd", no shuffle)
+    zstd,       // a plain zstd frame (numcodecs "zstd")
+    raw         // uncompressed (compressor null)
+};
+
+// Writes an OME-NGFF (0.4) multiscale image as a Zarr v2 directory store: a group with one uint8 array per
+// pyramid level ("0" the base level, "1" half its resolution, ...), each of shape (c, y, x) = (3, height, width)
+// and cut into chunks of 3 x chunk_size x chunk_size, planar RGB. Every chunk is a file of its own under
+// <level>/0/<chunk row>/<chunk column>; the directories are created when the level is added, so the chunks of
+// all levels can be written from any number of threads without a lock. The group's .zattrs with the multiscales
+// metadata is written last, by close(), so that a store without it is recognisably incomplete.
+class zarr_writer
+{
+public:
+    // Creates the store at 'path', replacing a Zarr group there. Throws if 'path' is something else, or on I/O errors.
+    zarr_writer(const std::string& path, std::uint32_t chunk_size, zarr_codec codec);
+
+    zarr_writer(const zarr_writer&) = delete;
+    zarr_writer& operator=(const zarr_writer&) = delete;
+
+    std::uint32_t chunk_size() const { return chunk_size_; }
+
+    // Adds the next level's array (its .zarray and chunk directories) and returns its number; each level is
+    // expected to have half the width and height of the one before, as the multiscales scales say.
+    std::size_t add_level(std::uint32_t width, std::uint32_t height);
+
+    // Cuts an image (or part of one) with rows 'stride' bytes apart into chunks and compresses them concurrently
+    // on the TBB pool, in row-major chunk order like encode_jpeg_tiles. The pixels are converted to RGB with
+    // convert_row; chunks at the right and bottom edge are zero padded to full size.
+    std::vector<std::vector<std::uint8_t>> encode_chunks(
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t stride,
+        const pixel_layout& layout) const;
+
+    // Writes chunk 'chunk' (row-major within the level) of 'level'. Thread-safe; throws if the write fails.
+    void write_chunk(std::size_t level, std::size_t chunk, const std::vector<std::uint8_t>& bytes) const;
+
+    // Writes the multiscales metadata. 'pixel_width'/'pixel_height' are the base level's pixel size in
+    // micrometres; 0 leaves the axes without a unit and the base level's scale at 1.
+    void close(const std::string& name, double pixel_width, double pixel_height);
+
+private:
+    struct level_state
+    {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t chunks_across = 0;
+    };
+
+    std::filesystem::path path_;
+    std::uint32_t chunk_size_;
+    zarr_codec codec_;
+    std::vector<level_state> levels_;
+};
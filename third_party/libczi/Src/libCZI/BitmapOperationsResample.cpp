@@ -0,0 +1,303 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "BitmapOperationsResample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "libCZI_Utilities.h"
+#include "utilities.h"
+
+using namespace std;
+using namespace libCZI;
+
+namespace
+{
+    constexpr double kPi = 3.14159265358979323846;
+
+    double Sinc(double x)
+    {
+        if (x == 0)
+        {
+            return 1;
+        }
+
+        const double pi_x = kPi * x;
+        return sin(pi_x) / pi_x;
+    }
+
+    double Lanczos3(double x)
+    {
+        return fabs(x) < 3 ? Sinc(x) * Sinc(x / 3) : 0;
+    }
+
+    void Accumulate(const uint8_t* row, float weight, uint32_t count, float* accumulator)
+    {
+        WeightedRowSum::AccumulateUint8(row, weight, count, accumulator);
+    }
+
+    void Accumulate(const uint16_t* row, float weight, uint32_t count, float* accumulator)
+    {
+        WeightedRowSum::AccumulateUint16(row, weight, count, accumulator);
+    }
+
+    /// The destination range [start, end] (both inclusive) along one axis, determined in the same way as it is done in CBitmapOperations::InternalNNScale2.
+    void CalculateDestinationRange(double dstRoiStart, double dstRoiSize, double srcRoiStart, double srcRoiSize, int srcSize, int dstSize, int* start, int* end)
+    {
+        const int dstStart = (max)(static_cast<int>(dstRoiStart), 0);
+        const int dstEnd = (min)(static_cast<int>(dstRoiStart + dstRoiSize), dstSize - 1);
+        const double minimum = ((0 - srcRoiStart) * dstRoiSize) / srcRoiSize + dstRoiStart;
+        const double maximum = ((srcSize - 1 - srcRoiStart) * dstRoiSize) / srcRoiSize + dstRoiStart;
+        *start = (max)(static_cast<int>(ceil(minimum)), dstStart);
+        *end = (min)(static_cast<int>(ceil(maximum)), dstEnd);
+    }
+
+    template <typename tSample, int tChannels>
+    void InternalResize(
+        const BitmapOperationsResample::Weights& weightsX,
+        const BitmapOperationsResample::Weights& weightsY,
+        int dstXStart,
+        int dstYStart,
+        const void* srcPtr,
+        int srcStride,
+        void* dstPtr,
+        int dstStride)
+    {
+        constexpr float maxValue = static_cast<float>((numeric_limits<tSample>::max)());
+        const int dstWidth = static_cast<int>(weightsX.start.size());
+        const int dstHeight = static_cast<int>(weightsY.start.size());
+        const uint32_t samplesPerRow = static_cast<uint32_t>(weightsX.maximum - weightsX.minimum) * tChannels;
+        vector<float> accumulator(samplesPerRow);
+
+        for (int y = 0; y < dstHeight; ++y)
+        {
+            // vertical pass - accumulate the weighted source rows (in the range of columns needed)
+            fill(accumulator.begin(), accumulator.end(), 0.f);
+            const float* weightY = weightsY.weights.data() + weightsY.offset[y];
+            for (int k = 0; k < weightsY.count[y]; ++k)
+            {
+                const tSample* srcRow = reinterpret_cast<const tSample*>(
+                    static_cast<const uint8_t*>(srcPtr) + static_cast<size_t>(weightsY.start[y] + k) * srcStride) + static_cast<size_t>(weightsX.minimum) * tChannels;
+                Accumulate(srcRow, weightY[k], samplesPerRow, accumulator.data());
+            }
+
+            // horizontal pass
+            tSample* dstRow = reinterpret_cast<tSample*>(static_cast<uint8_t*>(dstPtr) + static_cast<size_t>(dstYStart + y) * dstStride) + static_cast<size_t>(dstXStart) * tChannels;
+            for (int x = 0; x < dstWidth; ++x)
+            {
+                const float* weightX = weightsX.weights.data() + weightsX.offset[x];
+                const float* column = accumulator.data() + static_cast<size_t>(weightsX.start[x] - weightsX.minimum) * tChannels;
+                for (int c = 0; c < tChannels; ++c)
+                {
+                    float value = 0;
+                    for (int k = 0; k < weightsX.count[x]; ++k)
+                    {
+                        value += weightX[k] * column[k * tChannels + c];
+                    }
+
+                    value = (min)((max)(value, 0.f), maxValue);
+                    *dstRow++ = static_cast<tSample>(value + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+/*static*/bool BitmapOperationsResample::IsSupported(libCZI::ResamplingMode mode, libCZI::PixelType srcPixelType, libCZI::PixelType dstPixelType)
+{
+    switch (mode)
+    {
+    case ResamplingMode::NearestNeighbor:
+    case ResamplingMode::AreaAverage:
+    case ResamplingMode::Bilinear:
+    case ResamplingMode::Lanczos3:
+        break;
+    default:
+        return false;
+    }
+
+    if (srcPixelType != dstPixelType)
+    {
+        return false;
+    }
+
+    switch (srcPixelType)
+    {
+    case PixelType::Gray8:
+    case PixelType::Gray16:
+    case PixelType::Bgr24:
+    case PixelType::Bgr48:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*static*/BitmapOperationsResample::Weights BitmapOperationsResample::CalculateWeights(libCZI::ResamplingMode mode, int dstStart, int dstEnd, double dstRoiStart, double dstRoiSize, double srcRoiStart, double srcRoiSize, int srcSize)
+{
+    Weights result;
+    result.minimum = srcSize;
+    result.maximum = 0;
+    const int dstCount = (max)(dstEnd - dstStart + 1, 0);
+    result.start.reserve(dstCount);
+    result.count.reserve(dstCount);
+    result.offset.reserve(dstCount);
+
+    const double srcOverDst = srcRoiSize / dstRoiSize;
+    vector<double> contributions;
+    for (int d = dstStart; d <= dstEnd; ++d)
+    {
+        // the source position of the destination pixel's top left corner, and of its center (in units of source pixel indices)
+        const double corner = (d - dstRoiStart) * srcOverDst + srcRoiStart;
+        const double center = corner + srcOverDst / 2 - 0.5;
+
+        // determine the contributions of the source pixels [first, first + contributions.size())
+        int first = 0;
+        contributions.clear();
+        switch (mode)
+        {
+        case ResamplingMode::AreaAverage:
+        {
+            const double a = (max)(corner, 0.0);
+            const double b = (min)(corner + srcOverDst, static_cast<double>(srcSize));
+            if (b - a > 1e-9)
+            {
+                first = static_cast<int>(floor(a));
+                const int last = (min)(static_cast<int>(ceil(b)) - 1, srcSize - 1);
+                for (int i = first; i <= last; ++i)
+                {
+                    contributions.push_back((min)(b, i + 1.0) - (max)(a, static_cast<double>(i)));
+                }
+            }
+
+            break;
+        }
+        case ResamplingMode::Bilinear:
+        {
+            const double c = (min)((max)(center, 0.0), srcSize - 1.0);
+            first = static_cast<int>(floor(c));
+            const double fraction = c - first;
+            contributions.push_back(1 - fraction);
+            if (fraction > 0 && first + 1 < srcSize)
+            {
+                contributions.push_back(fraction);
+            }
+
+            break;
+        }
+        case ResamplingMode::Lanczos3:
+        {
+            // when scaling down, the filter is widened so that it covers the source area of the destination pixel
+            const double filterScale = (max)(srcOverDst, 1.0);
+            const double radius = 3 * filterScale;
+            const int lo = static_cast<int>(ceil(center - radius));
+            const int hi = static_cast<int>(floor(center + radius));
+            first = (max)((min)(lo, srcSize - 1), 0);
+            const int last = (max)((min)(hi, srcSize - 1), 0);
+            contributions.assign(static_cast<size_t>(last - first) + 1, 0.0);
+            for (int i = lo; i <= hi; ++i)
+            {
+                // source pixels outside the bitmap are taken to be equal to the nearest edge pixel
+                const int clamped = (max)((min)(i, srcSize - 1), 0);
+                contributions[clamped - first] += Lanczos3((i - center) / filterScale);
+            }
+
+            break;
+        }
+        default:
+            break;
+        }
+
+        double sum = 0;
+        for (const double contribution : contributions)
+        {
+            sum += contribution;
+        }
+
+        if (contributions.empty() || fabs(sum) < 1e-9)
+        {
+            // nearest-neighbor, as done by CBitmapOperations::InternalNNScale2
+            first = static_cast<int>((max)((min)(lround(corner), static_cast<long>(srcSize) - 1), 0L));
+            contributions.assign(1, 1.0);
+            sum = 1;
+        }
+
+        // drop zero contributions at the ends, which occur e.g. for a bilinear interpolation exactly at a pixel position
+        // or for the zero crossings of the Lanczos-filter
+        size_t leading = 0;
+        while (leading + 1 < contributions.size() && contributions[leading] == 0)
+        {
+            ++leading;
+        }
+
+        size_t count = contributions.size() - leading;
+        while (count > 1 && contributions[leading + count - 1] == 0)
+        {
+            --count;
+        }
+
+        result.start.push_back(first + static_cast<int>(leading));
+        result.count.push_back(static_cast<int>(count));
+        result.offset.push_back(result.weights.size());
+        for (size_t i = 0; i < count; ++i)
+        {
+            result.weights.push_back(static_cast<float>(contributions[leading + i] / sum));
+        }
+
+        result.minimum = (min)(result.minimum, result.start.back());
+        result.maximum = (max)(result.maximum, result.start.back() + result.count.back());
+    }
+
+    if (result.start.empty())
+    {
+        result.minimum = result.maximum = 0;
+    }
+
+    return result;
+}
+
+/*static*/void BitmapOperationsResample::Resize(libCZI::ResamplingMode mode, libCZI::IBitmapData* bmSrc, libCZI::IBitmapData* bmDest, const libCZI::DblRect& roiSrc, const libCZI::DblRect& roiDst)
+{
+    const PixelType pixelType = bmSrc->GetPixelType();
+    if (!BitmapOperationsResample::IsSupported(mode, pixelType, bmDest->GetPixelType()))
+    {
+        throw invalid_argument("The resampling mode is not supported for the pixel types of source and destination.");
+    }
+
+    const int srcWidth = static_cast<int>(bmSrc->GetWidth());
+    const int srcHeight = static_cast<int>(bmSrc->GetHeight());
+    int dstXStart, dstXEnd, dstYStart, dstYEnd;
+    CalculateDestinationRange(roiDst.x, roiDst.w, roiSrc.x, roiSrc.w, srcWidth, static_cast<int>(bmDest->GetWidth()), &dstXStart, &dstXEnd);
+    CalculateDestinationRange(roiDst.y, roiDst.h, roiSrc.y, roiSrc.h, srcHeight, static_cast<int>(bmDest->GetHeight()), &dstYStart, &dstYEnd);
+    if (dstXEnd < dstXStart || dstYEnd < dstYStart || srcWidth <= 0 || srcHeight <= 0)
+    {
+        return;
+    }
+
+    const Weights weightsX = BitmapOperationsResample::CalculateWeights(mode, dstXStart, dstXEnd, roiDst.x, roiDst.w, roiSrc.x, roiSrc.w, srcWidth);
+    const Weights weightsY = BitmapOperationsResample::CalculateWeights(mode, dstYStart, dstYEnd, roiDst.y, roiDst.h, roiSrc.y, roiSrc.h, srcHeight);
+
+    const ScopedBitmapLockerP lckSrc{ bmSrc };
+    const ScopedBitmapLockerP lckDst{ bmDest };
+    switch (pixelType)
+    {
+    case PixelType::Gray8:
+        InternalResize<uint8_t, 1>(weightsX, weightsY, dstXStart, dstYStart, lckSrc.ptrDataRoi, lckSrc.stride, lckDst.ptrDataRoi, lckDst.stride);
+        break;
+    case PixelType::Gray16:
+        InternalResize<uint16_t, 1>(weightsX, weightsY, dstXStart, dstYStart, lckSrc.ptrDataRoi, lckSrc.stride, lckDst.ptrDataRoi, lckDst.stride);
+        break;
+    case PixelType::Bgr24:
+        InternalResize<uint8_t, 3>(weightsX, weightsY, dstXStart, dstYStart, lckSrc.ptrDataRoi, lckSrc.stride, lckDst.ptrDataRoi, lckDst.stride);
+        break;
+    case PixelType::Bgr48:
+        InternalResize<uint16_t, 3>(weightsX, weightsY, dstXStart, dstYStart, lckSrc.ptrDataRoi, lckSrc.stride, lckDst.ptrDataRoi, lckDst.stride);
+        break;
+    default:
+        break;
+    }
+}
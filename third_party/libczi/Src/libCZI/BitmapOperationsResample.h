@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "libCZI_Pixels.h"
+#include "libCZI_Compositor.h"
+
+/// Here we gather the resampling operations other than nearest-neighbor (which is in CBitmapOperations).
+///
+/// The resampling is separable: for every destination column and row, the source pixels contributing to it and their
+/// (normalized) weights are determined up front. Then every destination row is produced by accumulating the weighted
+/// source rows (the vertical pass, which touches every source pixel and is done by WeightedRowSum, with an AVX2-kernel
+/// if available) and then the weighted columns of that accumulated row (the horizontal pass).
+class BitmapOperationsResample
+{
+public:
+    /// Gets a value indicating whether the specified resampling mode can be used with the specified source and destination pixel type.
+    /// This is the case if source and destination have the same pixel type, which is Gray8, Gray16, Bgr24 or Bgr48.
+    ///
+    /// \param mode             The resampling mode.
+    /// \param srcPixelType     The pixel type of the source.
+    /// \param dstPixelType     The pixel type of the destination.
+    ///
+    /// \returns True if supported, false if not.
+    static bool IsSupported(libCZI::ResamplingMode mode, libCZI::PixelType srcPixelType, libCZI::PixelType dstPixelType);
+
+    /// Scales the rectangle 'roiSrc' of the source bitmap into the rectangle 'roiDst' of the destination bitmap, using the
+    /// specified resampling mode. The destination pixels drawn are exactly those which CBitmapOperations::NNResize would
+    /// draw. Source pixels outside the source bitmap are taken to be equal to the nearest edge pixel.
+    /// If the combination of mode and pixel types is not supported (see IsSupported), an exception is thrown.
+    ///
+    /// \param mode     The resampling mode.
+    /// \param bmSrc    The source bitmap.
+    /// \param bmDest   The destination bitmap.
+    /// \param roiSrc   The source rectangle (in pixels of the source bitmap).
+    /// \param roiDst   The destination rectangle (in pixels of the destination bitmap).
+    static void Resize(libCZI::ResamplingMode mode, libCZI::IBitmapData* bmSrc, libCZI::IBitmapData* bmDest, const libCZI::DblRect& roiSrc, const libCZI::DblRect& roiDst);
+
+    /// The contributions of the source pixels to the destination pixels along one axis.
+    struct Weights
+    {
+        /// For every destination pixel, the index of the first source pixel contributing to it...
+        std::vector<int> start;
+
+        /// ... the number of contributing (consecutive) source pixels ...
+        std::vector<int> count;
+
+        /// ... and the offset of their weights in 'weights'.
+        std::vector<std::size_t> offset;
+
+        std::vector<float> weights;
+
+        /// The lowest source pixel index contributing to any destination pixel.
+        int minimum;
+
+        /// One past the highest source pixel index contributing to any destination pixel.
+        int maximum;
+    };
+
+    /// Determines the weights along one axis, for the destination pixels [dstStart, dstEnd] (both inclusive). A destination pixel 'd'
+    /// corresponds to the source position '(d - dstRoiStart) * srcRoiSize / dstRoiSize + srcRoiStart' (in units of pixels), and the
+    /// source is 'srcSize' pixels long.
+    static Weights CalculateWeights(libCZI::ResamplingMode mode, int dstStart, int dstEnd, double dstRoiStart, double dstRoiSize, double srcRoiStart, double srcRoiSize, int srcSize);
+};
@@ -196,7 +196,26 @@ CCZIReader::CCZIReader() :
 /*virtual*/void CCZIReader::EnumSubset(const IDimCoordinate* planeCoordinate, const IntRect* roi, bool onlyLayer0, const std::function<bool(int index, const SubBlockInfo& info)>& funcEnum)
 {
     this->ThrowIfNotOperational();
-    CziReaderCommon::EnumSubset(this, planeCoordinate, roi, onlyLayer0, funcEnum);
+    if (roi == nullptr)
+    {
+        CziReaderCommon::EnumSubset(this, planeCoordinate, roi, onlyLayer0, funcEnum);
+        return;
+    }
+
+    // the spatial index gives the subblocks intersecting the ROI (in the same order as walking all subblocks would),
+    //  the remaining criteria are checked as usual
+    this->subBlkDir.EnumSubBlocksIntersecting(
+        *roi,
+        [&](int index, const CCziSubBlockDirectory::SubBlkEntry& entry)->bool
+        {
+            const SubBlockInfo info = CziReaderCommon::ConvertToSubBlockInfo(entry);
+            if (CziReaderCommon::IsInSubset(info, planeCoordinate, nullptr, onlyLayer0))
+            {
+                return funcEnum(index, info);
+            }
+
+            return true;
+        });
 }
 
 /*virtual*/std::shared_ptr<ISubBlock> CCZIReader::ReadSubBlock(int index)
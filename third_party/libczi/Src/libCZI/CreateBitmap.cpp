@@ -98,6 +98,21 @@ static std::shared_ptr<libCZI::IBitmapData> CreateBitmapFromSubBlock_ZStd1(ISubB
                     handle_zstd_data_size_mismatch ? CZstd1Decoder::kOption_handle_data_size_mismatch : nullptr);
 }
 
+static std::shared_ptr<libCZI::IBitmapData> CreateBitmapFromSubBlock_Jpg(ISubBlock* subBlk)
+{
+    auto dec = GetSite()->GetDecoder(ImageDecoderType::Jpg, nullptr);
+    if (!dec)
+    {
+        throw std::logic_error("No decoder for JPG compressed subblocks available (it must be provided by the site-object).");
+    }
+
+    const void* ptr;
+    size_t size;
+    subBlk->DangerousGetRawData(ISubBlock::MemBlkType::Data, ptr, size);
+    const SubBlockInfo& sub_block_info = subBlk->GetSubBlockInfo();
+    return dec->Decode(ptr, size, sub_block_info.pixelType, sub_block_info.physicalSize.w, sub_block_info.physicalSize.h);
+}
+
 static std::shared_ptr<libCZI::IBitmapData> CreateBitmapFromSubBlock_Uncompressed(ISubBlock* subBlk, bool handle_uncompressed_data_size_mismatch)
 {
     const auto& sub_block_info = subBlk->GetSubBlockInfo();
@@ -111,6 +126,26 @@ static std::shared_ptr<libCZI::IBitmapData> CreateBitmapFromSubBlock_Uncompresse
 
     if (expected_size <= size)
     {
+        // data referring to the stream's memory is shared with every other read of the sub-block (and read-only), so
+        // the bitmap - which may be written to - gets a copy of its own (unless the conversion to big endian makes one)
+        const auto czi_sub_block = dynamic_cast<const CCziSubBlock*>(subBlk);
+        bool copy_data = czi_sub_block != nullptr && czi_sub_block->IsDataView();
+#if LIBCZI_ISBIGENDIANHOST
+        copy_data = copy_data && CziUtils::IsPixelTypeEndianessAgnostic(sub_block_info.pixelType);
+#endif
+        if (copy_data)
+        {
+            auto bitmap = GetSite()->CreateBitmap(sub_block_info.pixelType, sub_block_info.physicalSize.w, sub_block_info.physicalSize.h);
+            auto lock = bitmap->Lock();
+            for (uint32_t y = 0; y < sub_block_info.physicalSize.h; ++y)
+            {
+                memcpy(static_cast<uint8_t*>(lock.ptrDataRoi) + y * static_cast<size_t>(lock.stride), static_cast<const uint8_t*>(sub_block_data.get()) + y * static_cast<size_t>(stride), stride);
+            }
+
+            bitmap->Unlock();
+            return bitmap;
+        }
+
         CSharedPtrAllocator sharedPtrAllocator(sub_block_data);
         auto sb = CBitmapData<CSharedPtrAllocator>::Create(
                                                         sharedPtrAllocator,
@@ -181,6 +216,8 @@ std::shared_ptr<libCZI::IBitmapData> libCZI::CreateBitmapFromSubBlock(ISubBlock*
         return CreateBitmapFromSubBlock_ZStd0(subBlk, options != nullptr ? options->handle_zstd_data_size_mismatch : true);
     case CompressionMode::Zstd1:
         return CreateBitmapFromSubBlock_ZStd1(subBlk, options != nullptr ? options->handle_zstd_data_size_mismatch : true);
+    case CompressionMode::Jpg:
+        return CreateBitmapFromSubBlock_Jpg(subBlk);
     case CompressionMode::UnCompressed:
         return CreateBitmapFromSubBlock_Uncompressed(subBlk, options != nullptr ? options->handle_uncompressed_data_size_mismatch : true);
     default:    // silence warnings
@@ -162,6 +162,7 @@ public:
     {
         void* ptrData;
         std::uint64_t   dataSize;
+        std::shared_ptr<const void> dataView;   // if the stream implements IStreamMemoryView, the data refers to its memory (and ptrData is null)
         void* ptrAttachment;
         std::uint32_t   attachmentSize;
         void* ptrMetadata;
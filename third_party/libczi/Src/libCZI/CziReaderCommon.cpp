@@ -18,27 +18,40 @@ using namespace libCZI;
     bool onlyLayer0,
     const std::function<bool(int index, const libCZI::SubBlockInfo& info)>& funcEnum)
 {
-    // Ok... for a first tentative, experimental and quick-n-dirty implementation, simply
-    //      walk through all the subblocks. We surely want to have something more elaborated
-    //      here.
+    // This walks through all the subblocks - repositories with a spatial index (like CCZIReader) only use
+    //  this if no ROI is given.
     repository->EnumerateSubBlocks(
         [&](int index, const SubBlockInfo& info)->bool
         {
-            if (onlyLayer0 == false || (info.physicalSize.w == static_cast<uint32_t>(info.logicalRect.w) && info.physicalSize.h == static_cast<uint32_t>(info.logicalRect.h)))
+            if (CziReaderCommon::IsInSubset(info, planeCoordinate, roi, onlyLayer0))
             {
-                if (planeCoordinate == nullptr || CziUtils::CompareCoordinate(planeCoordinate, &info.coordinate) == true)
-                {
-                    if (roi == nullptr || Utilities::DoIntersect(*roi, info.logicalRect))
-                    {
-                        return funcEnum(index, info);
-                    }
-                }
+                return funcEnum(index, info);
             }
 
             return true;
         });
 }
 
+/*static*/bool CziReaderCommon::IsInSubset(
+    const libCZI::SubBlockInfo& info,
+    const libCZI::IDimCoordinate* planeCoordinate,
+    const libCZI::IntRect* roi,
+    bool onlyLayer0)
+{
+    if (onlyLayer0 == false || (info.physicalSize.w == static_cast<uint32_t>(info.logicalRect.w) && info.physicalSize.h == static_cast<uint32_t>(info.logicalRect.h)))
+    {
+        if (planeCoordinate == nullptr || CziUtils::CompareCoordinate(planeCoordinate, &info.coordinate) == true)
+        {
+            if (roi == nullptr || Utilities::DoIntersect(*roi, info.logicalRect))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 /*static*/bool CziReaderCommon::TryGetSubBlockInfoOfArbitrarySubBlockInChannel(
     libCZI::ISubBlockRepository* repository,
     int channelIndex,
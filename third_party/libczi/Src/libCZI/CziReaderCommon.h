@@ -19,6 +19,13 @@ public:
         bool onlyLayer0,
         const std::function<bool(int index, const libCZI::SubBlockInfo& info)>& funcEnum);
 
+    /// Determines whether the subblock passes the filter of EnumSubset.
+    static bool IsInSubset(
+        const libCZI::SubBlockInfo& info,
+        const libCZI::IDimCoordinate* planeCoordinate,
+        const libCZI::IntRect* roi,
+        bool onlyLayer0);
+
     static bool TryGetSubBlockInfoOfArbitrarySubBlockInChannel(
         libCZI::ISubBlockRepository* repository,
         int channelIndex, 
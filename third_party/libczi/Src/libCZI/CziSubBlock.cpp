@@ -9,12 +9,13 @@ using namespace libCZI;
 
 CCziSubBlock::CCziSubBlock(const libCZI::SubBlockInfo& info, const CCZIParse::SubBlockData& data, const std::function<void(void*)>& deleter)
     :
-    spData(std::shared_ptr<const void>(data.ptrData, deleter)),
+    spData(data.dataView ? data.dataView : std::shared_ptr<const void>(data.ptrData, deleter)),
     spAttachment(std::shared_ptr<const void>(data.ptrAttachment, deleter)),
     spMetadata(std::shared_ptr<const void>(data.ptrMetadata, deleter)),
     dataSize(data.dataSize),
     attachmentSize(data.attachmentSize),
     metaDataSize(data.metaDataSize),
+    dataIsView(data.dataView != nullptr),
     info(info)
 {
 }
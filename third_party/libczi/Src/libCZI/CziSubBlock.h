@@ -15,10 +15,13 @@ private:
     std::uint64_t   dataSize;
     std::uint32_t   attachmentSize;
     std::uint32_t   metaDataSize;
+    bool            dataIsView;     ///< Whether the data refers to the stream's memory (c.f. IStreamMemoryView), which is shared and read-only.
     libCZI::SubBlockInfo    info;
 public:
     CCziSubBlock(const libCZI::SubBlockInfo& info, const CCZIParse::SubBlockData& data, const std::function<void(void*)>& deleter);
 
+    bool IsDataView() const { return this->dataIsView; }
+
     // interface ISubBlock
     const libCZI::SubBlockInfo& GetSubBlockInfo() const override;
     void DangerousGetRawData(libCZI::ISubBlock::MemBlkType type, const void*& ptr, size_t& size) const override;
@@ -4,6 +4,8 @@
 
 #include "CziSubBlockDirectory.h"
 #include "CziUtils.h"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 
 using namespace libCZI;
@@ -367,6 +369,165 @@ void CSbBlkStatisticsUpdater::SortPyramidStatistics()
 
 // ---------------------------------------------------------------------------------------------
 
+void CSubBlockSpatialIndex::Build(const std::vector<CCziSubBlockDirectoryBase::SubBlkEntry>& entries)
+{
+    this->grids.clear();
+    this->rects.clear();
+    this->rects.reserve(entries.size());
+
+    // group the subblocks by their minification factor, i.e. by pyramid layer - subblocks with an empty
+    // logical rectangle cannot intersect anything, and are not indexed at all
+    map<int, vector<int>> membersByMinification;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const auto& entry = entries[i];
+        this->rects.emplace_back(IntRect{ entry.x, entry.y, entry.width, entry.height });
+        if (entry.width > 0 && entry.height > 0)
+        {
+            const int minification = entry.storedWidth > 0 ? max(1, static_cast<int>(lround(static_cast<double>(entry.width) / entry.storedWidth))) : 1;
+            membersByMinification[minification].push_back(static_cast<int>(i));
+        }
+    }
+
+    for (const auto& group : membersByMinification)
+    {
+        this->grids.emplace_back(CSubBlockSpatialIndex::CreateGrid(this->rects, group.second));
+    }
+}
+
+/*static*/CSubBlockSpatialIndex::Grid CSubBlockSpatialIndex::CreateGrid(const std::vector<libCZI::IntRect>& rects, const std::vector<int>& members)
+{
+    std::int64_t left = (numeric_limits<std::int64_t>::max)(), top = (numeric_limits<std::int64_t>::max)();
+    std::int64_t right = (numeric_limits<std::int64_t>::min)(), bottom = (numeric_limits<std::int64_t>::min)();
+    std::int64_t sumWidth = 0, sumHeight = 0;
+    for (const int index : members)
+    {
+        const IntRect& r = rects[index];
+        left = min<std::int64_t>(left, r.x);
+        top = min<std::int64_t>(top, r.y);
+        right = max<std::int64_t>(right, static_cast<std::int64_t>(r.x) + r.w);
+        bottom = max<std::int64_t>(bottom, static_cast<std::int64_t>(r.y) + r.h);
+        sumWidth += r.w;
+        sumHeight += r.h;
+    }
+
+    Grid grid;
+    grid.x0 = left;
+    grid.y0 = top;
+    grid.cellWidth = max<std::int64_t>(1, sumWidth / static_cast<std::int64_t>(members.size()));
+    grid.cellHeight = max<std::int64_t>(1, sumHeight / static_cast<std::int64_t>(members.size()));
+
+    // for sparse layouts (e.g. scenes far apart) the grid would be mostly empty cells, so its size is limited to a
+    // small multiple of the number of subblocks
+    const std::int64_t maxCells = 4 * static_cast<std::int64_t>(members.size()) + 64;
+    for (;;)
+    {
+        grid.columns = (right - left + grid.cellWidth - 1) / grid.cellWidth;
+        grid.rows = (bottom - top + grid.cellHeight - 1) / grid.cellHeight;
+        if (grid.rows <= maxCells && grid.columns <= maxCells / grid.rows)
+        {
+            break;
+        }
+
+        grid.cellWidth *= 2;
+        grid.cellHeight *= 2;
+    }
+
+    // every subblock is listed in all cells it overlaps
+    const auto forEachCell = [&](const IntRect& r, const std::function<void(size_t cell)>& func)
+    {
+        const std::int64_t firstColumn = (r.x - grid.x0) / grid.cellWidth;
+        const std::int64_t lastColumn = (r.x + static_cast<std::int64_t>(r.w) - 1 - grid.x0) / grid.cellWidth;
+        const std::int64_t firstRow = (r.y - grid.y0) / grid.cellHeight;
+        const std::int64_t lastRow = (r.y + static_cast<std::int64_t>(r.h) - 1 - grid.y0) / grid.cellHeight;
+        for (std::int64_t row = firstRow; row <= lastRow; ++row)
+        {
+            for (std::int64_t column = firstColumn; column <= lastColumn; ++column)
+            {
+                func(static_cast<size_t>(row * grid.columns + column));
+            }
+        }
+    };
+
+    grid.cellStart.assign(static_cast<size_t>(grid.columns * grid.rows) + 1, 0);
+    for (const int index : members)
+    {
+        forEachCell(rects[index], [&](size_t cell) { ++grid.cellStart[cell + 1]; });
+    }
+
+    for (size_t i = 1; i < grid.cellStart.size(); ++i)
+    {
+        grid.cellStart[i] += grid.cellStart[i - 1];
+    }
+
+    grid.entries.resize(grid.cellStart.back());
+    vector<std::uint32_t> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    for (const int index : members)
+    {
+        forEachCell(rects[index], [&](size_t cell) { grid.entries[fill[cell]++] = index; });
+    }
+
+    return grid;
+}
+
+void CSubBlockSpatialIndex::Query(const libCZI::IntRect& roi, std::vector<int>& indices) const
+{
+    if (roi.w <= 0 || roi.h <= 0)
+    {
+        return;
+    }
+
+    const size_t firstResult = indices.size();
+    const std::int64_t roiRight = static_cast<std::int64_t>(roi.x) + roi.w;
+    const std::int64_t roiBottom = static_cast<std::int64_t>(roi.y) + roi.h;
+    for (const auto& grid : this->grids)
+    {
+        const std::int64_t left = roi.x - grid.x0;
+        const std::int64_t top = roi.y - grid.y0;
+        const std::int64_t right = roiRight - 1 - grid.x0;
+        const std::int64_t bottom = roiBottom - 1 - grid.y0;
+        if (right < 0 || bottom < 0 || left >= grid.columns * grid.cellWidth || top >= grid.rows * grid.cellHeight)
+        {
+            continue;
+        }
+
+        const std::int64_t firstColumn = left < 0 ? 0 : left / grid.cellWidth;
+        const std::int64_t lastColumn = min(grid.columns - 1, right / grid.cellWidth);
+        const std::int64_t firstRow = top < 0 ? 0 : top / grid.cellHeight;
+        const std::int64_t lastRow = min(grid.rows - 1, bottom / grid.cellHeight);
+        for (std::int64_t row = firstRow; row <= lastRow; ++row)
+        {
+            for (std::int64_t column = firstColumn; column <= lastColumn; ++column)
+            {
+                const size_t cell = static_cast<size_t>(row * grid.columns + column);
+                for (std::uint32_t i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; ++i)
+                {
+                    const int index = grid.entries[i];
+                    const IntRect& r = this->rects[index];
+                    const std::int64_t intersectionLeft = max<std::int64_t>(r.x, roi.x);
+                    const std::int64_t intersectionTop = max<std::int64_t>(r.y, roi.y);
+                    if (intersectionLeft >= min(static_cast<std::int64_t>(r.x) + r.w, roiRight) ||
+                        intersectionTop >= min(static_cast<std::int64_t>(r.y) + r.h, roiBottom))
+                    {
+                        continue;
+                    }
+
+                    // a subblock listed in several cells is only reported from the one which contains the top-left
+                    // corner of its intersection with the ROI
+                    if ((intersectionLeft - grid.x0) / grid.cellWidth == column && (intersectionTop - grid.y0) / grid.cellHeight == row)
+                    {
+                        indices.push_back(index);
+                    }
+                }
+            }
+        }
+    }
+
+    sort(indices.begin() + firstResult, indices.end());
+}
+
+// ---------------------------------------------------------------------------------------------
+
 CCziSubBlockDirectory::CCziSubBlockDirectory() : state(State::AddingAllowed)
 {
 }
@@ -386,6 +547,7 @@ void CCziSubBlockDirectory::AddingFinished()
 {
     this->state = State::AddingFinished;
     this->sblkStatistics.Consolidate();
+    this->spatialIndex.Build(this->subBlks);
 }
 
 const libCZI::SubBlockStatistics& CCziSubBlockDirectory::GetStatistics() const
@@ -412,6 +574,24 @@ void CCziSubBlockDirectory::EnumSubBlocks(const std::function<bool(int index, co
     }
 }
 
+void CCziSubBlockDirectory::EnumSubBlocksIntersecting(const libCZI::IntRect& roi, const std::function<bool(int index, const SubBlkEntry&)>& func) const
+{
+    if (this->state != State::AddingFinished)
+    {
+        throw std::logic_error("The spatial index is only available after adding subblocks is finished.");
+    }
+
+    vector<int> indices;
+    this->spatialIndex.Query(roi, indices);
+    for (const int index : indices)
+    {
+        if (!func(index, this->subBlks[index]))
+        {
+            break;
+        }
+    }
+}
+
 bool CCziSubBlockDirectory::TryGetSubBlock(int index, SubBlkEntry& entry) const
 {
     if (index < (int)this->subBlks.size())
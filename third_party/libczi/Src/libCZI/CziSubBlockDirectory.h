@@ -76,11 +76,43 @@ private:
     static void UpdatePyramidLayerStatistics(std::vector<libCZI::PyramidStatistics::PyramidLayerStatistics>& vec, const libCZI::PyramidStatistics::PyramidLayerInfo& pli);
 };
 
+/// A spatial index over the logical rectangles of the subblocks of a directory, so that the subblocks intersecting
+/// a ROI can be found without walking all of them. The subblocks are grouped by pyramid layer (i.e. by the ratio of
+/// logical to stored size), and every group gets a uniform grid with cells about the size of its subblocks. A
+/// subblock is therefore listed in a few cells only (even if it is a pyramid subblock covering a large area), and a
+/// query visits the cells covered by the ROI, independent of the number of subblocks.
+/// Subblocks of all planes share the grids; filtering by plane coordinate is up to the caller.
+class CSubBlockSpatialIndex
+{
+private:
+    struct Grid
+    {
+        std::int64_t x0{ 0 }, y0{ 0 };
+        std::int64_t cellWidth{ 1 }, cellHeight{ 1 };
+        std::int64_t columns{ 0 }, rows{ 0 };
+        std::vector<std::uint32_t> cellStart;   ///< The entries of cell i are entries[cellStart[i]..cellStart[i+1]).
+        std::vector<int> entries;               ///< Indices into 'rects'.
+    };
+
+    std::vector<Grid> grids;
+    std::vector<libCZI::IntRect> rects;
+public:
+    /// Builds the index for the specified subblocks, replacing a previous one.
+    void Build(const std::vector<CCziSubBlockDirectoryBase::SubBlkEntry>& entries);
+
+    /// Gets the indices of all subblocks whose logical rectangle intersects the specified ROI, in ascending order.
+    /// \param          roi     The ROI.
+    /// \param [in,out] indices The indices are appended to this vector.
+    void Query(const libCZI::IntRect& roi, std::vector<int>& indices) const;
+private:
+    static Grid CreateGrid(const std::vector<libCZI::IntRect>& rects, const std::vector<int>& members);
+};
 
 class CCziSubBlockDirectory : public CCziSubBlockDirectoryBase
 {
 private:
     std::vector<SubBlkEntry> subBlks;
+    CSubBlockSpatialIndex spatialIndex;
     mutable CSbBlkStatisticsUpdater sblkStatistics;
     enum class State
     {
@@ -98,6 +130,13 @@ public:
     void AddingFinished();
 
     void EnumSubBlocks(const std::function<bool(int index, const SubBlkEntry&)>& func);
+
+    /// Enumerates the subblocks whose logical rectangle intersects the specified ROI, in ascending order of their index.
+    /// This uses the spatial index which is built when adding subblocks is finished.
+    /// \param roi  The ROI.
+    /// \param func The functor to be called for each subblock; if it returns false, the enumeration is stopped.
+    void EnumSubBlocksIntersecting(const libCZI::IntRect& roi, const std::function<bool(int index, const SubBlkEntry&)>& func) const;
+
     bool TryGetSubBlock(int index, SubBlkEntry& entry) const;
 };
 
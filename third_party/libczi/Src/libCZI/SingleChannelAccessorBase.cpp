@@ -4,6 +4,7 @@
 
 #include "SingleChannelAccessorBase.h"
 #include "BitmapOperations.h"
+#include "Site.h"
 #include "libCZI_Pixels.h"
 #include "utilities.h"
 
@@ -29,6 +30,17 @@ bool CSingleChannelAccessorBase::TryGetPixelType(const libCZI::IDimCoordinate* p
     }
 }
 
+/*static*/std::shared_ptr<libCZI::IBitmapData> CSingleChannelAccessorBase::CreateDestinationBitmap(libCZI::PixelType pixeltype, std::uint32_t width, std::uint32_t height, const libCZI::RgbFloatColor& backgroundColor)
+{
+    auto bm = GetSite()->CreateBitmap(pixeltype, width, height);
+    if (isnan(backgroundColor.r) || isnan(backgroundColor.g) || isnan(backgroundColor.b))
+    {
+        CBitmapOperations::Fill(bm.get(), RgbFloatColor{ 0, 0, 0 });
+    }
+
+    return bm;
+}
+
 void CSingleChannelAccessorBase::CheckPlaneCoordinates(const libCZI::IDimCoordinate* planeCoordinate) const
 {
     // planeCoordinate must not contain S
@@ -21,6 +21,11 @@ protected:
 
     static void Clear(libCZI::IBitmapData* bm, const libCZI::RgbFloatColor& floatColor);
 
+    /// Creates the bitmap an accessor draws into (through the site). The bitmap may reuse a pooled buffer (c.f. BufferPool),
+    /// so if the background color does not clear it (i.e. it contains a NaN), it is zeroed here - otherwise the previous
+    /// content of the buffer would show where no sub-block is drawn.
+    static std::shared_ptr<libCZI::IBitmapData> CreateDestinationBitmap(libCZI::PixelType pixeltype, std::uint32_t width, std::uint32_t height, const libCZI::RgbFloatColor& backgroundColor);
+
     void CheckPlaneCoordinates(const libCZI::IDimCoordinate* planeCoordinate) const;
 
     /// This method is used to do a visibility test of a list of subblocks. The mode of operation is as follows:
@@ -52,7 +52,7 @@ CSingleChannelPyramidLevelTileAccessor::CSingleChannelPyramidLevelTileAccessor(c
         throw runtime_error("error");
     }
 
-    auto bmDest = GetSite()->CreateBitmap(pixeltype, sizeOfBitmap.w, sizeOfBitmap.h);
+    auto bmDest = CreateDestinationBitmap(pixeltype, sizeOfBitmap.w, sizeOfBitmap.h, pOptions->backGroundColor);
     this->InternalGet(bmDest.get(), roi_raw_sub_block_cs.x, roi_raw_sub_block_cs.y, sizeOfPixel, planeCoordinate, pyramidInfo, *pOptions);
     return bmDest;
 }
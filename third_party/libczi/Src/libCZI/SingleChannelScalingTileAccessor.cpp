@@ -6,7 +6,12 @@
 #include "utilities.h"
 #include "BitmapOperations.h"
 #include "BitmapOperationsBitonal.h"
+#include "BitmapOperationsResample.h"
 #include "Site.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 using namespace libCZI;
 using namespace std;
@@ -49,7 +54,7 @@ CSingleChannelScalingTileAccessor::CSingleChannelScalingTileAccessor(const std::
 
     const IntRect roi_raw_sub_block_cs = this->sbBlkRepository->TransformRectangle(roi, CZIFrameOfReference::RawSubBlockCoordinateSystem).rectangle;
     const IntSize sizeOfBitmap = InternalCalcSize(roi_raw_sub_block_cs, zoom);
-    auto bmDest = GetSite()->CreateBitmap(pixeltype, sizeOfBitmap.w, sizeOfBitmap.h);
+    auto bmDest = CreateDestinationBitmap(pixeltype, sizeOfBitmap.w, sizeOfBitmap.h, pOptions->backGroundColor);
     this->InternalGet(bmDest.get(), roi_raw_sub_block_cs, planeCoordinate, zoom, *pOptions);
     return bmDest;
 }
@@ -81,14 +86,18 @@ CSingleChannelScalingTileAccessor::CSingleChannelScalingTileAccessor(const std::
     return IntSize{ static_cast<uint32_t>(roi.w * zoom),static_cast<uint32_t>(roi.h * zoom) };
 }
 
-void CSingleChannelScalingTileAccessor::ScaleBlt(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const SbInfo& sbInfo, const libCZI::ISingleChannelScalingTileAccessor::Options& options)
+CSingleChannelAccessorBase::SubBlockData CSingleChannelScalingTileAccessor::ReadSubBlock(const SbInfo& sbInfo, const libCZI::ISingleChannelScalingTileAccessor::Options& options)
 {
-    auto subblock_bitmap_data = CSingleChannelAccessorBase::GetSubBlockDataIncludingMaskForSubBlockIndex(
+    return CSingleChannelAccessorBase::GetSubBlockDataIncludingMaskForSubBlockIndex(
                                                                             this->sbBlkRepository,
                                                                             options.subBlockCache,
                                                                             sbInfo.index,
                                                                             options.onlyUseSubBlockCacheForCompressedData,
                                                                             options.maskAware);
+}
+
+void CSingleChannelScalingTileAccessor::ScaleBlt(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const SbInfo& sbInfo, const SubBlockData& subblock_bitmap_data, const libCZI::ISingleChannelScalingTileAccessor::Options& options)
+{
     if (GetSite()->IsEnabled(LOGLEVEL_CHATTYINFORMATION))
     {
         stringstream ss;
@@ -165,6 +174,11 @@ void CSingleChannelScalingTileAccessor::ScaleBlt(libCZI::IBitmapData* bmDest, fl
         {
             BitmapOperationsBitonal::NNResizeMaskAware(source.get(), source_mask.get(), bmDest, srcRoi, dstRoi);
         }
+        else if (options.resamplingMode != ResamplingMode::NearestNeighbor &&
+                 BitmapOperationsResample::IsSupported(options.resamplingMode, source->GetPixelType(), bmDest->GetPixelType()))
+        {
+            BitmapOperationsResample::Resize(options.resamplingMode, source.get(), bmDest, srcRoi, dstRoi);
+        }
         else
         {
             CBitmapOperations::NNResize(source.get(), bmDest, srcRoi, dstRoi);
@@ -367,20 +381,14 @@ void CSingleChannelScalingTileAccessor::Paint(libCZI::IBitmapData* bmDest, const
         }
     }
 
+    // the subblocks to draw, in the order in which they are to be drawn
+    std::vector<const SbInfo*> subblocks_to_draw;
     if (!options.useVisibilityCheckOptimization)
     {
+        subblocks_to_draw.reserve(distance(start_iterator, end_iterator));
         for (auto it = start_iterator; it != end_iterator; ++it)
         {
-            const SbInfo& sbInfo = sbSetSortedByZoom.subBlocks.at(*it);
-
-            if (GetSite()->IsEnabled(LOGLEVEL_CHATTYINFORMATION))
-            {
-                stringstream ss;
-                ss << " Drawing subblock: idx=" << sbInfo.index << " Log.: " << sbInfo.logicalRect << " Phys.Size: " << sbInfo.physicalSize;
-                GetSite()->Log(LOGLEVEL_CHATTYINFORMATION, ss);
-            }
-
-            this->ScaleBlt(bmDest, zoom, roi, sbInfo, options);
+            subblocks_to_draw.push_back(&sbSetSortedByZoom.subBlocks.at(*it));
         }
     }
     else
@@ -396,20 +404,114 @@ void CSingleChannelScalingTileAccessor::Paint(libCZI::IBitmapData* bmDest, const
             });
 
         // Now, draw only the subblocks which are visible - the vector "indices_of_visible_tiles" contains the indices "as they were passed to the lambda".
+        subblocks_to_draw.reserve(indices_of_visible_tiles.size());
         for (const auto i : indices_of_visible_tiles)
         {
             // dereference the iterator (advanced by the index from out loop variable), this gives us an index into the
             // subBlocks-vector
-            const SbInfo& sbInfo = sbSetSortedByZoom.subBlocks.at(*(start_iterator + i));
-            if (GetSite()->IsEnabled(LOGLEVEL_CHATTYINFORMATION))
+            subblocks_to_draw.push_back(&sbSetSortedByZoom.subBlocks.at(*(start_iterator + i)));
+        }
+    }
+
+    this->DrawSubBlocks(bmDest, zoom, roi, subblocks_to_draw, options);
+}
+
+void CSingleChannelScalingTileAccessor::DrawSubBlocks(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const std::vector<const SbInfo*>& subblocks, const libCZI::ISingleChannelScalingTileAccessor::Options& options)
+{
+    auto draw = [&](const SbInfo& sbInfo, const SubBlockData& subblock_bitmap_data)
+    {
+        if (GetSite()->IsEnabled(LOGLEVEL_CHATTYINFORMATION))
+        {
+            stringstream ss;
+            ss << " Drawing subblock: idx=" << sbInfo.index << " Log.: " << sbInfo.logicalRect << " Phys.Size: " << sbInfo.physicalSize;
+            GetSite()->Log(LOGLEVEL_CHATTYINFORMATION, ss);
+        }
+
+        this->ScaleBlt(bmDest, zoom, roi, sbInfo, subblock_bitmap_data, options);
+    };
+
+    if (options.decodeThreadCount <= 1 || subblocks.size() <= 1)
+    {
+        for (const SbInfo* sbInfo : subblocks)
+        {
+            draw(*sbInfo, this->ReadSubBlock(*sbInfo, options));
+        }
+
+        return;
+    }
+
+    // Read and decode a batch of subblocks concurrently, then draw them in order (which is what determines the result), and
+    // continue with the next batch. The batches bound the number of decoded bitmaps held at a time.
+    const size_t batch_size = static_cast<size_t>(options.decodeThreadCount) * 2;
+    std::vector<SubBlockData> batch;
+    for (size_t batch_start = 0; batch_start < subblocks.size(); batch_start += batch_size)
+    {
+        const size_t count = (min)(batch_size, subblocks.size() - batch_start);
+        batch.assign(count, SubBlockData());
+        std::exception_ptr first_exception;
+        std::mutex exception_mutex;
+        const std::function<void(int)> read_subblock = [&](int i)
+        {
+            try
             {
-                stringstream ss;
-                ss << " Drawing subblock: idx=" << sbInfo.index << " Log.: " << sbInfo.logicalRect << " Phys.Size: " << sbInfo.physicalSize;
-                GetSite()->Log(LOGLEVEL_CHATTYINFORMATION, ss);
+                batch[i] = this->ReadSubBlock(*subblocks[batch_start + i], options);
             }
+            catch (...)
+            {
+                const lock_guard<mutex> lock(exception_mutex);
+                if (!first_exception)
+                {
+                    first_exception = current_exception();
+                }
+            }
+        };
+
+        if (options.decodeTaskRunner)
+        {
+            options.decodeTaskRunner(static_cast<int>(count), read_subblock);
+        }
+        else
+        {
+            CSingleChannelScalingTileAccessor::RunConcurrently(static_cast<int>(count), options.decodeThreadCount, read_subblock);
+        }
 
-            this->ScaleBlt(bmDest, zoom, roi, sbInfo, options);
+        if (first_exception)
+        {
+            rethrow_exception(first_exception);
         }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            draw(*subblocks[batch_start + i], batch[i]);
+            batch[i] = SubBlockData();
+        }
+    }
+}
+
+/*static*/void CSingleChannelScalingTileAccessor::RunConcurrently(int task_count, std::uint32_t thread_count, const std::function<void(int)>& task)
+{
+    atomic<int> next_task{ 0 };
+    auto worker = [&]()
+    {
+        for (int i = next_task++; i < task_count; i = next_task++)
+        {
+            task(i);
+        }
+    };
+
+    // the calling thread is one of the workers
+    std::vector<std::thread> threads;
+    const int additional_threads = (min)(static_cast<int>(thread_count), task_count) - 1;
+    threads.reserve(additional_threads);
+    for (int i = 0; i < additional_threads; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+    for (auto& thread : threads)
+    {
+        thread.join();
     }
 }
 
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <tuple>
 #include <vector>
 #include <memory>
@@ -38,7 +39,15 @@ private:
     static std::vector<int> CreateSortByZoom(const std::vector<SbInfo>& sbBlks, bool sortByM);
     std::vector<SbInfo> GetSubSet(const libCZI::IntRect& roi, const libCZI::IDimCoordinate* planeCoordinate, const std::vector<int>* allowedScenes);
     static int GetIdxOf1stSubBlockWithZoomGreater(const std::vector<SbInfo>& sbBlks, const std::vector<int>& byZoom, float zoom);
-    void ScaleBlt(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const SbInfo& sbInfo, const libCZI::ISingleChannelScalingTileAccessor::Options& options);
+    SubBlockData ReadSubBlock(const SbInfo& sbInfo, const libCZI::ISingleChannelScalingTileAccessor::Options& options);
+    void ScaleBlt(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const SbInfo& sbInfo, const SubBlockData& subblock_bitmap_data, const libCZI::ISingleChannelScalingTileAccessor::Options& options);
+
+    /// Reads, decodes and draws the specified subblocks in the order given - or, if options.decodeThreadCount is greater than 1, reads and
+    /// decodes them concurrently in batches, drawing each batch in the order given.
+    void DrawSubBlocks(libCZI::IBitmapData* bmDest, float zoom, const libCZI::IntRect& roi, const std::vector<const SbInfo*>& subblocks, const libCZI::ISingleChannelScalingTileAccessor::Options& options);
+
+    /// Calls 'task' for every index in [0, task_count) on up to 'thread_count' threads (including the calling one).
+    static void RunConcurrently(int task_count, std::uint32_t thread_count, const std::function<void(int)>& task);
 
     void InternalGet(libCZI::IBitmapData* bmDest, const libCZI::IntRect& roi, const libCZI::IDimCoordinate* planeCoordinate, float zoom, const libCZI::ISingleChannelScalingTileAccessor::Options& options);
 
@@ -33,7 +33,8 @@ CSingleChannelTileAccessor::CSingleChannelTileAccessor(const std::shared_ptr<ISu
 /*virtual*/std::shared_ptr<libCZI::IBitmapData> CSingleChannelTileAccessor::Get(libCZI::PixelType pixeltype, const  libCZI::IntRectAndFrameOfReference& roi, const IDimCoordinate* planeCoordinate, const Options* pOptions)
 {
     const IntRect roi_raw_sub_block_cs = this->sbBlkRepository->TransformRectangle(roi, CZIFrameOfReference::RawSubBlockCoordinateSystem).rectangle;
-    auto bmDest = GetSite()->CreateBitmap(pixeltype, roi_raw_sub_block_cs.w, roi_raw_sub_block_cs.h);
+    const float nan = numeric_limits<float>::quiet_NaN();
+    auto bmDest = CreateDestinationBitmap(pixeltype, roi_raw_sub_block_cs.w, roi_raw_sub_block_cs.h, pOptions != nullptr ? pOptions->backGroundColor : RgbFloatColor{ nan, nan, nan });
     this->InternalGet(roi_raw_sub_block_cs.x, roi_raw_sub_block_cs.y, bmDest.get(), planeCoordinate, pOptions);
     return bmDest;
 }
@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "mmapfileinputstream.h"
+
+#if LIBCZI_USE_PREADPWRITEBASED_STREAMIMPL
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <limits>
+
+#include "../utilities.h"
+
+using namespace libCZI;
+using namespace std;
+
+namespace
+{
+    [[noreturn]] void ThrowErrno(const char* what, const string& filename)
+    {
+        const auto err = errno;
+        stringstream ss;
+        ss << what << " \"" << filename << "\" -> errno=" << err << " (" << strerror(err) << ")";
+        throw runtime_error(ss.str());
+    }
+
+    int GetAccessHint(const std::map<int, StreamsFactory::Property>& property_bag)
+    {
+        const auto property = property_bag.find(StreamsFactory::StreamProperties::kMmapFile_AccessHint);
+        if (property == property_bag.cend())
+        {
+            return MADV_NORMAL;
+        }
+
+        const string hint = property->second.GetAsStringOrThrow();
+        if (hint == "Normal")
+        {
+            return MADV_NORMAL;
+        }
+        else if (hint == "Sequential")
+        {
+            return MADV_SEQUENTIAL;
+        }
+        else if (hint == "Random")
+        {
+            return MADV_RANDOM;
+        }
+
+        throw invalid_argument("Unknown value for the property \"MmapFile_AccessHint\": \"" + hint + "\"");
+    }
+}
+
+MmapFileInputStream::MmapFileInputStream(const std::string& filename, const std::map<int, libCZI::StreamsFactory::Property>& property_bag)
+    : size_(0), will_need_views_(true)
+{
+    const int access_hint = GetAccessHint(property_bag);
+    const auto will_need = property_bag.find(StreamsFactory::StreamProperties::kMmapFile_WillNeed);
+    if (will_need != property_bag.cend())
+    {
+        this->will_need_views_ = will_need->second.GetAsBoolOrThrow();
+    }
+
+    const int file_descriptor = open(filename.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        ThrowErrno("Error opening the file", filename);
+    }
+
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0)
+    {
+        close(file_descriptor);
+        ThrowErrno("Error querying the size of the file", filename);
+    }
+
+    if (static_cast<uint64_t>(file_status.st_size) > (numeric_limits<size_t>::max)())
+    {
+        close(file_descriptor);
+        throw runtime_error("The file \"" + filename + "\" is too large to be mapped.");
+    }
+
+    this->size_ = static_cast<uint64_t>(file_status.st_size);
+    if (this->size_ > 0)
+    {
+        void* address = mmap(nullptr, static_cast<size_t>(this->size_), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        if (address == MAP_FAILED)
+        {
+            close(file_descriptor);
+            ThrowErrno("Error mapping the file", filename);
+        }
+
+        // the hint is only advisory, so a failure is of no concern
+        madvise(address, static_cast<size_t>(this->size_), access_hint);
+        const size_t size = static_cast<size_t>(this->size_);
+        this->mapping_ = shared_ptr<void>(address, [size](void* p) { munmap(p, size); });
+    }
+
+    // the mapping stays valid after closing the file
+    close(file_descriptor);
+}
+
+MmapFileInputStream::MmapFileInputStream(const wchar_t* filename)
+    : MmapFileInputStream(Utilities::convertWchar_tToUtf8(filename), std::map<int, libCZI::StreamsFactory::Property>())
+{
+}
+
+/*virtual*/void MmapFileInputStream::Read(std::uint64_t offset, void* pv, std::uint64_t size, std::uint64_t* ptrBytesRead)
+{
+    const uint64_t bytes_to_copy = offset < this->size_ ? (min)(size, this->size_ - offset) : 0;
+    if (bytes_to_copy > 0)
+    {
+        memcpy(pv, static_cast<const uint8_t*>(this->mapping_.get()) + offset, static_cast<size_t>(bytes_to_copy));
+    }
+
+    if (ptrBytesRead != nullptr)
+    {
+        *ptrBytesRead = bytes_to_copy;
+    }
+}
+
+/*virtual*/std::shared_ptr<const void> MmapFileInputStream::GetView(std::uint64_t offset, std::uint64_t size)
+{
+    if (!this->mapping_ || offset > this->size_ || size > this->size_ - offset)
+    {
+        return {};
+    }
+
+    uint8_t* view = static_cast<uint8_t*>(this->mapping_.get()) + offset;
+    if (this->will_need_views_ && size > 0)
+    {
+        // the view is about to be used (i.e. decoded), so have the kernel read in all of its pages now instead of
+        // faulting them in one at a time - madvise requires a page-aligned address
+        const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uintptr_t start = reinterpret_cast<uintptr_t>(view) & ~(page_size - 1);
+        madvise(reinterpret_cast<void*>(start), static_cast<size_t>(reinterpret_cast<uintptr_t>(view) + size - start), MADV_WILLNEED);
+    }
+
+    // the view shares the ownership of the mapping
+    return shared_ptr<const void>(this->mapping_, view);
+}
+
+#endif // LIBCZI_USE_PREADPWRITEBASED_STREAMIMPL
@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+#include <libCZI_Config.h>
+
+#if LIBCZI_USE_PREADPWRITEBASED_STREAMIMPL
+#include <map>
+#include <memory>
+#include <string>
+#include "../libCZI.h"
+
+/// Implementation of the IStream-interface for files based on the Unix-specific mmap-API. The whole file is mapped
+/// into memory when the stream is constructed, so a read is a memcpy from the mapping, and - more importantly - the
+/// stream implements IStreamMemoryView, which lets the data of the sub-blocks refer to the mapping instead of being
+/// copied. The pages are brought in by the kernel on first access (or ahead of it, c.f. the access hint).
+///
+/// The mapping is read-only, and all views of a range share its pages; writing to a view faults. A bitmap is writable,
+/// so the one of an uncompressed sub-block gets a copy of the view (c.f. CreateBitmapFromSubBlock). Note that
+/// truncating the file while it is mapped results in a SIGBUS on the next access of the truncated part.
+class MmapFileInputStream : public libCZI::IStream, public libCZI::IStreamMemoryView
+{
+private:
+    std::shared_ptr<void> mapping_;     ///< The base address of the mapping, the deleter unmaps it. Null for an empty file.
+    std::uint64_t size_;                ///< The size of the file (and of the mapping).
+    bool will_need_views_;              ///< Whether to advise the kernel to read ahead the range of a view when it is handed out.
+public:
+    MmapFileInputStream() = delete;
+    explicit MmapFileInputStream(const wchar_t* filename);
+    MmapFileInputStream(const std::string& filename, const std::map<int, libCZI::StreamsFactory::Property>& property_bag);
+    ~MmapFileInputStream() override = default;
+public: // interface libCZI::IStream
+    void Read(std::uint64_t offset, void* pv, std::uint64_t size, std::uint64_t* ptrBytesRead) override;
+public: // interface libCZI::IStreamMemoryView
+    std::shared_ptr<const void> GetView(std::uint64_t offset, std::uint64_t size) override;
+};
+
+#endif
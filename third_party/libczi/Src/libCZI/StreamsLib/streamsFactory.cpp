@@ -12,6 +12,7 @@
 #include "uwpfileinputstream.h"
 #include "simplefileinputstream.h"
 #include "preadfileinputstream.h"
+#include "mmapfileinputstream.h"
 #include "azureblobinputstream.h"
 #include "../utilities.h"
 
@@ -97,6 +98,14 @@ static const struct
             },
             nullptr
         },
+        {
+            { "mmap_file_inputstream", "stream implementation based on mmap-API, sub-blocks refer to the mapped file", nullptr, nullptr },
+            [](const StreamsFactory::CreateStreamInfo& stream_info, const std::string& file_name) -> std::shared_ptr<libCZI::IStream>
+            {
+                return std::make_shared<MmapFileInputStream>(file_name, stream_info.property_bag);
+            },
+            nullptr
+        },
 #endif // LIBCZI_USE_PREADPWRITEBASED_STREAMIMPL
         {
             { "c_runtime_file_inputstream", "stream implementation based on C-runtime library", nullptr, nullptr },
@@ -147,6 +156,10 @@ void libCZI::StreamsFactory::Initialize()
 #endif
 #if LIBCZI_AZURESDK_BASED_STREAM_AVAILABLE
         {"AzureBlob_AuthenticationMode", StreamsFactory::StreamProperties::kAzureBlob_AuthenticationMode, StreamsFactory::Property::Type::String},
+#endif
+#if LIBCZI_USE_PREADPWRITEBASED_STREAMIMPL
+        {"MmapFile_AccessHint", StreamsFactory::StreamProperties::kMmapFile_AccessHint, StreamsFactory::Property::Type::String},
+        {"MmapFile_WillNeed", StreamsFactory::StreamProperties::kMmapFile_WillNeed, StreamsFactory::Property::Type::Boolean},
 #endif
         {nullptr, 0, StreamsFactory::Property::Type::Invalid},
     };
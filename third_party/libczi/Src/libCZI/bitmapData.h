@@ -159,6 +159,7 @@ template <typename tAllocator>
 }
 
 typedef CBitmapData<CHeapAllocator> CStdBitmapData;
+typedef CBitmapData<CPooledAllocator> CPooledBitmapData;
 
 //-----------------------------------------------------------------------------
 
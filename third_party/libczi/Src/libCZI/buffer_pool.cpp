@@ -0,0 +1,281 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "buffer_pool.h"
+#include "stdAllocator.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace libCZI;
+using namespace std;
+
+namespace
+{
+    constexpr int kSmallestSizeClassLog2 = 12;      ///< The smallest size class is 4 KiB...
+    constexpr int kLargestSizeClassLog2 = 31;       ///< ... and the largest one is 3.5 GiB.
+    constexpr int kSizeClassesPerPowerOfTwo = 4;
+    constexpr int kSizeClassCount = (kLargestSizeClassLog2 - kSmallestSizeClassLog2 + 1) * kSizeClassesPerPowerOfTwo;
+
+    int FloorLog2(uint64_t value)
+    {
+        int result = 0;
+        while (value >>= 1)
+        {
+            ++result;
+        }
+
+        return result;
+    }
+
+    /// Gets the index of the smallest size class which is at least 'size', or -1 if 'size' is too small or too large for the size classes.
+    int GetSizeClassIndex(uint64_t size)
+    {
+        if (size < (uint64_t{ 1 } << kSmallestSizeClassLog2))
+        {
+            return -1;
+        }
+
+        int exponent = FloorLog2(size);
+        const uint64_t step = (uint64_t{ 1 } << exponent) / kSizeClassesPerPowerOfTwo;
+        uint64_t sub_class = (size - (uint64_t{ 1 } << exponent) + step - 1) / step;
+        if (sub_class == kSizeClassesPerPowerOfTwo)
+        {
+            ++exponent;
+            sub_class = 0;
+        }
+
+        if (exponent > kLargestSizeClassLog2)
+        {
+            return -1;
+        }
+
+        return (exponent - kSmallestSizeClassLog2) * kSizeClassesPerPowerOfTwo + static_cast<int>(sub_class);
+    }
+
+    uint64_t GetSizeOfSizeClass(int index)
+    {
+        const uint64_t step = (uint64_t{ 1 } << (kSmallestSizeClassLog2 + index / kSizeClassesPerPowerOfTwo)) / kSizeClassesPerPowerOfTwo;
+        return step * (kSizeClassesPerPowerOfTwo + index % kSizeClassesPerPowerOfTwo);
+    }
+
+    struct GlobalState
+    {
+        atomic<uint64_t> max_retained_bytes{ 0 };
+        atomic<uint32_t> buffers_per_thread{ 4 };
+        atomic<uint32_t> generation{ 0 };           ///< Incremented by Configure, which invalidates the thread-local caches.
+        atomic<uint64_t> retained_bytes{ 0 };       ///< The size of the buffers in all thread-local caches and global lists.
+        atomic<uint64_t> peak_retained_bytes{ 0 };
+        atomic<uint64_t> allocation_count{ 0 };
+        atomic<uint64_t> reuse_count{ 0 };
+
+        mutex free_lists_mutex;
+        vector<void*> free_lists[kSizeClassCount];
+    };
+
+    GlobalState& GetGlobalState()
+    {
+        // intentionally leaked, so that it is still there when the thread-local caches are destroyed at thread exit
+        static GlobalState* state = new GlobalState();
+        return *state;
+    }
+
+    /// Accounts for a buffer of the specified size to be retained - if the budget allows.
+    bool TryReserve(GlobalState& state, uint64_t size)
+    {
+        const uint64_t retained = state.retained_bytes.fetch_add(size) + size;
+        if (retained > state.max_retained_bytes.load(memory_order_relaxed))
+        {
+            state.retained_bytes.fetch_sub(size);
+            return false;
+        }
+
+        uint64_t peak = state.peak_retained_bytes.load(memory_order_relaxed);
+        while (retained > peak && !state.peak_retained_bytes.compare_exchange_weak(peak, retained))
+        {
+        }
+
+        return true;
+    }
+
+    void FreeRetained(GlobalState& state, vector<void*>& buffers, int index)
+    {
+        for (void* ptr : buffers)
+        {
+            CHeapAllocator().Free(ptr);
+        }
+
+        state.retained_bytes.fetch_sub(buffers.size() * GetSizeOfSizeClass(index));
+        buffers.clear();
+    }
+
+    struct ThreadCache
+    {
+        uint32_t generation{ 0 };
+        vector<void*> buffers[kSizeClassCount];
+
+        ~ThreadCache()
+        {
+            // hand the buffers over to the global lists, unless the pool was re-configured in the meantime
+            GlobalState& state = GetGlobalState();
+            const bool still_valid = this->generation == state.generation.load();
+            lock_guard<mutex> lck(state.free_lists_mutex);
+            for (int i = 0; i < kSizeClassCount; ++i)
+            {
+                if (still_valid)
+                {
+                    state.free_lists[i].insert(state.free_lists[i].end(), this->buffers[i].begin(), this->buffers[i].end());
+                    this->buffers[i].clear();
+                }
+                else
+                {
+                    FreeRetained(state, this->buffers[i], i);
+                }
+            }
+        }
+    };
+
+    ThreadCache& GetThreadCache(GlobalState& state)
+    {
+        thread_local ThreadCache cache;
+        const uint32_t generation = state.generation.load();
+        if (cache.generation != generation)
+        {
+            for (int i = 0; i < kSizeClassCount; ++i)
+            {
+                FreeRetained(state, cache.buffers[i], i);
+            }
+
+            cache.generation = generation;
+        }
+
+        return cache;
+    }
+}
+
+/*static*/void* BufferPool::Allocate(std::uint64_t size, std::uint64_t* capacity)
+{
+    GlobalState& state = GetGlobalState();
+    ThreadCache& cache = GetThreadCache(state);
+    const int index = state.max_retained_bytes.load(memory_order_relaxed) > 0 ? GetSizeClassIndex(size) : -1;
+    if (index < 0)
+    {
+        *capacity = size;
+        return CHeapAllocator().Allocate(size);
+    }
+
+    const uint64_t size_of_class = GetSizeOfSizeClass(index);
+    *capacity = size_of_class;
+    state.allocation_count.fetch_add(1, memory_order_relaxed);
+
+    void* ptr = nullptr;
+    vector<void*>& cached = cache.buffers[index];
+    if (!cached.empty())
+    {
+        ptr = cached.back();
+        cached.pop_back();
+    }
+    else
+    {
+        lock_guard<mutex> lck(state.free_lists_mutex);
+        vector<void*>& free_list = state.free_lists[index];
+        if (!free_list.empty())
+        {
+            ptr = free_list.back();
+            free_list.pop_back();
+        }
+    }
+
+    if (ptr != nullptr)
+    {
+        state.retained_bytes.fetch_sub(size_of_class);
+        state.reuse_count.fetch_add(1, memory_order_relaxed);
+        return ptr;
+    }
+
+    return CHeapAllocator().Allocate(size_of_class);
+}
+
+/*static*/void BufferPool::Release(void* ptr, std::uint64_t capacity)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    GlobalState& state = GetGlobalState();
+    const int index = GetSizeClassIndex(capacity);
+    if (index >= 0 && GetSizeOfSizeClass(index) == capacity && TryReserve(state, capacity))
+    {
+        vector<void*>& cached = GetThreadCache(state).buffers[index];
+        if (cached.size() < state.buffers_per_thread.load(memory_order_relaxed))
+        {
+            cached.push_back(ptr);
+        }
+        else
+        {
+            lock_guard<mutex> lck(state.free_lists_mutex);
+            state.free_lists[index].push_back(ptr);
+        }
+
+        return;
+    }
+
+    CHeapAllocator().Free(ptr);
+}
+
+/*static*/void BufferPool::Configure(const libCZI::BufferPoolOptions& options)
+{
+    GlobalState& state = GetGlobalState();
+    state.buffers_per_thread.store(options.buffersPerThreadAndSizeClass);
+    state.max_retained_bytes.store(options.maxRetainedBytes);
+    state.generation.fetch_add(1);
+
+    lock_guard<mutex> lck(state.free_lists_mutex);
+    for (int i = 0; i < kSizeClassCount; ++i)
+    {
+        FreeRetained(state, state.free_lists[i], i);
+    }
+}
+
+/*static*/libCZI::BufferPoolStatistics BufferPool::GetStatistics()
+{
+    const GlobalState& state = GetGlobalState();
+    BufferPoolStatistics statistics;
+    statistics.allocationCount = state.allocation_count.load();
+    statistics.reuseCount = state.reuse_count.load();
+    statistics.retainedBytes = state.retained_bytes.load();
+    statistics.peakRetainedBytes = state.peak_retained_bytes.load();
+    return statistics;
+}
+
+/*static*/std::uint64_t BufferPool::GetSizeClass(std::uint64_t size)
+{
+    const int index = GetSizeClassIndex(size);
+    return index >= 0 ? GetSizeOfSizeClass(index) : size;
+}
+
+/*static*/BufferPool::Buffer BufferPool::AllocateBuffer(std::uint64_t size)
+{
+    uint64_t capacity;
+    void* ptr = BufferPool::Allocate(size, &capacity);
+    if (ptr == nullptr)
+    {
+        throw bad_alloc();
+    }
+
+    return Buffer(ptr, Releaser{ capacity });
+}
+
+void libCZI::ConfigureBufferPool(const BufferPoolOptions& options)
+{
+    BufferPool::Configure(options);
+}
+
+libCZI::BufferPoolStatistics libCZI::GetBufferPoolStatistics()
+{
+    return BufferPool::GetStatistics();
+}
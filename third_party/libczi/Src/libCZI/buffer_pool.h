@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "libCZI.h"
+
+/// A process-wide pool of (32-byte aligned) heap buffers, used for bitmaps and for the scratch buffers of the decoders.
+/// Decoding a sub-block typically needs a handful of buffers of the same few sizes over and over again, and for sizes
+/// above the mmap-threshold of the C runtime every allocation means fresh pages from the operating system (and a page
+/// fault for each of them when they are touched). The pool keeps released buffers and hands them out again.
+///
+/// The requested sizes are rounded up to size classes (four per power of two, starting at 4 KiB, so the rounding wastes
+/// less than 25%). Every thread keeps a few buffers per size class in a thread-local cache, which is accessed without
+/// locking; buffers beyond that go to a global free list per size class (guarded by a mutex). The sum of the sizes of all
+/// buffers retained (in all the thread-local caches and in the global lists) is kept within the configured budget, buffers
+/// released beyond it are freed. The pool is disabled by default (i.e. the budget is zero) - then Allocate and Release
+/// are plain heap operations.
+class BufferPool
+{
+public:
+    /// Allocates a buffer of at least the specified size.
+    ///
+    /// \param          size        The requested size in bytes.
+    /// \param [out]    capacity    The actual size of the buffer, which has to be passed to Release. This is either
+    ///                             a size class, or exactly 'size' (if the pool is disabled, or 'size' is too small or
+    ///                             too large for the size classes).
+    ///
+    /// \returns    The buffer, or nullptr if the allocation failed.
+    static void* Allocate(std::uint64_t size, std::uint64_t* capacity);
+
+    /// Releases a buffer obtained from Allocate. It is retained in the pool if the pool is enabled, the capacity is a
+    /// size class and the budget allows, otherwise it is freed.
+    ///
+    /// \param  ptr         The buffer (may be nullptr).
+    /// \param  capacity    The capacity as reported by Allocate.
+    static void Release(void* ptr, std::uint64_t capacity);
+
+    /// Sets the options of the pool, and frees the buffers retained so far - those in the global lists immediately,
+    /// those in the thread-local caches when the respective thread next uses the pool.
+    static void Configure(const libCZI::BufferPoolOptions& options);
+
+    static libCZI::BufferPoolStatistics GetStatistics();
+
+    /// Gets the size class of the specified size, i.e. the size of the buffer which Allocate would return if the pool is
+    /// enabled. If 'size' is too small or too large for the size classes, 'size' is returned.
+    static std::uint64_t GetSizeClass(std::uint64_t size);
+
+    /// A deleter for std::unique_ptr, releasing a buffer of the specified capacity to the pool.
+    struct Releaser
+    {
+        std::uint64_t capacity;
+        void operator()(void* ptr) const { BufferPool::Release(ptr, this->capacity); }
+    };
+
+    typedef std::unique_ptr<void, Releaser> Buffer;
+
+    /// Allocates a buffer of at least the specified size, which is released to the pool when going out of scope.
+    /// In case of an allocation failure, an exception of type std::bad_alloc is thrown.
+    static Buffer AllocateBuffer(std::uint64_t size);
+};
@@ -10,6 +10,8 @@
 #include <common/zstd_errors.h>
 #endif
 #include "bitmapData.h"
+#include "buffer_pool.h"
+#include "Site.h"
 #include "libCZI_Utilities.h"
 #include "utilities.h"
 #include <cstring>
@@ -139,7 +141,7 @@ namespace
             throw runtime_error(ss.str());
         }
 
-        auto bitmap = CStdBitmapData::Create(pixel_type, width, height, stride);
+        auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height, stride);
         auto bitmap_lock_info = libCZI::ScopedBitmapLockerSP(bitmap);
 
         // Decompress the data into the bitmap       
@@ -174,15 +176,11 @@ namespace
             throw runtime_error(ss.str());
         }
 
-        unique_ptr<void, void(*)(void*)> temporary_buffer(malloc(expected_size), free);
-        if (temporary_buffer == nullptr)
-        {
-            throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-        }
+        const auto temporary_buffer = BufferPool::AllocateBuffer(expected_size);
 
         const size_t decompressed_size = DecompressAndThrowIfError(ptr_data, size, temporary_buffer.get(), expected_size, zstd_frame_content_size);
 
-        auto bitmap = CStdBitmapData::Create(pixel_type, width, height);
+        auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height);
         const auto bitmap_lock_info = libCZI::ScopedBitmapLockerSP(bitmap);
 
         // Note: "width * bytes_per_pel / 2" gives the "number of 16-bit pels" in a row, and we divide by 2 because that's
@@ -212,7 +210,7 @@ namespace
         size_t expected_size = height * stride;
         const auto zstd_frame_content_size = GetZstdContentSizeOrThrow(ptr_data, size);
 
-        auto bitmap = CStdBitmapData::Create(pixel_type, width, height, stride);
+        auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height, stride);
         if (zstd_frame_content_size == expected_size)
         {
             // sizes match, so we can decode normally
@@ -242,11 +240,7 @@ namespace
         {
             // sizes mismatch, and the decoded size is larger than expected - we need to decode to a temporary buffer, and
             // copy from there into the bitmap
-            unique_ptr<void, decltype(&free)> temporary_buffer(malloc(zstd_frame_content_size), free);
-            if (temporary_buffer == nullptr)
-            {
-                throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-            }
+            const auto temporary_buffer = BufferPool::AllocateBuffer(zstd_frame_content_size);
 
             DecompressAndThrowIfError(ptr_data, size, temporary_buffer.get(), zstd_frame_content_size, zstd_frame_content_size);
 
@@ -281,30 +275,22 @@ namespace
 
         if (zstd_frame_content_size == expectedSize)
         {
-            unique_ptr<void, decltype(&free)> temporary_buffer(malloc(zstd_frame_content_size), free);
-            if (temporary_buffer == nullptr)
-            {
-                throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-            }
+            const auto temporary_buffer = BufferPool::AllocateBuffer(zstd_frame_content_size);
 
             DecompressAndThrowIfError(ptr_data, size, temporary_buffer.get(), zstd_frame_content_size, zstd_frame_content_size);
 
-            auto bitmap = CStdBitmapData::Create(pixel_type, width, height);
+            auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height);
             auto bitmap_lock_info = libCZI::ScopedBitmapLockerSP(bitmap);
             LoHiBytePackUnpack::LoHiBytePackStrided(temporary_buffer.get(), zstd_frame_content_size, stride / bytes_per_pel, height, bitmap_lock_info.stride, bitmap_lock_info.ptrDataRoi);
             return bitmap;
         }
         else if (zstd_frame_content_size < expectedSize)
         {
-            unique_ptr<void, decltype(&free)> temporary_buffer(malloc(zstd_frame_content_size), free);
-            if (temporary_buffer == nullptr)
-            {
-                throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-            }
+            const auto temporary_buffer = BufferPool::AllocateBuffer(zstd_frame_content_size);
 
             const size_t decompressed_size = DecompressAndThrowIfError(ptr_data, size, temporary_buffer.get(), zstd_frame_content_size, zstd_frame_content_size);
 
-            auto bitmap = CStdBitmapData::Create(pixel_type, width, height, stride);
+            auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height, stride);
             auto bitmap_lock_info = libCZI::ScopedBitmapLockerSP(bitmap);
             LoHiBytePackUnpack::LoHiBytePackStrided(temporary_buffer.get(), zstd_frame_content_size, decompressed_size / bytes_per_pel, 1, zstd_frame_content_size, bitmap_lock_info.ptrDataRoi);
             memset(static_cast<uint8_t*>(bitmap_lock_info.ptrDataRoi) + decompressed_size, 0, expectedSize - decompressed_size);
@@ -314,28 +300,20 @@ namespace
         {
             // sizes mismatch, and the decoded size is larger than expected - we need to decode to a temporary buffer, and
             // copy from there into the bitmap
-            unique_ptr<void, decltype(&free)> temporary_buffer(malloc(zstd_frame_content_size), free);
-            if (temporary_buffer == nullptr)
-            {
-                throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-            }
+            auto temporary_buffer = BufferPool::AllocateBuffer(zstd_frame_content_size);
 
             const size_t decompressed_size = DecompressAndThrowIfError(ptr_data, size, temporary_buffer.get(), zstd_frame_content_size, zstd_frame_content_size);
 
             // Ok, now we need an additional temporary buffer for the packing (we simply cannot pack into the
             //  destination bitmap, at least not without a new LoHiBytePack-method which would allow this)
-            unique_ptr<void, decltype(&free)> temporary_buffer_for_packed(malloc(zstd_frame_content_size), free);
-            if (temporary_buffer_for_packed == nullptr)
-            {
-                throw runtime_error("Failed to allocate temporary buffer for Zstd-decompression.");
-            }
+            const auto temporary_buffer_for_packed = BufferPool::AllocateBuffer(zstd_frame_content_size);
 
             LoHiBytePackUnpack::LoHiBytePackStrided(temporary_buffer.get(), zstd_frame_content_size, decompressed_size / bytes_per_pel, 1, zstd_frame_content_size, temporary_buffer_for_packed.get());
 
             // now we can release the first temporary buffer
             temporary_buffer.reset();
 
-            auto bitmap = CStdBitmapData::Create(pixel_type, width, height, stride);
+            auto bitmap = GetSite()->CreateBitmap(pixel_type, width, height, stride);
             auto bitmap_lock_info = libCZI::ScopedBitmapLockerSP(bitmap);
             memcpy(bitmap_lock_info.ptrDataRoi, temporary_buffer_for_packed.get(), expectedSize);
             return bitmap;
@@ -54,6 +54,45 @@ namespace libCZI
     /// \param [in] pSite The Site-object to use. It must not be nullptr.
     LIBCZI_API void SetSiteObject(libCZI::ISite* pSite);
 
+    /// Options for the pool of buffers which the default Site-objects use for the bitmaps they create (c.f. ISite::CreateBitmap),
+    /// and which the decoders use for their scratch buffers.
+    struct BufferPoolOptions
+    {
+        /// The maximum number of bytes which are kept in the pool for re-use. 0 disables the pool (which is the default),
+        /// then every buffer is allocated from and returned to the heap.
+        std::uint64_t maxRetainedBytes;
+
+        /// The number of buffers of each size class which every thread keeps for re-use without locking. Buffers beyond
+        /// this number go to a global list.
+        std::uint32_t buffersPerThreadAndSizeClass;
+
+        /// Clears this object to its blank state (i.e. a disabled pool).
+        void Clear()
+        {
+            this->maxRetainedBytes = 0;
+            this->buffersPerThreadAndSizeClass = 4;
+        }
+    };
+
+    /// Counters of the buffer pool (c.f. ConfigureBufferPool).
+    struct BufferPoolStatistics
+    {
+        std::uint64_t allocationCount;      ///< The number of buffers requested from the pool (while it was enabled).
+        std::uint64_t reuseCount;           ///< The number of those requests which were served with a retained buffer.
+        std::uint64_t retainedBytes;        ///< The size of the buffers currently kept in the pool.
+        std::uint64_t peakRetainedBytes;    ///< The maximum of 'retainedBytes' so far.
+    };
+
+    /// Configures the buffer pool, which is used for the bitmaps created by the default Site-objects and for the scratch
+    /// buffers of the decoders. The buffers retained so far are freed. This function may be called at any time (and
+    /// concurrently with other operations of the library).
+    /// \param options The options.
+    LIBCZI_API void ConfigureBufferPool(const BufferPoolOptions& options);
+
+    /// Gets the counters of the buffer pool.
+    /// \returns The statistics.
+    LIBCZI_API BufferPoolStatistics GetBufferPoolStatistics();
+
     class ICZIReader;
     class ICziWriter;
     class ICziReaderWriter;
@@ -65,6 +104,7 @@ namespace libCZI
     class ISubBlockRepository;
     class IAttachment;
     class ISubBlockCache;
+    struct SubBlockCacheOptions;
     class ISubBlockMetadata;
     class ISubBlockAttachmentAccessor;
 
@@ -208,6 +248,11 @@ namespace libCZI
     /// \returns    The newly created sub block cache.
     LIBCZI_API std::shared_ptr<ISubBlockCache> CreateSubBlockCache();
 
+    /// Creates a sub block cache object of the type specified in the options.
+    /// \param  options The options specifying the implementation (and its parameters).
+    /// \returns    The newly created sub block cache.
+    LIBCZI_API std::shared_ptr<ISubBlockCache> CreateSubBlockCache(const SubBlockCacheOptions& options);
+
     /// Creates metadata builder object from the specified UTF8-encoded XML-string. If the XML is
     /// invalid or if the root-node "ImageDocument" is not present, then an exception is thrown.
     /// \param  xml The UTF8-encoded XML string.
@@ -257,6 +302,25 @@ namespace libCZI
         virtual ~IStream() = default;
     };
 
+    /// An optional interface of an input stream whose content is accessible in memory, as it is the case for a memory-mapped file.
+    /// If the stream given to a reader implements this interface (which is determined with a dynamic_cast), the data of the sub-blocks
+    /// read refers to the stream's memory directly (c.f. ISubBlock::GetRawData), instead of being copied into a buffer of its own.
+    class IStreamMemoryView
+    {
+    public:
+        /// Gets a view of the stream's content in the range [offset, offset + size). The returned object keeps the memory valid, also
+        /// beyond the lifetime of the stream object. If the range is not available as a view (e.g. because it extends beyond the end of
+        /// the stream), an empty shared_ptr is returned - the caller is then expected to fall back to IStream::Read.
+        ///
+        /// \param offset The offset of the range.
+        /// \param size   The size of the range (in bytes).
+        ///
+        /// \returns A pointer to the content at 'offset', or an empty shared_ptr.
+        virtual std::shared_ptr<const void> GetView(std::uint64_t offset, std::uint64_t size) = 0;
+
+        virtual ~IStreamMemoryView() = default;
+    };
+
     /// Interface used for writing a data-stream. The abstraction used is:
     /// - It is possible to write to arbitrary positions.  
     /// - The end of the stream is defined by the highest position written to.  
@@ -6,6 +6,7 @@
 
 #include "ImportExport.h"
 #include <cstring>
+#include <functional>
 #include <limits>
 #include <vector>
 #include <memory>
@@ -25,12 +26,23 @@ namespace libCZI
         SingleChannelScalingTileAccessor        ///< The scaling-single-channel-tile accessor (associated interface: ISingleChannelScalingTileAccessor).
     };
 
+    /// Values that represent the resampling methods used when a sub-block is scaled into the destination.
+    enum class ResamplingMode : std::uint8_t
+    {
+        NearestNeighbor,    ///< Every destination pixel takes the value of the nearest source pixel. Fast, but aliases when scaling down.
+        AreaAverage,        ///< Every destination pixel is the average of the source area it covers (with partially covered pixels weighted accordingly). For an integer downscale, this is a box filter.
+        Bilinear,           ///< Bilinear interpolation between the four source pixels around the center of the destination pixel.
+        Lanczos3            ///< Lanczos filter with three lobes, widened by the downscale factor when scaling down.
+    };
+
     /// This interface defines how status information about the cache-state can be queried.
     class ISubBlockCacheStatistics
     {
     public:
         static constexpr std::uint8_t kMemoryUsage = 1;     ///< Bit-mask identifying the memory-usage field in the statistics struct.
         static constexpr std::uint8_t kElementsCount = 2;   ///< Bit-mask identifying the elements-count field in the statistics struct.
+        static constexpr std::uint8_t kHitCount = 4;        ///< Bit-mask identifying the hit-count field in the statistics struct.
+        static constexpr std::uint8_t kMissCount = 8;       ///< Bit-mask identifying the miss-count field in the statistics struct.
 
         /// This struct defines the statistics which can be queried from the cache. There is a bitfield which
         /// defines which elements are valid. If the bit is set, then the corresponding member is valid.
@@ -44,11 +56,20 @@ namespace libCZI
 
             /// The number of elements in the cache. This field is only valid if the bit kElementsCount is set in the validityMask.
             std::uint32_t elementsCount;
+
+            /// The number of Get-operations which found the requested element in the cache (since the cache was created).
+            /// This field is only valid if the bit kHitCount is set in the validityMask.
+            std::uint64_t hitCount;
+
+            /// The number of Get-operations which did not find the requested element in the cache (since the cache was created).
+            /// This field is only valid if the bit kMissCount is set in the validityMask.
+            std::uint64_t missCount;
         };
 
         /// Gets momentarily valid statistics about the cache. The mask defines which statistic/s is/are to be retrieved.
-        /// In case of multiple fields being requested, it is guaranteed that all requested fields are a transactional 
-        /// snapshot of the state.
+        /// In case of multiple fields being requested, it is guaranteed that the memory usage and the elements count are a
+        /// transactional snapshot of the state. The hit and miss counters are updated without locking, they are only
+        /// guaranteed to be consistent once all concurrent Get-operations have returned.
         ///
         /// \param  mask A bitmask specifying which fields are requested. Only the fields requested are guaranteed to be valid
         ///              in the returned struct.
@@ -176,6 +197,44 @@ namespace libCZI
         ISubBlockCache& operator=(ISubBlockCache&&) noexcept = delete;
     };
 
+    /// Options for creating a sub-block cache object (c.f. CreateSubBlockCache).
+    struct SubBlockCacheOptions
+    {
+        /// Values that represent the sub-block cache implementations.
+        enum class Type : std::uint8_t
+        {
+            /// All elements are kept in one map guarded by one mutex. Pruning searches for the least recently used element
+            /// for every element it removes.
+            Simple,
+
+            /// The elements are distributed over a number of shards, each with its own mutex, hash map and intrusive LRU list.
+            /// Concurrent operations on different shards do not contend for a lock, evicting an element is O(1) and hits and
+            /// misses are counted without locking. Suited for many threads sharing one cache.
+            Sharded,
+        };
+
+        /// The cache implementation to create.
+        Type type;
+
+        /// The number of shards (only used with Type::Sharded). It is rounded up to a power of two, 0 selects a number
+        /// based on the number of hardware threads.
+        std::uint32_t shardCount;
+
+        /// A memory budget in bytes (only used with Type::Sharded). Every shard gets an equal part of it. When an element is
+        /// added to a shard, the shard's least recently used elements are evicted until the new element fits, and an element
+        /// larger than a shard's part of the budget is not added at all. With the default (the maximum value of the type)
+        /// the cache is only pruned by calling Prune, like the simple implementation.
+        std::uint64_t maxMemoryUsage;
+
+        /// Clears this object to its blank state.
+        void Clear()
+        {
+            this->type = Type::Simple;
+            this->shardCount = 0;
+            this->maxMemoryUsage = (std::numeric_limits<std::uint64_t>::max)();
+        }
+    };
+
     /// The base interface (all accessor interfaces must derive from this).
     class IAccessor
     {
@@ -491,7 +550,7 @@ namespace libCZI
     /// This accessor creates a multi-tile composite of a single channel (and a single plane) with a given zoom-factor.
     /// It will use pyramid sub-blocks (if present) in order to create the destination bitmap. In this operation, it will use
     /// the pyramid-layer just above the specified zoom-factor and scale down to the requested size.\n
-    /// The scaling operation employed here is a simple nearest-neighbor algorithm.
+    /// The scaling operation employed is chosen by the option 'resamplingMode', by default it is a simple nearest-neighbor algorithm.
     class ISingleChannelScalingTileAccessor : public IAccessor
     {
     public:
@@ -533,6 +592,25 @@ namespace libCZI
             /// If true, then masks (if present) are taken into account when composing the tile-composite.
             bool maskAware;
 
+            /// The number of threads reading and decoding the sub-blocks. If greater than 1, the sub-blocks needed for the
+            /// composite are read and decoded concurrently, in batches of twice this number (so only a bounded number of decoded
+            /// sub-blocks is held at a time). Drawing them into the destination is still done one after the other, in the order
+            /// given by the zoom and the M-index, so the result is identical to the one with 0 or 1 (where each sub-block is
+            /// read, decoded and drawn in turn on the calling thread).
+            std::uint32_t decodeThreadCount;
+
+            /// If specified (and decodeThreadCount is greater than 1), the concurrent reading and decoding is run by this function
+            /// instead of threads created by the accessor - e.g. in order to use a thread pool of the application. It is called with
+            /// a number of tasks n and a function which must be called once for every index in [0, n), from any thread and in any
+            /// order. It must only return after all those calls have returned. The function passed in does not throw.
+            std::function<void(int, const std::function<void(int)>&)> decodeTaskRunner;
+
+            /// The resampling method used when scaling a sub-block into the destination. The modes other than nearest-neighbor are
+            /// available if the sub-block and the destination have the same pixel type, which must be Gray8, Gray16, Bgr24 or Bgr48;
+            /// otherwise, and for sub-blocks with a mask (if 'maskAware' is true), nearest-neighbor is used. Every sub-block is resampled
+            /// on its own (with its edge pixels repeated), and exactly the destination pixels which nearest-neighbor would draw are drawn.
+            ResamplingMode resamplingMode;
+
             /// Clears this object to its blank state.
             void Clear()
             {
@@ -544,6 +622,9 @@ namespace libCZI
                 this->maskAware = false;
                 this->subBlockCache.reset();
                 this->onlyUseSubBlockCacheForCompressedData = true;
+                this->decodeThreadCount = 0;
+                this->decodeTaskRunner = nullptr;
+                this->resamplingMode = ResamplingMode::NearestNeighbor;
             }
         };
 
@@ -34,7 +34,7 @@ public:
 
     std::shared_ptr<libCZI::IBitmapData> CreateBitmap(libCZI::PixelType pixeltype, std::uint32_t width, std::uint32_t height, std::uint32_t stride, std::uint32_t extraRows, std::uint32_t extraColumns) override
     {
-        return CStdBitmapData::Create(pixeltype, width, height, stride, extraRows, extraColumns);
+        return CPooledBitmapData::Create(pixeltype, width, height, stride, extraRows, extraColumns);
     }
 
     std::shared_ptr<IDecoder> GetDecoder(ImageDecoderType type, const char* arguments) override
@@ -101,6 +101,9 @@ public:
 
             return this->zstd1decoder;
         }
+        case ImageDecoderType::Jpg:
+            // no built-in JPG decoder
+            break;
         }
 
         return shared_ptr<IDecoder>();
@@ -154,6 +157,9 @@ public:
 
             return this->zstd1decoder;
         }
+        case ImageDecoderType::Jpg:
+            // no built-in JPG decoder
+            break;
         }
 
         return shared_ptr<IDecoder>();
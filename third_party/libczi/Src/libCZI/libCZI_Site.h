@@ -19,7 +19,9 @@ namespace libCZI
 
         ZStd0,          ///< Identifies a decoder capable of decoding a zstd compressed image (type "zstd0").
 
-        ZStd1           ///< Identifies a decoder capable of decoding a zstd compressed image (type "zstd1").
+        ZStd1,          ///< Identifies a decoder capable of decoding a zstd compressed image (type "zstd1").
+
+        Jpg             ///< Identifies a decoder capable of decoding a JPG compressed image. libCZI does not include one, it has to be provided by a custom site-object.
     };
 
     class IBitmapData;
@@ -237,6 +237,15 @@ namespace libCZI
                 /// Possible values are: "DefaultAzureCredential", "EnvironmentCredential", "AzureCliCredential", "ManagedIdentityCredential", "WorkloadIdentityCredential", "ConnectionString".
                 /// The default is: "DefaultAzureCredential".
                 kAzureBlob_AuthenticationMode = 200,
+
+                /// For MmapFileInputStream, type string: the access pattern the kernel is advised of for the whole file (c.f. madvise).
+                /// Possible values are: "Normal", "Sequential" (aggressive read-ahead, pages are dropped soon after being accessed) and
+                /// "Random" (no read-ahead). The default is: "Normal".
+                kMmapFile_AccessHint = 300,
+
+                /// For MmapFileInputStream, type bool: whether the kernel is asked to read ahead the range of a view (i.e. the data of
+                /// a sub-block) when it is handed out (c.f. MADV_WILLNEED). The default is: true.
+                kMmapFile_WillNeed = 301,
             };
         };
 
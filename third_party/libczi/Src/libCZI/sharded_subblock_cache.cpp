@@ -0,0 +1,248 @@
+// SPDX-FileCopyrightText: 2023 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "sharded_subblock_cache.h"
+#include "subblock_cache.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace libCZI;
+using namespace std;
+
+ShardedSubBlockCache::ShardedSubBlockCache(std::uint32_t shard_count, std::uint64_t max_memory_usage)
+    : shard_count_(ShardedSubBlockCache::DetermineShardCount(shard_count))
+{
+    this->shards_ = unique_ptr<Shard[]>(new Shard[this->shard_count_]);
+    this->shard_memory_budget_ = max_memory_usage == numeric_limits<uint64_t>::max() ? max_memory_usage : max_memory_usage / this->shard_count_;
+}
+
+ISubBlockCacheOperation::CacheItem ShardedSubBlockCache::Get(int subblock_index)
+{
+    Shard& shard = this->GetShard(subblock_index);
+    CacheItem result;
+    {
+        lock_guard<mutex> lck(shard.mutex);
+        const auto element = shard.entries.find(subblock_index);
+        if (element != shard.entries.end())
+        {
+            CacheEntry* entry = &element->second;
+            entry->lru_value = this->lru_counter_.fetch_add(1, memory_order_relaxed);
+            if (shard.most_recently_used != entry)
+            {
+                ShardedSubBlockCache::Unlink(shard, entry);
+                ShardedSubBlockCache::LinkAsMostRecentlyUsed(shard, entry);
+            }
+
+            result = CacheItem{ entry->bitmap, entry->mask };
+        }
+    }
+
+    if (result.IsValid())
+    {
+        shard.hit_count.fetch_add(1, memory_order_relaxed);
+    }
+    else
+    {
+        shard.miss_count.fetch_add(1, memory_order_relaxed);
+    }
+
+    return result;
+}
+
+void ShardedSubBlockCache::Add(int subblock_index, const ISubBlockCacheOperation::CacheItem& cache_item)
+{
+    const auto size_of_added_cache_item = SubBlockCache::CalculateSizeInBytes(cache_item.bitmap.get(), cache_item.mask.get());
+    Shard& shard = this->GetShard(subblock_index);
+
+    lock_guard<mutex> lck(shard.mutex);
+    const auto existing = shard.entries.find(subblock_index);
+    if (size_of_added_cache_item > this->shard_memory_budget_)
+    {
+        // The element is not admitted, as it would displace the whole shard. An element already present for this
+        // sub-block is removed nevertheless, since it is meant to be overwritten.
+        if (existing != shard.entries.end())
+        {
+            ShardedSubBlockCache::Evict(shard, &existing->second);
+        }
+
+        return;
+    }
+
+    CacheEntry* entry;
+    if (existing == shard.entries.end())
+    {
+        entry = &shard.entries[subblock_index];
+        entry->subblock_index = subblock_index;
+    }
+    else
+    {
+        entry = &existing->second;
+        shard.size_in_bytes -= entry->size_in_bytes;
+        ShardedSubBlockCache::Unlink(shard, entry);
+    }
+
+    entry->bitmap = cache_item.bitmap;
+    entry->mask = cache_item.mask;
+    entry->size_in_bytes = size_of_added_cache_item;
+    entry->lru_value = this->lru_counter_.fetch_add(1, memory_order_relaxed);
+    shard.size_in_bytes += size_of_added_cache_item;
+    ShardedSubBlockCache::LinkAsMostRecentlyUsed(shard, entry);
+
+    // The new element fits into the budget by itself, so this never evicts it.
+    while (shard.size_in_bytes > this->shard_memory_budget_)
+    {
+        ShardedSubBlockCache::Evict(shard, shard.least_recently_used);
+    }
+}
+
+void ShardedSubBlockCache::Prune(const PruneOptions& options)
+{
+    if (options.maxMemoryUsage == numeric_limits<decltype(options.maxMemoryUsage)>::max() &&
+        options.maxSubBlockCount == numeric_limits<decltype(options.maxSubBlockCount)>::max())
+    {
+        return;
+    }
+
+    // The shards are always locked in the same order (by ascending index), so concurrent prune operations cannot deadlock.
+    vector<unique_lock<mutex>> locks;
+    locks.reserve(this->shard_count_);
+    uint64_t memory_usage = 0;
+    uint64_t element_count = 0;
+    for (uint32_t i = 0; i < this->shard_count_; ++i)
+    {
+        locks.emplace_back(this->shards_[i].mutex);
+        memory_usage += this->shards_[i].size_in_bytes;
+        element_count += this->shards_[i].entries.size();
+    }
+
+    // Merge the shards' LRU lists: the queue holds the least recently used element of every non-empty shard, ordered by LRU value.
+    using Candidate = pair<uint64_t, uint32_t>;
+    priority_queue<Candidate, vector<Candidate>, greater<Candidate>> oldest;
+    for (uint32_t i = 0; i < this->shard_count_; ++i)
+    {
+        if (this->shards_[i].least_recently_used != nullptr)
+        {
+            oldest.emplace(this->shards_[i].least_recently_used->lru_value, i);
+        }
+    }
+
+    while ((memory_usage > options.maxMemoryUsage || element_count > options.maxSubBlockCount) && !oldest.empty())
+    {
+        Shard& shard = this->shards_[oldest.top().second];
+        oldest.pop();
+        memory_usage -= shard.least_recently_used->size_in_bytes;
+        --element_count;
+        ShardedSubBlockCache::Evict(shard, shard.least_recently_used);
+        if (shard.least_recently_used != nullptr)
+        {
+            oldest.emplace(shard.least_recently_used->lru_value, static_cast<uint32_t>(&shard - this->shards_.get()));
+        }
+    }
+}
+
+ISubBlockCacheStatistics::Statistics ShardedSubBlockCache::GetStatistics(std::uint8_t mask) const
+{
+    Statistics result{};
+    if ((mask & (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount)) != 0)
+    {
+        // All shards are locked at the same time, so that the memory usage and the element count are a consistent snapshot.
+        vector<unique_lock<mutex>> locks;
+        locks.reserve(this->shard_count_);
+        uint64_t element_count = 0;
+        for (uint32_t i = 0; i < this->shard_count_; ++i)
+        {
+            locks.emplace_back(this->shards_[i].mutex);
+            result.memoryUsage += this->shards_[i].size_in_bytes;
+            element_count += this->shards_[i].entries.size();
+        }
+
+        result.elementsCount = static_cast<uint32_t>(element_count);
+    }
+
+    for (uint32_t i = 0; i < this->shard_count_; ++i)
+    {
+        result.hitCount += this->shards_[i].hit_count.load(memory_order_relaxed);
+        result.missCount += this->shards_[i].miss_count.load(memory_order_relaxed);
+    }
+
+    result.validityMask = mask & (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount | ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    return result;
+}
+
+ShardedSubBlockCache::Shard& ShardedSubBlockCache::GetShard(int subblock_index) const
+{
+    // Fibonacci hashing, so that runs of consecutive sub-block indices are spread over all shards.
+    const uint32_t hash = static_cast<uint32_t>(subblock_index) * 0x9E3779B9u;
+    return this->shards_[(hash >> 16) & (this->shard_count_ - 1)];
+}
+
+/*static*/void ShardedSubBlockCache::Unlink(Shard& shard, CacheEntry* entry)
+{
+    if (entry->newer != nullptr)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        shard.most_recently_used = entry->older;
+    }
+
+    if (entry->older != nullptr)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        shard.least_recently_used = entry->newer;
+    }
+
+    entry->newer = entry->older = nullptr;
+}
+
+/*static*/void ShardedSubBlockCache::LinkAsMostRecentlyUsed(Shard& shard, CacheEntry* entry)
+{
+    entry->newer = nullptr;
+    entry->older = shard.most_recently_used;
+    if (shard.most_recently_used != nullptr)
+    {
+        shard.most_recently_used->newer = entry;
+    }
+    else
+    {
+        shard.least_recently_used = entry;
+    }
+
+    shard.most_recently_used = entry;
+}
+
+/*static*/void ShardedSubBlockCache::Evict(Shard& shard, CacheEntry* entry)
+{
+    ShardedSubBlockCache::Unlink(shard, entry);
+    shard.size_in_bytes -= entry->size_in_bytes;
+    shard.entries.erase(entry->subblock_index);
+}
+
+/*static*/std::uint32_t ShardedSubBlockCache::DetermineShardCount(std::uint32_t requested_shard_count)
+{
+    constexpr uint32_t kMaxShardCount = 1024;
+    uint32_t shard_count = requested_shard_count;
+    if (shard_count == 0)
+    {
+        // A few shards per hardware thread keep the probability of two threads hitting the same shard low.
+        shard_count = max(1u, thread::hardware_concurrency()) * 4;
+    }
+
+    shard_count = min(shard_count, kMaxShardCount);
+    uint32_t power_of_two = 1;
+    while (power_of_two < shard_count)
+    {
+        power_of_two *= 2;
+    }
+
+    return power_of_two;
+}
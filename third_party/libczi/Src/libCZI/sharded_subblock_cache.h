@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2023 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "libCZI.h"
+#include <unordered_map>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+/// A sub-block cache for many concurrent users. The elements are distributed over shards by their sub-block index,
+/// and each shard has its own mutex, hash map and intrusive LRU list (a doubly linked list through the elements,
+/// ordered from most to least recently used). Operations on different shards therefore do not contend for a lock,
+/// and evicting the least recently used element of a shard is O(1).
+/// Every element carries a stamp from a global "LRU counter", so Prune (which locks all shards) still evicts in the
+/// exact LRU order of the whole cache by merging the shards' lists. Optionally, the cache keeps itself within a memory
+/// budget when elements are added (c.f. SubBlockCacheOptions::maxMemoryUsage).
+class ShardedSubBlockCache : public libCZI::ISubBlockCache
+{
+private:
+    struct CacheEntry
+    {
+        int subblock_index{ 0 };                            ///< The key of the element (needed when evicting it).
+        std::shared_ptr<libCZI::IBitmapData> bitmap;        ///< The cached bitmap.
+        std::shared_ptr<libCZI::IBitonalBitmapData> mask;   ///< The cached bitonal mask (if any).
+        std::uint64_t size_in_bytes{ 0 };                   ///< The memory usage accounted for the element.
+        std::uint64_t lru_value{ 0 };                       ///< The value of the "LRU counter" when the element was last used.
+        CacheEntry* newer{ nullptr };                       ///< The next more recently used element of the shard.
+        CacheEntry* older{ nullptr };                       ///< The next less recently used element of the shard.
+    };
+
+    /// A shard is aligned to a cache line, so that threads working on different shards do not share cache lines.
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<int, CacheEntry> entries;
+        CacheEntry* most_recently_used{ nullptr };
+        CacheEntry* least_recently_used{ nullptr };
+        std::uint64_t size_in_bytes{ 0 };                   ///< The memory usage of the shard's elements (guarded by the mutex).
+        std::atomic<std::uint64_t> hit_count{ 0 };          ///< Counted outside of the mutex.
+        std::atomic<std::uint64_t> miss_count{ 0 };         ///< Counted outside of the mutex.
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    std::uint32_t shard_count_;                             ///< The number of shards, a power of two.
+    std::uint64_t shard_memory_budget_;                     ///< The maximum memory usage of a shard.
+    std::atomic<std::uint64_t> lru_counter_{ 0 };           ///< The "LRU counter" - incremented whenever an element is used.
+public:
+    /// Constructor.
+    /// \param  shard_count         The number of shards, rounded up to a power of two. If 0, a number based on the hardware concurrency is chosen.
+    /// \param  max_memory_usage    The memory budget of the cache (which is split evenly between the shards). The maximum value of the type means "no budget".
+    ShardedSubBlockCache(std::uint32_t shard_count, std::uint64_t max_memory_usage);
+    ~ShardedSubBlockCache() override = default;
+
+    CacheItem Get(int subblock_index) override;
+    void Add(int subblock_index, const CacheItem& cache_item) override;
+    void Prune(const PruneOptions& options) override;
+    Statistics GetStatistics(std::uint8_t mask) const override;
+
+    /// Gets the number of shards.
+    std::uint32_t GetShardCount() const { return this->shard_count_; }
+private:
+    Shard& GetShard(int subblock_index) const;
+    static void Unlink(Shard& shard, CacheEntry* entry);
+    static void LinkAsMostRecentlyUsed(Shard& shard, CacheEntry* entry);
+    static void Evict(Shard& shard, CacheEntry* entry);
+    static std::uint32_t DetermineShardCount(std::uint32_t requested_shard_count);
+};
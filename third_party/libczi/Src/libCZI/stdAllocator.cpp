@@ -7,6 +7,7 @@
 #include <cstdlib>
 #include <stdexcept>
 #include "libCZI_Config.h"
+#include "buffer_pool.h"
 
 constexpr int ALLOC_ALIGNMENT = 32;
 
@@ -50,3 +51,13 @@ void CHeapAllocator::Free(void* ptr)
     free(p1);
 #endif
 }
+
+void* CPooledAllocator::Allocate(std::uint64_t size)
+{
+    return BufferPool::Allocate(size, &this->capacity);
+}
+
+void CPooledAllocator::Free(void* ptr)
+{
+    BufferPool::Release(ptr, this->capacity);
+}
@@ -15,6 +15,17 @@ public:
     void  Free(void* ptr);
 };
 
+/// An allocator using the buffer pool (c.f. BufferPool). It remembers the capacity of the buffer it allocated (which is
+/// needed to release it to the pool), so an instance must only be used for one buffer at a time.
+class CPooledAllocator
+{
+private:
+    std::uint64_t capacity{ 0 };
+public:
+    void* Allocate(std::uint64_t size);
+    void  Free(void* ptr);
+};
+
 class CSharedPtrAllocator
 {
 private:
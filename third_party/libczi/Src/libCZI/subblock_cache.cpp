@@ -3,6 +3,8 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "subblock_cache.h"
+#include "sharded_subblock_cache.h"
+#include <stdexcept>
 
 using namespace libCZI;
 using namespace std;
@@ -12,29 +14,50 @@ std::shared_ptr<ISubBlockCache> libCZI::CreateSubBlockCache()
     return make_shared<SubBlockCache>();
 }
 
+std::shared_ptr<ISubBlockCache> libCZI::CreateSubBlockCache(const SubBlockCacheOptions& options)
+{
+    switch (options.type)
+    {
+    case SubBlockCacheOptions::Type::Simple:
+        return make_shared<SubBlockCache>();
+    case SubBlockCacheOptions::Type::Sharded:
+        return make_shared<ShardedSubBlockCache>(options.shardCount, options.maxMemoryUsage);
+    }
+
+    throw invalid_argument("Unknown sub-block cache type.");
+}
+
 ISubBlockCacheStatistics::Statistics SubBlockCache::GetStatistics(std::uint8_t mask) const
 {
     Statistics result{};
-    if (mask == ISubBlockCacheStatistics::kMemoryUsage)
+    const uint8_t size_mask = mask & (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount);
+    if (size_mask == ISubBlockCacheStatistics::kMemoryUsage)
     {
-        result.validityMask = ISubBlockCacheStatistics::kMemoryUsage;
         result.memoryUsage = this->cache_size_in_bytes_.load();
     }
-    else if (mask == ISubBlockCacheStatistics::kElementsCount)
+    else if (size_mask == ISubBlockCacheStatistics::kElementsCount)
     {
-        result.validityMask = ISubBlockCacheStatistics::kElementsCount;
         result.elementsCount = this->cache_subblock_count_.load();
     }
-    else if (mask == (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount))
+    else if (size_mask == (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount))
     {
-        result.validityMask = ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount;
-
         // We want to ensure that the memory usage and the element count are consistent, therefore we need to lock reading both values.
         lock_guard<mutex> lck(this->mutex_);
         result.memoryUsage = this->cache_size_in_bytes_.load();
         result.elementsCount = this->cache_subblock_count_.load();
     }
 
+    if ((mask & ISubBlockCacheStatistics::kHitCount) != 0)
+    {
+        result.hitCount = this->hit_count_.load();
+    }
+
+    if ((mask & ISubBlockCacheStatistics::kMissCount) != 0)
+    {
+        result.missCount = this->miss_count_.load();
+    }
+
+    result.validityMask = mask & (ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount | ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
     return result;
 }
 
@@ -45,9 +68,11 @@ ISubBlockCacheOperation::CacheItem SubBlockCache::Get(int subblock_index)
     if (element != this->cache_.end())
     {
         element->second.lru_value = this->lru_counter_.fetch_add(1);
+        ++this->hit_count_;
         return { element->second.bitmap, element->second.mask };
     }
 
+    ++this->miss_count_;
     return {};
 }
 
@@ -26,6 +26,8 @@ private:
     std::atomic<std::uint64_t> lru_counter_{ 0 };           ///< The "LRU counter" - when marking a cache entry as "used", this counter is incremented and the new value is stored in the cache entry.
     std::atomic<std::uint64_t> cache_size_in_bytes_{ 0 };   ///< The current size of the cache in bytes.
     std::atomic<std::uint32_t> cache_subblock_count_{ 0 };  ///< The current number of sub-blocks in the cache.
+    std::atomic<std::uint64_t> hit_count_{ 0 };             ///< The number of Get-calls which found the sub-block in the cache.
+    std::atomic<std::uint64_t> miss_count_{ 0 };            ///< The number of Get-calls which did not find the sub-block in the cache.
 public:
     SubBlockCache() = default;
     ~SubBlockCache() override = default;
@@ -34,11 +36,13 @@ public:
     void Add(int subblock_index, const CacheItem& cache_item) override;
     void Prune(const PruneOptions& options) override;
     Statistics GetStatistics(std::uint8_t mask) const override;
+
+    /// The memory usage accounted for a cache element with the specified bitmap and mask (which may be nullptr).
+    static std::uint64_t CalculateSizeInBytes(const libCZI::IBitmapData* bitmap, const libCZI::IBitonalBitmapData* mask);
 private:
     void PruneByMemoryUsageAndElementCount(std::uint64_t max_memory_usage, std::uint32_t max_element_count);
     static std::uint64_t CalculateSizeInBytes(const libCZI::IBitmapData* bitmap);
     static std::uint64_t CalculateSizeInBytes(const libCZI::IBitonalBitmapData* mask);
-    static std::uint64_t CalculateSizeInBytes(const libCZI::IBitmapData* bitmap, const libCZI::IBitonalBitmapData* mask);
     static std::uint64_t CalculateSizeInBytes(const CacheEntry& entry);
     static bool CompareForLruValue(const std::pair<int, CacheEntry>& a, const std::pair<int, CacheEntry>& b);
 };
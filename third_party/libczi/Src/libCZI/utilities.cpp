@@ -589,6 +589,34 @@ tString trimImpl(const tString& str, const tString& whitespace)
 }
 #endif
 
+/*static*/void WeightedRowSum::AccumulateUint8_C(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        accumulator[i] = accumulator[i] + weight * static_cast<float>(row[i]);
+    }
+}
+
+/*static*/void WeightedRowSum::AccumulateUint16_C(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        accumulator[i] = accumulator[i] + weight * static_cast<float>(row[i]);
+    }
+}
+
+#if !LIBCZI_HAS_AVXINTRINSICS
+/*static*/void WeightedRowSum::AccumulateUint8(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    AccumulateUint8_C(row, weight, count, accumulator);
+}
+
+/*static*/void WeightedRowSum::AccumulateUint16(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    AccumulateUint16_C(row, weight, count, accumulator);
+}
+#endif
+
 void RectangleCoverageCalculator::AddRectangle(const libCZI::IntRect& rectangle)
 {
     if (!rectangle.IsValid())
@@ -163,6 +163,20 @@ protected:
     static void CheckLoHiByteUnpackArgumentsAndThrow(std::uint32_t width, std::uint32_t stride, const void* source, void* dest);
 };
 
+/// The kernel of the separable resampling (see BitmapOperationsResample): a weighted row of samples is added
+/// to a row of accumulators. There is an AVX2-version which is chosen at runtime if the CPU supports it, it gives
+/// the same result as the plain C-version to the bit.
+class WeightedRowSum
+{
+public:
+    /// Adds 'weight' times the samples in 'row' to the accumulators, i.e. accumulator[i] += weight * row[i] for i in [0, count).
+    static void AccumulateUint8(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator);
+    static void AccumulateUint16(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator);
+protected:
+    static void AccumulateUint8_C(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator);
+    static void AccumulateUint16_C(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator);
+};
+
 template <typename t>
 struct Nullable
 {
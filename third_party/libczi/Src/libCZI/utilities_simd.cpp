@@ -234,6 +234,107 @@ LoHiBytePackUnpackAvx::pfnLoHiBytePackStrided_t LoHiBytePackUnpackAvx::pfnLoHiBy
     (*LoHiBytePackUnpackAvx::pfnLoHiBytePackStrided)(ptrSrc, sizeSrc, width, height, stride, dest);
 }
 
+class WeightedRowSumAvx : public WeightedRowSum
+{
+public:
+    typedef void(*pfnAccumulateUint8_t)(const std::uint8_t*, float, std::uint32_t, float*);
+    typedef void(*pfnAccumulateUint16_t)(const std::uint16_t*, float, std::uint32_t, float*);
+
+    static pfnAccumulateUint8_t pfnAccumulateUint8;
+    static pfnAccumulateUint16_t pfnAccumulateUint16;
+
+    static void AccumulateUint8_Choose(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator);
+    static void AccumulateUint16_Choose(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator);
+
+    static void AccumulateUint8_AVX(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator);
+    static void AccumulateUint16_AVX(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator);
+};
+
+WeightedRowSumAvx::pfnAccumulateUint8_t WeightedRowSumAvx::pfnAccumulateUint8 = &WeightedRowSumAvx::AccumulateUint8_Choose;
+WeightedRowSumAvx::pfnAccumulateUint16_t WeightedRowSumAvx::pfnAccumulateUint16 = &WeightedRowSumAvx::AccumulateUint16_Choose;
+
+/*static*/void WeightedRowSum::AccumulateUint8(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    (*WeightedRowSumAvx::pfnAccumulateUint8)(row, weight, count, accumulator);
+}
+
+/*static*/void WeightedRowSum::AccumulateUint16(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    (*WeightedRowSumAvx::pfnAccumulateUint16)(row, weight, count, accumulator);
+}
+
+// Note: multiplication and addition are done separately (and not with an FMA-instruction), so that the result is
+//        identical to the one of the C-version.
+/*static*/void WeightedRowSumAvx::AccumulateUint8_AVX(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    const __m256 w = _mm256_set1_ps(weight);
+    const uint32_t countOver8 = count / 8;
+    for (uint32_t i = 0; i < countOver8; ++i)
+    {
+        const __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row))));
+        _mm256_storeu_ps(accumulator, _mm256_add_ps(_mm256_loadu_ps(accumulator), _mm256_mul_ps(w, v)));
+        row += 8;
+        accumulator += 8;
+    }
+
+    for (uint32_t i = countOver8 * 8; i < count; ++i)
+    {
+        *accumulator = *accumulator + weight * static_cast<float>(*row++);
+        ++accumulator;
+    }
+
+    _mm256_zeroupper();
+}
+
+/*static*/void WeightedRowSumAvx::AccumulateUint16_AVX(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    const __m256 w = _mm256_set1_ps(weight);
+    const uint32_t countOver8 = count / 8;
+    for (uint32_t i = 0; i < countOver8; ++i)
+    {
+        const __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row))));
+        _mm256_storeu_ps(accumulator, _mm256_add_ps(_mm256_loadu_ps(accumulator), _mm256_mul_ps(w, v)));
+        row += 8;
+        accumulator += 8;
+    }
+
+    for (uint32_t i = countOver8 * 8; i < count; ++i)
+    {
+        *accumulator = *accumulator + weight * static_cast<float>(*row++);
+        ++accumulator;
+    }
+
+    _mm256_zeroupper();
+}
+
+/*static*/void WeightedRowSumAvx::AccumulateUint8_Choose(const std::uint8_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    if (CheckWhetherCpuSupportsAVX2())
+    {
+        WeightedRowSumAvx::pfnAccumulateUint8 = WeightedRowSumAvx::AccumulateUint8_AVX;
+    }
+    else
+    {
+        WeightedRowSumAvx::pfnAccumulateUint8 = WeightedRowSumAvx::AccumulateUint8_C;
+    }
+
+    (*WeightedRowSumAvx::pfnAccumulateUint8)(row, weight, count, accumulator);
+}
+
+/*static*/void WeightedRowSumAvx::AccumulateUint16_Choose(const std::uint16_t* row, float weight, std::uint32_t count, float* accumulator)
+{
+    if (CheckWhetherCpuSupportsAVX2())
+    {
+        WeightedRowSumAvx::pfnAccumulateUint16 = WeightedRowSumAvx::AccumulateUint16_AVX;
+    }
+    else
+    {
+        WeightedRowSumAvx::pfnAccumulateUint16 = WeightedRowSumAvx::AccumulateUint16_C;
+    }
+
+    (*WeightedRowSumAvx::pfnAccumulateUint16)(row, weight, count, accumulator);
+}
+
 #elif LIBCZI_HAS_NEOININTRINSICS
 
 #include <arm_neon.h>
@@ -4,6 +4,7 @@
 
 #include "include_gtest.h"
 #include <array>
+#include <functional>
 #include <tuple>
 #include <memory>
 #include "inc_libCZI.h"
@@ -312,6 +313,52 @@ TEST_P(ZOrderAndResultGray8Fixture, CreateDocumentAndUseSingleChannelScalingTile
     EXPECT_EQ(p[3], expected[3]);
 }
 
+TEST_P(ZOrderAndResultGray8Fixture, CreateDocumentAndUseSingleChannelScalingTileAccessorWithConcurrentDecodeAndCheckResult)
+{
+    // Same as above, but with the subblocks being decoded concurrently - once on threads of the accessor, and once
+    // with a task-runner which decodes the subblocks in reverse order. The result must not depend on this.
+    const auto parameters = GetParam();
+
+    // arrange
+    auto czi_document_as_blob = CreateTestCziDocumentAndGetAsBlob(array<int, 3>{ get<0>(parameters), get<1>(parameters), get<2>(parameters) });
+    const auto memory_stream = make_shared<CMemInputOutputStream>(get<0>(czi_document_as_blob).get(), get<1>(czi_document_as_blob));
+    const auto reader = CreateCZIReader();
+    reader->Open(memory_stream);
+    const auto accessor = reader->CreateSingleChannelScalingTileAccessor();
+    const CDimCoordinate plane_coordinate{ {DimensionIndex::C, 0} };
+    ISingleChannelScalingTileAccessor::Options options;
+    options.Clear();
+    options.decodeThreadCount = 4;
+    ISingleChannelScalingTileAccessor::Options options_with_task_runner = options;
+    int tasks_run = 0;
+    options_with_task_runner.decodeTaskRunner = [&](int task_count, const std::function<void(int)>& task)
+        {
+            for (int i = task_count - 1; i >= 0; --i)
+            {
+                task(i);
+                ++tasks_run;
+            }
+        };
+
+    // act
+    const auto composite_bitmap = accessor->Get(PixelType::Gray8, IntRect{ 0,0,4,1 }, &plane_coordinate, 1.f, &options);
+    const auto composite_bitmap_with_task_runner = accessor->Get(PixelType::Gray8, IntRect{ 0,0,4,1 }, &plane_coordinate, 1.f, &options_with_task_runner);
+
+    // assert
+    const auto& expected = get<3>(parameters);
+    for (const auto& bitmap : { composite_bitmap, composite_bitmap_with_task_runner })
+    {
+        const ScopedBitmapLockerSP lock_info_bitmap{ bitmap };
+        const uint8_t* p = static_cast<const uint8_t*>(lock_info_bitmap.ptrDataRoi);
+        EXPECT_EQ(p[0], expected[0]);
+        EXPECT_EQ(p[1], expected[1]);
+        EXPECT_EQ(p[2], expected[2]);
+        EXPECT_EQ(p[3], expected[3]);
+    }
+
+    EXPECT_EQ(tasks_run, 3);
+}
+
 TEST_P(ZOrderAndResultGray8Fixture, CreateDocumentAndUseSingleChannelTileAccessorWithSortByMAndCheckResult)
 {
     // We create a document with 3 subblocks, where the M-index (of each subblock) is given by the test parameters.
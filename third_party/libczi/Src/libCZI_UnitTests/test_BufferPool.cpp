@@ -0,0 +1,219 @@
+// SPDX-FileCopyrightText: 2025 Carl Zeiss Microscopy GmbH
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "include_gtest.h"
+#include "inc_libCZI.h"
+#include "utils.h"
+#include "MemInputOutputStream.h"
+#include "MemOutputStream.h"
+#include "../libCZI/buffer_pool.h"
+#include "../libCZI/decoder_zstd.h"
+
+using namespace libCZI;
+using namespace std;
+
+namespace
+{
+    /// Enables the buffer pool for the lifetime of the object (and disables it afterwards, which is the default).
+    struct ScopedBufferPool
+    {
+        explicit ScopedBufferPool(uint64_t max_retained_bytes, uint32_t buffers_per_thread = 4)
+        {
+            BufferPoolOptions options;
+            options.Clear();
+            options.maxRetainedBytes = max_retained_bytes;
+            options.buffersPerThreadAndSizeClass = buffers_per_thread;
+            ConfigureBufferPool(options);
+        }
+
+        ~ScopedBufferPool()
+        {
+            BufferPoolOptions options;
+            options.Clear();
+            ConfigureBufferPool(options);
+        }
+    };
+}
+
+TEST(BufferPool, SizeClasses)
+{
+    EXPECT_EQ(BufferPool::GetSizeClass(100), 100u);
+    EXPECT_EQ(BufferPool::GetSizeClass(4095), 4095u);
+    EXPECT_EQ(BufferPool::GetSizeClass(4096), 4096u);
+    EXPECT_EQ(BufferPool::GetSizeClass(4097), 5120u);
+    EXPECT_EQ(BufferPool::GetSizeClass(7169), 8192u);
+    EXPECT_EQ(BufferPool::GetSizeClass(8192), 8192u);
+    EXPECT_EQ(BufferPool::GetSizeClass(3 * 1024 * 1024 + 1), 3 * 1024 * 1024 + 512 * 1024u);
+    EXPECT_EQ(BufferPool::GetSizeClass(uint64_t{ 1 } << 33), uint64_t{ 1 } << 33);
+    for (uint64_t size = 4096; size < 1000000; size += 997)
+    {
+        const uint64_t size_class = BufferPool::GetSizeClass(size);
+        EXPECT_GE(size_class, size);
+        EXPECT_LT(size_class, size + size / 4 + 1);
+    }
+}
+
+TEST(BufferPool, DisabledPoolDoesNotRetain)
+{
+    const auto before = GetBufferPoolStatistics();
+    uint64_t capacity;
+    void* ptr = BufferPool::Allocate(100000, &capacity);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(capacity, 100000u);
+    BufferPool::Release(ptr, capacity);
+    const auto after = GetBufferPoolStatistics();
+    EXPECT_EQ(after.retainedBytes, 0u);
+    EXPECT_EQ(after.allocationCount, before.allocationCount);
+}
+
+TEST(BufferPool, ReleasedBufferIsReused)
+{
+    ScopedBufferPool pool(16 * 1024 * 1024);
+    const auto before = GetBufferPoolStatistics();
+    uint64_t capacity;
+    void* ptr = BufferPool::Allocate(100000, &capacity);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(capacity, BufferPool::GetSizeClass(100000));
+    BufferPool::Release(ptr, capacity);
+    EXPECT_EQ(GetBufferPoolStatistics().retainedBytes, capacity);
+
+    // a request of a different size in the same size class gets the same buffer
+    uint64_t capacity2;
+    void* ptr2 = BufferPool::Allocate(99000, &capacity2);
+    EXPECT_EQ(ptr2, ptr);
+    EXPECT_EQ(capacity2, capacity);
+    const auto after = GetBufferPoolStatistics();
+    EXPECT_EQ(after.allocationCount - before.allocationCount, 2u);
+    EXPECT_EQ(after.reuseCount - before.reuseCount, 1u);
+    EXPECT_EQ(after.retainedBytes, 0u);
+    BufferPool::Release(ptr2, capacity2);
+}
+
+TEST(BufferPool, RetainedBytesStayWithinBudget)
+{
+    // 2 buffers per thread, so half of the buffers go to the global list, and the fifth one exceeds the budget
+    ScopedBufferPool pool(128 * 1024, 2);
+    const auto before = GetBufferPoolStatistics();
+    vector<BufferPool::Buffer> buffers;
+    for (int i = 0; i < 5; ++i)
+    {
+        buffers.emplace_back(BufferPool::AllocateBuffer(32 * 1024));
+    }
+
+    buffers.clear();
+    auto statistics = GetBufferPoolStatistics();
+    EXPECT_EQ(statistics.retainedBytes, 128 * 1024u);
+    EXPECT_EQ(statistics.peakRetainedBytes, 128 * 1024u);
+
+    // the buffers from the thread-local cache and from the global list are re-used
+    for (int i = 0; i < 5; ++i)
+    {
+        buffers.emplace_back(BufferPool::AllocateBuffer(32 * 1024));
+    }
+
+    statistics = GetBufferPoolStatistics();
+    EXPECT_EQ(statistics.retainedBytes, 0u);
+    EXPECT_EQ(statistics.allocationCount - before.allocationCount, 10u);
+    EXPECT_EQ(statistics.reuseCount - before.reuseCount, 4u);
+    buffers.clear();
+    EXPECT_EQ(GetBufferPoolStatistics().retainedBytes, 128 * 1024u);
+}
+
+TEST(BufferPool, ReconfiguringFreesRetainedBuffers)
+{
+    {
+        ScopedBufferPool pool(1024 * 1024);
+        BufferPool::AllocateBuffer(32 * 1024);
+        BufferPool::AllocateBuffer(40 * 1024);
+        EXPECT_GT(GetBufferPoolStatistics().retainedBytes, 0u);
+    }
+
+    // the global lists are emptied right away, the thread-local cache when the thread next uses the pool
+    BufferPool::AllocateBuffer(1000);
+    EXPECT_EQ(GetBufferPoolStatistics().retainedBytes, 0u);
+}
+
+TEST(BufferPool, ZstdDecodeGivesSameResultWithPool)
+{
+    const auto bitmap = CreateRandomBitmap(PixelType::Gray16, 500, 300);
+    CompressParametersOnMap parameters;
+    parameters.map[static_cast<int>(CompressionParameterKey::ZSTD_PREPROCESS_DOLOHIBYTEPACKING)] = CompressParameter(true);
+    ScopedBitmapLockerSP lock{ bitmap };
+    const auto compressed = ZstdCompress::CompressZStd1Alloc(bitmap->GetWidth(), bitmap->GetHeight(), lock.stride, bitmap->GetPixelType(), lock.ptrDataRoi, &parameters);
+
+    const auto decoder = CZstd1Decoder::Create();
+    ScopedBufferPool pool(16 * 1024 * 1024);
+    const auto before = GetBufferPoolStatistics();
+    for (int i = 0; i < 3; ++i)
+    {
+        const auto decoded = decoder->Decode(compressed->GetPtr(), compressed->GetSizeOfData(), PixelType::Gray16, 500, 300);
+        EXPECT_TRUE(AreBitmapDataEqual(bitmap, decoded));
+    }
+
+    // the bitmap and the temporary buffer of the second and third decode are re-used
+    const auto after = GetBufferPoolStatistics();
+    EXPECT_EQ(after.allocationCount - before.allocationCount, 6u);
+    EXPECT_EQ(after.reuseCount - before.reuseCount, 4u);
+}
+
+TEST(BufferPool, ScalingAccessorDoesNotShowPreviousContentOfPooledBitmap)
+{
+    // two 64x64 sub-blocks at x=0 and x=128, so that the ROI (0,0,192,64) has a gap between them
+    auto writer = CreateCZIWriter();
+    auto out_stream = make_shared<CMemOutputStream>(0);
+    writer->Create(out_stream, make_shared<CCziWriterInfo>(GUID{ 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } }));
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto bitmap = CreateGray8BitmapAndFill(64, 64, 42);
+        AddSubBlockInfoStridedBitmap add_info;
+        add_info.Clear();
+        add_info.coordinate.Set(DimensionIndex::C, 0);
+        add_info.mIndexValid = true;
+        add_info.mIndex = i;
+        add_info.x = i * 128;
+        add_info.y = 0;
+        add_info.logicalWidth = add_info.physicalWidth = 64;
+        add_info.logicalHeight = add_info.physicalHeight = 64;
+        add_info.PixelType = PixelType::Gray8;
+        ScopedBitmapLockerSP lock{ bitmap };
+        add_info.ptrBitmap = lock.ptrDataRoi;
+        add_info.strideBitmap = lock.stride;
+        writer->SyncAddSubBlock(add_info);
+    }
+
+    writer->Close();
+    size_t size = 0;
+    const auto data = out_stream->GetCopy(&size);
+    const auto reader = CreateCZIReader();
+    reader->Open(make_shared<CMemInputOutputStream>(data.get(), size));
+    const auto accessor = reader->CreateSingleChannelScalingTileAccessor();
+    const CDimCoordinate plane_coordinate{ { DimensionIndex::C, 0 } };
+
+    ScopedBufferPool pool(16 * 1024 * 1024);
+    {
+        // leave a dirty buffer of the composite's size class in the pool
+        const auto dirty = GetDefaultSiteObject(SiteObjectType::Default)->CreateBitmap(PixelType::Gray8, 192, 64);
+        ScopedBitmapLockerSP lock{ dirty };
+        for (uint32_t y = 0; y < 64; ++y)
+        {
+            memset(static_cast<uint8_t*>(lock.ptrDataRoi) + y * static_cast<size_t>(lock.stride), 0xab, 192);
+        }
+    }
+
+    const auto before = GetBufferPoolStatistics();
+    ISingleChannelScalingTileAccessor::Options options;
+    options.Clear();    // the background color is NaN, i.e. "do not clear"
+    const auto composite = accessor->Get(PixelType::Gray8, IntRect{ 0, 0, 192, 64 }, &plane_coordinate, 1.f, &options);
+    EXPECT_GT(GetBufferPoolStatistics().reuseCount, before.reuseCount);
+
+    const ScopedBitmapLockerSP lock{ composite };
+    for (uint32_t y = 0; y < 64; ++y)
+    {
+        const uint8_t* row = static_cast<const uint8_t*>(lock.ptrDataRoi) + y * static_cast<size_t>(lock.stride);
+        for (uint32_t x = 0; x < 192; ++x)
+        {
+            ASSERT_EQ(row[x], (x < 64 || x >= 128) ? 42 : 0) << "at (" << x << "," << y << ")";
+        }
+    }
+}
@@ -236,3 +236,100 @@ TEST(CziSubBlockDirectory, CziSubBlockDirectory1)
 
     //auto pyramidStatistics = subBlkDir.GetPyramidStatistics();
 }
+
+static std::vector<int> GetSubBlocksIntersectingByLinearScan(const std::vector<CCziSubBlockDirectory::SubBlkEntry>& entries, const IntRect& roi)
+{
+    std::vector<int> indices;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const auto& e = entries[i];
+        const IntRect intersection = IntRect{ e.x, e.y, e.width, e.height }.Intersect(roi);
+        if (intersection.w > 0 && intersection.h > 0)
+        {
+            indices.push_back(static_cast<int>(i));
+        }
+    }
+
+    return indices;
+}
+
+TEST(CziSubBlockDirectory, SpatialIndexGivesSameResultAsLinearScan)
+{
+    // two scenes of overlapping layer-0 subblocks (far apart, so the grid has to cope with a sparse layout), with
+    //  pyramid subblocks of minification 2 and 4 on top, plus a subblock with an empty logical rectangle
+    std::vector<CCziSubBlockDirectory::SubBlkEntry> entries;
+    auto add = [&](int s, int x, int y, int w, int h, int storedW, int storedH)
+    {
+        const std::string coordinate = "C0S" + std::to_string(s);
+        const SubBlockEntryData data{ coordinate.c_str(), static_cast<int>(entries.size()), x, y, w, h, storedW, storedH };
+        entries.push_back(SubBlkEntryFromSubBlockEntryData(&data));
+    };
+
+    for (int s = 0; s < 2; ++s)
+    {
+        const int x0 = s == 0 ? -3000 : 200000;
+        const int y0 = s == 0 ? -1000 : 150000;
+        for (int y = 0; y < 12; ++y)
+        {
+            for (int x = 0; x < 15; ++x)
+            {
+                add(s, x0 + x * 460, y0 + y * 460, 512, 512, 512, 512);
+            }
+        }
+
+        for (int minification = 2; minification <= 4; minification *= 2)
+        {
+            for (int y = 0; y < 12 * 460; y += 512 * minification)
+            {
+                for (int x = 0; x < 15 * 460; x += 512 * minification)
+                {
+                    add(s, x0 + x, y0 + y, 512 * minification, 512 * minification, 512, 512);
+                }
+            }
+        }
+    }
+
+    add(0, 100, 100, 0, 512, 0, 512);
+
+    CCziSubBlockDirectory subBlkDir;
+    for (const auto& entry : entries)
+    {
+        subBlkDir.AddSubBlock(entry);
+    }
+
+    subBlkDir.AddingFinished();
+
+    auto query = [&](const IntRect& roi)
+    {
+        std::vector<int> indices;
+        subBlkDir.EnumSubBlocksIntersecting(roi, [&](int index, const CCziSubBlockDirectory::SubBlkEntry&)->bool
+            {
+                indices.push_back(index);
+                return true;
+            });
+        return indices;
+    };
+
+    std::uint32_t state = 42;
+    auto random = [&](int range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<int>((state >> 8) % static_cast<std::uint32_t>(range));
+    };
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        const bool secondScene = random(2) == 1;
+        const IntRect roi{
+            (secondScene ? 200000 : -3000) + random(8000) - 1000,
+            (secondScene ? 150000 : -1000) + random(7000) - 1000,
+            random(3000) + (i % 10 == 0 ? 0 : 1),
+            random(3000) + 1 };
+        EXPECT_EQ(query(roi), GetSubBlocksIntersectingByLinearScan(entries, roi)) << "for ROI " << roi.x << "," << roi.y << "," << roi.w << "," << roi.h;
+    }
+
+    // a ROI covering everything, one in between the scenes, and one beyond them
+    EXPECT_EQ(query(IntRect{ -100000, -100000, 1000000, 1000000 }).size(), entries.size() - 1);
+    EXPECT_TRUE(query(IntRect{ 50000, 50000, 1000, 1000 }).empty());
+    EXPECT_TRUE(query(IntRect{ 900000, 900000, 1000, 1000 }).empty());
+}
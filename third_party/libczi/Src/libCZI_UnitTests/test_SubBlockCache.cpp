@@ -5,6 +5,9 @@
 #include "include_gtest.h"
 #include "inc_libCZI.h"
 #include "utils.h"
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace libCZI;
 using namespace std;
@@ -156,3 +159,171 @@ TEST(SubBlockCache, PruneCacheCase3)
     cache_item_from_cache = cache->Get(2);
     EXPECT_TRUE(cache_item_from_cache.IsValid());
 }
+
+TEST(SubBlockCache, HitAndMissCount)
+{
+    const auto cache = CreateSubBlockCache();
+    cache->Add(0, { CreateTestBitmap(PixelType::Gray8, 4, 2) });
+    EXPECT_TRUE(cache->Get(0).IsValid());
+    EXPECT_TRUE(cache->Get(0).IsValid());
+    EXPECT_FALSE(cache->Get(1).IsValid());
+
+    const auto statistics = cache->GetStatistics(ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    EXPECT_EQ(statistics.validityMask, ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    EXPECT_EQ(statistics.hitCount, 2);
+    EXPECT_EQ(statistics.missCount, 1);
+}
+
+namespace
+{
+    shared_ptr<ISubBlockCache> CreateShardedSubBlockCache(uint32_t shard_count, uint64_t max_memory_usage = numeric_limits<uint64_t>::max())
+    {
+        SubBlockCacheOptions options;
+        options.Clear();
+        options.type = SubBlockCacheOptions::Type::Sharded;
+        options.shardCount = shard_count;
+        options.maxMemoryUsage = max_memory_usage;
+        return CreateSubBlockCache(options);
+    }
+}
+
+TEST(SubBlockCache, ShardedOverwriteExistingAndGetStatistics)
+{
+    const auto cache = CreateShardedSubBlockCache(4);
+    const auto bm1 = CreateTestBitmap(PixelType::Bgr24, 163, 128);
+    cache->Add(0, { bm1 });
+    const auto bm2 = CreateTestBitmap(PixelType::Bgr24, 161, 114);
+    cache->Add(1, { bm2 });
+    const auto bm3 = CreateTestBitmap(PixelType::Gray8, 11, 14);
+    cache->Add(1, { bm3 });
+
+    EXPECT_TRUE(AreBitmapDataEqual(bm1, cache->Get(0).bitmap));
+    EXPECT_TRUE(AreBitmapDataEqual(bm3, cache->Get(1).bitmap));
+    EXPECT_FALSE(cache->Get(2).IsValid());
+
+    const auto statistics = cache->GetStatistics(ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount | ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    EXPECT_EQ(statistics.validityMask, ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount | ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    EXPECT_EQ(statistics.memoryUsage, 163 * 128 * 3 + 11 * 14);
+    EXPECT_EQ(statistics.elementsCount, 2);
+    EXPECT_EQ(statistics.hitCount, 2);
+    EXPECT_EQ(statistics.missCount, 1);
+}
+
+TEST(SubBlockCache, ShardedPruneEvictsInLruOrderAcrossShards)
+{
+    // Elements 0..63 are spread over 8 shards. After using the elements with an even index, pruning to 32 elements
+    // must keep exactly those (i.e. the LRU order is global and not per shard).
+    const auto cache = CreateShardedSubBlockCache(8);
+    for (int i = 0; i < 64; ++i)
+    {
+        cache->Add(i, { CreateTestBitmap(PixelType::Gray8, 1, 1) });
+    }
+
+    for (int i = 0; i < 64; i += 2)
+    {
+        EXPECT_TRUE(cache->Get(i).IsValid());
+    }
+
+    cache->Prune({ numeric_limits<uint64_t>::max(), 32 });
+    EXPECT_EQ(cache->GetStatistics(ISubBlockCacheStatistics::kElementsCount).elementsCount, 32);
+    for (int i = 0; i < 64; ++i)
+    {
+        EXPECT_EQ(cache->Get(i).IsValid(), i % 2 == 0) << "element " << i;
+    }
+
+    ISubBlockCache::PruneOptions prune_options;
+    prune_options.maxMemoryUsage = 1;
+    cache->Prune(prune_options);
+    const auto statistics = cache->GetStatistics(ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount);
+    EXPECT_EQ(statistics.memoryUsage, 1);
+    EXPECT_EQ(statistics.elementsCount, 1);
+    EXPECT_TRUE(cache->Get(62).IsValid());
+}
+
+TEST(SubBlockCache, ShardedMemoryBudgetEvictsOnAddAndRejectsOversizedElements)
+{
+    // One shard with a budget of 100 bytes: adding a fourth element of 30 bytes evicts the least recently used one,
+    // and an element larger than the budget is not admitted (and removes the element it would have overwritten).
+    const auto cache = CreateShardedSubBlockCache(1, 100);
+    cache->Add(0, { CreateTestBitmap(PixelType::Gray8, 30, 1) });
+    cache->Add(1, { CreateTestBitmap(PixelType::Gray8, 30, 1) });
+    cache->Add(2, { CreateTestBitmap(PixelType::Gray8, 30, 1) });
+    EXPECT_TRUE(cache->Get(0).IsValid());
+    cache->Add(3, { CreateTestBitmap(PixelType::Gray8, 30, 1) });
+
+    EXPECT_TRUE(cache->Get(0).IsValid());
+    EXPECT_FALSE(cache->Get(1).IsValid());
+    EXPECT_TRUE(cache->Get(2).IsValid());
+    EXPECT_TRUE(cache->Get(3).IsValid());
+
+    cache->Add(2, { CreateTestBitmap(PixelType::Gray8, 101, 1) });
+    EXPECT_FALSE(cache->Get(2).IsValid());
+    const auto statistics = cache->GetStatistics(ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount);
+    EXPECT_EQ(statistics.memoryUsage, 60);
+    EXPECT_EQ(statistics.elementsCount, 2);
+}
+
+TEST(SubBlockCache, ShardedConcurrentAccess)
+{
+    // Several threads add, get and prune concurrently. Every element found must be the bitmap added for its key, and
+    // the statistics must add up afterwards.
+    const auto cache = CreateShardedSubBlockCache(0);
+    constexpr int kThreadCount = 8;
+    constexpr int kOperationsPerThread = 5000;
+    constexpr int kKeyCount = 512;
+    vector<shared_ptr<IBitmapData>> bitmaps;
+    for (int i = 0; i < kKeyCount; ++i)
+    {
+        bitmaps.push_back(CreateTestBitmap(PixelType::Gray8, 1 + i % 7, 1));
+    }
+
+    atomic<bool> all_found_elements_correct{ true };
+    vector<thread> threads;
+    for (int t = 0; t < kThreadCount; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            uint32_t state = 17 + t;
+            for (int i = 0; i < kOperationsPerThread; ++i)
+            {
+                state = state * 1664525u + 1013904223u;
+                const int key = static_cast<int>((state >> 8) % kKeyCount);
+                const auto item = cache->Get(key);
+                if (!item.IsValid())
+                {
+                    cache->Add(key, { bitmaps[key] });
+                }
+                else if (item.bitmap != bitmaps[key])
+                {
+                    all_found_elements_correct = false;
+                }
+
+                if (i % 500 == 499)
+                {
+                    cache->Prune({ numeric_limits<uint64_t>::max(), 200 });
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_TRUE(all_found_elements_correct);
+    const auto statistics = cache->GetStatistics(ISubBlockCacheStatistics::kMemoryUsage | ISubBlockCacheStatistics::kElementsCount | ISubBlockCacheStatistics::kHitCount | ISubBlockCacheStatistics::kMissCount);
+    EXPECT_EQ(statistics.hitCount + statistics.missCount, static_cast<uint64_t>(kThreadCount) * kOperationsPerThread);
+    uint64_t memory_usage = 0;
+    uint32_t elements_count = 0;
+    for (int i = 0; i < kKeyCount; ++i)
+    {
+        if (cache->Get(i).IsValid())
+        {
+            memory_usage += bitmaps[i]->GetSize().w;
+            ++elements_count;
+        }
+    }
+
+    EXPECT_EQ(statistics.memoryUsage, memory_usage);
+    EXPECT_EQ(statistics.elementsCount, elements_count);
+}
@@ -6,6 +6,11 @@
 #include "testImage.h"
 #include "inc_libCZI.h"
 #include "utils.h"
+#include "../libCZI/BitmapOperationsResample.h"
+#include "../libCZI/utilities.h"
+#include <cmath>
+#include <random>
+#include <vector>
 
 using namespace libCZI;
 
@@ -357,3 +362,160 @@ TEST(BitmapOperations, CopyWithOffsetGray8ToGray16_2)
 
     ASSERT_EQ(memcmp(destination_locked.ptrDataRoi, expected_result_data, 8 * 8 * 2), 0);
 }
+
+TEST(BitmapOperations, ResampleAreaAverageWithIntegerDownscaleGray8)
+{
+    // a 4x4 bitmap is scaled down to 2x2, every destination pixel must be the mean of a 2x2 block
+    static const uint8_t source_data[4 * 4] =
+    {
+        0, 4, 10, 10,
+        8, 12, 20, 20,
+        1, 1, 255, 253,
+        3, 3, 251, 249
+    };
+
+    const auto source = CreateTestBitmap(PixelType::Gray8, 4, 4);
+    const auto destination = CreateTestBitmap(PixelType::Gray8, 2, 2);
+    {
+        const ScopedBitmapLockerSP source_locked{ source };
+        for (int y = 0; y < 4; ++y)
+        {
+            memcpy(static_cast<uint8_t*>(source_locked.ptrDataRoi) + static_cast<size_t>(y) * source_locked.stride, source_data + y * 4, 4);
+        }
+    }
+
+    BitmapOperationsResample::Resize(ResamplingMode::AreaAverage, source.get(), destination.get(), DblRect{ 0, 0, 4, 4 }, DblRect{ 0, 0, 2, 2 });
+
+    const ScopedBitmapLockerSP destination_locked{ destination };
+    const uint8_t* p = static_cast<const uint8_t*>(destination_locked.ptrDataRoi);
+    EXPECT_EQ(p[0], 6);
+    EXPECT_EQ(p[1], 15);
+    EXPECT_EQ(p[destination_locked.stride], 2);
+    EXPECT_EQ(p[destination_locked.stride + 1], 252);
+}
+
+TEST(BitmapOperations, ResampleWithZoomOneIsCopy)
+{
+    // for a scale factor of 1, every resampling mode must give an exact copy
+    for (const auto pixel_type : { PixelType::Gray8, PixelType::Gray16, PixelType::Bgr24, PixelType::Bgr48 })
+    {
+        for (const auto mode : { ResamplingMode::AreaAverage, ResamplingMode::Bilinear, ResamplingMode::Lanczos3 })
+        {
+            const auto source = CreateRandomBitmap(pixel_type, 37, 23);
+            const auto destination = CreateTestBitmap(pixel_type, 37, 23);
+            BitmapOperationsResample::Resize(mode, source.get(), destination.get(), DblRect{ 0, 0, 37, 23 }, DblRect{ 0, 0, 37, 23 });
+            EXPECT_TRUE(AreBitmapDataEqual(source, destination)) << "pixel type " << static_cast<int>(pixel_type) << ", mode " << static_cast<int>(mode);
+        }
+    }
+}
+
+TEST(BitmapOperations, ResampleConstantBitmapStaysConstant)
+{
+    // the weights are normalized, so a constant bitmap must stay constant for any scale factor
+    for (const auto mode : { ResamplingMode::AreaAverage, ResamplingMode::Bilinear, ResamplingMode::Lanczos3 })
+    {
+        for (const double zoom : { 0.04, 0.3, 0.5, 1.7 })
+        {
+            const auto source = CreateTestBitmap(PixelType::Bgr48, 100, 60);
+            {
+                const ScopedBitmapLockerSP locked{ source };
+                CBitmapOperations::Fill_Bgr48(100, 60, locked.ptrDataRoi, locked.stride, 1000, 40000, 65535);
+            }
+            const uint32_t width = static_cast<uint32_t>(std::ceil(100 * zoom));
+            const uint32_t height = static_cast<uint32_t>(std::ceil(60 * zoom));
+            const auto destination = CreateTestBitmap(PixelType::Bgr48, width, height);
+            {
+                const ScopedBitmapLockerSP locked{ destination };
+                CBitmapOperations::Fill_Bgr48(width, height, locked.ptrDataRoi, locked.stride, 0, 0, 0);
+            }
+            BitmapOperationsResample::Resize(mode, source.get(), destination.get(), DblRect{ 0, 0, 100, 60 }, DblRect{ 0, 0, 100 * zoom, 60 * zoom });
+
+            const ScopedBitmapLockerSP destination_locked{ destination };
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                const uint16_t* p = reinterpret_cast<const uint16_t*>(static_cast<const uint8_t*>(destination_locked.ptrDataRoi) + static_cast<size_t>(y) * destination_locked.stride);
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    ASSERT_EQ(p[x * 3 + 0], 1000) << "mode " << static_cast<int>(mode) << ", zoom " << zoom;
+                    ASSERT_EQ(p[x * 3 + 1], 40000) << "mode " << static_cast<int>(mode) << ", zoom " << zoom;
+                    ASSERT_EQ(p[x * 3 + 2], 65535) << "mode " << static_cast<int>(mode) << ", zoom " << zoom;
+                }
+            }
+        }
+    }
+}
+
+TEST(BitmapOperations, ResampleWeightsCoverTheSameDestinationPixelsAsNearestNeighbor)
+{
+    // draw a 10x10 bitmap (with value 1) into a cleared 20x20 bitmap with an arbitrary zoom and offset - the destination pixels
+    // drawn must be the same with every resampling mode
+    const auto source = CreateTestBitmap(PixelType::Gray8, 10, 10);
+    {
+        const ScopedBitmapLockerSP locked{ source };
+        CBitmapOperations::Fill_Gray8(10, 10, locked.ptrDataRoi, locked.stride, 1);
+    }
+    const DblRect roi_source{ 1.3, 0.6, 8.2, 9.1 };
+    const DblRect roi_destination{ 2.7, 3.1, 5.9, 13.4 };
+
+    const auto expected = CreateTestBitmap(PixelType::Gray8, 20, 20);
+    {
+        const ScopedBitmapLockerSP locked{ expected };
+        CBitmapOperations::Fill_Gray8(20, 20, locked.ptrDataRoi, locked.stride, 0);
+    }
+    CBitmapOperations::NNResize(source.get(), expected.get(), roi_source, roi_destination);
+    for (const auto mode : { ResamplingMode::AreaAverage, ResamplingMode::Bilinear, ResamplingMode::Lanczos3 })
+    {
+        const auto destination = CreateTestBitmap(PixelType::Gray8, 20, 20);
+        {
+            const ScopedBitmapLockerSP locked{ destination };
+            CBitmapOperations::Fill_Gray8(20, 20, locked.ptrDataRoi, locked.stride, 0);
+        }
+        BitmapOperationsResample::Resize(mode, source.get(), destination.get(), roi_source, roi_destination);
+        EXPECT_TRUE(AreBitmapDataEqual(expected, destination)) << "mode " << static_cast<int>(mode);
+    }
+}
+
+namespace
+{
+    class WeightedRowSumExposed : public WeightedRowSum
+    {
+    public:
+        using WeightedRowSum::AccumulateUint8_C;
+        using WeightedRowSum::AccumulateUint16_C;
+    };
+}
+
+TEST(BitmapOperations, WeightedRowSumGivesSameResultAsCVersion)
+{
+    // whichever kernel is chosen at runtime (e.g. the AVX2-version), the result must be identical to the C-version
+    std::mt19937 random_engine(42);
+    std::uniform_int_distribution<int> distribution(0, 65535);
+    std::vector<uint8_t> row8(100);
+    std::vector<uint16_t> row16(100);
+    for (size_t i = 0; i < row8.size(); ++i)
+    {
+        row8[i] = static_cast<uint8_t>(distribution(random_engine));
+        row16[i] = static_cast<uint16_t>(distribution(random_engine));
+    }
+
+    for (uint32_t offset = 0; offset < 4; ++offset)
+    {
+        for (uint32_t count = 0; count <= 40; ++count)
+        {
+            std::vector<float> accumulator(count, 0.25f), accumulator_c(count, 0.25f);
+            WeightedRowSum::AccumulateUint8(row8.data() + offset, 0.3f, count, accumulator.data());
+            WeightedRowSum::AccumulateUint8(row8.data() + offset + 1, 0.7f, count, accumulator.data());
+            WeightedRowSumExposed::AccumulateUint8_C(row8.data() + offset, 0.3f, count, accumulator_c.data());
+            WeightedRowSumExposed::AccumulateUint8_C(row8.data() + offset + 1, 0.7f, count, accumulator_c.data());
+            ASSERT_EQ(memcmp(accumulator.data(), accumulator_c.data(), count * sizeof(float)), 0);
+
+            std::fill(accumulator.begin(), accumulator.end(), 0.25f);
+            std::fill(accumulator_c.begin(), accumulator_c.end(), 0.25f);
+            WeightedRowSum::AccumulateUint16(row16.data() + offset, 0.3f, count, accumulator.data());
+            WeightedRowSum::AccumulateUint16(row16.data() + offset + 1, 0.7f, count, accumulator.data());
+            WeightedRowSumExposed::AccumulateUint16_C(row16.data() + offset, 0.3f, count, accumulator_c.data());
+            WeightedRowSumExposed::AccumulateUint16_C(row16.data() + offset + 1, 0.7f, count, accumulator_c.data());
+            ASSERT_EQ(memcmp(accumulator.data(), accumulator_c.data(), count * sizeof(float)), 0);
+        }
+    }
+}
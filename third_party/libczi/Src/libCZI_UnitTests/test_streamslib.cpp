@@ -4,6 +4,10 @@
 
 #include "include_gtest.h"
 #include "inc_libCZI.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
 
 using namespace libCZI;
 
@@ -114,3 +118,142 @@ TEST(StreamsLib, TestGetStreamPropertyBagPropertyInfo)
     // check that the list of properties is terminated with an empty entry
     ASSERT_TRUE(property_infos[property_infos_count].property_name == nullptr);
 }
+
+TEST(StreamsLib, MmapStreamSubBlocksReferToTheMappedFile)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "libczi_unittest_mmapstream.czi").string();
+
+    // write a document with two (uncompressed) sub-blocks of different content
+    std::vector<std::uint8_t> pixels(64 * 32);
+    {
+        auto writer = CreateCZIWriter();
+        writer->Create(CreateOutputStreamForFileUtf8(path.c_str(), true), nullptr);
+        for (int index = 0; index < 2; ++index)
+        {
+            for (size_t i = 0; i < pixels.size(); ++i)
+            {
+                pixels[i] = static_cast<std::uint8_t>(i * 7 + index * 13);
+            }
+
+            AddSubBlockInfoMemPtr info;
+            info.Clear();
+            info.coordinate = CDimCoordinate{ { DimensionIndex::C, index } };
+            info.mIndexValid = true;
+            info.mIndex = 0;
+            info.logicalWidth = info.physicalWidth = 64;
+            info.logicalHeight = info.physicalHeight = 32;
+            info.PixelType = PixelType::Gray8;
+            info.ptrData = pixels.data();
+            info.dataSize = static_cast<std::uint32_t>(pixels.size());
+            writer->SyncAddSubBlock(info);
+        }
+
+        writer->Close();
+    }
+
+    StreamsFactory::CreateStreamInfo create_info;
+    create_info.class_name = "mmap_file_inputstream";
+    create_info.property_bag = { { StreamsFactory::StreamProperties::kMmapFile_AccessHint, StreamsFactory::Property("Random") } };
+    const auto mmap_stream = StreamsFactory::CreateStream(create_info, path);
+    if (!mmap_stream)
+    {
+        std::remove(path.c_str());
+        GTEST_SKIP() << "The stream-class 'mmap_file_inputstream' is not available, therefore skipping this test.";
+    }
+
+    ASSERT_TRUE(dynamic_cast<IStreamMemoryView*>(mmap_stream.get()) != nullptr);
+    const auto mmap_reader = CreateCZIReader();
+    mmap_reader->Open(mmap_stream);
+    const auto reference_reader = CreateCZIReader();
+    reference_reader->Open(StreamsFactory::CreateDefaultStreamForFile(path.c_str()));
+
+    for (int index = 0; index < 2; ++index)
+    {
+        const auto sub_block = mmap_reader->ReadSubBlock(index);
+        const auto reference_sub_block = reference_reader->ReadSubBlock(index);
+        size_t size, reference_size;
+        const auto data = sub_block->GetRawData(ISubBlock::MemBlkType::Data, &size);
+        const auto reference_data = reference_sub_block->GetRawData(ISubBlock::MemBlkType::Data, &reference_size);
+        ASSERT_EQ(size, reference_size);
+        EXPECT_EQ(memcmp(data.get(), reference_data.get(), size), 0);
+
+        // reading the sub-block again gives the same memory, i.e. the data is not copied
+        EXPECT_EQ(mmap_reader->ReadSubBlock(index)->GetRawData(ISubBlock::MemBlkType::Data, nullptr).get(), data.get());
+    }
+
+    // the views stay valid when the reader and the stream are gone
+    const auto data = mmap_reader->ReadSubBlock(1)->GetRawData(ISubBlock::MemBlkType::Data, nullptr);
+    mmap_reader->Close();
+    EXPECT_EQ(memcmp(data.get(), pixels.data(), pixels.size()), 0);
+
+    // reading beyond the end of the file gives less data
+    std::uint8_t buffer[16];
+    std::uint64_t bytes_read = 0;
+    const auto file_size = std::filesystem::file_size(path);
+    mmap_stream->Read(file_size - 4, buffer, sizeof(buffer), &bytes_read);
+    EXPECT_EQ(bytes_read, 4u);
+    mmap_stream->Read(file_size + 4, buffer, sizeof(buffer), &bytes_read);
+    EXPECT_EQ(bytes_read, 0u);
+    EXPECT_FALSE(dynamic_cast<IStreamMemoryView*>(mmap_stream.get())->GetView(file_size - 4, 8));
+
+    std::remove(path.c_str());
+}
+
+TEST(StreamsLib, MmapStreamBitmapOfUncompressedSubBlockIsACopy)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "libczi_unittest_mmapstream_bitmap.czi").string();
+
+    std::vector<std::uint8_t> pixels(64 * 32);
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = static_cast<std::uint8_t>(i * 5);
+    }
+
+    {
+        auto writer = CreateCZIWriter();
+        writer->Create(CreateOutputStreamForFileUtf8(path.c_str(), true), nullptr);
+        AddSubBlockInfoMemPtr info;
+        info.Clear();
+        info.coordinate = CDimCoordinate{ { DimensionIndex::C, 0 } };
+        info.mIndexValid = true;
+        info.mIndex = 0;
+        info.logicalWidth = info.physicalWidth = 64;
+        info.logicalHeight = info.physicalHeight = 32;
+        info.PixelType = PixelType::Gray8;
+        info.ptrData = pixels.data();
+        info.dataSize = static_cast<std::uint32_t>(pixels.size());
+        writer->SyncAddSubBlock(info);
+        writer->Close();
+    }
+
+    StreamsFactory::CreateStreamInfo create_info;
+    create_info.class_name = "mmap_file_inputstream";
+    const auto mmap_stream = StreamsFactory::CreateStream(create_info, path);
+    if (!mmap_stream)
+    {
+        std::remove(path.c_str());
+        GTEST_SKIP() << "The stream-class 'mmap_file_inputstream' is not available, therefore skipping this test.";
+    }
+
+    const auto reader = CreateCZIReader();
+    reader->Open(mmap_stream);
+
+    // writing to the bitmap neither faults nor changes what a later read of the sub-block gives
+    const auto sub_block = reader->ReadSubBlock(0);
+    const auto bitmap = sub_block->CreateBitmap();
+    {
+        const ScopedBitmapLockerSP lock{ bitmap };
+        EXPECT_NE(lock.ptrDataRoi, sub_block->GetRawData(ISubBlock::MemBlkType::Data, nullptr).get());
+        EXPECT_EQ(memcmp(lock.ptrDataRoi, pixels.data(), 64), 0);
+        std::memset(lock.ptrDataRoi, 0xff, 64);
+    }
+
+    const auto data = reader->ReadSubBlock(0)->GetRawData(ISubBlock::MemBlkType::Data, nullptr);
+    EXPECT_EQ(memcmp(data.get(), pixels.data(), pixels.size()), 0);
+    const auto bitmap_again = reader->ReadSubBlock(0)->CreateBitmap();
+    const ScopedBitmapLockerSP lock_again{ bitmap_again };
+    EXPECT_EQ(memcmp(lock_again.ptrDataRoi, pixels.data(), 64), 0);
+
+    reader->Close();
+    std::remove(path.c_str());
+}